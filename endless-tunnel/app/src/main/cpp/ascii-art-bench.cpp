@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and startup benchmark of the ASCII art converted at compile time:
+ *
+ *   ascii-art-bench [-r rounds]
+ *
+ * The baked alphabet and life icon must be byte for byte what parsing the
+ * art at runtime gives, and well formed: a vertex per '+', white, and lines
+ * between existing vertices. Then the art setup of a graphics init is timed
+ * both ways: parsing every piece of art into new arrays, as graphics init
+ * did before the bake, against taking views of the baked pools. Exits non
+ * zero when a check fails.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include "ascii_art.hpp"
+#include "game_consts.hpp"
+
+#include "data/alphabet.inl"
+#include "data/ascii_art.inl"
+
+// as TextRenderer and PlayScene bake them
+#define ALPHABET_SCALE 0.01f
+static constexpr const char *LIFE_ART[] = { ART_LIFE };
+
+BAKE_ASCII_ART_POOL(ALPHABET_GEOM, ALPHABET_ART, ALPHABET_SCALE);
+BAKE_ASCII_ART_POOL(LIFE_GEOM, LIFE_ART, LIFE_ICON_SCALE);
+
+static int errors = 0;
+
+static void Check(bool ok, const char *what, const char *pool, int i) {
+    if (!ok && errors++ < 10) {
+        fprintf(stderr, "%s: %s of art %d\n", pool, what, i);
+    }
+}
+
+void AsciiArtError(const char *what, int row, int col) {
+    fprintf(stderr, "invalid ascii art: %s at %d,%d\n", what, row, col);
+    abort();
+}
+
+// Art parsed at runtime, into arrays of its own.
+struct ParsedArt {
+    std::vector<GLfloat> vertices;
+    std::vector<GLushort> indices;
+};
+
+static void Parse(const char *art, float scale, ParsedArt *out) {
+    AsciiArtGrid grid(art);
+    out->vertices.resize(grid.GetVertexCount() * ASCII_ART_VERTEX_FLOATS);
+    out->indices.resize(grid.GetIndexCount());
+    grid.Convert(scale, out->vertices.data(), out->indices.data());
+}
+
+static int CountVertices(const char *art) {
+    int n = 0;
+    for (; *art; ++art) {
+        n += *art == '+' ? 1 : 0;
+    }
+    return n;
+}
+
+template<typename Pool> static void CheckPool(const char *name, const Pool& pool,
+        const char *const *arts, float scale) {
+    for (int i = 0; i < pool.GetCount(); ++i) {
+        AsciiArtData data = pool.Get(i);
+        if (!arts[i]) {
+            Check(data.vertexCount == 0 && data.indexCount == 0, "geometry without art", name,
+                    i);
+            continue;
+        }
+        ParsedArt parsed;
+        Parse(arts[i], scale, &parsed);
+        bool same = data.vertexCount * ASCII_ART_VERTEX_FLOATS == (int)parsed.vertices.size() &&
+                data.indexCount == (int)parsed.indices.size() &&
+                !memcmp(data.vertices, parsed.vertices.data(),
+                        parsed.vertices.size() * sizeof(GLfloat)) &&
+                !memcmp(data.indices, parsed.indices.data(),
+                        parsed.indices.size() * sizeof(GLushort));
+        Check(same, "baked geometry differs from the runtime parse", name, i);
+
+        bool formed = data.vertexCount == CountVertices(arts[i]) && data.indexCount % 2 == 0;
+        for (int v = 0; v < data.vertexCount; ++v) {
+            const GLfloat *p = &data.vertices[v * ASCII_ART_VERTEX_FLOATS];
+            formed = formed && p[2] == 0.0f && p[3] == 1.0f && p[4] == 1.0f && p[5] == 1.0f &&
+                    p[6] == 1.0f;
+        }
+        for (int k = 0; k < data.indexCount; ++k) {
+            formed = formed && data.indices[k] < data.vertexCount;
+        }
+        for (int k = 0; k + 1 < data.indexCount; k += 2) {
+            formed = formed && data.indices[k] != data.indices[k + 1];
+        }
+        Check(formed, "malformed geometry", name, i);
+    }
+}
+
+static double MicrosPerRound(std::chrono::steady_clock::time_point start, int rounds) {
+    return std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count() / rounds;
+}
+
+static void Bench(int rounds) {
+    const int glyphs = ALPHABET_GEOM.GetCount();
+    long sink = 0;
+    int allocations = 0;
+
+    // the art setup of one graphics init: every glyph, then the life icon
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        ParsedArt *parsed = new ParsedArt[glyphs + 1];
+        for (int i = 0; i < glyphs; ++i) {
+            if (ALPHABET_ART[i]) {
+                Parse(ALPHABET_ART[i], ALPHABET_SCALE, &parsed[i]);
+            }
+        }
+        Parse(LIFE_ART[0], LIFE_ICON_SCALE, &parsed[glyphs]);
+        if (r == 0) {
+            for (int i = 0; i <= glyphs; ++i) {
+                allocations += (parsed[i].vertices.empty() ? 0 : 1) +
+                        (parsed[i].indices.empty() ? 0 : 1);
+            }
+        }
+        sink += parsed[glyphs].indices.size();
+        delete [] parsed;
+    }
+    double parseUs = MicrosPerRound(start, rounds);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        AsciiArtData views[ALPHABET_GEOM.GetCount() + 1];
+        for (int i = 0; i < glyphs; ++i) {
+            views[i] = ALPHABET_GEOM.Get(i);
+        }
+        views[glyphs] = LIFE_GEOM.Get(0);
+        // keep the views from being optimized out
+        asm volatile("" : : "r"(views) : "memory");
+        sink += views[glyphs].indexCount;
+    }
+    double bakedUs = MicrosPerRound(start, rounds);
+
+    printf("art setup per graphics init: runtime parse %.2f us and %d allocations, "
+            "baked %.3f us and none; %d bytes baked [%ld]\n", parseUs, allocations, bakedUs,
+            (int)(sizeof(ALPHABET_GEOM) + sizeof(LIFE_GEOM)), sink & 1);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 10000;
+    int c;
+    while ((c = getopt(argc, argv, "r:")) != -1) {
+        switch (c) {
+            case 'r': rounds = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r rounds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (rounds <= 0) {
+        fprintf(stderr, "need at least one round\n");
+        return 1;
+    }
+
+    CheckPool("alphabet", ALPHABET_GEOM, ALPHABET_ART, ALPHABET_SCALE);
+    CheckPool("life icon", LIFE_GEOM, LIFE_ART, LIFE_ICON_SCALE);
+    Bench(rounds);
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_ascii_art_hpp
+#define endlesstunnel_ascii_art_hpp
+
+// GL types only: converting art needs no GL context
+#include <GLES2/gl2.h>
+
+// Converted ASCII art. Vertices are ASCII_ART_VERTEX_FLOATS floats each: x, y, z, r, g,
+// b, a. Lines are index pairs.
+#define ASCII_ART_VERTEX_FLOATS 7
+#define ASCII_ART_COLOR_OFFSET (3 * sizeof(GLfloat))
+struct AsciiArtData {
+    const GLfloat *vertices;
+    int vertexCount;
+    const GLushort *indices;
+    int indexCount;
+};
+
+// Reports invalid ASCII art and aborts. Not constexpr on purpose: reaching it while
+// converting art at compile time is a compile error.
+void AsciiArtError(const char *what, int row, int col);
+
+/* The parser behind AsciiArtToGeom(). Everything is constexpr, so art that is a
+ * constant expression can be converted while compiling and stored in read-only arrays
+ * (see BAKE_ASCII_ART_POOL); AsciiArtToGeom(const char*, float) runs the same code at
+ * runtime. Reads the art in place, without allocating. */
+class AsciiArtGrid {
+    public:
+        static const int MAX_ROWS = 64;
+
+        constexpr AsciiArtGrid(const char *art) : mArt(art), mRows(1), mCols(0),
+                mVertexCount(0), mRowStart(), mRowLen(), mRowFirstVertex() {
+            int i = 0;
+            for (; art[i]; ++i) {
+                if (art[i] != '\n') {
+                    continue;
+                }
+                if (mRows >= MAX_ROWS) {
+                    AsciiArtError("too many rows", mRows, 0);
+                    return;
+                }
+                mRowLen[mRows - 1] = i - mRowStart[mRows - 1];
+                mRowStart[mRows++] = i + 1;
+            }
+            mRowLen[mRows - 1] = i - mRowStart[mRows - 1];
+
+            for (int r = 0; r < mRows; ++r) {
+                mCols = mRowLen[r] > mCols ? mRowLen[r] : mCols;
+                mRowFirstVertex[r] = mVertexCount;
+                for (int c = 0; c < mRowLen[r]; ++c) {
+                    mVertexCount += art[mRowStart[r] + c] == '+' ? 1 : 0;
+                }
+            }
+        }
+
+        constexpr int GetRows() const { return mRows; }
+        constexpr int GetCols() const { return mCols; }
+        constexpr int GetVertexCount() const { return mVertexCount; }
+
+        // character at r,c (a space past the end of a row)
+        constexpr char RawAt(int r, int c) const {
+            return c < mRowLen[r] ? mArt[mRowStart[r] + c] : ' ';
+        }
+
+        // character at r,c with redundant line markers removed, so that each line is
+        // marked by exactly one character (its last one)
+        constexpr char At(int r, int c) const {
+            char t = RawAt(r, c);
+            switch (t) {
+                case '-': return RawAt(r, c + 1) == '-' ? ' ' : t;
+                case '|': return r + 1 < mRows && RawAt(r + 1, c) == '|' ? ' ' : t;
+                case '`': return r + 1 < mRows && RawAt(r + 1, c + 1) == '`' ? ' ' : t;
+                case '/': return r + 1 < mRows && c > 0 && RawAt(r + 1, c - 1) == '/' ? ' ' : t;
+                default: return t;
+            }
+        }
+
+        constexpr int GetIndexCount() const {
+            int indices = 0;
+            for (int r = 0; r < mRows; ++r) {
+                for (int c = 0; c < mRowLen[r]; ++c) {
+                    indices += IsLine(At(r, c)) ? 2 : 0;  // each line requires 2 indices
+                }
+            }
+            return indices;
+        }
+
+        // writes GetVertexCount() vertices and GetIndexCount() indices, and returns the
+        // number of indices. The center of the art will be at 0,0 and scale is the size
+        // of each character.
+        constexpr int Convert(float scale, GLfloat *vertices, GLushort *indices) const {
+            float left = (-mCols / 2) * scale;
+            if (mCols % 2 == 0) left += scale * 0.5f;
+            float top = (mRows / 2) * scale;
+            if (mRows % 2 == 0) top += scale * 0.5f;
+
+            // vertices, in reading order
+            for (int r = 0; r < mRows; ++r) {
+                for (int c = 0; c < mRowLen[r]; ++c) {
+                    if (mArt[mRowStart[r] + c] == '+') {
+                        vertices[0] = left + c * scale;
+                        vertices[1] = top - r * scale;
+                        vertices[2] = 0.0f;  // z coord is always 0
+                        vertices[3] = vertices[4] = vertices[5] = vertices[6] = 1.0f;  // white
+                        vertices += ASCII_ART_VERTEX_FLOATS;
+                    }
+                }
+            }
+
+            // lines: follow each marker both ways to the vertices it connects
+            int indexCount = 0;
+            for (int r = 0; r < mRows; ++r) {
+                for (int c = 0; c < mRowLen[r]; ++c) {
+                    int colDir = 0, rowDir = 0;
+                    switch (At(r, c)) {
+                        case '-': colDir = -1; rowDir = 0; break;  // horizontal
+                        case '|': colDir = 0; rowDir = -1; break;  // vertical
+                        case '`': colDir = -1; rowDir = -1; break;  // slanting down
+                        case '/': colDir = -1; rowDir = 1; break;  // slanting up
+                        default: continue;
+                    }
+                    indices[indexCount++] = (GLushort)FindVertex(r, c, colDir, rowDir);
+                    indices[indexCount++] = (GLushort)FindVertex(r, c, -colDir, -rowDir);
+                }
+            }
+            return indexCount;
+        }
+
+    private:
+        const char *mArt;
+        int mRows, mCols;
+        int mVertexCount;
+        int mRowStart[MAX_ROWS];
+        int mRowLen[MAX_ROWS];
+        int mRowFirstVertex[MAX_ROWS];  // index of the first vertex on each row
+
+        static constexpr bool IsLine(char t) {
+            return t == '-' || t == '|' || t == '`' || t == '/';
+        }
+
+        // walks from r,c in the given direction to the first vertex; returns its index
+        constexpr int FindVertex(int r, int c, int colDir, int rowDir) const {
+            while (RawAt(r, c) != '+') {
+                c += colDir;
+                r += rowDir;
+                if (c < 0 || r < 0 || c >= mCols || r >= mRows) {
+                    AsciiArtError("line without a vertex at its end", r, c);
+                    return 0;
+                }
+            }
+            int index = mRowFirstVertex[r];
+            for (int i = 0; i < c; ++i) {
+                index += RawAt(r, i) == '+' ? 1 : 0;
+            }
+            return index;
+        }
+};
+
+constexpr int AsciiArtPoolVertexCount(const char *const *arts, int count) {
+    int n = 0;
+    for (int i = 0; i < count; ++i) {
+        n += arts[i] ? AsciiArtGrid(arts[i]).GetVertexCount() : 0;
+    }
+    return n;
+}
+
+constexpr int AsciiArtPoolIndexCount(const char *const *arts, int count) {
+    int n = 0;
+    for (int i = 0; i < count; ++i) {
+        n += arts[i] ? AsciiArtGrid(arts[i]).GetIndexCount() : 0;
+    }
+    return n;
+}
+
+/* The converted geometry of an array of ASCII art (NULL entries are empty), packed in
+ * two arrays. Built by BakeAsciiArtPool(). */
+template <int ARTS, int VERTICES, int INDICES>
+struct AsciiArtPool {
+    // one extra element, so the arrays are never empty
+    GLfloat vertices[VERTICES * ASCII_ART_VERTEX_FLOATS + 1];
+    GLushort indices[INDICES + 1];
+    int firstVertex[ARTS], vertexCount[ARTS];
+    int firstIndex[ARTS], indexCount[ARTS];
+
+    constexpr int GetCount() const { return ARTS; }
+
+    AsciiArtData Get(int i) const {
+        AsciiArtData data;
+        data.vertices = &vertices[firstVertex[i] * ASCII_ART_VERTEX_FLOATS];
+        data.vertexCount = vertexCount[i];
+        data.indices = &indices[firstIndex[i]];
+        data.indexCount = indexCount[i];
+        return data;
+    }
+};
+
+template <int ARTS, int VERTICES, int INDICES>
+constexpr AsciiArtPool<ARTS, VERTICES, INDICES> BakeAsciiArtPool(const char *const *arts,
+        float scale) {
+    AsciiArtPool<ARTS, VERTICES, INDICES> pool{};
+    int vertices = 0, indices = 0;
+    for (int i = 0; i < ARTS; ++i) {
+        pool.firstVertex[i] = vertices;
+        pool.firstIndex[i] = indices;
+        if (arts[i]) {
+            AsciiArtGrid grid(arts[i]);
+            pool.vertexCount[i] = grid.GetVertexCount();
+            pool.indexCount[i] = grid.Convert(scale,
+                    &pool.vertices[vertices * ASCII_ART_VERTEX_FLOATS], &pool.indices[indices]);
+            vertices += pool.vertexCount[i];
+            indices += pool.indexCount[i];
+        }
+    }
+    return pool;
+}
+
+#define ASCII_ART_COUNT(arts) ((int)(sizeof(arts) / sizeof((arts)[0])))
+
+// Declares name as an AsciiArtPool with the geometry of arts (a constexpr array of
+// ASCII art), converted at compile time. The geometry goes in read-only data.
+#define BAKE_ASCII_ART_POOL(name, arts, scale) \
+    static constexpr auto name = BakeAsciiArtPool<ASCII_ART_COUNT(arts), \
+            AsciiArtPoolVertexCount(arts, ASCII_ART_COUNT(arts)), \
+            AsciiArtPoolIndexCount(arts, ASCII_ART_COUNT(arts))>(arts, scale)
+
+#endif
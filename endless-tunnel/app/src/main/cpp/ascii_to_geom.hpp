@@ -16,6 +16,7 @@
 #ifndef endlesstunnel_ascii_to_geom_hpp
 #define endlesstunnel_ascii_to_geom_hpp
 
+#include "ascii_art.hpp"
 #include "engine.hpp"
 
 /* Converts ASCII art into a Vbo/Ibo pair. Useful for retro-looking drawings/text!
@@ -38,5 +39,7 @@
  */
 SimpleGeom* AsciiArtToGeom(const char *art, float scale);
 
-#endif
+// Uploads ASCII art converted at compile time (see BAKE_ASCII_ART_POOL).
+SimpleGeom* AsciiArtToGeom(const AsciiArtData& data);
 
+#endif
@@ -19,7 +19,7 @@
 #define ALPHABET_GLYPH_COLS 5 
 #define ALPHABET_GLYPH_ROWS 9 
 
-static const char *ALPHABET_ART[] = {
+static constexpr const char *ALPHABET_ART[] = {
     NULL, // chr 0
     NULL, // chr 1
     NULL, // chr 2
@@ -60,5 +60,66 @@
            "   gl_FragColor = mix(v_Color * u_Tint * texture2D(u_Sampler, v_TexCoord) + u_PointLightColor * att, vec4(0), v_FogFactor);\n" \
            "}";
 
+// Batched variant of the shader above: the geometry is replicated
+// OUR_SHADER_MAX_INSTANCES times, each copy tagged with its index in a_Instance, and
+// the per-instance matrix, tint and point light color come from uniform arrays. This
+// draws up to OUR_SHADER_MAX_INSTANCES copies per draw call on plain GLES 2.0. The
+// arrays take 6 vectors per instance, which has to stay below the 128 vertex uniform
+// vectors that GLES 2.0 guarantees.
+#define OUR_SHADER_MAX_INSTANCES 16
+#define _OUR_SHADER_STR(x) #x
+#define _OUR_SHADER_XSTR(x) _OUR_SHADER_STR(x)
+
+#define OUR_INSTANCED_VERTEX_SHADER_SOURCE \
+           "uniform mat4 u_MVP[" _OUR_SHADER_XSTR(OUR_SHADER_MAX_INSTANCES) "]; \n" \
+           "uniform vec4 u_Tint[" _OUR_SHADER_XSTR(OUR_SHADER_MAX_INSTANCES) "]; \n" \
+           "uniform mediump vec4 u_PointLightColor[" _OUR_SHADER_XSTR(OUR_SHADER_MAX_INSTANCES) "]; \n" \
+           "uniform vec4 u_PointLightPos;  \n" \
+           "attribute vec4 a_Position;     \n" \
+           "attribute vec4 a_Color;        \n" \
+           "attribute vec2 a_TexCoord;     \n" \
+           "attribute float a_Instance;    \n" \
+           "varying vec4 v_Color;          \n" \
+           "varying vec4 v_Pos;            \n" \
+           "varying float v_FogFactor;     \n" \
+           "varying vec2 v_TexCoord;      \n" \
+           "varying vec4 v_Tint;           \n" \
+           "varying vec4 v_PointLightColor; \n" \
+           "float FOG_START = 100.0;        \n" \
+           "float FOG_END = 200.0;         \n" \
+           "varying vec4 v_PointLightPos;  \n" \
+           "void main()                    \n" \
+           "{                              \n" \
+           "   int i = int(a_Instance);    \n" \
+           "   mat4 mvp = u_MVP[i];        \n" \
+           "   v_Color = a_Color;          \n" \
+           "   v_Tint = u_Tint[i];         \n" \
+           "   v_PointLightColor = u_PointLightColor[i]; \n" \
+           "   gl_Position = mvp * a_Position; \n" \
+           "   v_Pos = gl_Position;        \n" \
+           "   v_PointLightPos = mvp * u_PointLightPos; \n" \
+           "   v_TexCoord = a_TexCoord;    \n" \
+           "   v_FogFactor = clamp((v_Pos.z - FOG_START) / (FOG_END - FOG_START), 0.0, 1.0); \n" \
+           "}                              \n";
+
+#define OUR_INSTANCED_FRAG_SHADER_SOURCE \
+           "precision mediump float;       \n" \
+           "varying vec4 v_Color;          \n" \
+           "varying vec4 v_Pos;          \n" \
+           "varying vec2 v_TexCoord;      \n" \
+           "varying float v_FogFactor;     \n" \
+           "varying vec4 v_Tint;           \n" \
+           "varying vec4 v_PointLightColor; \n" \
+           "uniform sampler2D u_Sampler;   \n" \
+           "varying vec4 v_PointLightPos;   \n" \
+           "float ATT_FACT_2 = 0.005;          \n" \
+           "float ATT_FACT_1 = 0.00;          \n" \
+           "void main()                    \n" \
+           "{                              \n" \
+           "   float d = distance(v_PointLightPos, v_Pos);\n" \
+           "   float att = 1.0/(ATT_FACT_1 * d + ATT_FACT_2 * d * d);\n" \
+           "   gl_FragColor = mix(v_Color * v_Tint * texture2D(u_Sampler, v_TexCoord) + v_PointLightColor * att, vec4(0), v_FogFactor);\n" \
+           "}";
+
 #endif
 
@@ -31,6 +31,10 @@
 // number of tunnel sections to render ahead
 #define RENDER_TUNNEL_SECTION_COUNT 4
 
+// number of tunnel sections (with their obstacles) the game generates ahead of the
+// player; must cover the render distance
+#define OBS_LOOKAHEAD_SECTION_COUNT (RENDER_TUNNEL_SECTION_COUNT * 2)
+
 // An obstacle is a grid of boxes. This indicates how many boxes by how many boxes this grid is.
 #define OBS_GRID_SIZE 5
 
@@ -52,6 +56,11 @@
 // maximum delta T between two frames
 #define MAX_DELTA_T 0.05f
 
+// the game logic advances in fixed steps of this many ticks per second,
+// independently of the frame rate
+#define SIM_TICKS_PER_SECOND 60
+#define SIM_TIMESTEP (1.0f / SIM_TICKS_PER_SECOND)
+
 // player's speed
 #define PLAYER_SPEED 80.0f
 
@@ -154,6 +163,9 @@
 // save file name
 #define SAVE_FILE_NAME "tunnel.dat"
 
+// file the input of the last game is written to, so that it can be replayed
+#define REPLAY_FILE_NAME "tunnel_replay.txt"
+
 // checkpoint (save progress) every how many levels?
 #define LEVELS_PER_CHECKPOINT 4
 
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "instanced_renderer.hpp"
+
+InstancedRenderer::InstancedRenderer() {
+    mShader = NULL;
+    mGeom = NULL;
+}
+
+InstancedRenderer::~InstancedRenderer() {
+    for (size_t i = 0; i < mGeoms.size(); i++) {
+        CleanUp(&mGeoms[i].geom);
+    }
+}
+
+int InstancedRenderer::AddShader(OurInstancedShader *shader) {
+    mShaders.push_back(shader);
+    return (int)mShaders.size() - 1;
+}
+
+int InstancedRenderer::AddGeom(const GLfloat *geomData, int dataSize, int stride,
+        int colorsOffset, int texCoordsOffset, const GLushort *indices, int indicesSize,
+        Texture *texture) {
+    InstancedGeomData data;
+    OurInstancedShader::PrepareInstancedGeom(geomData, dataSize, stride, colorsOffset,
+            texCoordsOffset, indices, indicesSize, &data);
+    return AddGeom(data, texture);
+}
+
+int InstancedRenderer::AddGeom(const InstancedGeomData& data, Texture *texture) {
+    Geom g;
+    g.geom = OurInstancedShader::MakeInstancedGeom(data);
+    g.elemsPerCopy = data.elemsPerCopy;
+    g.texture = texture;
+    mGeoms.push_back(g);
+    return (int)mGeoms.size() - 1;
+}
+
+int InstancedRenderer::GetMaxInstances() {
+    return OurInstancedShader::GetMaxInstances();
+}
+
+void InstancedRenderer::BeginBatch(int shader, int geom) {
+    MY_ASSERT(shader >= 0 && shader < (int)mShaders.size());
+    MY_ASSERT(geom >= 0 && geom < (int)mGeoms.size());
+    mShader = mShaders[shader];
+    mGeom = &mGeoms[geom];
+    mShader->BeginRender(mGeom->geom->vbuf);
+    mShader->SetTexture(mGeom->texture);
+}
+
+void InstancedRenderer::DrawInstances(const glm::mat4 *mvp, const glm::vec4 *tint,
+        const glm::vec4 *lightColor, int count) {
+    MY_ASSERT(mShader != NULL);
+    mShader->RenderInstances(mGeom->geom->ibuf, mGeom->elemsPerCopy, mvp, tint, lightColor,
+            count);
+}
+
+void InstancedRenderer::EndBatch() {
+    mShader->EndRender();
+    mShader = NULL;
+    mGeom = NULL;
+}
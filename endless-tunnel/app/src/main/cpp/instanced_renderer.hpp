@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_instanced_renderer_hpp
+#define endlesstunnel_instanced_renderer_hpp
+
+#include <vector>
+#include "engine.hpp"
+#include "our_shader.hpp"
+#include "render_queue.hpp"
+#include "util.hpp"
+
+/* RenderQueue backend that draws with OurInstancedShader. Geometries are registered
+ * once (when graphics start) and replicated for batched drawing; the ids returned by
+ * AddShader() and AddGeom() are what goes into the RenderQueue. */
+class InstancedRenderer : public RenderBackend {
+    private:
+        struct Geom {
+            SimpleGeom *geom;
+            int elemsPerCopy;  // vertices, or indices if the geometry is indexed
+            Texture *texture;
+        };
+        std::vector<OurInstancedShader*> mShaders;
+        std::vector<Geom> mGeoms;
+
+        // current batch
+        OurInstancedShader *mShader;
+        Geom *mGeom;
+
+    public:
+        InstancedRenderer();
+        ~InstancedRenderer();
+
+        // registers a (compiled) shader; it's not owned by the renderer
+        int AddShader(OurInstancedShader *shader);
+
+        // registers a geometry and the texture to draw it with (the texture is not
+        // owned by the renderer)
+        int AddGeom(const GLfloat *geomData, int dataSize, int stride, int colorsOffset,
+                int texCoordsOffset, const GLushort *indices, int indicesSize,
+                Texture *texture);
+
+        // same, for a geometry already replicated with
+        // OurInstancedShader::PrepareInstancedGeom()
+        int AddGeom(const InstancedGeomData& data, Texture *texture);
+
+        virtual int GetMaxInstances();
+        virtual void BeginBatch(int shader, int geom);
+        virtual void DrawInstances(const glm::mat4 *mvp, const glm::vec4 *tint,
+                const glm::vec4 *lightColor, int count);
+        virtual void EndBatch();
+};
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of the obstacle bitmasks:
+ *
+ *   obstacle-bench [-f frames] [-d density %] [-n obstacles] [-s seed]
+ *
+ * Random obstacles are filled to the given density and kept next to the
+ * bool grid they used to be. The masks must agree with the grid on boxes,
+ * collisions, close calls (the nine point lookups the game used to make),
+ * the cells around boxes, and where PutRandomBonus may put the bonus. Then
+ * a frame's worth of obstacle work, the collision and bonus test, the close
+ * call test and the walk over every box to draw, is timed on both. Exits
+ * non zero when a check fails.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "obstacle.hpp"
+
+// points tested per obstacle in the checks
+static const int CHECK_POINTS = 1000;
+
+static int errors = 0;
+
+static void Check(bool ok, const char *what, int obstacle) {
+    if (!ok && errors++ < 10) {
+        fprintf(stderr, "%s differs on obstacle %d\n", what, obstacle);
+    }
+}
+
+// The grid as it was stored before the bitmasks.
+struct GridObstacle {
+    bool grid[OBS_GRID_SIZE][OBS_GRID_SIZE];
+    int bonusRow, bonusCol;
+
+    int GetRowAt(float z) {
+        return Clamp((int)floor((z + TUNNEL_HALF_H) / OBS_CELL_SIZE), 0, OBS_GRID_SIZE - 1);
+    }
+    int GetColAt(float x) {
+        return Clamp((int)floor((x + TUNNEL_HALF_W) / OBS_CELL_SIZE), 0, OBS_GRID_SIZE - 1);
+    }
+    bool IsCloseCall(float x, float z) {
+        for (int i = -1; i <= 1; i++) {
+            for (int j = -1; j <= 1; j++) {
+                if (grid[GetColAt(x + i * CLOSE_CALL_CALC_DELTA)]
+                        [GetRowAt(z + j * CLOSE_CALL_CALC_DELTA)]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    bool IsNextToBox(int col, int row) {
+        for (int c = col - 1; c <= col + 1; c++) {
+            for (int r = row - 1; r <= row + 1; r++) {
+                if (c >= 0 && c < OBS_GRID_SIZE && r >= 0 && r < OBS_GRID_SIZE &&
+                        grid[c][r]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+static void MakeObstacles(int count, int density, RandomGen *rng,
+        std::vector<Obstacle> *obs, std::vector<GridObstacle> *grids) {
+    obs->resize(count);
+    grids->resize(count);
+    for (int i = 0; i < count; i++) {
+        Obstacle& o = (*obs)[i];
+        GridObstacle& g = (*grids)[i];
+        o.Reset();
+        o.style = 1;
+        for (int c = 0; c < OBS_GRID_SIZE; c++) {
+            for (int r = 0; r < OBS_GRID_SIZE; r++) {
+                g.grid[c][r] = rng->Next(100) < density;
+                if (g.grid[c][r]) {
+                    o.SetBox(c, r);
+                }
+            }
+        }
+        g.bonusCol = rng->Next(OBS_GRID_SIZE);
+        g.bonusRow = rng->Next(OBS_GRID_SIZE);
+        o.SetBonus(g.bonusCol, g.bonusRow);
+    }
+}
+
+static float RandomCoord(RandomGen *rng) {
+    // a little past the walls, to exercise the clamping
+    return rng->Next(2400) * 0.01f - 12.0f;
+}
+
+static void CheckMasks(std::vector<Obstacle>& obs, std::vector<GridObstacle>& grids,
+        RandomGen *rng) {
+    for (int i = 0; i < (int)obs.size(); i++) {
+        Obstacle& o = obs[i];
+        GridObstacle& g = grids[i];
+        bool boxes = true, around = true;
+        ObsMask dilated = Obstacle::Dilate(o.boxes);
+        for (int c = 0; c < OBS_GRID_SIZE; c++) {
+            for (int r = 0; r < OBS_GRID_SIZE; r++) {
+                boxes = boxes && o.HasBox(c, r) == g.grid[c][r];
+                around = around &&
+                        (0 != (dilated & Obstacle::CellMask(c, r))) == g.IsNextToBox(c, r);
+            }
+        }
+        Check(boxes, "boxes", i);
+        Check(around, "cells around boxes", i);
+
+        bool hits = true, bonuses = true, closeCalls = true;
+        for (int p = 0; p < CHECK_POINTS; p++) {
+            float x = RandomCoord(rng), z = RandomCoord(rng);
+            int col = g.GetColAt(x), row = g.GetRowAt(z);
+            ObsMask cell = o.GetCellAt(x, z);
+            hits = hits && (0 != (o.boxes & cell)) == g.grid[col][row];
+            bonuses = bonuses && (0 != (o.bonus & cell)) ==
+                    (col == g.bonusCol && row == g.bonusRow);
+            closeCalls = closeCalls &&
+                    (0 != (o.boxes & o.GetCellsNear(x, z, CLOSE_CALL_CALC_DELTA))) ==
+                    g.IsCloseCall(x, z);
+        }
+        Check(hits, "collision", i);
+        Check(bonuses, "bonus hit", i);
+        Check(closeCalls, "close call", i);
+
+        // the bonus, when there is one, goes on a free cell next to a box
+        bool bonusOk = true;
+        for (int tries = 0; tries < 20; tries++) {
+            o.DeleteBonus();
+            o.PutRandomBonus(rng);
+            int c = o.GetBonusCol(), r = o.GetBonusRow();
+            bonusOk = bonusOk && (!o.bonus || (!g.grid[c][r] && g.IsNextToBox(c, r)));
+        }
+        Check(bonusOk, "random bonus", i);
+        o.SetBonus(g.bonusCol, g.bonusRow);
+    }
+}
+
+// Stands for drawing the box at col, row: keeps the compiler from folding the
+// walk over boxes, which doesn't change from frame to frame, out of the loop.
+static inline void DrawBox(int col, int row) {
+    asm volatile("" : : "r"(col), "r"(row) : "memory");
+}
+
+// Times frames of work, each given the obstacle the ship is in and its position.
+template<typename Frame> static double TimeFrames(int frames, const std::vector<float>& xs,
+        const std::vector<float>& zs, int count, Frame frame, long *sink) {
+    long acc = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        int p = f % (int)xs.size();
+        acc += frame(f % count, xs[p], zs[p]);
+    }
+    double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    *sink += acc;
+    return seconds * 1e9 / frames;
+}
+
+static void PrintTimes(const char *what, double gridNs, double maskNs) {
+    printf("  %s: bool grid %.1f ns/frame, bitmask %.1f ns/frame (%.2fx)\n", what,
+            gridNs, maskNs, maskNs > 0 ? gridNs / maskNs : 0.0);
+}
+
+// A frame's tests are the collision and bonus test and the close call test on
+// the obstacle the ship is in; drawing then visits every box of every obstacle.
+static void Bench(int frames, int density, std::vector<Obstacle>& obs,
+        std::vector<GridObstacle>& grids, RandomGen *rng) {
+    int count = (int)obs.size();
+    std::vector<float> xs(1024), zs(1024);
+    for (size_t i = 0; i < xs.size(); i++) {
+        xs[i] = RandomCoord(rng);
+        zs[i] = RandomCoord(rng);
+    }
+    long sink = 0;
+
+    double gridTestNs = TimeFrames(frames, xs, zs, count, [&](int i, float x, float z) {
+        GridObstacle& g = grids[i];
+        int col = g.GetColAt(x), row = g.GetRowAt(z);
+        return g.grid[col][row] + (col == g.bonusCol && row == g.bonusRow) +
+                g.IsCloseCall(x, z);
+    }, &sink);
+    double maskTestNs = TimeFrames(frames, xs, zs, count, [&](int i, float x, float z) {
+        Obstacle& o = obs[i];
+        ObsMask cell = o.GetCellAt(x, z);
+        return (0 != (o.boxes & cell)) + (0 != (o.bonus & cell)) +
+                (0 != (o.boxes & o.GetCellsNear(x, z, CLOSE_CALL_CALC_DELTA)));
+    }, &sink);
+
+    double gridDrawNs = TimeFrames(frames, xs, zs, count, [&](int, float, float) {
+        for (int k = 0; k < count; k++) {
+            for (int r = 0; r < OBS_GRID_SIZE; r++) {
+                for (int c = 0; c < OBS_GRID_SIZE; c++) {
+                    if (grids[k].grid[c][r]) {
+                        DrawBox(c, r);
+                    }
+                }
+            }
+        }
+        return 0;
+    }, &sink);
+    double maskDrawNs = TimeFrames(frames, xs, zs, count, [&](int, float, float) {
+        for (int k = 0; k < count; k++) {
+            for (ObsMask m = obs[k].boxes; m; m &= m - 1) {
+                int cell = ObsMaskFirstCell(m);
+                DrawBox(Obstacle::CellCol(cell), Obstacle::CellRow(cell));
+            }
+        }
+        return 0;
+    }, &sink);
+
+    printf("%d obstacles at %d%% density, %d frames [%ld]\n", count, density, frames,
+            sink & 1);
+    PrintTimes("tests", gridTestNs, maskTestNs);
+    PrintTimes("box walk", gridDrawNs, maskDrawNs);
+}
+
+int main(int argc, char **argv) {
+    int frames = 2000000, density = 80, count = 8;
+    unsigned seed = 5;
+    int c;
+    while ((c = getopt(argc, argv, "f:d:n:s:")) != -1) {
+        switch (c) {
+            case 'f': frames = atoi(optarg); break;
+            case 'd': density = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            case 's': seed = (unsigned)strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-f frames] [-d density %%] [-n obstacles] "
+                        "[-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (frames <= 0 || count <= 0 || density < 0 || density > 100) {
+        fprintf(stderr, "need frames, obstacles, and a density of 0 to 100%%\n");
+        return 1;
+    }
+
+    RandomGen rng(seed);
+    std::vector<Obstacle> obs;
+    std::vector<GridObstacle> grids;
+    // the checks also run sparse and full grids, whatever density is benched
+    static const int checkDensities[] = { 0, 20, 50, 80, 100 };
+    for (int d : checkDensities) {
+        MakeObstacles(64, d, &rng, &obs, &grids);
+        CheckMasks(obs, grids, &rng);
+    }
+
+    MakeObstacles(count, density, &rng, &obs, &grids);
+    Bench(frames, density, obs, grids, &rng);
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -18,49 +18,27 @@
 
 #define BONUS_PROBABILITY 0.7f
 
-void Obstacle::PutRandomBonus() {
-    if (Random(100) * 0.01f > BONUS_PROBABILITY) {
+void Obstacle::PutRandomBonus(RandomGen *rng) {
+    if (rng->Next(100) * 0.01f > BONUS_PROBABILITY) {
         return;
     }
 
-    bool candidate[OBS_GRID_SIZE][OBS_GRID_SIZE];
-    memset(candidate, 0, sizeof(candidate));
-
-    int r, c;
-    int i, j;
-
-    // (This is the most deeply indented code I have written in my life)
-    // It goes through the grid and marks all the squares that are adjacent to
-    // a solid square as candidates for the bonus.
-    for (r = 0; r < OBS_GRID_SIZE; r++) {
-        for (c = 0; c < OBS_GRID_SIZE; c++) {
-            if (grid[c][r]) {
-                for (i = r - 1; i <= r + 1; i++) {
-                    for (j = c - 1; j <= c + 1; j++) {
-                        if (i >= 0 && i < OBS_GRID_SIZE && j >= 0 && j < OBS_GRID_SIZE) {
-                            candidate[j][i] = true;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    // now we randomly choose one of the candidates
-    int r0 = Random(0, OBS_GRID_SIZE);
-    int c0 = Random(0, OBS_GRID_SIZE);
-    int rd, cd;
-    bonusRow = bonusCol = -1;
-    for (rd = 0; rd < OBS_GRID_SIZE && bonusRow < 0; rd++) {
-        for (cd = 0; cd < OBS_GRID_SIZE; cd++) {
-            int my_r = (r0 + rd) % OBS_GRID_SIZE;
-            int my_c = (c0 + cd) % OBS_GRID_SIZE;
-            if (!grid[my_c][my_r] && candidate[my_c][my_r]) {
-                bonusRow = my_r;
-                bonusCol = my_c;
-                break;
-            }
+    // the bonus goes on a free square that is adjacent to a solid square
+    ObsMask candidates = Obstacle::Dilate(boxes) & ~boxes;
+
+    // now we randomly choose one of the candidates, scanning rows from r0 and,
+    // within each row, columns from c0 (wrapping around)
+    int r0 = rng->Next(0, OBS_GRID_SIZE);
+    int c0 = rng->Next(0, OBS_GRID_SIZE);
+    const ObsMask ROW = (1u << OBS_GRID_SIZE) - 1;
+    bonus = 0;
+    for (int rd = 0; rd < OBS_GRID_SIZE && candidates; rd++) {
+        int r = (r0 + rd) % OBS_GRID_SIZE;
+        ObsMask rowBits = (candidates >> (r * OBS_GRID_SIZE)) & ROW;
+        ObsMask rotated = ((rowBits >> c0) | (rowBits << (OBS_GRID_SIZE - c0))) & ROW;
+        if (rotated) {
+            SetBonus((c0 + ObsMaskFirstCell(rotated)) % OBS_GRID_SIZE, r);
+            break;
         }
     }
 }
-
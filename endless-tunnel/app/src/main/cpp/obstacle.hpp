@@ -16,10 +16,25 @@
 #ifndef endlesstunnel_obstacle_hpp
 #define endlesstunnel_obstacle_hpp
 
-#include "engine.hpp"
+#include <cstring>
+#include "glm/glm.hpp"
 #include "game_consts.hpp"
 #include "util.hpp"
 
+// Bitmask of obstacle cells: bit (row * OBS_GRID_SIZE + col) stands for the cell at
+// column col, row row. The whole grid fits in one word, so tests against the grid
+// are a handful of bit operations instead of loops over cells.
+typedef unsigned ObsMask;
+static_assert(OBS_GRID_SIZE * OBS_GRID_SIZE <= 32, "obstacle grid doesn't fit in ObsMask");
+
+// all cells of the grid
+#define OBS_MASK_ALL ((ObsMask)(((unsigned long long)1 << (OBS_GRID_SIZE * OBS_GRID_SIZE)) - 1))
+
+// returns the index of the lowest set bit of a non-zero mask
+inline int ObsMaskFirstCell(ObsMask m) {
+    return __builtin_ctz(m);
+}
+
 // An obstacle consists of a grid of OBS_GRID_SIZE x OBS_GRID_SIZE cells; each of them may
 // or may not contain a box. One of the cells may be the bonus cell, which gives the player
 // a bonus when hit.
@@ -27,11 +42,55 @@
 // The obstacle grid lies on the XZ plane.
 class Obstacle {
     public:
-        bool grid[OBS_GRID_SIZE][OBS_GRID_SIZE]; // indexed as [col][row]
+        ObsMask boxes;  // cells that contain a box
+        ObsMask bonus;  // the bonus cell (at most one bit set)
         int style;  // obstacle style (currently, this specifies its color).
-        int bonusRow, bonusCol;
         const static int STYLE_NULL = 0;  // a null obstacle (not displayed)
 
+        static ObsMask CellMask(int col, int row) {
+            return (ObsMask)1 << (row * OBS_GRID_SIZE + col);
+        }
+
+        // all cells of a row
+        static ObsMask RowMask(int row) {
+            return (ObsMask)((1u << OBS_GRID_SIZE) - 1) << (row * OBS_GRID_SIZE);
+        }
+
+        // all cells of a column
+        static ObsMask ColMask(int col) {
+            ObsMask m = 0;
+            for (int r = 0; r < OBS_GRID_SIZE; r++) {
+                m |= CellMask(col, r);
+            }
+            return m;
+        }
+
+        // all cells in columns col0..col1 and rows row0..row1 (inclusive)
+        static ObsMask RectMask(int col0, int row0, int col1, int row1) {
+            ObsMask rowBits = ((1u << (col1 + 1)) - 1) & ~((1u << col0) - 1);
+            // repeating the bits of one row across the grid can't carry, since each
+            // copy fits within its own row
+            return (rowBits * ColMask(0)) & RowSpanMask(row0, row1);
+        }
+
+        // cells in rows row0..row1 (inclusive)
+        static ObsMask RowSpanMask(int row0, int row1) {
+            return (ObsMask)((((unsigned long long)1 << ((row1 + 1) * OBS_GRID_SIZE)) - 1) &
+                    ~(((unsigned long long)1 << (row0 * OBS_GRID_SIZE)) - 1));
+        }
+
+        // the given cells plus their 8 neighbours
+        static ObsMask Dilate(ObsMask m) {
+            // the last cell shifts left past the grid, where the shift down would
+            // bring it back on the first column
+            ObsMask h = (m | ((m << 1) & ~ColMask(0)) | ((m >> 1) & ~ColMask(OBS_GRID_SIZE - 1))) &
+                    OBS_MASK_ALL;
+            return (h | (h << OBS_GRID_SIZE) | (h >> OBS_GRID_SIZE)) & OBS_MASK_ALL;
+        }
+
+        static int CellCol(int cell) { return cell % OBS_GRID_SIZE; }
+        static int CellRow(int cell) { return cell / OBS_GRID_SIZE; }
+
         glm::vec3 GetBoxCenter(int gridCol, int gridRow, float posY) {
             return glm::vec3(-TUNNEL_HALF_W + (gridCol + 0.5f) * OBS_CELL_SIZE, posY,
                     -TUNNEL_HALF_H + (gridRow + 0.5f) * OBS_CELL_SIZE);
@@ -49,31 +108,53 @@ class Obstacle {
             return Clamp((int)floor((x + TUNNEL_HALF_W) / OBS_CELL_SIZE), 0, OBS_GRID_SIZE - 1);
         }
 
+        // the cell the point x,z is in
+        ObsMask GetCellAt(float x, float z) {
+            return CellMask(GetColAt(x), GetRowAt(z));
+        }
+
+        // the cells touched by a square of half size delta centered at x,z
+        ObsMask GetCellsNear(float x, float z, float delta) {
+            return RectMask(GetColAt(x - delta), GetRowAt(z - delta),
+                    GetColAt(x + delta), GetRowAt(z + delta));
+        }
+
         float GetMinY(float posY) { return posY - OBS_BOX_SIZE * 0.5f; }
         float GetMaxY(float posY) { return posY + OBS_BOX_SIZE * 0.5f; }
 
         void Reset() {
             style = STYLE_NULL;
-            bonusRow = bonusCol = -1;
-            memset(grid, 0, sizeof(grid));
+            boxes = bonus = 0;
+        }
+
+        bool HasBox(int col, int row) {
+            return 0 != (boxes & CellMask(col, row));
+        }
+
+        void SetBox(int col, int row) {
+            boxes |= CellMask(col, row);
+        }
+
+        void ClearBox(int col, int row) {
+            boxes &= ~CellMask(col, row);
         }
 
         void SetBonus(int col, int row) {
-            bonusCol = col;
-            bonusRow = row;
+            bonus = CellMask(col, row);
         }
 
-        void PutRandomBonus();
+        void PutRandomBonus(RandomGen *rng);
 
         void DeleteBonus() {
-            bonusCol = bonusRow = -1;
+            bonus = 0;
         }
 
         bool HasBonus() {
-            return bonusRow >= 0 && bonusRow < OBS_GRID_SIZE &&
-                    bonusCol >= 0 && bonusCol < OBS_GRID_SIZE &&
-                    !grid[bonusCol][bonusRow];
+            return 0 != (bonus & ~boxes);
         }
+
+        int GetBonusCol() { return bonus ? CellCol(ObsMaskFirstCell(bonus)) : -1; }
+        int GetBonusRow() { return bonus ? CellRow(ObsMaskFirstCell(bonus)) : -1; }
 };
 
 #endif
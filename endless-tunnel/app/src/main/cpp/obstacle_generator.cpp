@@ -35,13 +35,13 @@ void ObstacleGenerator::Generate(Obstacle *result) {
           0,   0,   0, 100   // difficulty 12+
     };
     result->Reset();
-    result->style = 1 + Random(7);
+    result->style = 1 + mRng.Next(7);
 
     int d = Clamp(mDifficulty, 0, 12);
     int easyProb = PROB_TABLE[d * 4];
     int medProb = PROB_TABLE[d * 4 + 1];
     int intermediateProb = PROB_TABLE[d * 4 + 2];
-    int roll = Random(100);
+    int roll = mRng.Next(100);
     if (roll <= easyProb) {
         GenEasy(result);
     } else if (roll <= easyProb + medProb) {
@@ -51,33 +51,37 @@ void ObstacleGenerator::Generate(Obstacle *result) {
     } else {
         GenHard(result);
     }
-    result->PutRandomBonus();
+    result->PutRandomBonus(&mRng);
 }
 
 void ObstacleGenerator::FillRow(Obstacle *result, int row) {
-    for (int i = 0; i < OBS_GRID_SIZE; ++i) {
-        result->grid[i][row] = true;
-    }
+    result->boxes |= Obstacle::RowMask(row);
 }
 
 void ObstacleGenerator::FillCol(Obstacle *result, int col) {
-    for (int i = 0; i < OBS_GRID_SIZE; ++i) {
-        result->grid[col][i] = true;
-    }
+    result->boxes |= Obstacle::ColMask(col);
+}
+
+void ObstacleGenerator::PunchHole(Obstacle *result) {
+    // draw the column first: the evaluation order of two draws in one
+    // expression is unspecified, which would break replays across compilers
+    int col = mRng.Next(0, OBS_GRID_SIZE);
+    int row = mRng.Next(0, OBS_GRID_SIZE);
+    result->ClearBox(col, row);
 }
 
 void ObstacleGenerator::GenEasy(Obstacle *result) {
-    int n = Random(4);
+    int n = mRng.Next(4);
     int i, j;
     Obstacle *o = result; // shorthand
     switch (n) {
         case 0:
-            i = Random(1, OBS_GRID_SIZE - 1); // i is the row of the bonus
-            FillRow(result, i + (Random(2) ? 1 : -1)); // horizontal bar next to i
+            i = mRng.Next(1, OBS_GRID_SIZE - 1); // i is the row of the bonus
+            FillRow(result, i + (mRng.Next(2) ? 1 : -1)); // horizontal bar next to i
             break;
         case 1:
-            i = Random(1, OBS_GRID_SIZE - 1); // i is the column of the bonus
-            FillCol(result, i + (Random(2) ? 1 : -1)); // vertical bar next to i
+            i = mRng.Next(1, OBS_GRID_SIZE - 1); // i is the column of the bonus
+            FillCol(result, i + (mRng.Next(2) ? 1 : -1)); // vertical bar next to i
             break;
         case 2:
             FillRow(result, 0);
@@ -86,29 +90,29 @@ void ObstacleGenerator::GenEasy(Obstacle *result) {
             FillCol(result, OBS_GRID_SIZE - 1);
             break;
         default:
-            i = Random(0, OBS_GRID_SIZE - 2); // i is the row of the bonus
-            j = Random(0, OBS_GRID_SIZE - 2); // i is the row of the bonus
-            o->grid[i][j] = o->grid[i+1][j] = o->grid[i][j+1] = o->grid[i+1][j+1] = true;
+            i = mRng.Next(0, OBS_GRID_SIZE - 2); // i is the row of the bonus
+            j = mRng.Next(0, OBS_GRID_SIZE - 2); // i is the row of the bonus
+            o->boxes |= Obstacle::RectMask(i, j, i + 1, j + 1);
             break;
     }
 }
 
 void ObstacleGenerator::GenMedium(Obstacle *result) {
-    int n = Random(3);
+    int n = mRng.Next(3);
     int i;
     switch (n) {
         case 0:
-            i = Random(1, OBS_GRID_SIZE - 1); // i is the row of the bonus
+            i = mRng.Next(1, OBS_GRID_SIZE - 1); // i is the row of the bonus
             FillRow(result, i + 1);
             FillRow(result, i - 1);
             break;
         case 1:
-            i = Random(1, OBS_GRID_SIZE - 1); // i is the column of the bonus
+            i = mRng.Next(1, OBS_GRID_SIZE - 1); // i is the column of the bonus
             FillCol(result, i - 1);
             FillCol(result, i + 1);
             break;
         default:
-            i = Random(1, OBS_GRID_SIZE - 1); // i is the column of the bonus
+            i = mRng.Next(1, OBS_GRID_SIZE - 1); // i is the column of the bonus
             FillRow(result, i);
             FillCol(result, i);
             break;
@@ -117,23 +121,23 @@ void ObstacleGenerator::GenMedium(Obstacle *result) {
 }
 
 void ObstacleGenerator::GenIntermediate(Obstacle *result) {
-    int n = Random(3);
+    int n = mRng.Next(3);
     int i;
     switch (n) {
         case 0:
-            i = Random(0, OBS_GRID_SIZE - 2);
+            i = mRng.Next(0, OBS_GRID_SIZE - 2);
             FillRow(result, i);
             FillRow(result, i + 1);
             FillRow(result, i + 2);
             break;
         case 1:
-            i = Random(0, OBS_GRID_SIZE - 2); // i is the column of the bonus
+            i = mRng.Next(0, OBS_GRID_SIZE - 2); // i is the column of the bonus
             FillCol(result, i);
             FillCol(result, i + 1);
             FillCol(result, i + 2);
             break;
         default:
-            i = Random(1, OBS_GRID_SIZE - 2); // i is the column of the bonus
+            i = mRng.Next(1, OBS_GRID_SIZE - 2); // i is the column of the bonus
             FillCol(result, i - 1);
             FillCol(result, i + 1);
             FillCol(result, i + 2);
@@ -142,43 +146,43 @@ void ObstacleGenerator::GenIntermediate(Obstacle *result) {
 }
 
 void ObstacleGenerator::GenHard(Obstacle *result) {
-    int n = Random(4);
+    int n = mRng.Next(4);
     int i;
     int j;
     switch (n) {
         case 0:
-            i = Random(0, OBS_GRID_SIZE - 3);
+            i = mRng.Next(0, OBS_GRID_SIZE - 3);
             FillRow(result, i);
             FillRow(result, i + 1);
             FillRow(result, i + 2);
             FillRow(result, i + 3);
-            result->grid[Random(0, OBS_GRID_SIZE)][Random(0, OBS_GRID_SIZE)] = false;
+            PunchHole(result);
             break;
         case 1:
-            i = Random(0, OBS_GRID_SIZE - 3);
+            i = mRng.Next(0, OBS_GRID_SIZE - 3);
             FillCol(result, i);
             FillCol(result, i + 1);
             FillCol(result, i + 2);
             FillCol(result, i + 3);
-            result->grid[Random(0, OBS_GRID_SIZE)][Random(0, OBS_GRID_SIZE)] = false;
+            PunchHole(result);
             break;
         case 2:
-            i = Random(0, OBS_GRID_SIZE);
+            i = mRng.Next(0, OBS_GRID_SIZE);
             for (j = 0; j < OBS_GRID_SIZE; j++) {
                 if (i != j) {
                     FillCol(result, i);
                 }
             }
-            result->grid[Random(0, OBS_GRID_SIZE)][Random(0, OBS_GRID_SIZE)] = false;
+            PunchHole(result);
             break;
         default:
-            i = Random(0, OBS_GRID_SIZE);
+            i = mRng.Next(0, OBS_GRID_SIZE);
             for (j = 0; j < OBS_GRID_SIZE; j++) {
                 if (i != j) {
                     FillRow(result, i);
                 }
             }
-            result->grid[Random(0, OBS_GRID_SIZE)][Random(0, OBS_GRID_SIZE)] = false;
+            PunchHole(result);
             break;
     }
 }
@@ -16,13 +16,15 @@
 #ifndef endlesstunnel_obstacle_generator_hpp
 #define endlesstunnel_obstacle_generator_hpp
 
-#include "engine.hpp"
 #include "obstacle.hpp"
+#include "util.hpp"
 
-// Generates obstacles given a difficulty level.
+// Generates obstacles given a difficulty level. The sequence of obstacles only
+// depends on the seed and on the difficulty changes.
 class ObstacleGenerator {
     private:
         int mDifficulty;
+        RandomGen mRng;
     public:
         ObstacleGenerator() {
             mDifficulty = 0;
@@ -32,6 +34,10 @@ class ObstacleGenerator {
             mDifficulty = dif;
         }
 
+        void SetSeed(unsigned seed) {
+            mRng.Seed(seed);
+        }
+
         // generate a new obstacle.
         void Generate(Obstacle *result);
 
@@ -43,6 +49,7 @@ class ObstacleGenerator {
 
         void FillRow(Obstacle *result, int row);
         void FillCol(Obstacle *result, int col);
+        void PunchHole(Obstacle *result);
 };
 
 #endif
@@ -130,3 +130,122 @@ const char* OurShader::GetShaderName() {
     return "OurShader";
 }
 
+
+OurInstancedShader::OurInstancedShader() : OurShader() {
+    mInstanceLoc = (GLint) -1;
+}
+
+int OurInstancedShader::GetMaxInstances() {
+    return OUR_SHADER_MAX_INSTANCES;
+}
+
+void OurInstancedShader::Compile() {
+    // the uniform arrays use the same names as OurShader's uniforms, so the base class
+    // finds their first elements
+    OurShader::Compile();
+
+    BindShader();
+    mInstanceLoc = glGetAttribLocation(mProgramH, "a_Instance");
+    if (mInstanceLoc < 0) {
+        LOGE("*** Couldn't get instance attrib location from shader (OurInstancedShader).");
+        ABORT_GAME;
+    }
+    UnbindShader();
+}
+
+void OurInstancedShader::BeginRender(VertexBuf *geom) {
+    OurShader::BeginRender(geom);
+
+    MY_ASSERT(geom->HasInstanceIds());
+    glVertexAttribPointer(mInstanceLoc, 1, GL_FLOAT, GL_FALSE, geom->GetStride(),
+                          BUFFER_OFFSET(geom->GetInstanceIdsOffset()));
+    glEnableVertexAttribArray(mInstanceLoc);
+}
+
+void OurInstancedShader::PrepareInstancedGeom(const GLfloat *geomData, int dataSize,
+        int stride, int colorsOffset, int texCoordsOffset, const GLushort *indices,
+        int indicesSize, InstancedGeomData *out) {
+    int copies = OUR_SHADER_MAX_INSTANCES;
+    int vertCount = dataSize / stride;
+    int floatsPerVert = stride / sizeof(GLfloat);
+
+    // each vertex gets its copy's index appended
+    out->vertices.resize(copies * vertCount * (floatsPerVert + 1));
+    GLfloat *v = out->vertices.empty() ? NULL : &out->vertices[0];
+    for (int c = 0; c < copies; c++) {
+        const GLfloat *in = geomData;
+        for (int i = 0; i < vertCount; i++) {
+            memcpy(v, in, stride);
+            v[floatsPerVert] = (GLfloat)c;
+            v += floatsPerVert + 1;
+            in += floatsPerVert;
+        }
+    }
+    out->stride = stride + sizeof(GLfloat);
+    out->colorsOffset = colorsOffset;
+    out->texCoordsOffset = texCoordsOffset;
+    out->instanceIdsOffset = stride;
+    out->elemsPerCopy = vertCount;
+
+    out->indices.clear();
+    if (indices) {
+        int indexCount = indicesSize / sizeof(GLushort);
+        MY_ASSERT(copies * vertCount <= 65536);
+        out->indices.resize(copies * indexCount);
+        for (int c = 0; c < copies; c++) {
+            for (int i = 0; i < indexCount; i++) {
+                out->indices[c * indexCount + i] = (GLushort)(indices[i] + c * vertCount);
+            }
+        }
+        out->elemsPerCopy = indexCount;
+    }
+}
+
+SimpleGeom *OurInstancedShader::MakeInstancedGeom(const InstancedGeomData& data) {
+    VertexBuf *vbuf = new VertexBuf(&data.vertices[0],
+            (int)(data.vertices.size() * sizeof(GLfloat)), data.stride);
+    vbuf->SetColorsOffset(data.colorsOffset);
+    vbuf->SetTexCoordsOffset(data.texCoordsOffset);
+    vbuf->SetInstanceIdsOffset(data.instanceIdsOffset);
+
+    IndexBuf *ibuf = NULL;
+    if (!data.indices.empty()) {
+        ibuf = new IndexBuf(&data.indices[0], (int)(data.indices.size() * sizeof(GLushort)));
+    }
+    return new SimpleGeom(vbuf, ibuf);
+}
+
+void OurInstancedShader::RenderInstances(IndexBuf *ibuf, int elemsPerCopy,
+        const glm::mat4 *mvp, const glm::vec4 *tint, const glm::vec4 *lightColor,
+        int count) {
+    MY_ASSERT(mPreparedVertexBuf != NULL);
+    MY_ASSERT(count > 0 && count <= OUR_SHADER_MAX_INSTANCES);
+
+    glUniformMatrix4fv(mMVPMatrixLoc, count, GL_FALSE, glm::value_ptr(mvp[0]));
+    glUniform4fv(mTintLoc, count, glm::value_ptr(tint[0]));
+    glUniform4fv(mPointLightColorLoc, count, glm::value_ptr(lightColor[0]));
+
+    // the point light sits at the origin of each copy
+    glUniform4f(mPointLightPosLoc, 0.0f, 0.0f, 0.0f, 1.0f);
+
+    if (ibuf) {
+        ibuf->BindBuffer();
+        glDrawElements(mPreparedVertexBuf->GetPrimitive(), count * elemsPerCopy,
+                GL_UNSIGNED_SHORT, BUFFER_OFFSET(0));
+        ibuf->UnbindBuffer();
+    } else {
+        glDrawArrays(mPreparedVertexBuf->GetPrimitive(), 0, count * elemsPerCopy);
+    }
+}
+
+const char* OurInstancedShader::GetVertShaderSource() {
+    return OUR_INSTANCED_VERTEX_SHADER_SOURCE;
+}
+
+const char* OurInstancedShader::GetFragShaderSource() {
+    return OUR_INSTANCED_FRAG_SHADER_SOURCE;
+}
+
+const char* OurInstancedShader::GetShaderName() {
+    return "OurInstancedShader";
+}
@@ -16,6 +16,7 @@
 #ifndef endlesstunnel_our_shader_hpp
 #define endlesstunnel_our_shader_hpp
 
+#include <vector>
 #include "engine.hpp"
 
 // An OpenGL shader that can apply a texture and a point light.
@@ -43,5 +44,49 @@ class OurShader : public Shader {
        virtual const char *GetShaderName();
 };
 
+// A geometry replicated for batched drawing, before it's uploaded to buffers.
+struct InstancedGeomData {
+    std::vector<GLfloat> vertices;
+    std::vector<GLushort> indices;  // empty if the geometry isn't indexed
+    int stride;
+    int colorsOffset, texCoordsOffset, instanceIdsOffset;
+    int elemsPerCopy;  // vertices, or indices if the geometry is indexed
+};
+
+// Batched version of OurShader: draws many copies of a geometry in one draw call,
+// each with its own matrix, tint color and point light color. The geometry must have
+// been built with PrepareInstancedGeom() and MakeInstancedGeom().
+class OurInstancedShader : public OurShader {
+    protected:
+       GLint mInstanceLoc;
+    public:
+       OurInstancedShader();
+       virtual void Compile();
+       virtual void BeginRender(VertexBuf *geom);
+
+       // how many copies a single RenderInstances() call can draw
+       static int GetMaxInstances();
+
+       // Builds the arrays of GetMaxInstances() copies of the given geometry. Makes no
+       // GL calls, so it can run on any thread.
+       static void PrepareInstancedGeom(const GLfloat *geomData, int dataSize, int stride,
+               int colorsOffset, int texCoordsOffset, const GLushort *indices,
+               int indicesSize, InstancedGeomData *out);
+
+       // Uploads a prepared geometry to a vertex buffer (and index buffer, if it's
+       // indexed).
+       static SimpleGeom *MakeInstancedGeom(const InstancedGeomData& data);
+
+       // Renders count (at most GetMaxInstances()) copies of the prepared geometry.
+       // elemsPerCopy is the number of vertices (or indices, if ibuf is given) of one
+       // copy.
+       void RenderInstances(IndexBuf *ibuf, int elemsPerCopy, const glm::mat4 *mvp,
+               const glm::vec4 *tint, const glm::vec4 *lightColor, int count);
+   protected:
+       virtual const char *GetVertShaderSource();
+       virtual const char *GetFragShaderSource();
+       virtual const char *GetShaderName();
+};
+
 #endif
 
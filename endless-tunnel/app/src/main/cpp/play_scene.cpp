@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <cstdio>
+#include <ctime>
 #include "anim.hpp"
 #include "ascii_to_geom.hpp"
 #include "game_consts.hpp"
@@ -30,6 +31,10 @@
 
 #define WALL_TEXTURE_SIZE 64
 
+// life icon, converted at compile time
+static constexpr const char *LIFE_ART[] = { ART_LIFE };
+BAKE_ASCII_ART_POOL(LIFE_GEOM, LIFE_ART, LIFE_ICON_SCALE);
+
 // colors for menus
 static const float MENUITEM_SEL_COLOR[] = { 1.0f, 1.0f, 0.0f };
 static const float MENUITEM_COLOR[] = { 1.0f, 1.0f, 1.0f };
@@ -63,23 +68,25 @@ PlayScene::PlayScene() : Scene() {
     mTextRenderer = NULL;
     mShapeRenderer = NULL;
     mShipSteerX = mShipSteerZ = 0.0f;
-    mFilteredSteerX = mFilteredSteerZ = 0.0f;
 
     mPlayerDir = glm::vec3(0.0f, 1.0f, 0.0f); // forward
-    mDifficulty = 0;
     mUseCloudSave = false;
 
-    mCubeGeom = NULL;
-    mTunnelGeom = NULL;
+    mRenderer = NULL;
+    mOurShaderId = mTunnelGeomId = mCubeGeomId = -1;
+
+    // every game is a new random run; the seed is recorded in the replay
+    mSim.Reset((unsigned)time(NULL));
+    mSimAccumulator = 0.0f;
+    mReplay.seed = mSim.GetSeed();
+    mReplay.startDifficulty = 0;
 
-    mObstacleCount = 0;
-    mFirstObstacle = 0;
-    mFirstSection = 0;
     mSteering = STEERING_NONE;
     mPointerId = -1;
     mPointerAnchorX = mPointerAnchorY = 0.0f;
 
     mWallTexture = NULL;
+    mPreloaded = false;
 
     memset(mMenuItemText, 0, sizeof(mMenuItemText));
     mMenuItemText[MENUITEM_UNPAUSE] = S_UNPAUSE;
@@ -99,35 +106,22 @@ PlayScene::PlayScene() : Scene() {
     mShowedHowto = false;
     mLifeGeom = NULL;
 
-    mLives = PLAYER_LIVES;
-
-    mRollAngle = 0.0f;
-
-    mPlayerSpeed = 0.0f;
     mBlinkingHeart = false;
     mGameStartTime = Clock();
-
-    mBonusInARow = 0;
-    mLastCrashSection = -1;
+    mLeaving = false;
 
     mFrameClock.SetMaxDelta(MAX_DELTA_T);
-    mLastAmbientBeepEmitted = 0;
     mMenuTouchActive = false;
 
     mCheckpointSignPending = false;
 
-    SetScore(0);
-
     /*
      * where do I put the program???
      */
     const char *savePath = "/mnt/sdcard/com.google.example.games.tunnel.fix";
-    int len = strlen(savePath) + strlen(SAVE_FILE_NAME) + 3;
-    mSaveFileName = new char[len];
-    strcpy(mSaveFileName, savePath);
-    strcat(mSaveFileName, "/");
-    strcat(mSaveFileName, SAVE_FILE_NAME);
-    LOGD("Save file name: %s", mSaveFileName);
+    mSaveFileName = std::string(savePath) + "/" + SAVE_FILE_NAME;
+    LOGD("Save file name: %s", mSaveFileName.c_str());
+    mReplayFileName = std::string(savePath) + "/" + REPLAY_FILE_NAME;
     LoadProgress();
 
     if (mSavedCheckpoint) {
@@ -141,8 +135,8 @@ void PlayScene::LoadProgress() {
     // try to load save file
     mSavedCheckpoint = 0;
 
-    LOGD("Attempting to load: %s", mSaveFileName);
-    FILE *f = fopen(mSaveFileName, "r");
+    LOGD("Attempting to load: %s", mSaveFileName.c_str());
+    FILE *f = fopen(mSaveFileName.c_str(), "r");
     bool hasLocalFile = false;
     if (f) {
         hasLocalFile = true;
@@ -169,8 +163,8 @@ void PlayScene::LoadProgress() {
 
     if (mUseCloudSave && hasLocalFile) {
         // since we're using cloud save, we can delete the local progress file
-        LOGD("Since we're using cloud save, deleting local progress file %s", mSaveFileName);
-        if (0 != remove(mSaveFileName)) {
+        LOGD("Since we're using cloud save, deleting local progress file %s", mSaveFileName.c_str());
+        if (0 != remove(mSaveFileName.c_str())) {
             LOGW("WARNING: failed to remove local progress file.");
         }
     }
@@ -181,8 +175,8 @@ void PlayScene::LoadProgress() {
 }
 
 void PlayScene::WriteSaveFile(int level) {
-    LOGD("Saving progress (level %d) to file: %s", level, mSaveFileName);
-    FILE *f = fopen(mSaveFileName, "w");
+    LOGD("Saving progress (level %d) to file: %s", level, mSaveFileName.c_str());
+    FILE *f = fopen(mSaveFileName.c_str(), "w");
     if (!f) {
         LOGE("Error writing to save game file.");
         return;
@@ -193,26 +187,27 @@ void PlayScene::WriteSaveFile(int level) {
 }
 
 void PlayScene::SaveProgress() {
-    if (mDifficulty <= mSavedCheckpoint) {
+    int difficulty = mSim.GetDifficulty();
+    if (difficulty <= mSavedCheckpoint) {
         // nothing to do
-        LOGD("No need to save level, current = %d, saved = %d", mDifficulty, mSavedCheckpoint);
+        LOGD("No need to save level, current = %d, saved = %d", difficulty, mSavedCheckpoint);
         return;
     } else if (!IsCheckpointLevel()) {
-        LOGD("Current level %d is not a checkpoint level. Nothing to save.", mDifficulty);
+        LOGD("Current level %d is not a checkpoint level. Nothing to save.", difficulty);
         return;
     }
 
-    mSavedCheckpoint = mDifficulty;
+    mSavedCheckpoint = difficulty;
 
     // Save state locally or to the cloud, depending on configuration:
     if (mUseCloudSave) {
-        LOGD("Saving progress to the cloud: level %d", mDifficulty);
+        LOGD("Saving progress to the cloud: level %d", difficulty);
         /*
          * No where to save
          */
     } else {
-        LOGD("Saving progress to LOCAL FILE: level %d", mDifficulty);
-        WriteSaveFile(mDifficulty);
+        LOGD("Saving progress to LOCAL FILE: level %d", difficulty);
+        WriteSaveFile(difficulty);
     }
 
     // Show a "checkpoint saved" sign when possible. We don't show it right away
@@ -221,21 +216,39 @@ void PlayScene::SaveProgress() {
     mCheckpointSignPending = true;
 }
 
-static unsigned char* _gen_wall_texture() {
-    static unsigned char pixel_data[WALL_TEXTURE_SIZE * WALL_TEXTURE_SIZE * 3];
+static void _gen_wall_texture(std::vector<unsigned char> *pixels, RandomGen *rng) {
+    pixels->resize(WALL_TEXTURE_SIZE * WALL_TEXTURE_SIZE * 3);
     unsigned char *p;
     int x, y;
-    for (y = 0, p = pixel_data; y < WALL_TEXTURE_SIZE; y++) {
+    for (y = 0, p = &(*pixels)[0]; y < WALL_TEXTURE_SIZE; y++) {
         for (x = 0; x < WALL_TEXTURE_SIZE; x++, p += 3) {
-            p[0] = p[1] = p[2] = 128 + ((x > 2 && y > 2) ? Random(128) : 0);
+            p[0] = p[1] = p[2] = 128 + ((x > 2 && y > 2) ? rng->Next(128) : 0);
         }
     }
-    return pixel_data;
+}
+
+void PlayScene::OnPreload() {
+    // the wall texture has its own generator: rand() isn't safe to call from here
+    RandomGen rng(mSim.GetSeed());
+    _gen_wall_texture(&mWallTexturePixels, &rng);
+
+    // tunnel geometry and cube geometry (to draw obstacles), replicated for batching
+    OurInstancedShader::PrepareInstancedGeom(TUNNEL_GEOM, sizeof(TUNNEL_GEOM),
+            TUNNEL_GEOM_STRIDE, TUNNEL_GEOM_COLOR_OFFSET, TUNNEL_GEOM_TEXCOORD_OFFSET,
+            TUNNEL_GEOM_INDICES, sizeof(TUNNEL_GEOM_INDICES), &mTunnelGeomData);
+    OurInstancedShader::PrepareInstancedGeom(CUBE_GEOM, sizeof(CUBE_GEOM), CUBE_GEOM_STRIDE,
+            CUBE_GEOM_COLOR_OFFSET, CUBE_GEOM_TEXCOORD_OFFSET, NULL, 0, &mCubeGeomData);
+
+    mPreloaded = true;
 }
 
 void PlayScene::OnStartGraphics() {
+    if (!mPreloaded) {
+        OnPreload();
+    }
+
     // build shaders
-    mOurShader = new OurShader();
+    mOurShader = new OurInstancedShader();
     mOurShader->Compile();
     mTrivialShader = new TrivialShader();
     mTrivialShader->Compile();
@@ -243,28 +256,22 @@ void PlayScene::OnStartGraphics() {
     // build projection matrix
     UpdateProjectionMatrix();
 
-    // build tunnel geometry
-    mTunnelGeom = new SimpleGeom(
-            new VertexBuf(TUNNEL_GEOM, sizeof(TUNNEL_GEOM),TUNNEL_GEOM_STRIDE),
-            new IndexBuf(TUNNEL_GEOM_INDICES, sizeof(TUNNEL_GEOM_INDICES)));
-    mTunnelGeom->vbuf->SetColorsOffset(TUNNEL_GEOM_COLOR_OFFSET);
-    mTunnelGeom->vbuf->SetTexCoordsOffset(TUNNEL_GEOM_TEXCOORD_OFFSET);
-
-    // build cube geometry (to draw obstacles)
-    mCubeGeom = new SimpleGeom(new VertexBuf(CUBE_GEOM, sizeof(CUBE_GEOM),CUBE_GEOM_STRIDE));
-    mCubeGeom->vbuf->SetColorsOffset(CUBE_GEOM_COLOR_OFFSET);
-    mCubeGeom->vbuf->SetTexCoordsOffset(CUBE_GEOM_TEXCOORD_OFFSET);
-
     // make the wall texture
     mWallTexture = new Texture();
     mWallTexture->InitFromRawRGB(WALL_TEXTURE_SIZE, WALL_TEXTURE_SIZE, false,
-            _gen_wall_texture());
+            &mWallTexturePixels[0]);
+
+    // upload tunnel geometry and cube geometry (to draw obstacles)
+    mRenderer = new InstancedRenderer();
+    mOurShaderId = mRenderer->AddShader(mOurShader);
+    mTunnelGeomId = mRenderer->AddGeom(mTunnelGeomData, mWallTexture);
+    mCubeGeomId = mRenderer->AddGeom(mCubeGeomData, mWallTexture);
 
     // reset frame clock so the animation doesn't jump
     mFrameClock.Reset();
 
     // life icon geometry
-    mLifeGeom = AsciiArtToGeom(ART_LIFE, LIFE_ICON_SCALE);
+    mLifeGeom = AsciiArtToGeom(LIFE_GEOM.Get(0));
 
     // create text renderer and shape renderer
     mTextRenderer = new TextRenderer(mTrivialShader);
@@ -276,15 +283,18 @@ void PlayScene::OnKillGraphics() {
     CleanUp(&mShapeRenderer);
     CleanUp(&mOurShader);
     CleanUp(&mTrivialShader);
-    CleanUp(&mTunnelGeom);
-    CleanUp(&mCubeGeom);
+    CleanUp(&mRenderer);
     CleanUp(&mWallTexture);
     CleanUp(&mLifeGeom);
 }
 
 void PlayScene::DoFrame() {
     float deltaT = mFrameClock.ReadDelta();
-    float previousY = mPlayerPos.y;
+
+    // advance the game (it's frozen while a menu is up)
+    if (!mMenu) {
+        UpdateSim(deltaT);
+    }
 
     // clear screen
     glClearColor(0.0, 0.0, 0.0, 1.0);
@@ -292,16 +302,20 @@ void PlayScene::DoFrame() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // rotate the view matrix according to current roll angle
-    glm::vec3 upVec = glm::vec3(-sin(mRollAngle), 0, cos(mRollAngle));
-
-    // set up view matrix according to player's ship position and direction
-    mViewMat = glm::lookAt(mPlayerPos, mPlayerPos + mPlayerDir, upVec);
+    float rollAngle = mSim.GetRollAngle();
+    glm::vec3 upVec = glm::vec3(-sin(rollAngle), 0, cos(rollAngle));
 
-    // render tunnel walls
-    RenderTunnel();
+    // set up view matrix according to player's ship position and direction. The
+    // position is interpolated between the last two ticks so that motion is smooth
+    // at any frame rate.
+    glm::vec3 playerPos = mSim.GetPlayerPos(mSimAccumulator / SIM_TIMESTEP);
+    mViewMat = glm::lookAt(playerPos, playerPos + mPlayerDir, upVec);
 
-    // render obstacles
-    RenderObstacles();
+    // render tunnel walls and obstacles
+    glm::mat4 viewProjMat = mProjMat * mViewMat;
+    RenderTunnel(viewProjMat);
+    RenderObstacles(viewProjMat);
+    mRenderQueue.Flush(mRenderer);
 
     if (mMenu) {
         RenderMenu();
@@ -327,7 +341,7 @@ void PlayScene::DoFrame() {
     }
 
     // did we already show the howto?
-    if (!mShowedHowto && mDifficulty == 0) {
+    if (!mShowedHowto && mSim.GetDifficulty() == 0) {
         mShowedHowto = true;
         ShowSign(S_HOWTO_WITHOUT_JOY, SIGN_DURATION);
     }
@@ -337,83 +351,74 @@ void PlayScene::DoFrame() {
         mBlinkingHeart = false;
     }
 
-    // update speed
-    float targetSpeed = PLAYER_SPEED + PLAYER_SPEED_INC_PER_LEVEL * mDifficulty;
-    float accel = mPlayerSpeed >= 0.0f ? PLAYER_ACCELERATION_POSITIVE_SPEED :
-            PLAYER_ACCELERATION_NEGATIVE_SPEED;
-    if (mLives <= 0) {
-        targetSpeed = 0.0f;
-    }
-    mPlayerSpeed = Approach(mPlayerSpeed, targetSpeed, deltaT * accel);
-
-    // apply noise filter on steering
-    mFilteredSteerX = (mFilteredSteerX * (NOISE_FILTER_SAMPLES - 1) + mShipSteerX)
-            / NOISE_FILTER_SAMPLES;
-    mFilteredSteerZ = (mFilteredSteerZ * (NOISE_FILTER_SAMPLES - 1) + mShipSteerZ)
-            / NOISE_FILTER_SAMPLES;
-
-    // move player
-    if (mLives > 0) {
-        float steerX = mFilteredSteerX, steerZ = mFilteredSteerZ;
-        if (mSteering == STEERING_TOUCH) {
-            // touch steering
-            mPlayerPos.x = Approach(mPlayerPos.x, steerX, PLAYER_MAX_LAT_SPEED * deltaT);
-            mPlayerPos.z = Approach(mPlayerPos.z, steerZ, PLAYER_MAX_LAT_SPEED * deltaT);
-        } else if (mSteering == STEERING_JOY) {
-            // joystick steering
-            mPlayerPos.x += deltaT * steerX;
-            mPlayerPos.z += deltaT * steerZ;
-        }
+    // did the game expire?
+    if (mSim.IsGameOver() && Clock() > mGameOverExpire) {
+        ReturnToWelcomeScene();
     }
-    mPlayerPos.y += deltaT * mPlayerSpeed;
-
-    // make sure player didn't leave tunnel
-    mPlayerPos.x = Clamp(mPlayerPos.x, PLAYER_MIN_X, PLAYER_MAX_X);
-    mPlayerPos.z = Clamp(mPlayerPos.z, PLAYER_MIN_Z, PLAYER_MAX_Z);
-
-    // shift sections if needed
-    ShiftIfNeeded();
+}
 
-    // generate more obstacles!
-    GenObstacles();
+void PlayScene::UpdateSim(float deltaT) {
+    SimInput input;
+    input.steering = mSteering;
+    input.steerX = mShipSteerX;
+    input.steerZ = mShipSteerZ;
+
+    mSimAccumulator += deltaT;
+    while (mSimAccumulator >= SIM_TIMESTEP) {
+        mSimAccumulator -= SIM_TIMESTEP;
+        if (!mSim.IsGameOver()) {
+            mReplay.inputs.push_back(input);
+        }
+        HandleSimEvents(mSim.Step(input));
+    }
+}
 
-    // detect collisions
-    DetectCollisions(previousY);
+void PlayScene::HandleSimEvents(int events) {
+    if (events & PlaySim::EVENT_CRASH) {
+        if (events & PlaySim::EVENT_GAME_OVER) {
+            // say "Game Over"
+            ShowSign(S_GAME_OVER, SIGN_DURATION_GAME_OVER);
+            SfxMan::GetInstance()->PlayTone(TONE_GAME_OVER);
+            mGameOverExpire = Clock() + GAME_OVER_EXPIRE;
 
-    // update ship's roll speed according to level
-    static float roll_speeds[] = ROLL_SPEEDS;
-    int count = sizeof(roll_speeds) / sizeof(float);
-    float speed = roll_speeds[mDifficulty % count];
-    mRollAngle += deltaT * speed;
-    while (mRollAngle < 0) {
-        mRollAngle += 2 * M_PI;
-    }
-    while (mRollAngle > 2 * M_PI) {
-        mRollAngle -= 2 * M_PI;
+            LOGD("Saving replay (%d ticks) to %s", (int)mReplay.inputs.size(),
+                 mReplayFileName.c_str());
+            if (!mReplay.Save(mReplayFileName.c_str())) {
+                LOGW("WARNING: failed to write replay file.");
+            }
+        } else {
+            ShowSign(S_OUCH, SIGN_DURATION);
+            SfxMan::GetInstance()->PlayTone(TONE_CRASHED);
+        }
+        mBlinkingHeart = true;
+        mBlinkingHeartExpire = Clock() + BLINKING_HEART_DURATION;
     }
 
-    // did the game expire?
-    if (mLives <= 0 && Clock() > mGameOverExpire) {
-        SceneManager::GetInstance()->RequestNewScene(new WelcomeScene());
+    if (events & PlaySim::EVENT_BONUS) {
+        ShowSign(S_GOT_BONUS, SIGN_DURATION_BONUS);
+        if (events & PlaySim::EVENT_LEVEL_UP) {
+            ShowLevelSign();
+            SfxMan::GetInstance()->PlayTone(TONE_LEVEL_UP);
 
+            // save progress, if needed
+            SaveProgress();
+        } else {
+            int score = mSim.GetScore();
+            int tone = (score % SCORE_PER_LEVEL) / BONUS_POINTS - 1;
+            tone = tone < 0 ? 0 :
+                   tone >= static_cast<int>(sizeof(TONE_BONUS)/sizeof(char*)) ?
+                   static_cast<int>(sizeof(TONE_BONUS)/sizeof(char*) - 1) : tone;
+            SfxMan::GetInstance()->PlayTone(TONE_BONUS[tone]);
+        }
     }
 
     // produce the ambient sound
-    int soundPoint = (int)floor(mPlayerPos.y / (TUNNEL_SECTION_LENGTH/3));
-    if (soundPoint % 3 != 0 && soundPoint > mLastAmbientBeepEmitted) {
-        mLastAmbientBeepEmitted = soundPoint;
+    if (events & PlaySim::EVENT_AMBIENT_BEEP) {
+        int soundPoint = mSim.GetAmbientBeep();
         SfxMan::GetInstance()->PlayTone(soundPoint % 2 ? TONE_AMBIENT_0 : TONE_AMBIENT_1);
     }
 }
 
-static float GetSectionCenterY(int i) {
-    return (float)i * TUNNEL_SECTION_LENGTH;
-}
-
-static float GetSectionEndY(int i) {
-    return GetSectionCenterY(i) + 0.5f * TUNNEL_SECTION_LENGTH;
-}
-
 static void _get_obs_color(int style, float *r, float *g, float *b) {
     style = Clamp(style, 1, 6);
     *r = OBS_COLORS[style * 3];
@@ -421,116 +426,76 @@ static void _get_obs_color(int style, float *r, float *g, float *b) {
     *b = OBS_COLORS[style * 3 + 2];
 }
 
-void PlayScene::RenderTunnel() {
+void PlayScene::RenderTunnel(const glm::mat4& viewProjMat) {
+    static const glm::vec4 WHITE(1.0f, 1.0f, 1.0f, 1.0f);
     glm::mat4 modelMat;
-    glm::mat4 mvpMat;
-    int i, oi;
+    SectionStream *sections = mSim.GetSections();
+    SectionHandle first = sections->GetFirst();
+    SectionHandle h;
 
-    mOurShader->BeginRender(mTunnelGeom->vbuf);
-    mOurShader->SetTexture(mWallTexture);
-    for (i = mFirstSection, oi = 0; i <= mFirstSection + RENDER_TUNNEL_SECTION_COUNT; ++i, ++oi) {
-        float segCenterY = GetSectionCenterY(i);
+    for (h = first; h <= first + RENDER_TUNNEL_SECTION_COUNT; ++h) {
+        float segCenterY = PlaySim::GetSectionCenterY(h);
         modelMat = glm::translate(glm::mat4(1.0), glm::vec3(0.0, segCenterY, 0.0));
-        mvpMat = mProjMat * mViewMat * modelMat;
 
-        Obstacle *o = oi >= mObstacleCount ? NULL : GetObstacleAt(oi);
+        Obstacle *o = sections->Find(h);
 
-        // the point light is given in model coordinates, which is 0,0,0 is ok (center of
-        // tunnel section)
+        // the point light is at the center of the tunnel section, and has the color
+        // of the section's obstacle
+        glm::vec4 lightColor(0.0f);
         if (o) {
             float red, green, blue;
             _get_obs_color(o->style, &red, &green, &blue);
-            mOurShader->EnablePointLight(glm::vec3(0.0, 0.0f, 0.0f), red, green, blue);
-        } else {
-            mOurShader->DisablePointLight();
+            lightColor = glm::vec4(red, green, blue, 1.0f);
         }
 
         // render tunnel section
-        mOurShader->Render(mTunnelGeom->ibuf, &mvpMat);
+        mRenderQueue.Add(mOurShaderId, mTunnelGeomId, viewProjMat * modelMat, WHITE,
+                lightColor);
     }
-    mOurShader->EndRender();
 }
 
-void PlayScene::RenderObstacles() {
-    int i;
+void PlayScene::RenderObstacles(const glm::mat4& viewProjMat) {
+    SectionStream *sections = mSim.GetSections();
+    SectionHandle h;
     int r, c;
     float red, green, blue;
     glm::mat4 modelMat;
-    glm::mat4 mvpMat;
 
-    mOurShader->BeginRender(mCubeGeom->vbuf);
-    mOurShader->SetTexture(mWallTexture);
+    // shimmering color of the bonus
+    float shimmer = SineWave(0.8f, 1.0f, 0.5f, 0.0f);
+    glm::vec4 bonusTint(shimmer, shimmer, shimmer, 1.0f);
 
-    for (i = 0; i < mObstacleCount; i++) {
-        Obstacle *o = GetObstacleAt(i);
-        float posY = GetSectionCenterY(mFirstSection + i);
+    for (h = sections->GetFirst(); h != sections->GetEnd(); ++h) {
+        Obstacle *o = sections->Get(h);
+        float posY = PlaySim::GetSectionCenterY(h);
 
         if (o->style == Obstacle::STYLE_NULL) {
             // don't render null obstacles
             continue;
         }
 
-        for (r = 0; r < OBS_GRID_SIZE; r++) {
-            for (c = 0; c < OBS_GRID_SIZE; c++) {
-                bool isBonus = r == o->bonusRow && c == o->bonusCol;
-                if (o->grid[c][r]) {
-                    // set up matrices
-                    modelMat = glm::translate(glm::mat4(1.0f), o->GetBoxCenter(c, r, posY));
-                    modelMat = glm::scale(modelMat, o->GetBoxSize(c, r));
-                    mvpMat = mProjMat * mViewMat * modelMat;
-
-                    // set up color
-                    _get_obs_color(o->style, &red, &green, &blue);
-                    mOurShader->SetTintColor(red, green, blue);
-
-                    // render box
-                    mOurShader->Render(&mvpMat);
-                } else if (isBonus) {
-                    modelMat = glm::translate(glm::mat4(1.0f), o->GetBoxCenter(c, r, posY));
-                    modelMat = glm::scale(modelMat, glm::vec3(OBS_BONUS_SIZE, OBS_BONUS_SIZE,
-                            OBS_BONUS_SIZE));
-                    modelMat = glm::rotate(modelMat, Clock() * 90.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-                    mvpMat = mProjMat * mViewMat * modelMat;
-                    mOurShader->SetTintColor(SineWave(0.8f, 1.0f, 0.5f, 0.0f),
-                            SineWave(0.8f, 1.0f, 0.5f, 0.0f),
-                            SineWave(0.8f, 1.0f, 0.5f, 0.0f)); // shimmering color
-                    mOurShader->Render(&mvpMat); // render
-                }
-            }
-        }
-    }
-    mOurShader->EndRender();
-}
+        _get_obs_color(o->style, &red, &green, &blue);
+        glm::vec4 tint(red, green, blue, 1.0f);
 
-void PlayScene::GenObstacles() {
-    while (mObstacleCount < MAX_OBS) {
-        // generate a new obstacle
-        int index = (mFirstObstacle + mObstacleCount) % MAX_OBS;
+        // queue the boxes, visiting only the occupied cells
+        for (ObsMask m = o->boxes; m; m &= m - 1) {
+            int cell = ObsMaskFirstCell(m);
+            c = Obstacle::CellCol(cell);
+            r = Obstacle::CellRow(cell);
 
-        int section = mFirstSection + mObstacleCount;
-        if (section < OBS_START_SECTION) {
-            // generate an empty obstacle
-            mObstacleCircBuf[index].Reset();
-            mObstacleCircBuf[index].style = Obstacle::STYLE_NULL;
-        } else {
-            // generate a normal obstacle
-            mObstacleGen.Generate(&mObstacleCircBuf[index]);
+            modelMat = glm::translate(glm::mat4(1.0f), o->GetBoxCenter(c, r, posY));
+            modelMat = glm::scale(modelMat, o->GetBoxSize(c, r));
+            mRenderQueue.Add(mOurShaderId, mCubeGeomId, viewProjMat * modelMat, tint);
         }
-        mObstacleCount++;
-    }
-}
 
-void PlayScene::ShiftIfNeeded() {
-    // is it time to discard a section and shift forward?
-    while (mPlayerPos.y > GetSectionEndY(mFirstSection) + SHIFT_THRESH) {
-        // shift to the next turnnel section
-        mFirstSection++;
-
-        // discard obstacle corresponding to the deleted section
-        if (mObstacleCount > 0) {
-            // discarding first object (shifting) is easy because it's a circular buffer!
-            mFirstObstacle = (mFirstObstacle + 1) % MAX_OBS;
-            --mObstacleCount;
+        if (o->HasBonus()) {
+            c = o->GetBonusCol();
+            r = o->GetBonusRow();
+            modelMat = glm::translate(glm::mat4(1.0f), o->GetBoxCenter(c, r, posY));
+            modelMat = glm::scale(modelMat, glm::vec3(OBS_BONUS_SIZE, OBS_BONUS_SIZE,
+                    OBS_BONUS_SIZE));
+            modelMat = glm::rotate(modelMat, Clock() * 90.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+            mRenderQueue.Add(mOurShaderId, mCubeGeomId, viewProjMat * modelMat, bonusTint);
         }
     }
 }
@@ -552,8 +517,8 @@ void PlayScene::OnPointerDown(int pointerId, const struct PointerCoords *coords)
         mPointerId = pointerId;
         mPointerAnchorX = x;
         mPointerAnchorY = y;
-        mShipAnchorX = mPlayerPos.x;
-        mShipAnchorZ = mPlayerPos.z;
+        mShipAnchorX = mSim.GetPlayerPos().x;
+        mShipAnchorZ = mSim.GetPlayerPos().z;
         mSteering = STEERING_TOUCH;
     }
 }
@@ -580,8 +545,9 @@ void PlayScene::OnPointerMove(int pointerId, const struct PointerCoords *coords)
     else if (mSteering == STEERING_TOUCH && pointerId == mPointerId) {
         float deltaX = (x - mPointerAnchorX) * TOUCH_CONTROL_SENSIVITY / rangeY;
         float deltaY = -(y - mPointerAnchorY) * TOUCH_CONTROL_SENSIVITY / rangeY;
-        float rotatedDx = cos(mRollAngle) * deltaX - sin(mRollAngle) * deltaY;
-        float rotatedDy = sin(mRollAngle) * deltaX + cos(mRollAngle) * deltaY;
+        float rollAngle = mSim.GetRollAngle();
+        float rotatedDx = cos(rollAngle) * deltaX - sin(rollAngle) * deltaY;
+        float rotatedDy = sin(rollAngle) * deltaX + cos(rollAngle) * deltaY;
 
         mShipSteerX = mShipAnchorX + rotatedDx;
         mShipSteerZ = mShipAnchorZ + rotatedDy;
@@ -599,7 +565,7 @@ void PlayScene::RenderHUD() {
     // render score digits
     int i, unit;
     static char score_str[6];
-    int score = GetScore();
+    int score = mSim.GetScore();
     for (i = 0, unit = 10000; i < 5; i++, unit /= 10) {
         score_str[i] = '0' + (score / unit) % 10;
     }
@@ -631,7 +597,8 @@ void PlayScene::RenderHUD() {
     float lifeX = LIFE_POS_X < 0.0f ? aspect + LIFE_POS_X : LIFE_POS_X;
     modelMat = glm::translate(glm::mat4(1.0), glm::vec3(lifeX, LIFE_POS_Y, 0.0f));
     modelMat = glm::scale(modelMat, glm::vec3(1.0f, LIFE_SCALE_Y, 1.0f));
-    int ubound = (mBlinkingHeart && BlinkFunc(0.2f)) ? mLives + 1 : mLives;
+    int lives = mSim.GetLives();
+    int ubound = (mBlinkingHeart && BlinkFunc(0.2f)) ? lives + 1 : lives;
     for (int i = 0; i < ubound; i++) {
         mat = orthoMat * modelMat;
         mTrivialShader->RenderSimpleGeom(&mat, mLifeGeom);
@@ -666,90 +633,6 @@ void PlayScene::RenderMenu() {
     glEnable(GL_DEPTH_TEST);
 }
 
-void PlayScene::DetectCollisions(float previousY) {
-    Obstacle *o = GetObstacleAt(0);
-    float obsCenter = GetSectionCenterY(mFirstSection);
-    float obsMin = obsCenter - OBS_BOX_SIZE;
-    float curY = mPlayerPos.y;
-
-    if (!o || !(previousY < obsMin && curY >= obsMin)) {
-        // no collision
-        return;
-    }
-
-    // what row/column is the player on?
-    int col = o->GetColAt(mPlayerPos.x);
-    int row = o->GetRowAt(mPlayerPos.z);
-
-    if (o->grid[col][row]) {
-        // crashed against obstacle
-        mLives--;
-        if (mLives > 0) {
-            ShowSign(S_OUCH, SIGN_DURATION);
-            SfxMan::GetInstance()->PlayTone(TONE_CRASHED);
-        } else {
-            // say "Game Over"
-            ShowSign(S_GAME_OVER, SIGN_DURATION_GAME_OVER);
-            SfxMan::GetInstance()->PlayTone(TONE_GAME_OVER);
-            mGameOverExpire = Clock() + GAME_OVER_EXPIRE;
-        }
-        mPlayerPos.y = obsMin - PLAYER_RECEDE_AFTER_COLLISION;
-        mPlayerSpeed = PLAYER_SPEED_AFTER_COLLISION;
-        mBlinkingHeart = true;
-        mBlinkingHeartExpire = Clock() + BLINKING_HEART_DURATION;
-
-        mLastCrashSection = mFirstSection;
-
-    } else if (row == o->bonusRow && col == o->bonusCol) {
-        ShowSign(S_GOT_BONUS, SIGN_DURATION_BONUS);
-        o->DeleteBonus();
-        AddScore(BONUS_POINTS);
-        mBonusInARow++;
-
-        if (mBonusInARow >= 10) {
-            mBonusInARow = 0;
-        }
-
-        // update difficulty level, if applicable
-        int score = GetScore();
-        if (mDifficulty < score / SCORE_PER_LEVEL) {
-            mDifficulty = score / SCORE_PER_LEVEL;
-            ShowLevelSign();
-            mObstacleGen.SetDifficulty(mDifficulty);
-            SfxMan::GetInstance()->PlayTone(TONE_LEVEL_UP);
-
-            // save progress, if needed
-            SaveProgress();
-        } else {
-            int tone = (score % SCORE_PER_LEVEL) / BONUS_POINTS - 1;
-            tone = tone < 0 ? 0 :
-                   tone >= static_cast<int>(sizeof(TONE_BONUS)/sizeof(char*)) ?
-                   static_cast<int>(sizeof(TONE_BONUS)/sizeof(char*) - 1) : tone;
-            SfxMan::GetInstance()->PlayTone(TONE_BONUS[tone]);
-        }
-
-    } else if (o->HasBonus()) {
-        // player missed bonus!
-        mBonusInARow = 0;
-    }
-
-    // was it a close call?
-    if (!o->grid[col][row]) {
-        bool isCloseCall = false;
-        for (int i = -1; i <= 1 && !isCloseCall; i++) {
-            for (int j = -1; j <= 1; j++) {
-                int other_row = o->GetColAt(mPlayerPos.x + i * CLOSE_CALL_CALC_DELTA);
-                int other_col = o->GetRowAt(mPlayerPos.z + j * CLOSE_CALL_CALC_DELTA);
-                if (o->grid[other_col][other_row]) {
-                    isCloseCall = true;
-                    break;
-                }
-            }
-        }
-
-    }
-}
-
 bool PlayScene::OnBackKeyPressed() {
     if (mMenu) {
         // reset frame clock so that the animation doesn't jump:
@@ -769,8 +652,9 @@ void PlayScene::OnJoy(float joyX, float joyY) {
     if (!mSteering || mSteering == STEERING_JOY) {
         float deltaX = joyX * JOYSTICK_CONTROL_SENSIVITY;
         float deltaY = joyY * JOYSTICK_CONTROL_SENSIVITY;
-        float rotatedDx = cos(-mRollAngle) * deltaX - sin(-mRollAngle) * deltaY;
-        float rotatedDy = sin(-mRollAngle) * deltaX + cos(-mRollAngle) * deltaY;
+        float rollAngle = mSim.GetRollAngle();
+        float rotatedDx = cos(-rollAngle) * deltaX - sin(-rollAngle) * deltaY;
+        float rotatedDy = sin(-rollAngle) * deltaX + cos(-rollAngle) * deltaY;
         mShipSteerX = rotatedDx;
         mShipSteerZ = -rotatedDy;
         mSteering = STEERING_JOY;
@@ -778,9 +662,10 @@ void PlayScene::OnJoy(float joyX, float joyY) {
         // If player is going faster than the reference speed, PLAYER_SPEED, adjust it.
         // This makes the steering react faster as the ship accelerates in more difficult
         // levels.
-        if (mPlayerSpeed > PLAYER_SPEED) {
-            mShipSteerX *= mPlayerSpeed / PLAYER_SPEED;
-            mShipSteerZ *= mPlayerSpeed / PLAYER_SPEED;
+        float playerSpeed = mSim.GetPlayerSpeed();
+        if (playerSpeed > PLAYER_SPEED) {
+            mShipSteerX *= playerSpeed / PLAYER_SPEED;
+            mShipSteerZ *= playerSpeed / PLAYER_SPEED;
         }
     }
 }
@@ -823,16 +708,15 @@ void PlayScene::ShowMenu(int menu) {
 void PlayScene::HandleMenu(int menuItem) {
     switch (menuItem) {
         case MENUITEM_QUIT:
-            SceneManager::GetInstance()->RequestNewScene(new WelcomeScene());
+            ReturnToWelcomeScene();
             break;
         case MENUITEM_UNPAUSE:
             ShowMenu(MENU_NONE);
             break;
         case MENUITEM_RESUME:
             // resume from saved level
-            mDifficulty = (mSavedCheckpoint / LEVELS_PER_CHECKPOINT) * LEVELS_PER_CHECKPOINT;
-            SetScore(SCORE_PER_LEVEL * mDifficulty);
-            mObstacleGen.SetDifficulty(mDifficulty);
+            mSim.StartAtLevel((mSavedCheckpoint / LEVELS_PER_CHECKPOINT) * LEVELS_PER_CHECKPOINT);
+            mReplay.startDifficulty = mSim.GetDifficulty();
             ShowLevelSign();
             ShowMenu(MENU_NONE);
             break;
@@ -843,9 +727,16 @@ void PlayScene::HandleMenu(int menuItem) {
     }
 }
 
+void PlayScene::ReturnToWelcomeScene() {
+    if (!mLeaving) {
+        mLeaving = true;
+        SceneManager::GetInstance()->RequestNewScene(new WelcomeScene());
+    }
+}
+
 void PlayScene::ShowLevelSign() {
     static char level_str[] = "LEVEL XX";
-    int level = mDifficulty + 1;
+    int level = mSim.GetDifficulty() + 1;
     level_str[6] = '0' + ((level > 9) ? (level / 10) % 10 : level % 10);
     level_str[7] = (level > 9) ? ('0' + level % 10) : '\0';
     level_str[8] = '\0';
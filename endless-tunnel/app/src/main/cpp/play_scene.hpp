@@ -16,21 +16,25 @@
 #ifndef endlesstunnel_play_scene_h
 #define endlesstunnel_play_scene_h
 
+#include <string>
 #include "engine.hpp"
-#include "obstacle_generator.hpp"
+#include "instanced_renderer.hpp"
 #include "obstacle.hpp"
+#include "play_sim.hpp"
+#include "render_queue.hpp"
 #include "sfxman.hpp"
 #include "shape_renderer.hpp"
 #include "text_renderer.hpp"
 #include "util.hpp"
 
-class OurShader;
-
 /* This is the gameplay scene -- the scene that shows the player flying down
- * the infinite tunnel, dodging obstacles, collecting bonuses and being awesome. */
+ * the infinite tunnel, dodging obstacles, collecting bonuses and being awesome.
+ * The game logic itself lives in PlaySim; this scene feeds it input, steps it at a
+ * fixed rate and renders, plays sounds and shows signs for what happened. */
 class PlayScene : public Scene {
     public:
         PlayScene();
+        virtual void OnPreload();
         virtual void OnStartGraphics();
         virtual void OnKillGraphics();
         virtual void DoFrame();
@@ -45,12 +49,18 @@ class PlayScene : public Scene {
 
     protected:
         // shaders
-        OurShader *mOurShader;
+        OurInstancedShader *mOurShader;
         TrivialShader *mTrivialShader;
 
         // the wall texture
         Texture *mWallTexture;
 
+        // CPU-side resources made by OnPreload(), uploaded by OnStartGraphics(). They
+        // are kept so they don't have to be made again when graphics restart.
+        bool mPreloaded;
+        std::vector<unsigned char> mWallTexturePixels;
+        InstancedGeomData mTunnelGeomData, mCubeGeomData;
+
         // shape and text renderers we use when rendering the HUD
         ShapeRenderer *mShapeRenderer;
         TextRenderer *mTextRenderer;
@@ -58,21 +68,17 @@ class PlayScene : public Scene {
         // matrices
         glm::mat4 mViewMat, mProjMat;
 
-        // player's position and direction
-        glm::vec3 mPlayerPos, mPlayerDir;
+        // player's direction
+        glm::vec3 mPlayerDir;
 
-        // lives left
-        int mLives;
+        // the game simulation (player, obstacles, score, lives, difficulty)
+        PlaySim mSim;
 
-        // player's score. As a trivial form of protection (just to give crackers a
-        // hard time), we *actually* store the score encrypted in mEncryptedScore, but have a
-        // fake variable mFakeScore that stores a copy of it. This serves as a honeypot to
-        // an attacker who's trying to crack the game using a memory editor.
-        unsigned mFakeScore;
-        unsigned mEncryptedScore;
+        // simulation time not yet consumed by a tick, in seconds
+        float mSimAccumulator;
 
-        // current difficulty level
-        int mDifficulty;
+        // input of every tick so far, saved when the game is over so it can be replayed
+        SimReplay mReplay;
 
         // should we use cloud save? If not, we will save progress to local data only.
         bool mUseCloudSave;
@@ -80,30 +86,19 @@ class PlayScene : public Scene {
         // greatest checkpoint level attained by player (loaded from file)
         int mSavedCheckpoint;
 
-        // vertex buffer and index buffer to render tunnel
-        SimpleGeom *mTunnelGeom;
-
-        // vertex buffer to render obstacles
-        SimpleGeom *mCubeGeom;
+        // draws the tunnel and the obstacles in batches
+        InstancedRenderer *mRenderer;
+        RenderQueue mRenderQueue;
 
-        // what is the first tunnel section that we are rendering
-        int mFirstSection;
-
-        // circular buffer of obstacles (mObstacleCircBuf[mFirstObstacle...])
-        // There is exactly one obstacle for each tunnel section:
-        // obstacle 0 is at section mFirstSection
-        // obstacle 1 is at section mFirstSection + 1
-        // and so on and so forth.
-        static const int MAX_OBS = RENDER_TUNNEL_SECTION_COUNT * 2;
-        int mFirstObstacle;
-        int mObstacleCount;
-        Obstacle mObstacleCircBuf[MAX_OBS];
-
-        // obstacle generator
-        ObstacleGenerator mObstacleGen;
+        // ids of our shader and of the tunnel and obstacle geometries in mRenderer
+        int mOurShaderId;
+        int mTunnelGeomId;
+        int mCubeGeomId;
 
         // touch pointer ID and anchor position (where touch started)
-        static const int STEERING_NONE = 0, STEERING_TOUCH = 1, STEERING_JOY = 2;
+        static const int STEERING_NONE = PlaySim::STEERING_NONE;
+        static const int STEERING_TOUCH = PlaySim::STEERING_TOUCH;
+        static const int STEERING_JOY = PlaySim::STEERING_JOY;
         int mSteering;  // is player steering at the moment? If so, how?
         int mPointerId;  // if so, what's the pointer ID
         float mPointerAnchorX, mPointerAnchorY; // where the drag started
@@ -111,10 +106,6 @@ class PlayScene : public Scene {
         float mShipSteerX, mShipSteerZ; // target x,z of ship (when using touch control) or
                                         // velocity vector (when using joystick)
 
-        // moving average filter for input (on mShipSteerX and mShipSteerY)
-        static const int NOISE_FILTER_SAMPLES = 5;
-        float mFilteredSteerX, mFilteredSteerZ;
-
         // frame clock -- it computes the deltas between successive frames so we can
         // update stuff properly
         DeltaClock mFrameClock;
@@ -156,12 +147,6 @@ class PlayScene : public Scene {
         // heart geom (to display # lives)
         SimpleGeom *mLifeGeom;
 
-        // current roll angle, in degrees, counterclockwise from original
-        float mRollAngle;
-
-        // current speed
-        float mPlayerSpeed;
-
         // are we showing the "just lost a heart" animation? If so, when does it expire?
         bool mBlinkingHeart;
         float mBlinkingHeartExpire;
@@ -170,49 +155,33 @@ class PlayScene : public Scene {
         // and indicates when we should return to the main screen
         float mGameOverExpire;
 
+        // did we ask to go back to the main screen? The welcome scene takes a few
+        // frames to preload, and asking again would start that over
+        bool mLeaving;
+
         // time when game started
         float mGameStartTime;
 
-        // how many bonuses were collected without missing one?
-        int mBonusInARow;
-
-        // what was the section number of the last obstacle with which the player crashed?
-        int mLastCrashSection;
-
-
-        // last subsection were an ambient sound was emitted
-        int mLastAmbientBeepEmitted;
-
         // name of the save file
-        char *mSaveFileName;
+        std::string mSaveFileName;
+
+        // name of the file the replay of the last game is written to
+        std::string mReplayFileName;
 
         // pending to show a "checkpoint saved" sign?
         bool mCheckpointSignPending;
 
-        // get current score
-        int GetScore() {
-            return (int)(mEncryptedScore ^ 0x600673);
-        }
-
-        // set current score
-        void SetScore(int s) {
-            mFakeScore = (unsigned)s;
-            mEncryptedScore = mFakeScore ^ 0x600673;
-        }
+        // runs as many simulation ticks as the elapsed time calls for
+        void UpdateSim(float deltaT);
 
-        // add to current score
-        void AddScore(int s) {
-            SetScore(GetScore() + s);
-        }
+        // reacts to the events (PlaySim::EVENT_*) of a simulation tick
+        void HandleSimEvents(int events);
 
-        // generate new obstacles as needed
-        void GenObstacles();
+        // queues the tunnel walls for rendering
+        void RenderTunnel(const glm::mat4& viewProjMat);
 
-        // renders the tunnel walls
-        void RenderTunnel();
-
-        // renders the obstacles
-        void RenderObstacles();
+        // queues the obstacles for rendering
+        void RenderObstacles(const glm::mat4& viewProjMat);
 
         // renders the HUD (score, lives, etc)
         void RenderHUD();
@@ -220,14 +189,6 @@ class PlayScene : public Scene {
         // renders the currently active menu
         void RenderMenu();
 
-        // Shift tunnel sections if needed (this means discarding the ones the
-        // player has already past and generating the obstacles for the new ones
-        // that came into view)
-        void ShiftIfNeeded();
-
-        // detect if the player hit obstacles or got the bonus
-        void DetectCollisions(float previousY);
-
         // shows a text sign on the middle of the screen
         void ShowSign(const char* sign, float timeout) {
             mSignTimeLeft = timeout;
@@ -240,9 +201,6 @@ class PlayScene : public Scene {
             mSignExpires = false;
             mSignStartTime = Clock();
         }
-        Obstacle* GetObstacleAt(int i) {
-            return &mObstacleCircBuf[(mFirstObstacle + i) % MAX_OBS];
-        }
 
         // shows the given menu
         void ShowMenu(int menu);
@@ -250,6 +208,9 @@ class PlayScene : public Scene {
         // handle the fact that the given menu item was selected
         void HandleMenu(int menuItem);
 
+        // goes back to the main screen, unless we already asked to
+        void ReturnToWelcomeScene();
+
         // updates which menu item is selected based on where the screen was touched
         void UpdateMenuSelFromTouch(float x, float y);
 
@@ -265,7 +226,7 @@ class PlayScene : public Scene {
         // returns whether or not this level is a "checkpoint level" (that is,
         // where progress should be saved)
         bool IsCheckpointLevel() {
-            return 0 == mDifficulty % LEVELS_PER_CHECKPOINT;
+            return 0 == mSim.GetDifficulty() % LEVELS_PER_CHECKPOINT;
         }
 
         // shows the sign that tells the player they've reached a new level.
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "play_sim.hpp"
+
+PlaySim::PlaySim() {
+    Reset(1);
+}
+
+void PlaySim::Reset(unsigned seed) {
+    mSeed = seed;
+    mTicks = 0;
+    mPlayerPos = mPrevPlayerPos = glm::vec3(0.0f, 0.0f, 0.0f);
+    mPlayerSpeed = 0.0f;
+    mRollAngle = 0.0f;
+    mFilteredSteerX = mFilteredSteerZ = 0.0f;
+    mLives = PLAYER_LIVES;
+    mDifficulty = 0;
+    mSections.Reset(OBS_LOOKAHEAD_SECTION_COUNT);
+    mBonusInARow = 0;
+    mLastCrashSection = -1;
+    mLastAmbientBeepEmitted = 0;
+    SetScore(0);
+
+    mObstacleGen.SetSeed(seed);
+    mObstacleGen.SetDifficulty(0);
+}
+
+void PlaySim::StartAtLevel(int difficulty) {
+    mDifficulty = difficulty;
+    SetScore(SCORE_PER_LEVEL * mDifficulty);
+    mObstacleGen.SetDifficulty(mDifficulty);
+}
+
+int PlaySim::Step(const SimInput& input) {
+    const float deltaT = SIM_TIMESTEP;
+    float previousY = mPlayerPos.y;
+    int events = 0;
+
+    mPrevPlayerPos = mPlayerPos;
+    mTicks++;
+
+    // update speed
+    float targetSpeed = PLAYER_SPEED + PLAYER_SPEED_INC_PER_LEVEL * mDifficulty;
+    float accel = mPlayerSpeed >= 0.0f ? PLAYER_ACCELERATION_POSITIVE_SPEED :
+            PLAYER_ACCELERATION_NEGATIVE_SPEED;
+    if (mLives <= 0) {
+        targetSpeed = 0.0f;
+    }
+    mPlayerSpeed = Approach(mPlayerSpeed, targetSpeed, deltaT * accel);
+
+    // apply noise filter on steering
+    mFilteredSteerX = (mFilteredSteerX * (NOISE_FILTER_SAMPLES - 1) + input.steerX)
+            / NOISE_FILTER_SAMPLES;
+    mFilteredSteerZ = (mFilteredSteerZ * (NOISE_FILTER_SAMPLES - 1) + input.steerZ)
+            / NOISE_FILTER_SAMPLES;
+
+    // move player
+    if (mLives > 0) {
+        float steerX = mFilteredSteerX, steerZ = mFilteredSteerZ;
+        if (input.steering == STEERING_TOUCH) {
+            // touch steering
+            mPlayerPos.x = Approach(mPlayerPos.x, steerX, PLAYER_MAX_LAT_SPEED * deltaT);
+            mPlayerPos.z = Approach(mPlayerPos.z, steerZ, PLAYER_MAX_LAT_SPEED * deltaT);
+        } else if (input.steering == STEERING_JOY) {
+            // joystick steering
+            mPlayerPos.x += deltaT * steerX;
+            mPlayerPos.z += deltaT * steerZ;
+        }
+    }
+    mPlayerPos.y += deltaT * mPlayerSpeed;
+
+    // make sure player didn't leave tunnel
+    mPlayerPos.x = Clamp(mPlayerPos.x, PLAYER_MIN_X, PLAYER_MAX_X);
+    mPlayerPos.z = Clamp(mPlayerPos.z, PLAYER_MIN_Z, PLAYER_MAX_Z);
+
+    // shift sections if needed
+    ShiftIfNeeded();
+
+    // generate more obstacles!
+    GenObstacles();
+
+    // detect collisions
+    events |= DetectCollisions(previousY);
+
+    // update ship's roll speed according to level
+    static const float roll_speeds[] = ROLL_SPEEDS;
+    int count = sizeof(roll_speeds) / sizeof(float);
+    float speed = roll_speeds[mDifficulty % count];
+    mRollAngle += deltaT * speed;
+    while (mRollAngle < 0) {
+        mRollAngle += 2 * M_PI;
+    }
+    while (mRollAngle > 2 * M_PI) {
+        mRollAngle -= 2 * M_PI;
+    }
+
+    // time for the ambient sound?
+    int soundPoint = (int)floor(mPlayerPos.y / (TUNNEL_SECTION_LENGTH/3));
+    if (soundPoint % 3 != 0 && soundPoint > mLastAmbientBeepEmitted) {
+        mLastAmbientBeepEmitted = soundPoint;
+        events |= EVENT_AMBIENT_BEEP;
+    }
+
+    return events;
+}
+
+void PlaySim::GenObstacles() {
+    mSections.Fill(&mObstacleGen);
+}
+
+void PlaySim::ShiftIfNeeded() {
+    // is it time to discard a section and shift forward?
+    while (mPlayerPos.y > GetSectionEndY(mSections.GetFirst()) + SHIFT_THRESH) {
+        // shift to the next turnnel section, discarding the obstacle of the old one
+        mSections.PopFront();
+    }
+}
+
+int PlaySim::DetectCollisions(float previousY) {
+    SectionHandle section = mSections.GetFirst();
+    Obstacle *o = mSections.Find(section);
+    float obsCenter = GetSectionCenterY(section);
+    float obsMin = obsCenter - OBS_BOX_SIZE;
+    float curY = mPlayerPos.y;
+
+    if (!o || !(previousY < obsMin && curY >= obsMin)) {
+        // no collision
+        return 0;
+    }
+
+    // what cell is the player on?
+    ObsMask cell = o->GetCellAt(mPlayerPos.x, mPlayerPos.z);
+
+    if (o->boxes & cell) {
+        // crashed against obstacle
+        mLives--;
+        mPlayerPos.y = obsMin - PLAYER_RECEDE_AFTER_COLLISION;
+        mPlayerSpeed = PLAYER_SPEED_AFTER_COLLISION;
+        mLastCrashSection = section;
+
+        // the ship jumps back, don't interpolate across the collision
+        mPrevPlayerPos = mPlayerPos;
+        return mLives > 0 ? EVENT_CRASH : EVENT_CRASH | EVENT_GAME_OVER;
+    }
+
+    // was it a close call?
+    int events = 0;
+    if (o->boxes & o->GetCellsNear(mPlayerPos.x, mPlayerPos.z, CLOSE_CALL_CALC_DELTA)) {
+        events |= EVENT_CLOSE_CALL;
+    }
+
+    if (o->bonus & cell) {
+        events |= EVENT_BONUS;
+        o->DeleteBonus();
+        AddScore(BONUS_POINTS);
+        mBonusInARow++;
+
+        if (mBonusInARow >= 10) {
+            mBonusInARow = 0;
+        }
+
+        // update difficulty level, if applicable
+        int score = GetScore();
+        if (mDifficulty < score / SCORE_PER_LEVEL) {
+            mDifficulty = score / SCORE_PER_LEVEL;
+            mObstacleGen.SetDifficulty(mDifficulty);
+            events |= EVENT_LEVEL_UP;
+        }
+    } else if (o->HasBonus()) {
+        // player missed bonus!
+        mBonusInARow = 0;
+        events |= EVENT_BONUS_MISSED;
+    }
+    return events;
+}
+
+// FNV-1a
+static unsigned _hash(unsigned h, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+unsigned PlaySim::GetStateHash() const {
+    unsigned h = 2166136261u;
+    int score = GetScore();
+    h = _hash(h, &mTicks, sizeof(mTicks));
+    h = _hash(h, &mPlayerPos, sizeof(mPlayerPos));
+    h = _hash(h, &mPlayerSpeed, sizeof(mPlayerSpeed));
+    h = _hash(h, &mLives, sizeof(mLives));
+    h = _hash(h, &score, sizeof(score));
+    h = _hash(h, &mDifficulty, sizeof(mDifficulty));
+    SectionHandle first = mSections.GetFirst();
+    h = _hash(h, &first, sizeof(first));
+    for (SectionHandle s = first; s != mSections.GetEnd(); s++) {
+        const Obstacle *o = mSections.Get(s);
+        h = _hash(h, &o->boxes, sizeof(o->boxes));
+        h = _hash(h, &o->bonus, sizeof(o->bonus));
+    }
+    return h;
+}
+
+// Replay file format: a "tunnelreplay v1 <seed> <level> <ticks>" header line followed
+// by one "<steering> <steerX> <steerZ>" line per tick. Floats are written in hex so
+// they read back bit exact.
+bool SimReplay::Save(const char *fileName) const {
+    FILE *f = fopen(fileName, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "tunnelreplay v1 %u %d %u\n", seed, startDifficulty, (unsigned)inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        fprintf(f, "%d %a %a\n", inputs[i].steering, inputs[i].steerX, inputs[i].steerZ);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+bool SimReplay::Load(const char *fileName) {
+    FILE *f = fopen(fileName, "r");
+    if (!f) {
+        return false;
+    }
+    unsigned ticks = 0;
+    inputs.clear();
+    bool ok = 3 == fscanf(f, "tunnelreplay v1 %u %d %u", &seed, &startDifficulty, &ticks);
+    if (ok) {
+        inputs.resize(ticks);
+    }
+    for (unsigned i = 0; ok && i < ticks; i++) {
+        ok = 3 == fscanf(f, "%d %a %a", &inputs[i].steering, &inputs[i].steerX,
+                &inputs[i].steerZ);
+    }
+    fclose(f);
+    if (!ok) {
+        inputs.clear();
+    }
+    return ok;
+}
+
+bool ReplayInputSource::NextInput(PlaySim *sim, SimInput *input) {
+    if (mPos >= mReplay->inputs.size()) {
+        return false;
+    }
+    *input = mReplay->inputs[mPos++];
+    return true;
+}
+
+AutopilotInputSource::AutopilotInputSource(unsigned seed, float mistakeRate) :
+        mRng(seed) {
+    mMistakeRate = mistakeRate;
+    mPlannedSection = -1;
+    mTargetX = mTargetZ = 0.0f;
+}
+
+bool AutopilotInputSource::NextInput(PlaySim *sim, SimInput *input) {
+    // plan for the first obstacle the ship hasn't passed yet
+    int i = sim->GetPlayerPos().y < PlaySim::GetSectionCenterY(sim->GetFirstSection()) -
+            OBS_BOX_SIZE ? 0 : 1;
+    SectionHandle section = sim->GetFirstSection() + i;
+    Obstacle *o = sim->GetSections()->Find(section);
+
+    if (section != mPlannedSection && o) {
+        int col = -1, row = -1;
+        if ((float)(mRng.Next() & 0xffff) < mMistakeRate * 0x10000) {
+            col = mRng.Next(OBS_GRID_SIZE);
+            row = mRng.Next(OBS_GRID_SIZE);
+        } else if (o->HasBonus()) {
+            col = o->GetBonusCol();
+            row = o->GetBonusRow();
+        } else {
+            // pick a free cell, starting at a random one
+            int start = mRng.Next(OBS_GRID_SIZE * OBS_GRID_SIZE);
+            for (int k = 0; k < OBS_GRID_SIZE * OBS_GRID_SIZE; k++) {
+                int cell = (start + k) % (OBS_GRID_SIZE * OBS_GRID_SIZE);
+                if (!(o->boxes & ((ObsMask)1 << cell))) {
+                    col = Obstacle::CellCol(cell);
+                    row = Obstacle::CellRow(cell);
+                    break;
+                }
+            }
+        }
+        if (col >= 0) {
+            glm::vec3 center = o->GetBoxCenter(col, row, 0.0f);
+            mTargetX = center.x;
+            mTargetZ = center.z;
+        }
+        mPlannedSection = section;
+    }
+
+    input->steering = PlaySim::STEERING_TOUCH;
+    input->steerX = mTargetX;
+    input->steerZ = mTargetZ;
+    return true;
+}
+
+SimRunResult RunSim(PlaySim *sim, SimInputSource *source, int maxTicks) {
+    SimRunResult result;
+    memset(&result, 0, sizeof(result));
+
+    SimInput input;
+    while (!sim->IsGameOver() && result.ticks < maxTicks && source->NextInput(sim, &input)) {
+        int events = sim->Step(input);
+        result.ticks++;
+        if (events & PlaySim::EVENT_CRASH) {
+            result.crashes++;
+        }
+        if (events & PlaySim::EVENT_BONUS) {
+            result.bonuses++;
+        }
+        if (events & PlaySim::EVENT_CLOSE_CALL) {
+            result.closeCalls++;
+        }
+    }
+
+    result.score = sim->GetScore();
+    result.difficulty = sim->GetDifficulty();
+    result.stateHash = sim->GetStateHash();
+    return result;
+}
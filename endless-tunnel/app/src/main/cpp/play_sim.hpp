@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_play_sim_hpp
+#define endlesstunnel_play_sim_hpp
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "game_consts.hpp"
+#include "obstacle.hpp"
+#include "obstacle_generator.hpp"
+#include "section_stream.hpp"
+#include "util.hpp"
+
+// Player input for one simulation tick.
+struct SimInput {
+    int steering;  // one of PlaySim::STEERING_*
+    float steerX, steerZ;  // target x,z of ship (touch) or velocity vector (joystick)
+};
+
+/* The game logic of the play scene: ship movement, tunnel sections, obstacles,
+ * collisions, score and difficulty. It advances in fixed steps of SIM_TIMESTEP and
+ * draws all random numbers from a seeded generator, so a run is fully determined by
+ * its seed, its starting level and the input of every tick. It doesn't touch GL,
+ * sound or the wall clock; the presentation reacts to the events returned by Step().
+ * This lets runs be replayed and batch simulated headless. */
+class PlaySim {
+    public:
+        static const int STEERING_NONE = 0, STEERING_TOUCH = 1, STEERING_JOY = 2;
+
+        // events returned by Step()
+        static const int EVENT_CRASH = 0x01;  // lost a life
+        static const int EVENT_GAME_OVER = 0x02;  // lost the last life
+        static const int EVENT_BONUS = 0x04;  // picked up a bonus
+        static const int EVENT_BONUS_MISSED = 0x08;
+        static const int EVENT_LEVEL_UP = 0x10;  // together with EVENT_BONUS
+        static const int EVENT_AMBIENT_BEEP = 0x20;  // see GetAmbientBeep()
+        static const int EVENT_CLOSE_CALL = 0x40;  // passed an obstacle next to a box
+
+        PlaySim();
+
+        // start a new run
+        void Reset(unsigned seed);
+
+        // start at the given level (e.g. a saved checkpoint) instead of level 0
+        void StartAtLevel(int difficulty);
+
+        // advance by SIM_TIMESTEP; returns EVENT_* flags
+        int Step(const SimInput& input);
+
+        const glm::vec3& GetPlayerPos() const { return mPlayerPos; }
+        // player position interpolated between the last two ticks (alpha in [0,1])
+        glm::vec3 GetPlayerPos(float alpha) const {
+            return mPrevPlayerPos + (mPlayerPos - mPrevPlayerPos) * alpha;
+        }
+        float GetPlayerSpeed() const { return mPlayerSpeed; }
+        float GetRollAngle() const { return mRollAngle; }
+        int GetLives() const { return mLives; }
+        int GetDifficulty() const { return mDifficulty; }
+        unsigned GetSeed() const { return mSeed; }
+        int GetTicks() const { return mTicks; }
+        int GetFirstSection() const { return mSections.GetFirst(); }
+        int GetAmbientBeep() const { return mLastAmbientBeepEmitted; }
+        bool IsGameOver() const { return mLives <= 0; }
+
+        // the tunnel sections around the player. There is exactly one obstacle for each
+        // section, and sections are identified by their number.
+        SectionStream* GetSections() { return &mSections; }
+        const SectionStream* GetSections() const { return &mSections; }
+
+        // get current score
+        int GetScore() const {
+            return (int)(mEncryptedScore ^ 0x600673);
+        }
+
+        // hash of the state that matters for the outcome of a run, to compare a replay
+        // against its golden result
+        unsigned GetStateHash() const;
+
+        static float GetSectionCenterY(int i) {
+            return (float)i * TUNNEL_SECTION_LENGTH;
+        }
+        static float GetSectionEndY(int i) {
+            return GetSectionCenterY(i) + 0.5f * TUNNEL_SECTION_LENGTH;
+        }
+
+    private:
+        unsigned mSeed;
+        int mTicks;
+
+        // player's position (and position at the previous tick)
+        glm::vec3 mPlayerPos, mPrevPlayerPos;
+        float mPlayerSpeed;
+
+        // current roll angle, in radians, counterclockwise from original
+        float mRollAngle;
+
+        // moving average filter for input (on the steering target)
+        static const int NOISE_FILTER_SAMPLES = 5;
+        float mFilteredSteerX, mFilteredSteerZ;
+
+        int mLives;
+
+        // player's score. As a trivial form of protection (just to give crackers a
+        // hard time), we *actually* store the score encrypted in mEncryptedScore, but have a
+        // fake variable mFakeScore that stores a copy of it. This serves as a honeypot to
+        // an attacker who's trying to crack the game using a memory editor.
+        unsigned mFakeScore;
+        unsigned mEncryptedScore;
+
+        int mDifficulty;
+
+        SectionStream mSections;
+        ObstacleGenerator mObstacleGen;
+
+        // how many bonuses were collected without missing one?
+        int mBonusInARow;
+
+        // what was the section number of the last obstacle with which the player crashed?
+        int mLastCrashSection;
+
+        // last subsection were an ambient sound was emitted
+        int mLastAmbientBeepEmitted;
+
+        void SetScore(int s) {
+            mFakeScore = (unsigned)s;
+            mEncryptedScore = mFakeScore ^ 0x600673;
+        }
+        void AddScore(int s) {
+            SetScore(GetScore() + s);
+        }
+
+        // generate new obstacles as needed
+        void GenObstacles();
+
+        // Shift tunnel sections if needed (this means discarding the ones the
+        // player has already past and generating the obstacles for the new ones
+        // that came into view)
+        void ShiftIfNeeded();
+
+        // detect if the player hit obstacles or got the bonus; returns EVENT_* flags
+        int DetectCollisions(float previousY);
+};
+
+// Recorded run: everything needed to play it back tick by tick.
+struct SimReplay {
+    unsigned seed;
+    int startDifficulty;
+    std::vector<SimInput> inputs;
+
+    SimReplay() : seed(0), startDifficulty(0) {}
+
+    bool Save(const char *fileName) const;
+    bool Load(const char *fileName);
+};
+
+// Source of per-tick input for headless runs.
+class SimInputSource {
+    public:
+        virtual ~SimInputSource() {}
+        // returns false when the source has no more input
+        virtual bool NextInput(PlaySim *sim, SimInput *input) = 0;
+};
+
+// Plays back the input of a recorded run.
+class ReplayInputSource : public SimInputSource {
+    private:
+        const SimReplay *mReplay;
+        size_t mPos;
+    public:
+        ReplayInputSource(const SimReplay *replay) : mReplay(replay), mPos(0) {}
+        virtual bool NextInput(PlaySim *sim, SimInput *input);
+};
+
+// A simple bot that steers towards the bonus (or any free cell) of the next
+// obstacle. mistakeRate (0..1) is the chance per obstacle that it aims at a random
+// cell instead, which approximates players of different skill when tuning the
+// difficulty curve.
+class AutopilotInputSource : public SimInputSource {
+    private:
+        RandomGen mRng;
+        float mMistakeRate;
+        int mPlannedSection;
+        float mTargetX, mTargetZ;
+    public:
+        AutopilotInputSource(unsigned seed, float mistakeRate);
+        virtual bool NextInput(PlaySim *sim, SimInput *input);
+};
+
+// Outcome of a headless run.
+struct SimRunResult {
+    int ticks;
+    int score;
+    int difficulty;
+    int crashes;
+    int bonuses;
+    int closeCalls;
+    unsigned stateHash;
+};
+
+// Runs the simulation headless until the game is over, the input runs out or
+// maxTicks ticks have been simulated.
+SimRunResult RunSim(PlaySim *sim, SimInputSource *input, int maxTicks);
+
+#endif
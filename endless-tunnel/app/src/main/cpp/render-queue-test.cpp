@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of RenderQueue batching, through RecordingRenderBackend:
+ *
+ *   render-queue-test [-s seed] [-t ticks]
+ *
+ * A hand-made frame must come out as the exact batches and draw calls
+ * expected. Then frames are recorded from an autopilot run of the game
+ * simulation, queued the way PlayScene queues the tunnel and the obstacles,
+ * and every flush must give one batch per shader and geometry, draw calls
+ * of at most the instance limit, and every instance once, in the order it
+ * was added. Exits non zero when a check fails.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "play_sim.hpp"
+#include "render_queue.hpp"
+
+// the instance limit of OurInstancedShader (OUR_SHADER_MAX_INSTANCES)
+static const int MAX_INSTANCES = 16;
+
+// shader and geometries as PlayScene numbers them
+static const int OUR_SHADER = 0;
+static const int TUNNEL_GEOM = 0;
+static const int CUBE_GEOM = 1;
+
+static int errors = 0;
+
+static void Check(bool ok, const char *what, int frame, int value, int expected) {
+    if (!ok && errors++ < 10) {
+        fprintf(stderr, "frame %d: %s %d, expected %d\n", frame, what, value, expected);
+    }
+}
+
+// Instances carry the order they were added in, so the backend's commands show
+// which instance starts each draw call.
+static glm::mat4 Tagged(int tag) {
+    return glm::mat4((float)tag);
+}
+
+static int TagOf(const glm::mat4& m) {
+    return (int)m[0][0];
+}
+
+static void CheckHandMadeFrame() {
+    RenderQueue queue;
+    RecordingRenderBackend backend(4);
+    static const glm::vec4 WHITE(1.0f);
+
+    // interleaved keys, added out of order; geometry 3 takes two draw calls
+    static const int SHADERS[] = { 1, 0, 1, 0, 0, 0, 0, 0, 1 };
+    static const int GEOMS[] = { 2, 3, 2, 3, 3, 3, 1, 3, 2 };
+    const int count = sizeof(SHADERS) / sizeof(SHADERS[0]);
+    for (int i = 0; i < count; i++) {
+        queue.Add(SHADERS[i], GEOMS[i], Tagged(i), WHITE);
+    }
+    queue.Flush(&backend);
+
+    // sorted by shader then geometry; same key keeps the order of Add()
+    static const int TYPES[] = {
+        RecordingRenderBackend::CMD_BEGIN_BATCH, RecordingRenderBackend::CMD_DRAW,
+        RecordingRenderBackend::CMD_END_BATCH,
+        RecordingRenderBackend::CMD_BEGIN_BATCH, RecordingRenderBackend::CMD_DRAW,
+        RecordingRenderBackend::CMD_DRAW, RecordingRenderBackend::CMD_END_BATCH,
+        RecordingRenderBackend::CMD_BEGIN_BATCH, RecordingRenderBackend::CMD_DRAW,
+        RecordingRenderBackend::CMD_END_BATCH
+    };
+    static const int CMD_SHADERS[] = { 0, 0, 0, 0, 0, 0, 0, 1, 1, 1 };
+    static const int CMD_GEOMS[] = { 1, 1, 1, 3, 3, 3, 3, 2, 2, 2 };
+    static const int CMD_COUNTS[] = { 0, 1, 0, 0, 4, 1, 0, 0, 3, 0 };
+    static const int CMD_FIRST[] = { -1, 6, -1, -1, 1, 7, -1, -1, 0, -1 };
+    const int commandCount = sizeof(TYPES) / sizeof(TYPES[0]);
+
+    const std::vector<RecordingRenderBackend::Command>& commands = backend.GetCommands();
+    Check((int)commands.size() == commandCount, "commands", 0, (int)commands.size(),
+            commandCount);
+    for (int i = 0; i < commandCount && i < (int)commands.size(); i++) {
+        const RecordingRenderBackend::Command& c = commands[i];
+        bool ok = c.type == TYPES[i] && c.shader == CMD_SHADERS[i] &&
+                c.geom == CMD_GEOMS[i] && c.count == CMD_COUNTS[i] &&
+                (CMD_FIRST[i] < 0 || TagOf(c.firstMvp) == CMD_FIRST[i]);
+        Check(ok, "unexpected command, index", 0, i, i);
+    }
+    Check(queue.GetLastBatches() == 3, "batches", 0, queue.GetLastBatches(), 3);
+    Check(queue.GetLastDrawCalls() == 4, "draw calls", 0, queue.GetLastDrawCalls(), 4);
+    Check(queue.GetCount() == 0, "instances left queued", 0, queue.GetCount(), 0);
+}
+
+// Queues what PlayScene draws of the simulation: the visible tunnel sections,
+// then the boxes and bonus of each obstacle.
+static void QueueFrame(PlaySim *sim, RenderQueue *queue, std::vector<int> *tunnelTags,
+        std::vector<int> *cubeTags) {
+    static const glm::vec4 WHITE(1.0f);
+    SectionStream *sections = sim->GetSections();
+    int tag = 0;
+    tunnelTags->clear();
+    cubeTags->clear();
+
+    SectionHandle first = sections->GetFirst();
+    for (SectionHandle h = first; h <= first + RENDER_TUNNEL_SECTION_COUNT; ++h) {
+        queue->Add(OUR_SHADER, TUNNEL_GEOM, Tagged(tag), WHITE, glm::vec4(0.0f));
+        tunnelTags->push_back(tag++);
+    }
+    for (SectionHandle h = first; h != sections->GetEnd(); ++h) {
+        Obstacle *o = sections->Get(h);
+        if (o->style == Obstacle::STYLE_NULL) {
+            continue;
+        }
+        for (ObsMask m = o->boxes; m; m &= m - 1) {
+            queue->Add(OUR_SHADER, CUBE_GEOM, Tagged(tag), WHITE);
+            cubeTags->push_back(tag++);
+        }
+        if (o->HasBonus()) {
+            queue->Add(OUR_SHADER, CUBE_GEOM, Tagged(tag), WHITE);
+            cubeTags->push_back(tag++);
+        }
+    }
+}
+
+// Checks the draw calls of one batch against the instances queued for it.
+static void CheckBatch(const std::vector<RecordingRenderBackend::Command>& commands,
+        size_t *pos, int geom, const std::vector<int>& tags, int frame) {
+    if (tags.empty()) {
+        return;
+    }
+    bool ok = *pos < commands.size() &&
+            commands[*pos].type == RecordingRenderBackend::CMD_BEGIN_BATCH &&
+            commands[*pos].geom == geom;
+    Check(ok, "batch of geometry", frame, geom, geom);
+    ++*pos;
+    for (size_t i = 0; i < tags.size(); i += MAX_INSTANCES) {
+        int expected = (int)(tags.size() - i < (size_t)MAX_INSTANCES ?
+                tags.size() - i : MAX_INSTANCES);
+        ok = *pos < commands.size() &&
+                commands[*pos].type == RecordingRenderBackend::CMD_DRAW &&
+                commands[*pos].count == expected &&
+                TagOf(commands[*pos].firstMvp) == tags[i];
+        Check(ok, "draw call of instances", frame, expected, expected);
+        ++*pos;
+    }
+    ok = *pos < commands.size() && commands[*pos].type == RecordingRenderBackend::CMD_END_BATCH;
+    Check(ok, "end of batch of geometry", frame, geom, geom);
+    ++*pos;
+}
+
+static void CheckRecordedFrames(unsigned seed, int ticks) {
+    PlaySim sim;
+    sim.Reset(seed);
+    // from a checkpoint, so the obstacles are dense
+    sim.StartAtLevel(8);
+    AutopilotInputSource autopilot(seed, 0.05f);
+    RenderQueue queue;
+    RecordingRenderBackend backend(MAX_INSTANCES);
+    std::vector<int> tunnelTags, cubeTags;
+    long long instances = 0, drawCalls = 0;
+    int frames = 0, mostDrawCalls = 0;
+
+    SimInput input;
+    for (int t = 0; t < ticks && !sim.IsGameOver(); t++, frames++) {
+        if (!autopilot.NextInput(&sim, &input)) {
+            break;
+        }
+        sim.Step(input);
+        QueueFrame(&sim, &queue, &tunnelTags, &cubeTags);
+        int queued = queue.GetCount();
+        backend.Clear();
+        queue.Flush(&backend);
+
+        int batches = (tunnelTags.empty() ? 0 : 1) + (cubeTags.empty() ? 0 : 1);
+        int draws = ((int)tunnelTags.size() + MAX_INSTANCES - 1) / MAX_INSTANCES +
+                ((int)cubeTags.size() + MAX_INSTANCES - 1) / MAX_INSTANCES;
+        Check(queue.GetLastInstances() == queued, "instances", t,
+                queue.GetLastInstances(), queued);
+        Check(backend.GetInstances() == queued, "instances drawn", t,
+                backend.GetInstances(), queued);
+        Check(queue.GetLastBatches() == batches, "batches", t, queue.GetLastBatches(),
+                batches);
+        Check(queue.GetLastDrawCalls() == draws, "draw calls", t,
+                queue.GetLastDrawCalls(), draws);
+        Check(backend.GetDrawCalls() == draws, "draw calls received", t,
+                backend.GetDrawCalls(), draws);
+
+        // the tunnel geometry sorts first
+        size_t pos = 0;
+        CheckBatch(backend.GetCommands(), &pos, TUNNEL_GEOM, tunnelTags, t);
+        CheckBatch(backend.GetCommands(), &pos, CUBE_GEOM, cubeTags, t);
+        Check(pos == backend.GetCommands().size(), "commands", t,
+                (int)backend.GetCommands().size(), (int)pos);
+
+        instances += queued;
+        drawCalls += draws;
+        mostDrawCalls = draws > mostDrawCalls ? draws : mostDrawCalls;
+    }
+
+    Check(frames > 0, "recorded frames", 0, frames, ticks);
+    if (frames > 0) {
+        printf("%d frames: %.1f instances in %.1f draw calls on average, "
+                "%d draw calls at most\n", frames, (double)instances / frames,
+                (double)drawCalls / frames, mostDrawCalls);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned seed = 7;
+    int ticks = 60 * SIM_TICKS_PER_SECOND;
+    int c;
+    while ((c = getopt(argc, argv, "s:t:")) != -1) {
+        switch (c) {
+            case 's': seed = (unsigned)strtoul(optarg, NULL, 0); break;
+            case 't': ticks = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-s seed] [-t ticks]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    CheckHandMadeFrame();
+    CheckRecordedFrames(seed, ticks);
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
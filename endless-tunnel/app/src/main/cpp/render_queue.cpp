@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include "render_queue.hpp"
+
+// layout of a sort key: shader (12 bits), geometry (20 bits), instance index (32 bits)
+#define KEY_INDEX_BITS 32
+#define KEY_GEOM_BITS 20
+
+static unsigned long long _make_key(int shader, int geom, int index) {
+    return ((unsigned long long)shader << (KEY_INDEX_BITS + KEY_GEOM_BITS)) |
+            ((unsigned long long)geom << KEY_INDEX_BITS) | (unsigned)index;
+}
+
+static int _key_index(unsigned long long key) {
+    return (int)(key & 0xffffffffu);
+}
+
+static unsigned _key_batch(unsigned long long key) {
+    return (unsigned)(key >> KEY_INDEX_BITS);
+}
+
+RenderQueue::RenderQueue() {
+    mLastInstances = mLastBatches = mLastDrawCalls = 0;
+}
+
+void RenderQueue::Add(int shader, int geom, const glm::mat4& mvp, const glm::vec4& tint,
+        const glm::vec4& lightColor) {
+    mKeys.push_back(_make_key(shader, geom, (int)mKeys.size()));
+    mMvp.push_back(mvp);
+    mTint.push_back(tint);
+    mLightColor.push_back(lightColor);
+}
+
+void RenderQueue::Clear() {
+    // clear() keeps the capacity, so a steady state frame doesn't allocate
+    mKeys.clear();
+    mMvp.clear();
+    mTint.clear();
+    mLightColor.clear();
+}
+
+void RenderQueue::Flush(RenderBackend *backend) {
+    int maxInstances = backend->GetMaxInstances();
+    int count = (int)mKeys.size();
+
+    mLastInstances = count;
+    mLastBatches = mLastDrawCalls = 0;
+
+    // the index in the low bits makes the sort stable
+    std::sort(mKeys.begin(), mKeys.end());
+
+    mBatchMvp.resize(maxInstances);
+    mBatchTint.resize(maxInstances);
+    mBatchLightColor.resize(maxInstances);
+
+    int i = 0;
+    while (i < count) {
+        unsigned batch = _key_batch(mKeys[i]);
+        int shader = (int)(batch >> KEY_GEOM_BITS);
+        int geom = (int)(batch & ((1u << KEY_GEOM_BITS) - 1));
+
+        backend->BeginBatch(shader, geom);
+        mLastBatches++;
+        while (i < count && _key_batch(mKeys[i]) == batch) {
+            // gather a chunk of instances into contiguous arrays
+            int n = 0;
+            for (; n < maxInstances && i < count && _key_batch(mKeys[i]) == batch; n++, i++) {
+                int index = _key_index(mKeys[i]);
+                mBatchMvp[n] = mMvp[index];
+                mBatchTint[n] = mTint[index];
+                mBatchLightColor[n] = mLightColor[index];
+            }
+            backend->DrawInstances(&mBatchMvp[0], &mBatchTint[0], &mBatchLightColor[0], n);
+            mLastDrawCalls++;
+        }
+        backend->EndBatch();
+    }
+
+    Clear();
+}
+
+RecordingRenderBackend::RecordingRenderBackend(int maxInstances) {
+    mMaxInstances = maxInstances;
+    mShader = mGeom = -1;
+}
+
+void RecordingRenderBackend::BeginBatch(int shader, int geom) {
+    mShader = shader;
+    mGeom = geom;
+    Command c;
+    c.type = CMD_BEGIN_BATCH;
+    c.shader = shader;
+    c.geom = geom;
+    c.count = 0;
+    c.firstMvp = glm::mat4(1.0f);
+    mCommands.push_back(c);
+}
+
+void RecordingRenderBackend::DrawInstances(const glm::mat4 *mvp, const glm::vec4 *tint,
+        const glm::vec4 *lightColor, int count) {
+    Command c;
+    c.type = CMD_DRAW;
+    c.shader = mShader;
+    c.geom = mGeom;
+    c.count = count;
+    c.firstMvp = mvp[0];
+    mCommands.push_back(c);
+}
+
+void RecordingRenderBackend::EndBatch() {
+    Command c;
+    c.type = CMD_END_BATCH;
+    c.shader = mShader;
+    c.geom = mGeom;
+    c.count = 0;
+    c.firstMvp = glm::mat4(1.0f);
+    mCommands.push_back(c);
+    mShader = mGeom = -1;
+}
+
+int RecordingRenderBackend::GetDrawCalls() {
+    int n = 0;
+    for (size_t i = 0; i < mCommands.size(); i++) {
+        n += mCommands[i].type == CMD_DRAW ? 1 : 0;
+    }
+    return n;
+}
+
+int RecordingRenderBackend::GetInstances() {
+    int n = 0;
+    for (size_t i = 0; i < mCommands.size(); i++) {
+        n += mCommands[i].type == CMD_DRAW ? mCommands[i].count : 0;
+    }
+    return n;
+}
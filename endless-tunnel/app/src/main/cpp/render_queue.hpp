@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_render_queue_hpp
+#define endlesstunnel_render_queue_hpp
+
+#include <vector>
+#include "glm/glm.hpp"
+
+/* Receives the batches produced by RenderQueue::Flush(). Shaders and geometries are
+ * identified by small integers that the backend assigns meaning to, so the queue
+ * itself doesn't depend on GL. */
+class RenderBackend {
+    public:
+        virtual ~RenderBackend() {}
+
+        // maximum number of instances per DrawInstances() call
+        virtual int GetMaxInstances() = 0;
+
+        // prepares to draw instances of the given geometry with the given shader
+        virtual void BeginBatch(int shader, int geom) = 0;
+
+        // draws count copies of the current geometry with one draw call. Each copy has
+        // its own model-view-projection matrix, tint color and point light color.
+        virtual void DrawInstances(const glm::mat4 *mvp, const glm::vec4 *tint,
+                const glm::vec4 *lightColor, int count) = 0;
+
+        virtual void EndBatch() = 0;
+};
+
+/* Collects the instances to draw in a frame and submits them in as few draw calls as
+ * possible: instances are sorted by shader and geometry, and each run of instances
+ * with the same shader and geometry is drawn in chunks of the backend's maximum
+ * instance count. Instances with the same key keep the order they were added in. */
+class RenderQueue {
+    private:
+        // per-instance data, in the order it was added
+        std::vector<unsigned long long> mKeys;  // (shader, geom, index), sorts by all three
+        std::vector<glm::mat4> mMvp;
+        std::vector<glm::vec4> mTint;
+        std::vector<glm::vec4> mLightColor;
+
+        // scratch arrays that hold one chunk of sorted instances
+        std::vector<glm::mat4> mBatchMvp;
+        std::vector<glm::vec4> mBatchTint;
+        std::vector<glm::vec4> mBatchLightColor;
+
+        // stats of the last Flush()
+        int mLastInstances, mLastBatches, mLastDrawCalls;
+
+    public:
+        RenderQueue();
+
+        // queues one instance of geometry geom, to be drawn with the given shader
+        void Add(int shader, int geom, const glm::mat4& mvp, const glm::vec4& tint,
+                const glm::vec4& lightColor);
+
+        // convenience for instances without a point light
+        void Add(int shader, int geom, const glm::mat4& mvp, const glm::vec4& tint) {
+            Add(shader, geom, mvp, tint, glm::vec4(0.0f));
+        }
+
+        // draws everything that was queued and empties the queue
+        void Flush(RenderBackend *backend);
+
+        // discards everything that was queued
+        void Clear();
+
+        int GetCount() { return (int)mKeys.size(); }
+        int GetLastInstances() { return mLastInstances; }
+        int GetLastBatches() { return mLastBatches; }
+        int GetLastDrawCalls() { return mLastDrawCalls; }
+};
+
+/* Backend that just records the commands it receives, so that batching can be checked
+ * without a GL context. */
+class RecordingRenderBackend : public RenderBackend {
+    public:
+        static const int CMD_BEGIN_BATCH = 0;
+        static const int CMD_DRAW = 1;
+        static const int CMD_END_BATCH = 2;
+
+        struct Command {
+            int type;  // CMD_*
+            int shader, geom;  // of the current batch
+            int count;  // instances (CMD_DRAW only)
+            glm::mat4 firstMvp;  // matrix of the first instance (CMD_DRAW only)
+        };
+
+    private:
+        int mMaxInstances;
+        int mShader, mGeom;
+        std::vector<Command> mCommands;
+
+    public:
+        RecordingRenderBackend(int maxInstances);
+
+        virtual int GetMaxInstances() { return mMaxInstances; }
+        virtual void BeginBatch(int shader, int geom);
+        virtual void DrawInstances(const glm::mat4 *mvp, const glm::vec4 *tint,
+                const glm::vec4 *lightColor, int count);
+        virtual void EndBatch();
+
+        const std::vector<Command>& GetCommands() { return mCommands; }
+        int GetDrawCalls();
+        int GetInstances();
+        void Clear() { mCommands.clear(); }
+};
+
+#endif
@@ -18,6 +18,7 @@
 // These are all stubs. Subclasses should override to implement their
 // specific functionality.
 
+void Scene::OnPreload() {}
 void Scene::OnInstall() {}
 void Scene::DoFrame() {}
 void Scene::OnUninstall() {}
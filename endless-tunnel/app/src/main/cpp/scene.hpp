@@ -32,6 +32,13 @@ class Scene {
         // all geometry, textures, etc.
         virtual void OnKillGraphics();
 
+        // Called on a background thread after this scene is requested and before it is
+        // installed, while the previous scene is still running. This is where CPU-side
+        // resources (geometry arrays, procedural textures, etc) should be prepared, so
+        // that OnStartGraphics() only has to upload them. Must not make GL calls or
+        // touch other scenes.
+        virtual void OnPreload();
+
         // Called when this scene has just been installed as the active scene.
         virtual void OnInstall();
 
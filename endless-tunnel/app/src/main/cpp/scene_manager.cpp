@@ -16,6 +16,7 @@
 #include "common.hpp"
 #include "scene.hpp"
 #include "scene_manager.hpp"
+#include "util.hpp"
 
 static SceneManager _sceneManager;
 
@@ -27,13 +28,46 @@ SceneManager::SceneManager() {
     mScreenHeight = 240;
 
     mSceneToInstall = NULL;
+    mPreloadDone = false;
+    mRequestTime = mPreloadTime = 0.0f;
 
     mHasGraphics = false;
 }
 
+SceneManager::~SceneManager() {
+    WaitForPreload();
+}
+
 void SceneManager::RequestNewScene(Scene *newScene) {
     LOGD("SceneManager: requesting new scene %p", newScene);
+
+    if (mSceneToInstall) {
+        // replaced before it was installed
+        LOGD("SceneManager: discarding scene %p, which was never installed.", mSceneToInstall);
+        WaitForPreload();
+        delete mSceneToInstall;
+    }
+
     mSceneToInstall = newScene;
+    mRequestTime = Clock();
+    mPreloadTime = 0.0f;
+    mPreloadDone = false;
+    if (newScene) {
+        mPreloadThread = std::thread(&SceneManager::PreloadScene, this, newScene);
+    }
+}
+
+void SceneManager::PreloadScene(Scene *scene) {
+    float start = Clock();
+    scene->OnPreload();
+    mPreloadTime = Clock() - start;
+    mPreloadDone = true;
+}
+
+void SceneManager::WaitForPreload() {
+    if (mPreloadThread.joinable()) {
+        mPreloadThread.join();
+    }
 }
 
 void SceneManager::InstallScene(Scene *newScene) {
@@ -69,9 +103,17 @@ Scene* SceneManager::GetScene() {
 }
 
 void SceneManager::DoFrame() {
-    if (mSceneToInstall) {
-        InstallScene(mSceneToInstall);
+    if (mSceneToInstall && mPreloadDone) {
+        Scene *newScene = mSceneToInstall;
         mSceneToInstall = NULL;
+        WaitForPreload();
+
+        float start = Clock();
+        InstallScene(newScene);
+        float end = Clock();
+        LOGD("SceneManager: transition to %p took %.1f ms: preload %.1f ms (in background), "
+                "install %.1f ms.", newScene, (end - mRequestTime) * 1000.0f,
+                mPreloadTime * 1000.0f, (end - start) * 1000.0f);
     }
 
     if (mHasGraphics && mCurScene) {
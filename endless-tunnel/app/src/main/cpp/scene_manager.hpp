@@ -16,6 +16,8 @@
 #ifndef endlesstunnel_scene_manager_h
 #define endlesstunnel_scene_manager_h
 
+#include <atomic>
+#include <thread>
 #include "our_key_codes.hpp"
 
 class Scene;
@@ -40,10 +42,21 @@ class SceneManager {
         int mScreenWidth, mScreenHeight;
         bool mHasGraphics;
         Scene *mSceneToInstall;
+
+        // the scene to install is preloaded (see Scene::OnPreload()) on this thread, and
+        // installed on the first frame after it's done
+        std::thread mPreloadThread;
+        std::atomic<bool> mPreloadDone;
+        float mRequestTime;  // when the scene to install was requested
+        float mPreloadTime;  // how long its OnPreload() took
+
+        void PreloadScene(Scene *scene);
+        void WaitForPreload();
         void InstallScene(Scene *newScene);
 
     public:
         SceneManager();
+        ~SceneManager();
         void SetScreenSize(int width, int height);
         void KillGraphics();
         void StartGraphics();
@@ -98,7 +111,8 @@ class SceneManager {
         void OnResume();
 
         // Requests that a new scene be installed, replacing the currently active
-        // scene. The new scene will be installed on the next DoFrame() call.
+        // scene. The new scene is preloaded in the background while the current one
+        // keeps running, and installed on the first DoFrame() call after that.
         void RequestNewScene(Scene *newScene);
 
         // Returns the (singleton) instance of SceneManager.
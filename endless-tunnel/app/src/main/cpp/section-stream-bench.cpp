@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of SectionStream:
+ *
+ *   section-stream-bench [-n sections] [-s seed]
+ *
+ * The stream is driven next to the circular buffer PlaySim used to keep,
+ * with the same seeds and the same difficulty changes, for every lookahead
+ * up to the capacity. After every shift the windows must hold the same
+ * obstacles, and handles taken earlier must keep referring to their section
+ * while it's in the window and be invalid once it's dropped. Then streaming
+ * (dropping a section and generating the next) and walking the window, as
+ * rendering and the state hash do every frame, are timed. Exits non zero
+ * when a check fails.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "section_stream.hpp"
+
+// sections between difficulty changes
+static const int LEVEL_SECTIONS = 37;
+
+static int errors = 0;
+
+static void Check(bool ok, const char *what, int lookahead, int section) {
+    if (!ok && errors++ < 10) {
+        fprintf(stderr, "lookahead %d, section %d: %s\n", lookahead, section, what);
+    }
+}
+
+// The window as PlaySim kept it before SectionStream.
+struct CircularWindow {
+    static const int MAX_OBS = SectionStream::CAPACITY;
+    Obstacle circBuf[MAX_OBS];
+    int firstSection, firstObstacle, count, lookahead;
+
+    void Reset(int lookahead) {
+        this->lookahead = lookahead;
+        firstSection = firstObstacle = count = 0;
+    }
+    void Fill(ObstacleGenerator *gen) {
+        while (count < lookahead) {
+            int index = (firstObstacle + count) % MAX_OBS;
+            if (firstSection + count < OBS_START_SECTION) {
+                circBuf[index].Reset();
+                circBuf[index].style = Obstacle::STYLE_NULL;
+            } else {
+                gen->Generate(&circBuf[index]);
+            }
+            count++;
+        }
+    }
+    void Shift() {
+        firstSection++;
+        if (count > 0) {
+            firstObstacle = (firstObstacle + 1) % MAX_OBS;
+            --count;
+        }
+    }
+    const Obstacle* Get(int i) const { return &circBuf[(firstObstacle + i) % MAX_OBS]; }
+};
+
+static bool SameObstacle(const Obstacle& a, const Obstacle& b) {
+    return a.boxes == b.boxes && a.bonus == b.bonus && a.style == b.style;
+}
+
+static void CheckLookahead(int lookahead, int sections, unsigned seed) {
+    SectionStream stream;
+    CircularWindow window;
+    ObstacleGenerator streamGen, windowGen;
+    streamGen.SetSeed(seed);
+    windowGen.SetSeed(seed);
+    stream.Reset(lookahead);
+    window.Reset(lookahead);
+
+    // a handle to the last section of the window, and what it held
+    SectionHandle held = -1;
+    Obstacle heldObstacle;
+    heldObstacle.Reset();
+
+    for (int s = 0; s < sections; s++) {
+        int difficulty = s / LEVEL_SECTIONS;
+        streamGen.SetDifficulty(difficulty);
+        windowGen.SetDifficulty(difficulty);
+        stream.Fill(&streamGen);
+        window.Fill(&windowGen);
+
+        bool same = stream.GetFirst() == window.firstSection &&
+                stream.GetCount() == window.count && stream.GetCount() == lookahead;
+        for (int i = 0; same && i < window.count; i++) {
+            same = SameObstacle(*stream.Get(stream.GetFirst() + i), *window.Get(i));
+        }
+        Check(same, "window differs from the circular buffer", lookahead, s);
+        Check(!stream.IsValid(stream.GetEnd()) && !stream.Find(stream.GetEnd()) &&
+                !stream.IsValid(stream.GetFirst() - 1), "handle outside the window is valid",
+                lookahead, s);
+
+        if (held < 0) {
+            held = stream.GetEnd() - 1;
+            heldObstacle = *stream.Get(held);
+        } else if (stream.IsValid(held)) {
+            Check(stream.Find(held) && SameObstacle(*stream.Find(held), heldObstacle),
+                    "handle moved to another section", lookahead, s);
+        } else {
+            Check(held < stream.GetFirst() && !stream.Find(held),
+                    "handle invalid while in the window", lookahead, s);
+            held = -1;
+        }
+
+        stream.PopFront();
+        window.Shift();
+    }
+}
+
+static double NsPer(std::chrono::steady_clock::time_point start, long count) {
+    return std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count() / count;
+}
+
+static void Bench(int sections, unsigned seed) {
+    SectionStream stream;
+    ObstacleGenerator gen;
+    gen.SetSeed(seed);
+    stream.Reset(OBS_LOOKAHEAD_SECTION_COUNT);
+    stream.Fill(&gen);
+    unsigned sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < sections; s++) {
+        gen.SetDifficulty(s / LEVEL_SECTIONS % 10);
+        stream.PopFront();
+        stream.Fill(&gen);
+    }
+    double streamNs = NsPer(start, sections);
+
+    // a window walk per frame, a few frames per section
+    int frames = sections * 4;
+    start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        for (SectionHandle h = stream.GetFirst(); h != stream.GetEnd(); ++h) {
+            sink += stream.Get(h)->boxes;
+        }
+        if (f % 4 == 3) {
+            stream.PopFront();
+            stream.Fill(&gen);
+        }
+    }
+    double walkNs = NsPer(start, frames);
+
+    // generating alone, for the share of streaming that isn't the ring
+    Obstacle o;
+    start = std::chrono::steady_clock::now();
+    for (int s = 0; s < sections; s++) {
+        gen.Generate(&o);
+        sink += o.boxes;
+    }
+    double genNs = NsPer(start, sections);
+
+    printf("%d sections, lookahead %d: %.1f ns per section streamed (%.1f ns of it "
+            "generating), %.1f ns per window walk [%u]\n", sections,
+            OBS_LOOKAHEAD_SECTION_COUNT, streamNs, genNs, walkNs, sink & 1);
+}
+
+int main(int argc, char **argv) {
+    int sections = 1000000;
+    unsigned seed = 1;
+    int c;
+    while ((c = getopt(argc, argv, "n:s:")) != -1) {
+        switch (c) {
+            case 'n': sections = atoi(optarg); break;
+            case 's': seed = (unsigned)strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n sections] [-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (sections <= 0) {
+        fprintf(stderr, "need at least one section\n");
+        return 1;
+    }
+
+    for (int lookahead = 1; lookahead <= SectionStream::CAPACITY; lookahead++) {
+        CheckLookahead(lookahead, 2000, seed + lookahead);
+    }
+    Bench(sections, seed);
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
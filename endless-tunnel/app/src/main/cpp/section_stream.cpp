@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cassert>
+#include "section_stream.hpp"
+
+SectionStream::SectionStream() {
+    mFirst = 0;
+    mCount = 0;
+    mLookahead = 0;
+}
+
+void SectionStream::Reset(int lookahead) {
+    assert(lookahead > 0 && lookahead <= CAPACITY);
+    mFirst = 0;
+    mCount = 0;
+    mLookahead = lookahead;
+}
+
+void SectionStream::Fill(ObstacleGenerator *gen) {
+    while (mCount < mLookahead) {
+        SectionHandle h = mFirst + mCount;
+        Obstacle *o = Slot(h);
+        if (h < OBS_START_SECTION) {
+            // generate an empty obstacle
+            o->Reset();
+            o->style = Obstacle::STYLE_NULL;
+        } else {
+            // generate a normal obstacle
+            gen->Generate(o);
+        }
+        mCount++;
+    }
+}
+
+void SectionStream::PopFront() {
+    // the slot of the dropped section is reused when the window reaches it again
+    mFirst++;
+    if (mCount > 0) {
+        mCount--;
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_section_stream_hpp
+#define endlesstunnel_section_stream_hpp
+
+#include "obstacle.hpp"
+#include "obstacle_generator.hpp"
+
+// Refers to a tunnel section of a SectionStream. It's the absolute section number, so it
+// keeps referring to the same section as the window moves forward; SectionStream::IsValid()
+// tells whether the section is still (or already) in the window.
+typedef int SectionHandle;
+
+/* The window of tunnel sections the game keeps around: from the section the player
+ * is in up to a fixed number of sections ahead, with the obstacle of each section.
+ * The window only moves forward: passed sections are dropped at the front and new ones
+ * are generated at the back, in generation order, so the obstacle sequence is exactly
+ * the one the ObstacleGenerator produces. Sections live in a ring of fixed capacity,
+ * so streaming doesn't allocate, and the capacity is a power of two so a handle maps
+ * to its slot with a mask. */
+class SectionStream {
+    public:
+        static const int CAPACITY = 16;
+
+    private:
+        static const int CAPACITY_MASK = CAPACITY - 1;
+        Obstacle mRing[CAPACITY];
+        SectionHandle mFirst;
+        int mCount;
+        int mLookahead;
+
+        Obstacle* Slot(SectionHandle h) { return &mRing[h & CAPACITY_MASK]; }
+
+    public:
+        SectionStream();
+
+        // empties the window and makes it start at section 0. lookahead is how many
+        // sections Fill() keeps in the window (at most CAPACITY).
+        void Reset(int lookahead);
+
+        // generates sections at the back until the window holds lookahead sections.
+        // Sections before OBS_START_SECTION get an empty (STYLE_NULL) obstacle.
+        void Fill(ObstacleGenerator *gen);
+
+        // drops the front section; the window now starts at the next one
+        void PopFront();
+
+        SectionHandle GetFirst() const { return mFirst; }
+        // one past the last section in the window
+        SectionHandle GetEnd() const { return mFirst + mCount; }
+        int GetCount() const { return mCount; }
+
+        bool IsValid(SectionHandle h) const {
+            return h >= mFirst && h < mFirst + mCount;
+        }
+
+        // h must be valid
+        Obstacle* Get(SectionHandle h) { return Slot(h); }
+        const Obstacle* Get(SectionHandle h) const { return &mRing[h & CAPACITY_MASK]; }
+
+        // NULL if h isn't in the window
+        Obstacle* Find(SectionHandle h) { return IsValid(h) ? Slot(h) : NULL; }
+};
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of the text meshes:
+ *
+ *   text-mesh-bench [-n strings] [-r rounds]
+ *
+ * Random strings are built into meshes with TextMeshBuilder and transformed
+ * with TransformTextMesh, and every vertex must land where TextRenderer used
+ * to draw it glyph by glyph, with its own matrix per glyph. Then, for the
+ * strings the game draws, the old per-glyph matrix setup is timed against
+ * building a mesh (once per string, then cached) and transforming one (each
+ * frame, for text drawn with a matrix). Exits non zero when a check fails.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "glm/gtc/matrix_transform.hpp"
+#include "text_mesh.hpp"
+
+#include "data/alphabet.inl"
+
+// as TextRenderer draws them
+#define ALPHABET_SCALE 0.01f
+#define CHAR_SPACING_F 0.1f
+#define LINE_SPACING_F 0.1f
+
+BAKE_ASCII_ART_POOL(ALPHABET_GEOM, ALPHABET_ART, ALPHABET_SCALE);
+
+// largest distance from where the glyph by glyph math puts a vertex
+static const float MAX_ERROR = 1e-5f;
+
+static int errors = 0;
+
+static void Check(bool ok, const char *what, const char *str) {
+    if (!ok && errors++ < 10) {
+        fprintf(stderr, "%s differs for \"%s\"\n", what, str);
+    }
+}
+
+void AsciiArtError(const char *what, int row, int col) {
+    fprintf(stderr, "invalid ascii art: %s at %d,%d\n", what, row, col);
+    abort();
+}
+
+static TextMeshBuilder *NewBuilder() {
+    AsciiArtData glyphs[ALPHABET_GEOM.GetCount()];
+    for (int i = 0; i < ALPHABET_GEOM.GetCount(); ++i) {
+        glyphs[i] = ALPHABET_GEOM.Get(i);
+    }
+    return new TextMeshBuilder(glyphs, ALPHABET_GEOM.GetCount(), ALPHABET_SCALE,
+            ALPHABET_GLYPH_COLS, ALPHABET_GLYPH_ROWS, CHAR_SPACING_F, LINE_SPACING_F);
+}
+
+static void CountRowsCols(const char *p, int *outCols, int *outRows) {
+    int cols = 0, rows = 1, curCols = 0;
+    for (; *p; ++p) {
+        if (*p == '\n') {
+            ++rows;
+            curCols = 0;
+        } else if (++curCols > cols) {
+            cols = curCols;
+        }
+    }
+    *outCols = cols;
+    *outRows = rows;
+}
+
+// The model matrix of each glyph, as TextRenderer::RenderText computed it before
+// strings were meshes. Calls glyph(code, mat) for every glyph drawn.
+template<typename Glyph> static void ForEachGlyph(const char *str, float centerX,
+        float centerY, float fontScale, const glm::mat4& matrix, Glyph glyph) {
+    int cols, rows;
+    CountRowsCols(str, &cols, &rows);
+    glm::mat4 scaleMat = glm::scale(glm::mat4(1.0f), glm::vec3(fontScale, fontScale, 1.0f));
+    float charWidth = ALPHABET_GLYPH_COLS * ALPHABET_SCALE * fontScale;
+    float charHeight = ALPHABET_GLYPH_ROWS * ALPHABET_SCALE * fontScale;
+    float charSpacing = CHAR_SPACING_F * charWidth;
+    float lineSpacing = LINE_SPACING_F * charHeight;
+    float width = cols * charWidth + (cols - 1) * charSpacing;
+    float height = rows * charHeight + (rows - 1) * lineSpacing;
+    float startX = centerX - width * 0.5f + 0.5f * charWidth;
+    float y = centerY + height * 0.5f - 0.5f * charHeight;
+
+    glm::mat4 modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, y, 0.0f));
+    for (; *str; ++str) {
+        if (*str == '\n') {
+            y -= charHeight + lineSpacing;
+            modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, y, 0.0f));
+            continue;
+        }
+        int code = (int) *str;
+        if (code >= 0 && code < ALPHABET_GEOM.GetCount() && ALPHABET_ART[code]) {
+            glyph(code, modelMat * scaleMat * matrix);
+        }
+        modelMat = glm::translate(modelMat, glm::vec3(charWidth + charSpacing, 0.0f, 0.0f));
+    }
+}
+
+static void CheckString(TextMeshBuilder *builder, const char *str, float fontScale,
+        const glm::mat4& matrix) {
+    float centerX = 0.7f, centerY = 0.4f;
+    TextMesh mesh;
+    std::vector<GLfloat> transformed;
+    Check(builder->Build(str, &mesh), "fit", str);
+    TransformTextMesh(mesh, matrix, &transformed);
+    Check(transformed.size() == mesh.vertices.size(), "transformed vertex count", str);
+
+    // the mesh is drawn centered at the text center, at the font scale
+    glm::mat4 meshMat = glm::scale(glm::translate(glm::mat4(1.0f),
+            glm::vec3(centerX, centerY, 0.0f)), glm::vec3(fontScale, fontScale, 1.0f));
+    int vertex = 0, index = 0;
+    float maxError = 0.0f;
+    bool indices = true;
+    ForEachGlyph(str, centerX, centerY, fontScale, matrix, [&](int code, const glm::mat4& mat) {
+        AsciiArtData glyph = ALPHABET_GEOM.Get(code);
+        for (int i = 0; i < glyph.indexCount; ++i, ++index) {
+            indices = indices && index < mesh.GetIndexCount() &&
+                    mesh.indices[index] == vertex + glyph.indices[i];
+        }
+        for (int i = 0; i < glyph.vertexCount; ++i, ++vertex) {
+            if (vertex >= mesh.GetVertexCount()) {
+                maxError = INFINITY;
+                return;
+            }
+            const GLfloat *v = &glyph.vertices[i * ASCII_ART_VERTEX_FLOATS];
+            const GLfloat *t = &transformed[vertex * ASCII_ART_VERTEX_FLOATS];
+            glm::vec4 expected = mat * glm::vec4(v[0], v[1], v[2], 1.0f);
+            glm::vec4 got = meshMat * glm::vec4(t[0], t[1], t[2], 1.0f);
+            for (int d = 0; d < 3; ++d) {
+                maxError = fmaxf(maxError, fabsf(expected[d] - got[d]));
+            }
+        }
+    });
+    Check(indices && index == mesh.GetIndexCount(), "indices", str);
+    Check(vertex == mesh.GetVertexCount(), "vertex count", str);
+    Check(maxError <= MAX_ERROR, "vertex positions", str);
+}
+
+static void CheckStrings(TextMeshBuilder *builder, int count) {
+    static const char CHARS[] = "ABCXYZ0123456789 !?:.\n";
+    srand(3);
+    for (int n = 0; n < count; ++n) {
+        char str[41];
+        int len = rand() % 40;
+        for (int i = 0; i < len; ++i) {
+            str[i] = CHARS[rand() % (sizeof(CHARS) - 1)];
+        }
+        str[len] = '\0';
+        float fontScale = 0.3f + (rand() % 100) * 0.02f;
+        glm::mat4 matrix(1.0f);
+        if (n % 2) {
+            // like the animated sign: turned and squashed about each glyph's center
+            matrix = glm::rotate(glm::mat4(1.0f), (float)(rand() % 90),
+                    glm::vec3(0.0f, 0.0f, 1.0f));
+            matrix = glm::scale(matrix, glm::vec3(1.0f, (rand() % 100) * 0.02f, 1.0f));
+        }
+        CheckString(builder, str, fontScale, matrix);
+    }
+}
+
+static double NsPerString(std::chrono::steady_clock::time_point start, long strings) {
+    return std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count() / strings;
+}
+
+static void Bench(TextMeshBuilder *builder, int rounds) {
+    // what the HUD, the menus and the sign show
+    static const char *STRINGS[] = {
+        "SCORE: 12345", "LIVES: 3", "LEVEL 7", "PLAY", "STORY", "ABOUT", "QUIT",
+        "GAME OVER", "SAVE PROGRESS?\nYES  NO", "ENDLESS\nTUNNEL"
+    };
+    const int count = sizeof(STRINGS) / sizeof(STRINGS[0]);
+    glm::mat4 matrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 0.5f, 1.0f));
+    long glyphs = 0;
+    float sink = 0.0f;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < count; ++i) {
+            ForEachGlyph(STRINGS[i], 0.5f, 0.5f, 1.0f, matrix,
+                    [&](int, const glm::mat4& mat) {
+                sink += mat[3][0];
+                glyphs++;
+            });
+        }
+    }
+    double glyphNs = NsPerString(start, (long)rounds * count);
+
+    TextMesh meshes[count];
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < count; ++i) {
+            builder->Build(STRINGS[i], &meshes[i]);
+        }
+    }
+    double buildNs = NsPerString(start, (long)rounds * count);
+
+    std::vector<GLfloat> transformed;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < count; ++i) {
+            TransformTextMesh(meshes[i], matrix, &transformed);
+            sink += transformed[0];
+        }
+    }
+    double transformNs = NsPerString(start, (long)rounds * count);
+
+    printf("%d strings, %.1f glyphs each: per glyph matrices %.0f ns and %.1f draw "
+            "calls per string, mesh build %.0f ns (once, cached), mesh transform %.0f ns "
+            "and 1 draw call per string [%d]\n", count, (double)glyphs / rounds / count,
+            glyphNs, (double)glyphs / rounds / count, buildNs, transformNs, sink != 0.0f);
+}
+
+int main(int argc, char **argv) {
+    int strings = 2000, rounds = 10000;
+    int c;
+    while ((c = getopt(argc, argv, "n:r:")) != -1) {
+        switch (c) {
+            case 'n': strings = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n strings] [-r rounds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (rounds <= 0) {
+        fprintf(stderr, "need at least one round\n");
+        return 1;
+    }
+
+    TextMeshBuilder *builder = NewBuilder();
+    CheckStrings(builder, strings);
+    Bench(builder, rounds);
+    delete builder;
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstring>
+#include "text_mesh.hpp"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TEXT_MESH_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define TEXT_MESH_SSE
+#endif
+
+#define MAX_TEXT_MESH_VERTICES 65536
+
+TextMeshBuilder::TextMeshBuilder(const AsciiArtData *glyphs, int glyphCount, float scale,
+        int glyphCols, int glyphRows, float charSpacing, float lineSpacing) {
+    int i;
+    memset(mGlyphs, 0, sizeof(mGlyphs));
+    for (i = 0; i < glyphCount && i < CHAR_CODES; ++i) {
+        mGlyphs[i] = glyphs[i];
+    }
+    mCharWidth = glyphCols * scale;
+    mCharHeight = glyphRows * scale;
+    mAdvanceX = mCharWidth * (1.0f + charSpacing);
+    mAdvanceY = mCharHeight * (1.0f + lineSpacing);
+}
+
+bool TextMeshBuilder::Build(const char *str, TextMesh *out) {
+    const char *p;
+    int cols = 0, rows = 1, curCols = 0;
+    for (p = str; *p; ++p) {
+        if (*p == '\n') {
+            ++rows;
+            curCols = 0;
+        } else if (++curCols > cols) {
+            cols = curCols;
+        }
+    }
+
+    // same layout as TextRenderer used to do glyph by glyph: lines are left aligned,
+    // and the whole block is centered
+    float width = cols * mAdvanceX - (mAdvanceX - mCharWidth);
+    float height = rows * mAdvanceY - (mAdvanceY - mCharHeight);
+    float startX = -width * 0.5f + 0.5f * mCharWidth;
+    float x = startX;
+    float y = height * 0.5f - 0.5f * mCharHeight;
+
+    out->vertices.clear();
+    out->indices.clear();
+    out->localX.clear();
+    out->localY.clear();
+    out->originX.clear();
+    out->originY.clear();
+
+    bool fits = true;
+    for (p = str; *p; ++p) {
+        if (*p == '\n') {
+            x = startX;
+            y -= mAdvanceY;
+            continue;
+        }
+
+        int code = (int) *p;
+        const AsciiArtData *glyph = (code >= 0 && code < CHAR_CODES) ? &mGlyphs[code] : NULL;
+        if (glyph && glyph->vertexCount > 0) {
+            int base = (int)out->localX.size();
+            if (base + glyph->vertexCount > MAX_TEXT_MESH_VERTICES) {
+                fits = false;
+                break;
+            }
+            int i;
+            for (i = 0; i < glyph->vertexCount; ++i) {
+                const GLfloat *v = &glyph->vertices[i * ASCII_ART_VERTEX_FLOATS];
+                out->localX.push_back(v[0]);
+                out->localY.push_back(v[1]);
+                out->originX.push_back(x);
+                out->originY.push_back(y);
+                out->vertices.push_back(x + v[0]);
+                out->vertices.push_back(y + v[1]);
+                out->vertices.insert(out->vertices.end(), v + 2, v + ASCII_ART_VERTEX_FLOATS);
+            }
+            for (i = 0; i < glyph->indexCount; ++i) {
+                out->indices.push_back((GLushort)(base + glyph->indices[i]));
+            }
+        }
+        x += mAdvanceX;
+    }
+
+    // pad the per-vertex arrays so TransformTextMesh can always work 4 at a time
+    while (out->localX.size() % 4) {
+        out->localX.push_back(0.0f);
+        out->localY.push_back(0.0f);
+        out->originX.push_back(0.0f);
+        out->originY.push_back(0.0f);
+    }
+    return fits;
+}
+
+void TransformTextMesh(const TextMesh& mesh, const glm::mat4& mat, std::vector<GLfloat> *out) {
+    int count = mesh.GetVertexCount();
+    int padded = (int)mesh.localX.size();
+    out->assign(mesh.vertices.begin(), mesh.vertices.end());
+    if (count == 0) {
+        return;
+    }
+
+    const float *lx = &mesh.localX[0], *ly = &mesh.localY[0];
+    const float *ox = &mesh.originX[0], *oy = &mesh.originY[0];
+    GLfloat *dst = &(*out)[0];
+    float rx[4], ry[4], rz[4];
+    int i, j;
+
+    for (i = 0; i < padded; i += 4) {
+#if defined(TEXT_MESH_NEON)
+        float32x4_t vx = vld1q_f32(lx + i), vy = vld1q_f32(ly + i);
+        float32x4_t resX = vaddq_f32(vld1q_f32(ox + i), vdupq_n_f32(mat[3][0]));
+        float32x4_t resY = vaddq_f32(vld1q_f32(oy + i), vdupq_n_f32(mat[3][1]));
+        float32x4_t resZ = vdupq_n_f32(mat[3][2]);
+        resX = vmlaq_n_f32(vmlaq_n_f32(resX, vx, mat[0][0]), vy, mat[1][0]);
+        resY = vmlaq_n_f32(vmlaq_n_f32(resY, vx, mat[0][1]), vy, mat[1][1]);
+        resZ = vmlaq_n_f32(vmlaq_n_f32(resZ, vx, mat[0][2]), vy, mat[1][2]);
+        vst1q_f32(rx, resX);
+        vst1q_f32(ry, resY);
+        vst1q_f32(rz, resZ);
+#elif defined(TEXT_MESH_SSE)
+        __m128 vx = _mm_loadu_ps(lx + i), vy = _mm_loadu_ps(ly + i);
+        __m128 resX = _mm_add_ps(_mm_loadu_ps(ox + i), _mm_set1_ps(mat[3][0]));
+        __m128 resY = _mm_add_ps(_mm_loadu_ps(oy + i), _mm_set1_ps(mat[3][1]));
+        __m128 resZ = _mm_set1_ps(mat[3][2]);
+        resX = _mm_add_ps(resX, _mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(mat[0][0])),
+                _mm_mul_ps(vy, _mm_set1_ps(mat[1][0]))));
+        resY = _mm_add_ps(resY, _mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(mat[0][1])),
+                _mm_mul_ps(vy, _mm_set1_ps(mat[1][1]))));
+        resZ = _mm_add_ps(resZ, _mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(mat[0][2])),
+                _mm_mul_ps(vy, _mm_set1_ps(mat[1][2]))));
+        _mm_storeu_ps(rx, resX);
+        _mm_storeu_ps(ry, resY);
+        _mm_storeu_ps(rz, resZ);
+#else
+        for (j = 0; j < 4; ++j) {
+            rx[j] = ox[i + j] + mat[0][0] * lx[i + j] + mat[1][0] * ly[i + j] + mat[3][0];
+            ry[j] = oy[i + j] + mat[0][1] * lx[i + j] + mat[1][1] * ly[i + j] + mat[3][1];
+            rz[j] = mat[0][2] * lx[i + j] + mat[1][2] * ly[i + j] + mat[3][2];
+        }
+#endif
+        // scatter into the interleaved vertex layout (the padding is dropped here)
+        for (j = 0; j < 4 && i + j < count; ++j) {
+            GLfloat *v = dst + (i + j) * ASCII_ART_VERTEX_FLOATS;
+            v[0] = rx[j];
+            v[1] = ry[j];
+            v[2] = rz[j];
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef endlesstunnel_text_mesh_hpp
+#define endlesstunnel_text_mesh_hpp
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "ascii_art.hpp"
+
+/* The geometry of a whole string ("glyph run"): the glyphs of all of its characters,
+ * laid out in lines and merged into one vertex array and one index array, so the
+ * string can be drawn with a single draw call. The mesh is built for a font scale of
+ * 1 with the text centered at 0,0; the font scale and the position go in the matrix
+ * it's drawn with. Vertices have the same layout as AsciiArtData vertices. */
+struct TextMesh {
+    std::vector<GLfloat> vertices;
+    std::vector<GLushort> indices;
+
+    // position of each vertex relative to the center of its glyph, and the center of
+    // its glyph. vertices holds origin + local. Padded with zeros to a multiple of 4.
+    std::vector<float> localX, localY, originX, originY;
+
+    int GetVertexCount() const { return (int)(vertices.size() / ASCII_ART_VERTEX_FLOATS); }
+    int GetIndexCount() const { return (int)indices.size(); }
+};
+
+/* Builds TextMesh'es out of the glyphs of an ASCII art alphabet. */
+class TextMeshBuilder {
+    private:
+        static const int CHAR_CODES = 128;
+        AsciiArtData mGlyphs[CHAR_CODES];
+        float mAdvanceX, mAdvanceY;  // distance between glyph centers
+        float mCharWidth, mCharHeight;
+
+    public:
+        // glyphs has one entry per character code (empty for characters without a
+        // glyph), converted with the given scale. The glyph data isn't copied.
+        // charSpacing and lineSpacing are fractions of the glyph width and height.
+        TextMeshBuilder(const AsciiArtData *glyphs, int glyphCount, float scale, int glyphCols,
+                int glyphRows, float charSpacing, float lineSpacing);
+
+        // builds the mesh of str. Returns false if the string has too many vertices for
+        // 16-bit indices, in which case the mesh has only the glyphs that fit.
+        bool Build(const char *str, TextMesh *out);
+};
+
+// Writes the vertices of mesh to out, with the local position of every vertex
+// transformed by mat before the glyph center is added. So mat is applied to each
+// glyph about its own center. mat must be affine.
+void TransformTextMesh(const TextMesh& mesh, const glm::mat4& mat, std::vector<GLfloat> *out);
+
+#endif
@@ -26,28 +26,71 @@
 
 #define CORRECTION_Y -0.02f
 
+// the glyphs, converted at compile time
+BAKE_ASCII_ART_POOL(ALPHABET_GEOM, ALPHABET_ART, ALPHABET_SCALE);
+
 TextRenderer::TextRenderer(TrivialShader *t) {
     mTrivialShader = t;
-    memset(mCharGeom, 0, sizeof(mCharGeom));
+    mTransformedVbuf = NULL;
     mFontScale = 1.0f;
     mMatrix = glm::mat4(1.0f);
     mColor[0] = mColor[1] = mColor[2] = 1.0f;
 
-    LOGD("Loading alphabet glyphs.");
+    AsciiArtData glyphs[ALPHABET_GEOM.GetCount()];
     int i;
-    for (i = 0; i < CHAR_CODES; ++i) {
-        if (ALPHABET_ART[i]) {
-            LOGD("Creating glyph for chr %d.", i);
-            mCharGeom[i] = AsciiArtToGeom(ALPHABET_ART[i], ALPHABET_SCALE);
-        }
+    for (i = 0; i < ALPHABET_GEOM.GetCount(); ++i) {
+        glyphs[i] = ALPHABET_GEOM.Get(i);
     }
+    mMeshBuilder = new TextMeshBuilder(glyphs, ALPHABET_GEOM.GetCount(), ALPHABET_SCALE,
+            ALPHABET_GLYPH_COLS, ALPHABET_GLYPH_ROWS, CHAR_SPACING_F, LINE_SPACING_F);
 }
 
 TextRenderer::~TextRenderer() {
-    int i;
-    for (i = 0; i < CHAR_CODES; i++) {
-        CleanUp(&mCharGeom[i]);
+    std::list<CachedText*>::iterator it;
+    for (it = mCache.begin(); it != mCache.end(); ++it) {
+        CleanUp(&(*it)->geom);
+        delete *it;
+    }
+    mCache.clear();
+    CleanUp(&mTransformedVbuf);
+    CleanUp(&mMeshBuilder);
+}
+
+TextRenderer::CachedText* TextRenderer::GetCachedText(const char *str) {
+    std::list<CachedText*>::iterator it;
+    for (it = mCache.begin(); it != mCache.end(); ++it) {
+        if ((*it)->text == str) {
+            // move to the front, so the least recently used entry is always last
+            mCache.splice(mCache.begin(), mCache, it);
+            return mCache.front();
+        }
+    }
+
+    CachedText *ct;
+    if ((int)mCache.size() >= CACHE_SIZE) {
+        // reuse the least recently used entry
+        ct = mCache.back();
+        mCache.pop_back();
+        CleanUp(&ct->geom);
+    } else {
+        ct = new CachedText();
+        ct->geom = NULL;
     }
+
+    ct->text = str;
+    if (!mMeshBuilder->Build(str, &ct->mesh)) {
+        LOGE("Text too long for one mesh, truncating: %s", str);
+    }
+    if (ct->mesh.GetIndexCount() > 0) {
+        const int stride = ASCII_ART_VERTEX_FLOATS * sizeof(GLfloat);
+        ct->geom = new SimpleGeom(new VertexBuf(&ct->mesh.vertices[0],
+                ct->mesh.GetVertexCount() * stride, stride), new IndexBuf(&ct->mesh.indices[0],
+                ct->mesh.GetIndexCount() * sizeof(GLushort)));
+        ct->geom->vbuf->SetPrimitive(GL_LINES);
+        ct->geom->vbuf->SetColorsOffset(ASCII_ART_COLOR_OFFSET);
+    }
+    mCache.push_front(ct);
+    return ct;
 }
 
 TextRenderer* TextRenderer::SetFontScale(float scale) {
@@ -91,14 +134,23 @@ void TextRenderer::MeasureText(const char *str, float fontScale, float *outWidth
 }
 
 TextRenderer* TextRenderer::RenderText(const char *str, float centerX, float centerY) {
+    CachedText *ct = GetCachedText(str);
+    if (!ct->geom) {
+        return this;
+    }
+
     float aspect = SceneManager::GetInstance()->GetScreenAspect();
     glm::mat4 orthoMat = glm::ortho(0.0f, aspect, 0.0f, 1.0f);
-    glm::mat4 modelMat, mat, scaleMat;
-    int cols, rows;
+    glm::mat4 modelMat, mat;
     bool hadDepthTest;
 
     centerY += CORRECTION_Y * mFontScale;
 
+    // the mesh is centered at 0,0 for a font scale of 1
+    modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(centerX, centerY, 0.0f));
+    modelMat = glm::scale(modelMat, glm::vec3(mFontScale, mFontScale, 1.0f));
+    mat = orthoMat * modelMat;
+
     glLineWidth(TEXT_LINE_WIDTH);
 
     hadDepthTest = glIsEnabled(GL_DEPTH_TEST);
@@ -106,31 +158,24 @@ TextRenderer* TextRenderer::RenderText(const char *str, float centerX, float cen
 
     mTrivialShader->SetTintColor(mColor[0], mColor[1], mColor[2]);
 
-    _count_rows_cols(str, &cols, &rows);
-    scaleMat = glm::scale(glm::mat4(1.0f), glm::vec3(mFontScale, mFontScale, 1.0f));
-    float charWidth = ALPHABET_GLYPH_COLS * ALPHABET_SCALE * mFontScale;
-    float charHeight = ALPHABET_GLYPH_ROWS * ALPHABET_SCALE * mFontScale;
-    float charSpacing = CHAR_SPACING_F * charWidth;
-    float lineSpacing = LINE_SPACING_F * charHeight;
-    float width = cols * charWidth + (cols - 1) * charSpacing;
-    float height = rows * charHeight + (rows - 1) * lineSpacing;
-    float startX = centerX - width * 0.5f + 0.5f * charWidth;
-    float startY = centerY + height * 0.5f - 0.5f * charHeight;
-    float y = startY;
-
-    modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, startY, 0.0f));
-    for (; *str; ++str) {
-        if (*str == '\n') {
-            y -= charHeight + lineSpacing;
-            modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(startX, y, 0.0f));
+    if (mMatrix == glm::mat4(1.0f)) {
+        mTrivialShader->RenderSimpleGeom(&mat, ct->geom);
+    } else {
+        // the matrix applies to each glyph separately, so it can't go in the MVP matrix:
+        // transform the vertices and draw them with the cached indices
+        const int stride = ASCII_ART_VERTEX_FLOATS * sizeof(GLfloat);
+        TransformTextMesh(ct->mesh, mMatrix, &mTransformedVerts);
+        int dataSize = (int)mTransformedVerts.size() * sizeof(GLfloat);
+        if (mTransformedVbuf) {
+            mTransformedVbuf->SetData(&mTransformedVerts[0], dataSize);
         } else {
-            int code = (int) *str;
-            if (code >= 0 && code < CHAR_CODES && mCharGeom[code]) {
-                mat = orthoMat * modelMat * scaleMat * mMatrix;
-                mTrivialShader->RenderSimpleGeom(&mat, mCharGeom[code]);
-            }
-            modelMat = glm::translate(modelMat, glm::vec3(charWidth + charSpacing, 0.0f, 0.0f));
+            mTransformedVbuf = new VertexBuf(&mTransformedVerts[0], dataSize, stride);
+            mTransformedVbuf->SetPrimitive(GL_LINES);
+            mTransformedVbuf->SetColorsOffset(ASCII_ART_COLOR_OFFSET);
         }
+        mTrivialShader->BeginRender(mTransformedVbuf);
+        mTrivialShader->Render(ct->geom->ibuf, &mat);
+        mTrivialShader->EndRender();
     }
 
     glLineWidth(1);
@@ -139,4 +184,3 @@ TextRenderer* TextRenderer::RenderText(const char *str, float centerX, float cen
     }
     return this;
 }
-
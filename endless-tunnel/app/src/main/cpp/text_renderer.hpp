@@ -16,24 +16,48 @@
 #ifndef endlesstunnel_text_renderer_hpp
 #define endlesstunnel_text_renderer_hpp
 
+#include <list>
+#include <string>
 #include "engine.hpp"
+#include "text_mesh.hpp"
 
 /* Renders text to the screen. Uses the "normalized 2D coordinate system" as
- * described in the README. */
+ * described in the README. Each string is drawn with a single draw call; the meshes
+ * of recently drawn strings are cached, so text that doesn't change (most of the HUD
+ * and menus) isn't rebuilt from frame to frame. */
 class TextRenderer {
     private:
-        static const int CHAR_CODES = 128;
-        SimpleGeom* mCharGeom[CHAR_CODES];
+        TextMeshBuilder *mMeshBuilder;
         TrivialShader *mTrivialShader;
 
+        // a string and its mesh. The mesh doesn't depend on the font scale, color or
+        // matrix, so the string alone is the key.
+        struct CachedText {
+            std::string text;
+            TextMesh mesh;
+            SimpleGeom *geom;  // NULL if the string has nothing to draw
+        };
+
+        // cached strings, most recently used first
+        static const int CACHE_SIZE = 32;
+        std::list<CachedText*> mCache;
+
+        // vertices of the last string drawn with a matrix (see SetMatrix())
+        VertexBuf *mTransformedVbuf;
+        std::vector<GLfloat> mTransformedVerts;
+
         float mFontScale;
         float mColor[3];
         glm::mat4 mMatrix;
 
+        // returns the cache entry for str, building it if it's not cached
+        CachedText* GetCachedText(const char *str);
+
     public:
         TextRenderer(TrivialShader *t);
         ~TextRenderer();
 
+        // sets a matrix that is applied to each glyph about its own center
         TextRenderer* SetMatrix(glm::mat4 mat);
         TextRenderer* SetFontScale(float size);
         TextRenderer* RenderText(const char *str, float centerX, float centerY);
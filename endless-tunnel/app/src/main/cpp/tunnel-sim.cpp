@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Headless runs of the play scene simulation on the host:
+ *
+ *   tunnel-sim [-n runs] [-s seed] [-m mistake rate] [-l level] [-t max ticks]
+ *       batch of autopilot runs, seeds seed, seed + 1, ..., for tuning the
+ *       difficulty curve: prints how far the runs got and how fast they ran
+ *   tunnel-sim -r file
+ *       plays back a replay, e.g. the one the game writes at game over
+ *   tunnel-sim -g golden
+ *       golden replays: every line of the golden file is an autopilot run and
+ *       its expected outcome. Each run is recorded, must reach that outcome,
+ *       and must reach it again when its replay is saved, loaded and played
+ *       back. Exits non zero on any difference
+ *   tunnel-sim -w golden
+ *       writes the golden file again, after a deliberate change of the rules
+ *
+ * Outcomes hash float state, so golden files hold for one compiler and
+ * architecture; they are generated on x86-64 Linux.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "play_sim.hpp"
+
+// most ticks of a run, 10 minutes of play
+static const int MAX_TICKS = 10 * 60 * SIM_TICKS_PER_SECOND;
+
+// Passes on the input of another source and records it.
+class RecordingInputSource : public SimInputSource {
+    private:
+        SimInputSource *mSource;
+        SimReplay *mReplay;
+    public:
+        RecordingInputSource(SimInputSource *source, SimReplay *replay) :
+                mSource(source), mReplay(replay) {}
+        virtual bool NextInput(PlaySim *sim, SimInput *input) {
+            if (!mSource->NextInput(sim, input)) {
+                return false;
+            }
+            mReplay->inputs.push_back(*input);
+            return true;
+        }
+};
+
+// One line of a golden file.
+struct GoldenRun {
+    unsigned seed;
+    int level;
+    float mistakeRate;
+    SimRunResult result;
+};
+
+static SimRunResult RunAutopilot(unsigned seed, int level, float mistakeRate,
+        int maxTicks, SimReplay *replay) {
+    PlaySim sim;
+    sim.Reset(seed);
+    if (level > 0) {
+        sim.StartAtLevel(level);
+    }
+    AutopilotInputSource autopilot(seed, mistakeRate);
+    if (!replay) {
+        return RunSim(&sim, &autopilot, maxTicks);
+    }
+    replay->seed = seed;
+    replay->startDifficulty = level;
+    replay->inputs.clear();
+    RecordingInputSource recorder(&autopilot, replay);
+    return RunSim(&sim, &recorder, maxTicks);
+}
+
+static SimRunResult RunReplay(const SimReplay& replay) {
+    PlaySim sim;
+    sim.Reset(replay.seed);
+    if (replay.startDifficulty > 0) {
+        sim.StartAtLevel(replay.startDifficulty);
+    }
+    ReplayInputSource source(&replay);
+    return RunSim(&sim, &source, (int)replay.inputs.size());
+}
+
+static void PrintResult(const char *what, const SimRunResult& r) {
+    printf("%s: %d ticks, score %d, level %d, %d crashes, %d bonuses, "
+            "%d close calls, hash %08x\n", what, r.ticks, r.score, r.difficulty,
+            r.crashes, r.bonuses, r.closeCalls, r.stateHash);
+}
+
+static bool SameResult(const SimRunResult& a, const SimRunResult& b) {
+    return a.ticks == b.ticks && a.score == b.score && a.difficulty == b.difficulty &&
+            a.crashes == b.crashes && a.bonuses == b.bonuses &&
+            a.closeCalls == b.closeCalls && a.stateHash == b.stateHash;
+}
+
+static bool ReadGolden(FILE *f, GoldenRun *g) {
+    SimRunResult& r = g->result;
+    return 10 == fscanf(f, "%u %d %f %d %d %d %d %d %d %x", &g->seed, &g->level,
+            &g->mistakeRate, &r.ticks, &r.score, &r.difficulty, &r.crashes, &r.bonuses,
+            &r.closeCalls, &r.stateHash);
+}
+
+static void WriteGolden(FILE *f, const GoldenRun& g) {
+    const SimRunResult& r = g.result;
+    fprintf(f, "%u %d %.2f %d %d %d %d %d %d %08x\n", g.seed, g.level, g.mistakeRate,
+            r.ticks, r.score, r.difficulty, r.crashes, r.bonuses, r.closeCalls,
+            r.stateHash);
+}
+
+static int CheckGolden(const char *fileName) {
+    FILE *f = fopen(fileName, "r");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", fileName);
+        return 1;
+    }
+    std::string replayFile = "/tmp/tunnel-sim-" + std::to_string(getpid()) + ".replay";
+    int runs = 0, failures = 0;
+    GoldenRun golden;
+    while (ReadGolden(f, &golden)) {
+        runs++;
+        SimReplay replay, loaded;
+        SimRunResult r = RunAutopilot(golden.seed, golden.level, golden.mistakeRate,
+                MAX_TICKS, &replay);
+        bool ok = SameResult(r, golden.result);
+        if (ok) {
+            // the recorded input must play back to the same outcome, through a file
+            ok = replay.Save(replayFile.c_str()) && loaded.Load(replayFile.c_str()) &&
+                    SameResult(RunReplay(loaded), golden.result);
+            if (!ok) {
+                fprintf(stderr, "seed %u: replay differs from the recorded run\n",
+                        golden.seed);
+            }
+        } else {
+            fprintf(stderr, "seed %u: not the golden outcome\n", golden.seed);
+            PrintResult("  expected", golden.result);
+            PrintResult("  got", r);
+        }
+        failures += ok ? 0 : 1;
+    }
+    fclose(f);
+    remove(replayFile.c_str());
+
+    printf("%d golden runs, %d failed\n", runs, failures);
+    return runs > 0 && failures == 0 ? 0 : 1;
+}
+
+static int WriteGoldenFile(const char *fileName) {
+    FILE *f = fopen(fileName, "w");
+    if (!f) {
+        fprintf(stderr, "can't create %s\n", fileName);
+        return 1;
+    }
+    // sloppy to good players, from level 0 and from a checkpoint
+    static const float mistakeRates[] = { 0.5f, 0.2f, 0.05f };
+    static const int levels[] = { 0, 4 };
+    unsigned seed = 1;
+    for (float rate : mistakeRates) {
+        for (int level : levels) {
+            for (int i = 0; i < 4; i++, seed++) {
+                GoldenRun golden;
+                golden.seed = seed;
+                golden.level = level;
+                golden.mistakeRate = rate;
+                golden.result = RunAutopilot(seed, level, rate, MAX_TICKS, NULL);
+                WriteGolden(f, golden);
+            }
+        }
+    }
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok ? 0 : 1;
+}
+
+static void RunBatch(int runs, unsigned seed, float mistakeRate, int level, int maxTicks) {
+    long long ticks = 0, score = 0;
+    int maxLevel = 0, finished = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++) {
+        SimRunResult r = RunAutopilot(seed + i, level, mistakeRate, maxTicks, NULL);
+        ticks += r.ticks;
+        score += r.score;
+        maxLevel = r.difficulty > maxLevel ? r.difficulty : maxLevel;
+        finished += r.ticks < maxTicks ? 1 : 0;
+    }
+    double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    printf("%d runs, mistake rate %.2f from level %d: %d game over, "
+            "%.1f s and score %.0f on average, level %d at best\n",
+            runs, mistakeRate, level, finished,
+            (double)ticks / runs / SIM_TICKS_PER_SECOND, (double)score / runs, maxLevel);
+    printf("%lld ticks in %.3f s: %.0f runs/s, %.0fx real time\n", ticks, seconds,
+            runs / seconds, ticks / (double)SIM_TICKS_PER_SECOND / seconds);
+}
+
+int main(int argc, char **argv) {
+    int runs = 1000, level = 0, maxTicks = MAX_TICKS;
+    unsigned seed = 1;
+    float mistakeRate = 0.1f;
+    const char *replayFile = NULL, *goldenFile = NULL, *newGoldenFile = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "n:s:m:l:t:r:g:w:")) != -1) {
+        switch (c) {
+            case 'n': runs = atoi(optarg); break;
+            case 's': seed = (unsigned)strtoul(optarg, NULL, 0); break;
+            case 'm': mistakeRate = (float)atof(optarg); break;
+            case 'l': level = atoi(optarg); break;
+            case 't': maxTicks = atoi(optarg); break;
+            case 'r': replayFile = optarg; break;
+            case 'g': goldenFile = optarg; break;
+            case 'w': newGoldenFile = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-n runs] [-s seed] [-m mistake rate] "
+                        "[-l level] [-t max ticks] | -r replay | -g golden | -w golden\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    if (goldenFile) {
+        return CheckGolden(goldenFile);
+    }
+    if (newGoldenFile) {
+        return WriteGoldenFile(newGoldenFile);
+    }
+    if (replayFile) {
+        SimReplay replay;
+        if (!replay.Load(replayFile)) {
+            fprintf(stderr, "can't load replay %s\n", replayFile);
+            return 1;
+        }
+        PrintResult(replayFile, RunReplay(replay));
+        return 0;
+    }
+    if (runs <= 0 || maxTicks <= 0) {
+        fprintf(stderr, "need at least one run of one tick\n");
+        return 1;
+    }
+    RunBatch(runs, seed, mistakeRate, level, maxTicks);
+    return 0;
+}
@@ -30,6 +30,33 @@ template<typename T> void CleanUp(T** pptr) {
 int Random(int uboundExclusive);
 int Random(int lbound, int uboundExclusive);
 
+// Seedable random number generator (xorshift32). Game logic draws from its own
+// generator instead of rand() so that a run can be reproduced from its seed.
+class RandomGen {
+    private:
+        unsigned mState;
+    public:
+        RandomGen(unsigned seed = 1) {
+            Seed(seed);
+        }
+        void Seed(unsigned seed) {
+            // xorshift never leaves the all-zero state
+            mState = seed ? seed : 0x9e3779b9u;
+        }
+        unsigned Next() {
+            mState ^= mState << 13;
+            mState ^= mState >> 17;
+            mState ^= mState << 5;
+            return mState;
+        }
+        int Next(int uboundExclusive) {
+            return (int)(Next() % (unsigned)uboundExclusive);
+        }
+        int Next(int lbound, int uboundExclusive) {
+            return lbound + Next(uboundExclusive - lbound);
+        }
+};
+
 template<typename T> T Max(T a, T b) { return a > b ? a : b; }
 template<typename T> T Min(T a, T b) { return a < b ? a : b; }
 template<typename T> T Clamp(T v, T min, T max) {
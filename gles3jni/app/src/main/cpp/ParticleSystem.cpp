@@ -0,0 +1,516 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ParticleSystem.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PARTICLES_NEON 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define PARTICLES_SSE 1
+#endif
+
+#define PARTICLE_MIN_BOUND  (-1.0f)
+#define PARTICLE_MAX_BOUND  1.0f
+// the grid is at most this many cells across; with a small radius the cells
+// are bigger than the radius, which is still correct, just slower.
+#define MAX_PARTICLE_GRID_DIM 1024
+
+// ----------------------------------------------------------------------------
+// Integrators. All of them move every particle by v * dt; a particle that
+// would leave the box stays where it would have been after moving the other
+// way, and turns around: it's the old float loop in Renderer::step(),
+// vectorized. The SIMD versions give the same results as the scalar one.
+
+static inline void integrateOne(float* x, float* v, float dt) {
+    float d = *v * dt;
+    float n = *x + d;
+    if (n > PARTICLE_MAX_BOUND || n < PARTICLE_MIN_BOUND) {
+        *x = *x - d;
+        *v = -*v;
+    } else {
+        *x = n;
+    }
+}
+
+static void integrateScalar(float* x, float* y, float* vx, float* vy,
+                            unsigned int n, float dt, float* out) {
+    for (unsigned int i = 0; i < n; i++) {
+        integrateOne(&x[i], &vx[i], dt);
+        integrateOne(&y[i], &vy[i], dt);
+        out[2 * i + 0] = x[i];
+        out[2 * i + 1] = y[i];
+    }
+}
+
+#if PARTICLES_NEON
+
+static inline float32x4_t reflectNEON(float32x4_t x, float32x4_t* v, float32x4_t dt) {
+    float32x4_t d = vmulq_f32(*v, dt);
+    float32x4_t n = vaddq_f32(x, d);
+    uint32x4_t out = vorrq_u32(vcgtq_f32(n, vdupq_n_f32(PARTICLE_MAX_BOUND)),
+                               vcltq_f32(n, vdupq_n_f32(PARTICLE_MIN_BOUND)));
+    *v = vbslq_f32(out, vnegq_f32(*v), *v);
+    return vbslq_f32(out, vsubq_f32(x, d), n);
+}
+
+static void integrateSIMD(float* x, float* y, float* vx, float* vy,
+                          unsigned int n, float dt, float* out) {
+    float32x4_t vdt = vdupq_n_f32(dt);
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t velX = vld1q_f32(vx + i), velY = vld1q_f32(vy + i);
+        float32x4x2_t pos;
+        pos.val[0] = reflectNEON(vld1q_f32(x + i), &velX, vdt);
+        pos.val[1] = reflectNEON(vld1q_f32(y + i), &velY, vdt);
+        vst1q_f32(x + i, pos.val[0]);
+        vst1q_f32(y + i, pos.val[1]);
+        vst1q_f32(vx + i, velX);
+        vst1q_f32(vy + i, velY);
+        vst2q_f32(out + 2 * i, pos);
+    }
+    integrateScalar(x + i, y + i, vx + i, vy + i, n - i, dt, out + 2 * i);
+}
+
+#elif PARTICLES_SSE
+
+static inline __m128 reflectSSE(__m128 x, __m128* v, __m128 dt) {
+    __m128 d = _mm_mul_ps(*v, dt);
+    __m128 n = _mm_add_ps(x, d);
+    __m128 out = _mm_or_ps(_mm_cmpgt_ps(n, _mm_set1_ps(PARTICLE_MAX_BOUND)),
+                           _mm_cmplt_ps(n, _mm_set1_ps(PARTICLE_MIN_BOUND)));
+    *v = _mm_xor_ps(*v, _mm_and_ps(out, _mm_set1_ps(-0.0f)));
+    return _mm_or_ps(_mm_and_ps(out, _mm_sub_ps(x, d)), _mm_andnot_ps(out, n));
+}
+
+static void integrateSIMD(float* x, float* y, float* vx, float* vy,
+                          unsigned int n, float dt, float* out) {
+    __m128 vdt = _mm_set1_ps(dt);
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 velX = _mm_loadu_ps(vx + i), velY = _mm_loadu_ps(vy + i);
+        __m128 posX = reflectSSE(_mm_loadu_ps(x + i), &velX, vdt);
+        __m128 posY = reflectSSE(_mm_loadu_ps(y + i), &velY, vdt);
+        _mm_storeu_ps(x + i, posX);
+        _mm_storeu_ps(y + i, posY);
+        _mm_storeu_ps(vx + i, velX);
+        _mm_storeu_ps(vy + i, velY);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(posX, posY));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(posX, posY));
+    }
+    integrateScalar(x + i, y + i, vx + i, vy + i, n - i, dt, out + 2 * i);
+}
+
+// The x86 ABIs only guarantee SSE, so the AVX version is compiled for AVX on
+// its own and picked at run time.
+#define PARTICLES_AVX_TARGET __attribute__((target("avx")))
+
+static inline PARTICLES_AVX_TARGET __m256 reflectAVX(__m256 x, __m256* v, __m256 dt) {
+    __m256 d = _mm256_mul_ps(*v, dt);
+    __m256 n = _mm256_add_ps(x, d);
+    __m256 out = _mm256_or_ps(_mm256_cmp_ps(n, _mm256_set1_ps(PARTICLE_MAX_BOUND), _CMP_GT_OQ),
+                              _mm256_cmp_ps(n, _mm256_set1_ps(PARTICLE_MIN_BOUND), _CMP_LT_OQ));
+    *v = _mm256_xor_ps(*v, _mm256_and_ps(out, _mm256_set1_ps(-0.0f)));
+    return _mm256_blendv_ps(n, _mm256_sub_ps(x, d), out);
+}
+
+static PARTICLES_AVX_TARGET void integrateAVX(float* x, float* y, float* vx, float* vy,
+                                              unsigned int n, float dt, float* out) {
+    __m256 vdt = _mm256_set1_ps(dt);
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 velX = _mm256_loadu_ps(vx + i), velY = _mm256_loadu_ps(vy + i);
+        __m256 posX = reflectAVX(_mm256_loadu_ps(x + i), &velX, vdt);
+        __m256 posY = reflectAVX(_mm256_loadu_ps(y + i), &velY, vdt);
+        _mm256_storeu_ps(x + i, posX);
+        _mm256_storeu_ps(y + i, posY);
+        _mm256_storeu_ps(vx + i, velX);
+        _mm256_storeu_ps(vy + i, velY);
+        // unpack interleaves within 128-bit lanes: lo = 0 1 | 4 5, hi = 2 3 | 6 7
+        __m256 lo = _mm256_unpacklo_ps(posX, posY);
+        __m256 hi = _mm256_unpackhi_ps(posX, posY);
+        _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    integrateSIMD(x + i, y + i, vx + i, vy + i, n - i, dt, out + 2 * i);
+}
+
+#else
+
+#define integrateSIMD integrateScalar
+
+#endif
+
+static void writeInterleaved(const float* x, const float* y, unsigned int n, float* out) {
+    for (unsigned int i = 0; i < n; i++) {
+        out[2 * i + 0] = x[i];
+        out[2 * i + 1] = y[i];
+    }
+}
+
+// [begin, end) of the index'th of count nearly equal parts of [0, total)
+static void partRange(unsigned int index, unsigned int count, unsigned int total,
+                      unsigned int* begin, unsigned int* end) {
+    *begin = (unsigned int)((unsigned long long)total * index / count);
+    *end = (unsigned int)((unsigned long long)total * (index + 1) / count);
+}
+
+// ----------------------------------------------------------------------------
+
+ParticleSystem::ParticleSystem()
+        : mCount(0),
+          mDt(0.0f),
+          mOut(NULL),
+          mIntegrate(integrateSIMD),
+          mRadius(0.0f),
+          mStrength(0.0f),
+          mGridDim(0),
+          mInvCellSize(0.0f),
+          mGeneration(0),
+          mBusy(0),
+          mQuit(false),
+          mPass(PASS_INTEGRATE),
+          mNumChunks(0),
+          mNextChunk(0) {
+#if PARTICLES_SSE
+    if (__builtin_cpu_supports("avx")) {
+        mIntegrate = integrateAVX;
+    }
+#endif
+}
+
+ParticleSystem::~ParticleSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mQuit = true;
+    }
+    mWake.notify_all();
+    for (size_t i = 0; i < mThreads.size(); i++) {
+        mThreads[i].join();
+    }
+}
+
+void ParticleSystem::reset(unsigned int count, float maxSpeed) {
+    mCount = count;
+    mX.resize(count);
+    mY.resize(count);
+    mVx.resize(count);
+    mVy.resize(count);
+    for (unsigned int i = 0; i < count; i++) {
+        mX[i] = (drand48() - 0.5) * (PARTICLE_MAX_BOUND - PARTICLE_MIN_BOUND);
+        mY[i] = (drand48() - 0.5) * (PARTICLE_MAX_BOUND - PARTICLE_MIN_BOUND);
+        mVx[i] = (2.0 * drand48() - 1.0) * maxSpeed;
+        mVy[i] = (2.0 * drand48() - 1.0) * maxSpeed;
+    }
+
+    // workers only pay off once there is more than one chunk of work
+    if (mThreads.empty() && count > PARTICLE_CHUNK_SIZE) {
+        unsigned int cpus = std::thread::hardware_concurrency();
+        unsigned int workers = (cpus > MAX_PARTICLE_THREADS ? MAX_PARTICLE_THREADS : cpus);
+        for (unsigned int i = 1; i < workers; i++) {
+            mThreads.push_back(std::thread(&ParticleSystem::workerLoop, this, mGeneration));
+        }
+    }
+}
+
+void ParticleSystem::setInteraction(float radius, float strength) {
+    mRadius = radius > 0.0f ? radius : 0.0f;
+    mStrength = strength;
+    if (mRadius > 0.0f) {
+        float size = PARTICLE_MAX_BOUND - PARTICLE_MIN_BOUND;
+        // cells no smaller than the radius, or the 3x3 search misses neighbors
+        mGridDim = std::max(1, (int)floorf(size / mRadius));
+        if (mGridDim > MAX_PARTICLE_GRID_DIM) {
+            mGridDim = MAX_PARTICLE_GRID_DIM;
+        }
+        mInvCellSize = mGridDim / size;
+        mCellStart.resize(mGridDim * mGridDim + 1);
+    } else {
+        mGridDim = 0;
+    }
+}
+
+void ParticleSystem::attachAttribute(float* values) {
+    mAttributes.push_back(values);
+    mSortAttributes.push_back(std::vector<float>());
+}
+
+void ParticleSystem::step(float dt, float* out) {
+    mDt = dt;
+    mOut = out;
+    if (mGridDim > 0 && mCount > 0) {
+        sortByCell();
+        runPass(PASS_INTERACT, numChunks());
+    }
+    runPass(PASS_INTEGRATE, numChunks());
+    mOut = NULL;
+}
+
+void ParticleSystem::writeOffsets(float* out) {
+    mOut = out;
+    runPass(PASS_WRITE, numChunks());
+    mOut = NULL;
+}
+
+unsigned int ParticleSystem::numChunks() const {
+    return (mCount + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+}
+
+unsigned int ParticleSystem::chunkSize(unsigned int chunk) const {
+    unsigned int left = mCount - chunk * PARTICLE_CHUNK_SIZE;
+    return left < PARTICLE_CHUNK_SIZE ? left : PARTICLE_CHUNK_SIZE;
+}
+
+unsigned int ParticleSystem::numParts() const {
+    return (unsigned int)mThreads.size() + 1;
+}
+
+// ----------------------------------------------------------------------------
+// Worker pool. A pass is split in numChunks pieces of work which the workers
+// and the calling thread take in turn, until there are none left.
+
+void ParticleSystem::runPass(Pass pass, unsigned int numChunks) {
+    if (mThreads.empty() || numChunks <= 1) {
+        for (unsigned int i = 0; i < numChunks; i++) {
+            runChunk(pass, i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPass = pass;
+        mNumChunks = numChunks;
+        mNextChunk.store(0);
+        mBusy = (unsigned int)mThreads.size();
+        mGeneration++;
+    }
+    mWake.notify_all();
+
+    unsigned int chunk;
+    while ((chunk = mNextChunk.fetch_add(1)) < numChunks) {
+        runChunk(pass, chunk);
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    mDone.wait(lock, [this] { return mBusy == 0; });
+}
+
+// generation is the last pass the worker isn't part of: a worker may start
+// running only after the first pass was posted.
+void ParticleSystem::workerLoop(unsigned int generation) {
+    std::unique_lock<std::mutex> lock(mLock);
+    for (;;) {
+        mWake.wait(lock, [&] { return mQuit || mGeneration != generation; });
+        if (mQuit) {
+            return;
+        }
+        generation = mGeneration;
+        Pass pass = mPass;
+        unsigned int numChunks = mNumChunks;
+        lock.unlock();
+
+        unsigned int chunk;
+        while ((chunk = mNextChunk.fetch_add(1)) < numChunks) {
+            runChunk(pass, chunk);
+        }
+
+        lock.lock();
+        if (--mBusy == 0) {
+            mDone.notify_one();
+        }
+    }
+}
+
+// chunk is a chunk of PARTICLE_CHUNK_SIZE particles for the integrate, write
+// and interact passes, and one of numParts() parts for the grid passes.
+void ParticleSystem::runChunk(Pass pass, unsigned int chunk) {
+    unsigned int begin = chunk * PARTICLE_CHUNK_SIZE;
+    switch (pass) {
+        case PASS_INTEGRATE:
+            mIntegrate(&mX[begin], &mY[begin], &mVx[begin], &mVy[begin],
+                       chunkSize(chunk), mDt, mOut + 2 * begin);
+            break;
+        case PASS_WRITE:
+            writeInterleaved(&mX[begin], &mY[begin], chunkSize(chunk), mOut + 2 * begin);
+            break;
+        case PASS_BIN:
+            binPart(chunk);
+            break;
+        case PASS_CELL_SUM:
+            sumCells(chunk);
+            break;
+        case PASS_CELL_OFFSET:
+            offsetCells(chunk);
+            break;
+        case PASS_SCATTER:
+            scatterPart(chunk);
+            break;
+        case PASS_INTERACT:
+            interactChunk(chunk);
+            break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Uniform grid. The particles are split in one part per thread; each part
+// counts its particles per cell, the counts are turned into the first sorted
+// index of each (cell, part) pair, and each part copies its particles there.
+// The sort is stable, so it doesn't depend on the number of threads.
+
+void ParticleSystem::sortByCell() {
+    unsigned int parts = numParts();
+    unsigned int cells = mGridDim * mGridDim;
+    mCell.resize(mCount);
+    mPartCount.assign(parts * cells, 0);
+    mPartTotal.resize(parts);
+    mSortX.resize(mCount);
+    mSortY.resize(mCount);
+    mSortVx.resize(mCount);
+    mSortVy.resize(mCount);
+    for (size_t k = 0; k < mSortAttributes.size(); k++) {
+        mSortAttributes[k].resize(mCount);
+    }
+
+    runPass(PASS_BIN, parts);
+    runPass(PASS_CELL_SUM, parts);
+    unsigned int total = 0;
+    for (unsigned int i = 0; i < parts; i++) {
+        unsigned int n = mPartTotal[i];
+        mPartTotal[i] = total;
+        total += n;
+    }
+    runPass(PASS_CELL_OFFSET, parts);
+    mCellStart[cells] = mCount;
+    runPass(PASS_SCATTER, parts);
+
+    mX.swap(mSortX);
+    mY.swap(mSortY);
+    mVx.swap(mSortVx);
+    mVy.swap(mSortVy);
+    // the attached arrays belong to the caller, so they're copied back
+    for (size_t k = 0; k < mAttributes.size(); k++) {
+        memcpy(mAttributes[k], &mSortAttributes[k][0], mCount * sizeof(float));
+    }
+}
+
+void ParticleSystem::binPart(unsigned int part) {
+    unsigned int begin, end;
+    partRange(part, numParts(), mCount, &begin, &end);
+    unsigned int* count = &mPartCount[part * mGridDim * mGridDim];
+    for (unsigned int i = begin; i < end; i++) {
+        int cx = (int)((mX[i] - PARTICLE_MIN_BOUND) * mInvCellSize);
+        int cy = (int)((mY[i] - PARTICLE_MIN_BOUND) * mInvCellSize);
+        cx = cx < 0 ? 0 : (cx >= mGridDim ? mGridDim - 1 : cx);
+        cy = cy < 0 ? 0 : (cy >= mGridDim ? mGridDim - 1 : cy);
+        unsigned int cell = cy * mGridDim + cx;
+        mCell[i] = cell;
+        count[cell]++;
+    }
+}
+
+// the cells are split in parts too, for the prefix sum over all the counts
+void ParticleSystem::sumCells(unsigned int part) {
+    unsigned int parts = numParts(), cells = mGridDim * mGridDim;
+    unsigned int begin, end;
+    partRange(part, parts, cells, &begin, &end);
+    unsigned int total = 0;
+    for (unsigned int cell = begin; cell < end; cell++) {
+        for (unsigned int p = 0; p < parts; p++) {
+            total += mPartCount[p * cells + cell];
+        }
+    }
+    mPartTotal[part] = total;
+}
+
+void ParticleSystem::offsetCells(unsigned int part) {
+    unsigned int parts = numParts(), cells = mGridDim * mGridDim;
+    unsigned int begin, end;
+    partRange(part, parts, cells, &begin, &end);
+    unsigned int next = mPartTotal[part];
+    for (unsigned int cell = begin; cell < end; cell++) {
+        mCellStart[cell] = next;
+        for (unsigned int p = 0; p < parts; p++) {
+            unsigned int n = mPartCount[p * cells + cell];
+            mPartCount[p * cells + cell] = next;
+            next += n;
+        }
+    }
+}
+
+void ParticleSystem::scatterPart(unsigned int part) {
+    unsigned int begin, end;
+    partRange(part, numParts(), mCount, &begin, &end);
+    unsigned int* cursor = &mPartCount[part * mGridDim * mGridDim];
+    for (unsigned int i = begin; i < end; i++) {
+        unsigned int j = cursor[mCell[i]]++;
+        mSortX[j] = mX[i];
+        mSortY[j] = mY[i];
+        mSortVx[j] = mVx[i];
+        mSortVy[j] = mVy[i];
+        for (size_t k = 0; k < mAttributes.size(); k++) {
+            mSortAttributes[k][j] = mAttributes[k][i];
+        }
+    }
+}
+
+// Each particle only changes its own velocity, and only reads positions, so
+// the chunks don't need to synchronize. mCell is in the order from before
+// the sort, so the cell is recomputed from the position instead.
+void ParticleSystem::interactChunk(unsigned int chunk) {
+    unsigned int begin = chunk * PARTICLE_CHUNK_SIZE;
+    unsigned int end = begin + chunkSize(chunk);
+    const float* x = &mX[0];
+    const float* y = &mY[0];
+    float radius2 = mRadius * mRadius;
+    float invRadius = 1.0f / mRadius;
+    float scale = mStrength * mDt;
+
+    for (unsigned int i = begin; i < end; i++) {
+        int cx = (int)((x[i] - PARTICLE_MIN_BOUND) * mInvCellSize);
+        int cy = (int)((y[i] - PARTICLE_MIN_BOUND) * mInvCellSize);
+        cx = cx < 0 ? 0 : (cx >= mGridDim ? mGridDim - 1 : cx);
+        cy = cy < 0 ? 0 : (cy >= mGridDim ? mGridDim - 1 : cy);
+        int x0 = cx > 0 ? cx - 1 : 0, x1 = cx < mGridDim - 1 ? cx + 1 : cx;
+        int y0 = cy > 0 ? cy - 1 : 0, y1 = cy < mGridDim - 1 ? cy + 1 : cy;
+
+        float ax = 0.0f, ay = 0.0f;
+        for (int gy = y0; gy <= y1; gy++) {
+            // the cells x0..x1 of a row are contiguous in the sorted order
+            unsigned int first = mCellStart[gy * mGridDim + x0];
+            unsigned int last = mCellStart[gy * mGridDim + x1 + 1];
+            for (unsigned int j = first; j < last; j++) {
+                float dx = x[i] - x[j];
+                float dy = y[i] - y[j];
+                float dist2 = dx * dx + dy * dy;
+                if (dist2 < radius2 && dist2 > 0.0f) {
+                    float dist = sqrtf(dist2);
+                    float push = (1.0f - dist * invRadius) / dist;
+                    ax += dx * push;
+                    ay += dy * push;
+                }
+            }
+        }
+        mVx[i] += ax * scale;
+        mVy[i] += ay * scale;
+    }
+}
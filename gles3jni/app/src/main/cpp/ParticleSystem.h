@@ -0,0 +1,138 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H 1
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Moves point particles inside the [-1 .. 1]^2 box, bouncing them off its
+// edges, and writes their positions as vec2 offsets for instanced drawing.
+//
+// Positions and velocities are kept as separate float arrays (x, y, vx, vy)
+// so the integrator can work on 8 (AVX) or 4 (SSE, NEON) particles at a time.
+// The particles are split into chunks of PARTICLE_CHUNK_SIZE which are spread
+// over a small pool of worker threads; each chunk writes its own range of the
+// output, so the output can be a mapped GL buffer.
+//
+// Optionally the particles push each other apart when they are closer than an
+// interaction radius. Neighbors are found with a uniform grid: every step the
+// particles are sorted by grid cell (a counting sort), so the particles of a
+// cell are contiguous and only the 3x3 cells around a particle are searched.
+// The cells are at least as big as the radius, so these hold every neighbor.
+
+#define PARTICLE_CHUNK_SIZE 16384
+#define MAX_PARTICLE_THREADS 8
+
+class ParticleSystem {
+public:
+    ParticleSystem();
+    ~ParticleSystem();
+
+    // replaces the particles with count new ones at random positions, moving
+    // in random directions at up to maxSpeed units per second.
+    void reset(unsigned int count, float maxSpeed);
+
+    // enables neighbor interactions: particles closer than radius are pushed
+    // apart, with an acceleration of strength at distance 0 falling linearly
+    // to 0 at radius. radius <= 0 disables them (the default).
+    void setInteraction(float radius, float strength);
+
+    // keeps values[i] with particle i when the particles are reordered, as
+    // they are by every step() with interactions enabled. values must hold
+    // count() floats and outlive the system.
+    void attachAttribute(float* values);
+
+    // advances the particles by dt seconds and writes count() vec2 offsets to
+    // out. out is only written to, never read, and may be a mapped buffer.
+    void step(float dt, float* out);
+
+    // writes the current positions without moving the particles.
+    void writeOffsets(float* out);
+
+    unsigned int count() const { return mCount; }
+
+private:
+    enum Pass {
+        PASS_INTEGRATE,
+        PASS_WRITE,
+        PASS_BIN,
+        PASS_CELL_SUM,
+        PASS_CELL_OFFSET,
+        PASS_SCATTER,
+        PASS_INTERACT,
+    };
+
+    typedef void (*IntegrateFn)(float* x, float* y, float* vx, float* vy,
+                                unsigned int n, float dt, float* out);
+
+    void runPass(Pass pass, unsigned int numChunks);
+    void runChunk(Pass pass, unsigned int chunk);
+    void workerLoop(unsigned int generation);
+
+    unsigned int numChunks() const;
+    unsigned int chunkSize(unsigned int chunk) const;
+    unsigned int numParts() const;
+
+    void sortByCell();
+    void binPart(unsigned int part);
+    void sumCells(unsigned int part);
+    void offsetCells(unsigned int part);
+    void scatterPart(unsigned int part);
+    void interactChunk(unsigned int chunk);
+
+    unsigned int mCount;
+    std::vector<float> mX, mY, mVx, mVy;
+
+    // step() parameters, for the worker threads
+    float mDt;
+    float* mOut;
+    IntegrateFn mIntegrate;
+
+    // uniform grid; only used with interactions enabled
+    float mRadius;
+    float mStrength;
+    int mGridDim;
+    float mInvCellSize;
+    std::vector<unsigned int> mCell;        // cell of each particle
+    std::vector<unsigned int> mCellStart;   // first sorted particle of each cell, + end
+    std::vector<unsigned int> mPartCount;   // per part cell counts, then scatter cursors
+    std::vector<unsigned int> mPartTotal;   // particles in each part's range of cells
+    std::vector<float> mSortX, mSortY, mSortVx, mSortVy;
+
+    // per particle arrays of the caller, reordered with the particles
+    std::vector<float*> mAttributes;
+    std::vector<std::vector<float> > mSortAttributes;
+
+    // worker pool. The calling thread works on chunks too.
+    std::vector<std::thread> mThreads;
+    std::mutex mLock;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    unsigned int mGeneration;
+    unsigned int mBusy;
+    bool mQuit;
+    Pass mPass;
+    unsigned int mNumChunks;
+    std::atomic<unsigned int> mNextChunk;
+};
+
+#endif // PARTICLESYSTEM_H
@@ -129,6 +129,9 @@ Renderer::Renderer()
     memset(mScale, 0, sizeof(mScale));
     memset(mAngularVelocity, 0, sizeof(mAngularVelocity));
     memset(mAngles, 0, sizeof(mAngles));
+    // the rotation of each instance stays with its particle
+    mParticles.attachAttribute(mAngles);
+    mParticles.attachAttribute(mAngularVelocity);
 }
 
 Renderer::~Renderer() {
@@ -153,16 +156,9 @@ void Renderer::resize(int w, int h) {
 void Renderer::calcSceneParams(unsigned int w, unsigned int h,
                                float *offsets) {
     mNumInstances = MAX_INSTANCES_ITEM;
-    localOffset = new float[MAX_INSTANCES_ITEM * 2];
-    mVx = new float[MAX_INSTANCES_ITEM * 2];
-    mVy = new float[MAX_INSTANCES_ITEM * 2];
-    offsetRatio = 2.0f;
-    for (int i = 0; i < MAX_INSTANCES_ITEM * 2; ++i) {
-        localOffset[i] = (drand48() - 0.5) * offsetRatio;
-        mVx[i] = (drand48() - 0.5) * 10.0;
-        mVy[i] = (drand48() - 0.5) * 10.0;
-        offsets[i] = localOffset[i];
-    }
+    // particles move at up to half the scene per second along each axis
+    mParticles.reset(mNumInstances, 0.5f);
+    mParticles.writeOffsets(offsets);
     float ratio = 0.1f;
     mScale[0] = ratio;
     mScale[1] = ratio * h / w;
@@ -197,23 +193,7 @@ void Renderer::step() {
 //        unmapTransformBuf();
 
         auto offsets = mapOffsetBuf();
-        for (int i = 0; i < 2 * MAX_INSTANCES_ITEM - 1; i += 2) {
-            localOffset[i] += mVx[i] * dt * 0.1;
-            if (localOffset[i] > 1.0 || localOffset[i] < -1.0) {
-                localOffset[i] -= 2 * mVx[i] * dt * 0.1;
-                mVx[i] = -mVx[i];
-            }
-            offsets[i] = localOffset[i];
-
-            localOffset[i + 1] += mVy[i] * dt * 0.1;
-            if (localOffset[i + 1] > 1.0 || localOffset[i + 1] < -1.0) {
-                localOffset[i + 1] -= 2 * mVy[i] * dt * 0.1;
-                mVy[i] = -mVy[i];
-            }
-            offsets[i + 1] = localOffset[i + 1];
-//        __android_log_print(ANDROID_LOG_INFO, "mgl","step %d offset %f", i, offsets[i]);
-
-        };
+        mParticles.step(dt, offsets);
         unmapOffsetBuf();
     }
 
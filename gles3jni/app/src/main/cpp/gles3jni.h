@@ -20,6 +20,8 @@
 #include <android/log.h>
 #include <math.h>
 
+#include "ParticleSystem.h"
+
 #if DYNAMIC_ES3
 #include "gl3stub.h"
 #else
@@ -107,10 +109,7 @@ private:
     float mAngularVelocity[MAX_INSTANCES_ITEM*2];
     uint64_t mLastFrameNs;
     float mAngles[MAX_INSTANCES_ITEM*2];
-    float* localOffset;
-    double offsetRatio;
-    float* mVx;
-    float* mVy;
+    ParticleSystem mParticles;
 };
 
 extern Renderer* createES2Renderer();
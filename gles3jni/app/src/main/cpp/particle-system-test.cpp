@@ -0,0 +1,183 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the ParticleSystem neighbor interactions:
+ *
+ *   particle-system-test [-n particles] [-s steps]
+ *
+ * For radii that do and don't divide the box, and one bigger than the box,
+ * the particles are stepped with interactions on next to a brute force
+ * reference that pushes every pair of particles closer than the radius, with
+ * the same equations. Each particle carries its index in an attached array,
+ * so after the sort by grid cell every output position must still be where
+ * the reference has that particle, and the attached array must still hold a
+ * permutation of the indices. Exits non zero when a check fails.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "ParticleSystem.h"
+
+// as in ParticleSystem.cpp
+#define PARTICLE_MIN_BOUND  (-1.0f)
+#define PARTICLE_MAX_BOUND  1.0f
+
+// position error allowed, from summing the pushes in another order
+static const float MAX_ERROR = 5e-5f;
+
+static const float MAX_SPEED = 0.5f;
+static const float DT = 0.05f;
+
+static int errors = 0;
+
+static void Check(bool ok, const char* what, float radius, int step, int particle) {
+    if (!ok && errors++ < 10) {
+        fprintf(stderr, "radius %g, step %d, particle %d: %s\n", radius, step, particle, what);
+    }
+}
+
+// The particles as ParticleSystem::reset() draws them, in their first order.
+struct Reference {
+    std::vector<float> x, y, vx, vy;
+
+    void reset(unsigned int count) {
+        x.resize(count);
+        y.resize(count);
+        vx.resize(count);
+        vy.resize(count);
+        for (unsigned int i = 0; i < count; i++) {
+            x[i] = (drand48() - 0.5) * (PARTICLE_MAX_BOUND - PARTICLE_MIN_BOUND);
+            y[i] = (drand48() - 0.5) * (PARTICLE_MAX_BOUND - PARTICLE_MIN_BOUND);
+            vx[i] = (2.0 * drand48() - 1.0) * MAX_SPEED;
+            vy[i] = (2.0 * drand48() - 1.0) * MAX_SPEED;
+        }
+    }
+
+    // every pair, then the same move and bounce as the integrators.
+    // Returns the number of particles that had a neighbor.
+    unsigned int step(float radius, float strength, float dt) {
+        unsigned int count = (unsigned int)x.size(), pushed = 0;
+        float radius2 = radius * radius, invRadius = 1.0f / radius;
+        std::vector<float> ax(count, 0.0f), ay(count, 0.0f);
+        for (unsigned int i = 0; i < count; i++) {
+            for (unsigned int j = 0; j < count; j++) {
+                float dx = x[i] - x[j];
+                float dy = y[i] - y[j];
+                float dist2 = dx * dx + dy * dy;
+                if (dist2 < radius2 && dist2 > 0.0f) {
+                    float dist = sqrtf(dist2);
+                    float push = (1.0f - dist * invRadius) / dist;
+                    ax[i] += dx * push;
+                    ay[i] += dy * push;
+                }
+            }
+            pushed += ax[i] != 0.0f || ay[i] != 0.0f;
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            vx[i] += ax[i] * strength * dt;
+            vy[i] += ay[i] * strength * dt;
+            move(&x[i], &vx[i], dt);
+            move(&y[i], &vy[i], dt);
+        }
+        return pushed;
+    }
+
+    static void move(float* x, float* v, float dt) {
+        float d = *v * dt;
+        float n = *x + d;
+        if (n > PARTICLE_MAX_BOUND || n < PARTICLE_MIN_BOUND) {
+            *x = *x - d;
+            *v = -*v;
+        } else {
+            *x = n;
+        }
+    }
+};
+
+static void CheckRadius(float radius, unsigned int count, int steps) {
+    const float strength = 5.0f;
+    ParticleSystem particles;
+    Reference reference;
+    std::vector<float> index(count), out(2 * count);
+
+    srand48(1);
+    particles.reset(count, MAX_SPEED);
+    srand48(1);
+    reference.reset(count);
+    for (unsigned int i = 0; i < count; i++) {
+        index[i] = (float)i;
+    }
+    particles.attachAttribute(&index[0]);
+    particles.setInteraction(radius, strength);
+
+    unsigned int pushed = 0;
+    for (int s = 0; s < steps; s++) {
+        particles.step(DT, &out[0]);
+        pushed += reference.step(radius, strength, DT);
+
+        std::vector<bool> seen(count, false);
+        for (unsigned int j = 0; j < count; j++) {
+            unsigned int i = (unsigned int)index[j];
+            bool valid = index[j] == (float)i && i < count && !seen[i];
+            Check(valid, "attached array is no permutation", radius, s, (int)j);
+            if (!valid) {
+                continue;
+            }
+            seen[i] = true;
+            float error = fmaxf(fabsf(out[2 * j] - reference.x[i]),
+                                fabsf(out[2 * j + 1] - reference.y[i]));
+            Check(error <= MAX_ERROR, "position differs from the brute force one", radius, s,
+                  (int)i);
+        }
+    }
+    // make sure the interactions were tested at all
+    Check(pushed > 0, "no particle had a neighbor", radius, steps, 0);
+    printf("radius %g: %d steps of %u particles, %.1f pushed per step\n", radius, steps, count,
+           (double)pushed / steps);
+}
+
+int main(int argc, char** argv) {
+    unsigned int count = 1000;
+    int steps = 3;
+    int c;
+    while ((c = getopt(argc, argv, "n:s:")) != -1) {
+        switch (c) {
+            case 'n': count = (unsigned int)atoi(optarg); break;
+            case 's': steps = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n particles] [-s steps]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (count == 0 || steps <= 0) {
+        fprintf(stderr, "need at least one particle and one step\n");
+        return 1;
+    }
+
+    // 2 / 0.3 and 2 / 0.7 aren't whole numbers of cells; 3 is bigger than the box
+    static const float RADII[] = { 0.3f, 0.7f, 0.025f, 0.5f, 3.0f };
+    for (size_t i = 0; i < sizeof(RADII) / sizeof(RADII[0]); i++) {
+        CheckRadius(RADII[i], count, steps);
+    }
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host benchmark of the looper: throughput and latency of messages posted
+ * from several threads at once, wake-up latency of a sleeping looper, and
+ * how late delayed messages are handled.
+ *
+ *   looper-bench [-t max posting threads] [-n messages per thread]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "looper.h"
+
+enum {
+    kMsgStamp,
+    kMsgDelayed,
+};
+
+// a message's obj points to the time it was posted, or was due
+class benchlooper: public looper {
+    public:
+        benchlooper(size_t expected) : handled(0) {
+            latencies.reserve(expected);
+        }
+        virtual void handle(int what, void* obj) {
+            latencies.push_back(nowus() - *(int64_t*)obj);
+            handled.fetch_add(1, std::memory_order_release);
+        }
+        void waitfor(int count) {
+            while (handled.load(std::memory_order_acquire) < count) {
+                usleep(100);
+            }
+        }
+        std::vector<int64_t> latencies;
+        std::atomic<int> handled;
+};
+
+struct poster {
+    pthread_t thread;
+    looper *target;
+    std::vector<int64_t> stamps;
+    int pauseus;
+};
+
+static void* postall(void* p) {
+    poster *ps = (poster*)p;
+    for (size_t i = 0; i < ps->stamps.size(); i++) {
+        ps->stamps[i] = looper::nowus();
+        ps->target->post(kMsgStamp, &ps->stamps[i]);
+        if (ps->pauseus) {
+            usleep(ps->pauseus);
+        }
+    }
+    return NULL;
+}
+
+static void report(const char *name, std::vector<int64_t> *latencies, double seconds) {
+    std::sort(latencies->begin(), latencies->end());
+    size_t n = latencies->size();
+    printf("%-22s %9.0f msg/s   latency us: p50 %5lld  p99 %6lld  max %7lld\n", name,
+           seconds > 0 ? n / seconds : 0.0, (long long)(*latencies)[n / 2],
+           (long long)(*latencies)[n * 99 / 100], (long long)(*latencies)[n - 1]);
+}
+
+// threads post count messages each, pauseus apart
+static void runposters(int threads, int count, int pauseus, const char *name) {
+    benchlooper l((size_t)threads * count);
+    std::vector<poster> posters(threads);
+    int64_t start = looper::nowus();
+    for (int i = 0; i < threads; i++) {
+        posters[i].target = &l;
+        posters[i].stamps.resize(count);
+        posters[i].pauseus = pauseus;
+        pthread_create(&posters[i].thread, NULL, postall, &posters[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(posters[i].thread, NULL);
+    }
+    l.waitfor(threads * count);
+    double seconds = (looper::nowus() - start) * 1e-6;
+    l.quit();
+    report(name, &l.latencies, seconds);
+}
+
+static void rundelayed(int count) {
+    benchlooper l(count);
+    std::vector<int64_t> due(count);
+    srand48(1);
+    for (int i = 0; i < count; i++) {
+        int64_t delay = (int64_t)(drand48() * 20000);
+        due[i] = looper::nowus() + delay;
+        l.postdelayed(kMsgDelayed, &due[i], delay);
+    }
+    l.waitfor(count);
+    l.quit();
+    report("delayed (0-20 ms)", &l.latencies, 0);
+}
+
+int main(int argc, char **argv) {
+    int maxthreads = 8;
+    int count = 200000;
+    int c;
+    while ((c = getopt(argc, argv, "t:n:")) != -1) {
+        switch (c) {
+            case 't':
+                maxthreads = atoi(optarg);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t max posting threads] [-n messages per thread]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    char name[64];
+    for (int threads = 1; threads <= maxthreads; threads *= 2) {
+        snprintf(name, sizeof(name), "%d thread%s, burst", threads, threads > 1 ? "s" : "");
+        runposters(threads, count, 0, name);
+    }
+    // a looper that sleeps between messages, so every post wakes it up
+    runposters(1, 2000, 200, "1 thread, paced");
+    rundelayed(2000);
+    return 0;
+}
@@ -17,23 +17,34 @@
 #include "looper.h"
 
 #include <assert.h>
-#include <jni.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
-#include <semaphore.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
+#include <algorithm>
+
+#ifdef __ANDROID__
 // for __android_log_print(ANDROID_LOG_INFO, "YourApp", "formatted message");
 #include <android/log.h>
 #define TAG "NativeCodec-looper"
 #define LOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+// host build of looper-bench
+#define LOGV(...) ((void)0)
+#endif
+
 
+enum {
+    kindMessage,
+    kindCancel,
+    kindQuit,
+};
 
 struct loopermessage;
 typedef struct loopermessage loopermessage;
@@ -42,9 +53,31 @@ struct loopermessage {
     int what;
     void *obj;
     loopermessage *next;
-    bool quit;
+    int kind;
+    bool flush;
+    int64_t when;       // microseconds, 0 for immediate messages
+    int64_t period;     // microseconds, 0 for one-shot messages
+    uint64_t seq;       // keeps timers with the same time in posting order
+    uint32_t index;     // index in the pool + 1, 0 if the message isn't pooled
+    std::atomic<uint32_t> nextfree;
 };
 
+#define INDEX_MASK 0xffffffffull
+#define TAG_ONE (1ull << 32)
+
+static bool timerafter(const loopermessage *a, const loopermessage *b) {
+    return a->when > b->when || (a->when == b->when && a->seq > b->seq);
+}
+
+static int futex(std::atomic<int> *addr, int op, int val, const timespec *timeout) {
+    return (int) syscall(SYS_futex, reinterpret_cast<int*>(addr), op, val, timeout, NULL, 0);
+}
+
+int64_t looper::nowus() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
 
 
 void* looper::trampoline(void* p) {
@@ -52,9 +85,13 @@ void* looper::trampoline(void* p) {
     return NULL;
 }
 
-looper::looper() {
-    sem_init(&headdataavailable, 0, 0);
-    sem_init(&headwriteprotect, 0, 1);
+looper::looper()
+        : inbox(NULL), sleeping(0), numslabs(0), freelist(0),
+          queuehead(NULL), queuetail(NULL), timerseq(0) {
+    memset(slabs, 0, sizeof(slabs));
+    pthread_mutex_init(&growlock, NULL);
+    grow();
+
     pthread_attr_t attr;
     pthread_attr_init(&attr);
 
@@ -68,85 +105,290 @@ looper::~looper() {
         LOGV("Looper deleted while still running. Some messages will not be processed");
         quit();
     }
+    for (int i = 0; i < numslabs.load(); i++) {
+        delete [] slabs[i];
+    }
+    pthread_mutex_destroy(&growlock);
+}
+
+// ----------------------------------------------------------------------------
+// Message pool. Any thread can take messages, only the looper thread gives
+// them back. When the pool is empty it grows by a slab, up to MAX_SLABS; past
+// that, messages are allocated one by one.
+
+loopermessage *looper::node(uint32_t index) {
+    uint32_t i = index - 1;
+    return &slabs[i / SLAB_SIZE][i % SLAB_SIZE];
+}
+
+loopermessage *looper::obtain() {
+    uint64_t head = freelist.load(std::memory_order_acquire);
+    while (true) {
+        while (head & INDEX_MASK) {
+            loopermessage *msg = node((uint32_t)(head & INDEX_MASK));
+            uint64_t next = ((head & ~INDEX_MASK) + TAG_ONE) |
+                    msg->nextfree.load(std::memory_order_relaxed);
+            if (freelist.compare_exchange_weak(head, next, std::memory_order_acquire)) {
+                return msg;
+            }
+        }
+        if (numslabs.load(std::memory_order_relaxed) >= MAX_SLABS) {
+            loopermessage *msg = new loopermessage();
+            msg->index = 0;
+            return msg;
+        }
+        grow();
+        head = freelist.load(std::memory_order_acquire);
+    }
+}
+
+void looper::recycle(loopermessage *msg) {
+    if (msg->index == 0) {
+        delete msg;
+        return;
+    }
+    uint64_t head = freelist.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        msg->nextfree.store((uint32_t)(head & INDEX_MASK), std::memory_order_relaxed);
+        next = ((head & ~INDEX_MASK) + TAG_ONE) | msg->index;
+    } while (!freelist.compare_exchange_weak(head, next, std::memory_order_release,
+                                             std::memory_order_relaxed));
+}
+
+void looper::grow() {
+    pthread_mutex_lock(&growlock);
+    // another thread may have grown the pool while this one waited
+    int n = numslabs.load(std::memory_order_relaxed);
+    if (n < MAX_SLABS && !(freelist.load(std::memory_order_acquire) & INDEX_MASK)) {
+        slabs[n] = new loopermessage[SLAB_SIZE];
+        numslabs.store(n + 1, std::memory_order_relaxed);
+        for (int i = 0; i < SLAB_SIZE; i++) {
+            slabs[n][i].index = (uint32_t)(n * SLAB_SIZE + i + 1);
+            recycle(&slabs[n][i]);
+        }
+    }
+    pthread_mutex_unlock(&growlock);
+}
+
+// ----------------------------------------------------------------------------
+// Posting. The message is pushed on the inbox; if the looper thread went to
+// sleep, the first poster to notice wakes it up.
+
+void looper::enqueue(loopermessage *msg) {
+    loopermessage *head = inbox.load(std::memory_order_relaxed);
+    do {
+        msg->next = head;
+    } while (!inbox.compare_exchange_weak(head, msg, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed));
+    if (sleeping.load(std::memory_order_seq_cst) && sleeping.exchange(0)) {
+        futex(&sleeping, FUTEX_WAKE_PRIVATE, 1, NULL);
+    }
 }
 
 void looper::post(int what, void *data, bool flush) {
-    loopermessage *msg = new loopermessage();
+    loopermessage *msg = obtain();
+    msg->what = what;
+    msg->obj = data;
+    msg->kind = kindMessage;
+    msg->flush = flush;
+    msg->when = 0;
+    msg->period = 0;
+    enqueue(msg);
+}
+
+void looper::postdelayed(int what, void *data, int64_t delayus) {
+    loopermessage *msg = obtain();
+    msg->what = what;
+    msg->obj = data;
+    msg->kind = kindMessage;
+    msg->flush = false;
+    msg->when = nowus() + (delayus > 0 ? delayus : 0);
+    msg->period = 0;
+    enqueue(msg);
+}
+
+void looper::postperiodic(int what, void *data, int64_t periodus) {
+    assert(periodus > 0);
+    loopermessage *msg = obtain();
     msg->what = what;
     msg->obj = data;
+    msg->kind = kindMessage;
+    msg->flush = false;
+    msg->when = nowus() + periodus;
+    msg->period = periodus;
+    enqueue(msg);
+}
+
+void looper::cancel(int what) {
+    loopermessage *msg = obtain();
+    msg->what = what;
+    msg->obj = NULL;
+    msg->kind = kindCancel;
+    msg->flush = false;
+    msg->when = 0;
+    msg->period = 0;
+    enqueue(msg);
+}
+
+// ----------------------------------------------------------------------------
+// Looper thread. Posted messages are moved from the inbox to the queue (or
+// the timer heap) before every message is handled, so a flush or a cancel
+// takes effect right after the message being handled.
+
+void looper::append(loopermessage *msg) {
     msg->next = NULL;
-    msg->quit = false;
-    addmsg(msg, flush);
+    if (queuetail) {
+        queuetail->next = msg;
+    } else {
+        queuehead = msg;
+    }
+    queuetail = msg;
 }
 
-void looper::addmsg(loopermessage *msg, bool flush) {
-    sem_wait(&headwriteprotect);
-    loopermessage *h = head;
+void looper::addtimer(loopermessage *msg) {
+    msg->seq = timerseq++;
+    timers.push_back(msg);
+    std::push_heap(timers.begin(), timers.end(), timerafter);
+}
 
-    if (flush) {
-        while(h) {
-            loopermessage *next = h->next;
-            delete h;
-            h = next;
+// drops all the pending messages, or only the ones with this what
+void looper::drop(bool all, int what) {
+    loopermessage *msg = queuehead;
+    queuehead = queuetail = NULL;
+    while (msg) {
+        loopermessage *next = msg->next;
+        if (all || msg->what == what) {
+            recycle(msg);
+        } else {
+            append(msg);
         }
-        h = NULL;
+        msg = next;
     }
-    if (h) {
-        while (h->next) {
-            h = h->next;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < timers.size(); i++) {
+        if (all || timers[i]->what == what) {
+            recycle(timers[i]);
+        } else {
+            timers[kept++] = timers[i];
         }
-        h->next = msg;
-    } else {
-        head = msg;
     }
-    LOGV("post msg %d", msg->what);
-    sem_post(&headwriteprotect);
-    sem_post(&headdataavailable);
+    timers.resize(kept);
+    std::make_heap(timers.begin(), timers.end(), timerafter);
+}
+
+void looper::drain() {
+    loopermessage *msg = inbox.exchange(NULL, std::memory_order_acquire);
+
+    // the inbox is newest first
+    loopermessage *posted = NULL;
+    while (msg) {
+        loopermessage *next = msg->next;
+        msg->next = posted;
+        posted = msg;
+        msg = next;
+    }
+
+    while (posted) {
+        msg = posted;
+        posted = posted->next;
+        if (msg->kind == kindCancel) {
+            drop(false, msg->what);
+            recycle(msg);
+            continue;
+        }
+        if (msg->flush) {
+            drop(true, 0);
+        }
+        if (msg->when) {
+            addtimer(msg);
+        } else {
+            append(msg);
+        }
+    }
+}
+
+void looper::sleep(int64_t untilus) {
+    sleeping.store(1, std::memory_order_seq_cst);
+    if (inbox.load(std::memory_order_seq_cst) == NULL) {
+        timespec timeout, *ptimeout = NULL;
+        int64_t waitus = untilus - nowus();
+        if (untilus >= 0) {
+            waitus = waitus > 0 ? waitus : 0;
+            timeout.tv_sec = waitus / 1000000;
+            timeout.tv_nsec = (waitus % 1000000) * 1000;
+            ptimeout = &timeout;
+        }
+        if (untilus < 0 || waitus > 0) {
+            futex(&sleeping, FUTEX_WAIT_PRIVATE, 1, ptimeout);
+        }
+    }
+    sleeping.store(0, std::memory_order_relaxed);
 }
 
 void looper::loop() {
     while(true) {
-        // wait for available message
-        sem_wait(&headdataavailable);
+        if (inbox.load(std::memory_order_relaxed)) {
+            drain();
+        }
 
-        // get next available message
-        sem_wait(&headwriteprotect);
-        loopermessage *msg = head;
+        if (!timers.empty()) {
+            int64_t now = nowus();
+            while (!timers.empty() && timers.front()->when <= now) {
+                loopermessage *msg = timers.front();
+                std::pop_heap(timers.begin(), timers.end(), timerafter);
+                timers.pop_back();
+                append(msg);
+            }
+        }
+
+        loopermessage *msg = queuehead;
         if (msg == NULL) {
-            LOGV("no msg");
-            sem_post(&headwriteprotect);
+            sleep(timers.empty() ? -1 : timers.front()->when);
             continue;
         }
-        head = msg->next;
-        sem_post(&headwriteprotect);
+        queuehead = msg->next;
+        if (queuehead == NULL) {
+            queuetail = NULL;
+        }
 
-        if (msg->quit) {
+        if (msg->kind == kindQuit) {
             LOGV("quitting");
-            delete msg;
+            recycle(msg);
+            drop(true, 0);
             return;
         }
-        LOGV("processing msg %d", msg->what);
         handle(msg->what, msg->obj);
-        delete msg;
+        if (msg->period) {
+            // keep the rate, but don't try to catch up after falling behind
+            msg->when += msg->period;
+            int64_t now = nowus();
+            if (msg->when < now) {
+                msg->when = now;
+            }
+            addtimer(msg);
+        } else {
+            recycle(msg);
+        }
     }
 }
 
 void looper::quit() {
     LOGV("quit");
-    loopermessage *msg = new loopermessage();
+    loopermessage *msg = obtain();
     msg->what = 0;
     msg->obj = NULL;
-    msg->next = NULL;
-    msg->quit = true;
-    addmsg(msg, false);
+    msg->kind = kindQuit;
+    msg->flush = false;
+    msg->when = 0;
+    msg->period = 0;
+    enqueue(msg);
     void *retval;
     pthread_join(worker, &retval);
-    sem_destroy(&headdataavailable);
-    sem_destroy(&headwriteprotect);
     running = false;
 }
 
 void looper::handle(int what, void* obj) {
     LOGV("dropping msg %d %p", what, obj);
 }
-
@@ -15,10 +15,19 @@
  */
 
 #include <pthread.h>
-#include <semaphore.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
 
 struct loopermessage;
 
+// A thread that handles the messages posted to it, in order.
+//
+// Any thread can post. Messages come from a pool and go through a lock-free
+// inbox, so posting doesn't allocate or take a lock, and only makes a system
+// call when the looper thread is asleep. Delayed and periodic messages wait
+// in a timer heap on the looper thread.
 class looper {
     public:
         looper();
@@ -26,18 +35,60 @@ class looper {
         looper(looper&) = delete;
         virtual ~looper();
 
+        // flush drops all the messages posted before this one that weren't
+        // handled yet, delayed and periodic ones included.
         void post(int what, void *data, bool flush = false);
+        // handles the message delayus microseconds from now.
+        void postdelayed(int what, void *data, int64_t delayus);
+        // handles the message every periodus microseconds, starting one period
+        // from now, until it's cancelled or flushed.
+        void postperiodic(int what, void *data, int64_t periodus);
+        // drops the pending messages with this what, delayed and periodic ones
+        // included.
+        void cancel(int what);
         void quit();
 
         virtual void handle(int what, void *data);
 
+        // CLOCK_MONOTONIC in microseconds, the clock of delayed messages
+        static int64_t nowus();
+
     private:
-        void addmsg(loopermessage *msg, bool flush);
+        loopermessage *obtain();
+        void recycle(loopermessage *msg);
+        loopermessage *node(uint32_t index);
+        void grow();
+        void enqueue(loopermessage *msg);
+
         static void* trampoline(void* p);
         void loop();
-        loopermessage *head;
+        void drain();
+        void append(loopermessage *msg);
+        void addtimer(loopermessage *msg);
+        void drop(bool all, int what);
+        void sleep(int64_t untilus);
+
+        // posted messages, newest first. Written by any thread.
+        std::atomic<loopermessage*> inbox;
+        // 1 while the looper thread is (about to be) asleep; it's the futex
+        // word the posting threads wake it up with.
+        std::atomic<int> sleeping;
+
+        // message pool: slabs of messages, and a free list of message indices
+        // tagged with a counter against ABA.
+        static const int MAX_SLABS = 64;
+        static const int SLAB_SIZE = 256;
+        loopermessage *slabs[MAX_SLABS];
+        std::atomic<int> numslabs;
+        std::atomic<uint64_t> freelist;
+        pthread_mutex_t growlock;
+
+        // owned by the looper thread
+        loopermessage *queuehead;
+        loopermessage *queuetail;
+        std::vector<loopermessage*> timers;
+        uint64_t timerseq;
+
         pthread_t worker;
-        sem_t headwriteprotect;
-        sem_t headdataavailable;
         bool running;
 };
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mediaclock.h"
+
+#include <stdint.h>
+#include <time.h>
+
+// errors up to this are slewed, bigger ones are jumped
+#define MAX_SLEW_ERROR_US 80000
+// a slewing clock runs at most this much fast or slow...
+#define MAX_SLEW_RATE 0.05
+// ...and aims to be back in sync after this long
+#define SLEW_PERIOD_US 500000
+
+static int64_t monotonicus() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+mediaclock::mediaclock(timesource now)
+        : mNow(now ? now : monotonicus), mStarted(false), mRunning(false),
+          mAnchorSystem(0), mAnchorMedia(0), mSlewEnd(0), mSlewRate(1.0) {
+}
+
+void mediaclock::start(int64_t mediaus) {
+    mStarted = true;
+    mRunning = true;
+    mAnchorSystem = mSlewEnd = now();
+    mAnchorMedia = mediaus;
+    mSlewRate = 1.0;
+}
+
+void mediaclock::reset() {
+    mStarted = false;
+    mRunning = false;
+}
+
+void mediaclock::pause() {
+    if (isrunning()) {
+        // a pause cuts the slew short
+        int64_t systemus = now();
+        mAnchorMedia = mediatimeat(systemus);
+        mAnchorSystem = mSlewEnd = systemus;
+        mSlewRate = 1.0;
+        mRunning = false;
+    }
+}
+
+void mediaclock::resume() {
+    if (mStarted && !mRunning) {
+        mAnchorSystem = mSlewEnd = now();
+        mRunning = true;
+    }
+}
+
+int64_t mediaclock::mediatime() const {
+    return mediatimeat(now());
+}
+
+int64_t mediaclock::mediatimeat(int64_t systemus) const {
+    if (!mRunning || systemus <= mAnchorSystem) {
+        return mAnchorMedia;
+    }
+    if (systemus <= mSlewEnd) {
+        return mAnchorMedia + (int64_t)((systemus - mAnchorSystem) * mSlewRate);
+    }
+    return mAnchorMedia + (int64_t)((mSlewEnd - mAnchorSystem) * mSlewRate) +
+            (systemus - mSlewEnd);
+}
+
+int64_t mediaclock::systemtimeof(int64_t mediaus) const {
+    if (!isrunning()) {
+        return INT64_MAX;
+    }
+    if (mediaus <= mAnchorMedia) {
+        return mAnchorSystem - (mAnchorMedia - mediaus);
+    }
+    int64_t slewedmedia = mAnchorMedia + (int64_t)((mSlewEnd - mAnchorSystem) * mSlewRate);
+    if (mediaus <= slewedmedia) {
+        return mAnchorSystem + (int64_t)((mediaus - mAnchorMedia) / mSlewRate);
+    }
+    return mSlewEnd + (mediaus - slewedmedia);
+}
+
+void mediaclock::sync(int64_t mastermediaus) {
+    if (!isrunning()) {
+        return;
+    }
+    int64_t systemus = now();
+    mAnchorMedia = mediatimeat(systemus);
+    mAnchorSystem = systemus;
+    int64_t error = mastermediaus - mAnchorMedia;
+    if (error > MAX_SLEW_ERROR_US || error < -MAX_SLEW_ERROR_US) {
+        mAnchorMedia = mastermediaus;
+        mSlewEnd = systemus;
+        mSlewRate = 1.0;
+        return;
+    }
+
+    // run fast (or slow) by error over the slew period, and stop once the
+    // error is gone
+    double slew = (double)error / SLEW_PERIOD_US;
+    if (slew > MAX_SLEW_RATE) {
+        slew = MAX_SLEW_RATE;
+    } else if (slew < -MAX_SLEW_RATE) {
+        slew = -MAX_SLEW_RATE;
+    }
+    if (error == 0) {
+        mSlewEnd = systemus;
+        mSlewRate = 1.0;
+    } else {
+        mSlewRate = 1.0 + slew;
+        mSlewEnd = systemus + (int64_t)(error / slew);
+    }
+}
+
+double mediaclock::rate(int64_t systemus) const {
+    if (!isrunning()) {
+        return 0.0;
+    }
+    return systemus < mSlewEnd ? mSlewRate : 1.0;
+}
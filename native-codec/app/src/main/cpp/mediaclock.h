@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIACLOCK_H
+#define MEDIACLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maps media time (presentation timestamps) to system time, both in
+// microseconds.
+//
+// The clock is started at some media time, runs along with the system clock,
+// and can be paused. By default it is its own master; when there is a better
+// reference (an audio sink's playback position, say), sync() pulls the clock
+// towards it: small errors are slewed away by running slightly fast or slow
+// for a while, so frame times stay smooth, and big ones are jumped.
+class mediaclock {
+    public:
+        typedef int64_t (*timesource)();
+
+        // now returns the system time, CLOCK_MONOTONIC by default
+        explicit mediaclock(timesource now = NULL);
+
+        int64_t now() const { return mNow(); }
+
+        // media time mediaus is now, and the clock runs from there
+        void start(int64_t mediaus);
+        // forgets the start point; the clock has to be started again
+        void reset();
+        void pause();
+        void resume();
+        bool isstarted() const { return mStarted; }
+        bool isrunning() const { return mStarted && mRunning; }
+
+        int64_t mediatime() const;
+        int64_t mediatimeat(int64_t systemus) const;
+        // the system time at which the clock reaches mediaus, or INT64_MAX
+        // if it isn't running
+        int64_t systemtimeof(int64_t mediaus) const;
+
+        // the master's media time is mastermediaus right now
+        void sync(int64_t mastermediaus);
+        // current rate of media time against system time; 1 unless slewing
+        double rate(int64_t systemus) const;
+
+    private:
+        timesource mNow;
+        bool mStarted;
+        bool mRunning;
+        int64_t mAnchorSystem;
+        int64_t mAnchorMedia;
+        // from mAnchorSystem to mSlewEnd the clock runs at mSlewRate
+        int64_t mSlewEnd;
+        double mSlewRate;
+};
+
+#endif // MEDIACLOCK_H
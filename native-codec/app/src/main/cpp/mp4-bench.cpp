@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host benchmark of the MP4 demuxer: how long indexing a file takes, how fast
+ * all of its samples can be read, next to plain read() of the same file, and
+ * how long seeks take.
+ *
+ *   mp4-bench [-g size[K|M|G]] [-c] file.mp4
+ *
+ * -g first writes a synthetic AVC file of about that size, whose samples are
+ * then checked as they're read. -c drops the file from the page cache before
+ * each pass, so reads come from the disk. A file whose stsz claims far more
+ * samples than it holds is always checked first.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mp4demuxer.h"
+
+#define TIMESCALE 90000
+#define FRAME_TICKS 3000    // 30 fps
+#define SYNC_INTERVAL 30
+#define SAMPLES_PER_CHUNK 10
+// the demuxer is asked to read this far ahead of the samples being read
+#define READAHEAD_BYTES (32 << 20)
+
+static int64_t nowus() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// ----------------------------------------------------------------------------
+// The synthetic file. Sample i is a single NAL unit: a 4 byte length, a NAL
+// header, then i, then filler.
+
+class boxwriter {
+    public:
+        void u8(uint32_t v) { data.push_back((uint8_t)v); }
+        void u16(uint32_t v) { u8(v >> 8); u8(v); }
+        void u32(uint32_t v) { u16(v >> 16); u16(v); }
+        void u64(uint64_t v) { u32((uint32_t)(v >> 32)); u32((uint32_t)v); }
+        void zeros(int n) { data.insert(data.end(), n, 0); }
+        void begin(const char *type) {
+            open.push_back(data.size());
+            u32(0);
+            data.insert(data.end(), type, type + 4);
+        }
+        // a full box: with version and flags
+        void beginfull(const char *type, uint32_t version) {
+            begin(type);
+            u32(version << 24);
+        }
+        void end() {
+            size_t start = open.back();
+            open.pop_back();
+            uint32_t size = (uint32_t)(data.size() - start);
+            for (int i = 0; i < 4; i++) {
+                data[start + i] = (uint8_t)(size >> (24 - 8 * i));
+            }
+        }
+        std::vector<uint8_t> data;
+    private:
+        std::vector<size_t> open;
+};
+
+static uint32_t samplesize(uint32_t index) {
+    // key frames big, the others in between 16 and 80 KB
+    if (index % SYNC_INTERVAL == 0) {
+        return 200000 + index % 7 * 1000;
+    }
+    return 16000 + (uint32_t)((index * 2654435761u) >> 16) % 64000;
+}
+
+static bool generate(const char *path, uint64_t target) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    boxwriter head;
+    head.begin("ftyp");
+    head.data.insert(head.data.end(), "isom", "isom" + 4);
+    head.u32(0x200);
+    head.data.insert(head.data.end(), "isomavc1", "isomavc1" + 8);
+    head.end();
+    uint64_t mdatstart = head.data.size();
+    // mdat with a 64 bit size, patched at the end
+    head.u32(1);
+    head.data.insert(head.data.end(), "mdat", "mdat" + 4);
+    head.u64(0);
+    fwrite(&head.data[0], 1, head.data.size(), f);
+
+    std::vector<uint8_t> buffer(1 << 20);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (uint8_t)(i * 31 + 7);
+    }
+    std::vector<uint32_t> sizes;
+    std::vector<uint64_t> chunks;
+    uint64_t offset = head.data.size();
+    while (offset < target) {
+        uint32_t index = (uint32_t)sizes.size();
+        uint32_t size = samplesize(index);
+        if (index % SAMPLES_PER_CHUNK == 0) {
+            chunks.push_back(offset);
+        }
+        uint8_t prefix[9] = {
+            (uint8_t)((size - 4) >> 24), (uint8_t)((size - 4) >> 16),
+            (uint8_t)((size - 4) >> 8), (uint8_t)(size - 4),
+            (uint8_t)(index % SYNC_INTERVAL == 0 ? 0x65 : 0x41),
+            (uint8_t)(index >> 24), (uint8_t)(index >> 16), (uint8_t)(index >> 8), (uint8_t)index
+        };
+        fwrite(prefix, 1, sizeof(prefix), f);
+        fwrite(&buffer[0], 1, size - sizeof(prefix), f);
+        sizes.push_back(size);
+        offset += size;
+    }
+    uint64_t mdatsize = offset - mdatstart;
+    uint32_t count = (uint32_t)sizes.size();
+
+    boxwriter moov;
+    moov.begin("moov");
+    moov.beginfull("mvhd", 0);
+    moov.zeros(8);
+    moov.u32(TIMESCALE);
+    moov.u32(count * FRAME_TICKS);
+    moov.u32(0x10000);
+    moov.u16(0x100);
+    moov.zeros(10 + 36 + 24);
+    moov.u32(2);
+    moov.end();
+    moov.begin("trak");
+    moov.beginfull("tkhd", 0);
+    moov.zeros(8);
+    moov.u32(1);
+    moov.zeros(4);
+    moov.u32(count * FRAME_TICKS);
+    moov.zeros(16 + 36);
+    moov.u32(1920 << 16);
+    moov.u32(1080 << 16);
+    moov.end();
+    moov.begin("mdia");
+    moov.beginfull("mdhd", 0);
+    moov.zeros(8);
+    moov.u32(TIMESCALE);
+    moov.u32(count * FRAME_TICKS);
+    moov.u32(0x55c40000);   // "und"
+    moov.end();
+    moov.beginfull("hdlr", 0);
+    moov.zeros(4);
+    moov.data.insert(moov.data.end(), "vide", "vide" + 4);
+    moov.zeros(12);
+    moov.u8(0);
+    moov.end();
+    moov.begin("minf");
+    moov.begin("stbl");
+
+    moov.beginfull("stsd", 0);
+    moov.u32(1);
+    moov.begin("avc1");
+    moov.zeros(6);
+    moov.u16(1);
+    moov.zeros(16);
+    moov.u16(1920);
+    moov.u16(1080);
+    moov.u32(0x480000);
+    moov.u32(0x480000);
+    moov.zeros(4);
+    moov.u16(1);
+    moov.zeros(32);
+    moov.u16(0x18);
+    moov.u16(0xffff);
+    // a made up SPS and PPS: the bench only checks they come back out
+    static const uint8_t sps[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78 };
+    static const uint8_t pps[] = { 0x68, 0xeb, 0xe3, 0xcb };
+    moov.begin("avcC");
+    moov.u8(1);
+    moov.u8(0x64);
+    moov.u8(0);
+    moov.u8(0x28);
+    moov.u8(0xff);
+    moov.u8(0xe1);
+    moov.u16(sizeof(sps));
+    moov.data.insert(moov.data.end(), sps, sps + sizeof(sps));
+    moov.u8(1);
+    moov.u16(sizeof(pps));
+    moov.data.insert(moov.data.end(), pps, pps + sizeof(pps));
+    moov.end();
+    moov.end();
+    moov.end();
+
+    moov.beginfull("stts", 0);
+    moov.u32(1);
+    moov.u32(count);
+    moov.u32(FRAME_TICKS);
+    moov.end();
+
+    moov.beginfull("stss", 0);
+    moov.u32((count + SYNC_INTERVAL - 1) / SYNC_INTERVAL);
+    for (uint32_t i = 0; i < count; i += SYNC_INTERVAL) {
+        moov.u32(i + 1);
+    }
+    moov.end();
+
+    // full chunks, then maybe a shorter last one
+    uint32_t last = count % SAMPLES_PER_CHUNK;
+    moov.beginfull("stsc", 0);
+    moov.u32(last ? 2 : 1);
+    moov.u32(1);
+    moov.u32(SAMPLES_PER_CHUNK);
+    moov.u32(1);
+    if (last) {
+        moov.u32((uint32_t)chunks.size());
+        moov.u32(last);
+        moov.u32(1);
+    }
+    moov.end();
+
+    moov.beginfull("stsz", 0);
+    moov.u32(0);
+    moov.u32(count);
+    for (uint32_t i = 0; i < count; i++) {
+        moov.u32(sizes[i]);
+    }
+    moov.end();
+
+    moov.beginfull("co64", 0);
+    moov.u32((uint32_t)chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        moov.u64(chunks[i]);
+    }
+    moov.end();
+
+    moov.end();     // stbl
+    moov.end();     // minf
+    moov.end();     // mdia
+    moov.end();     // trak
+    moov.end();     // moov
+    fwrite(&moov.data[0], 1, moov.data.size(), f);
+
+    fseeko(f, (off_t)mdatstart + 8, SEEK_SET);
+    uint8_t size[8];
+    for (int i = 0; i < 8; i++) {
+        size[i] = (uint8_t)(mdatsize >> (56 - 8 * i));
+    }
+    fwrite(size, 1, 8, f);
+    fflush(f);
+    fsync(fileno(f));
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// A tiny file whose stsz gives every sample the same size and claims 2^32 - 1
+// of them, in chunks of as many: only the samples that fit in the file may be
+// indexed, and no more than one per 8 bytes of it however small they are.
+// With chunks of its own, the track must be left out instead.
+static bool checkuniform(uint32_t chunkcount, uint32_t uniform) {
+    const uint32_t datasize = 64;
+    boxwriter file;
+    file.begin("ftyp");
+    file.data.insert(file.data.end(), "isom", "isom" + 4);
+    file.u32(0x200);
+    file.end();
+    file.begin("mdat");
+    uint32_t dataoffset = (uint32_t)file.data.size();
+    file.zeros(datasize);
+    file.end();
+
+    file.begin("moov");
+    file.begin("trak");
+    file.begin("mdia");
+    file.beginfull("mdhd", 0);
+    file.zeros(8);
+    file.u32(TIMESCALE);
+    file.u32(0);
+    file.u32(0x55c40000);
+    file.end();
+    file.beginfull("hdlr", 0);
+    file.zeros(4);
+    file.data.insert(file.data.end(), "vide", "vide" + 4);
+    file.zeros(13);
+    file.end();
+    file.begin("minf");
+    file.begin("stbl");
+    file.beginfull("stts", 0);
+    file.u32(1);
+    file.u32(0xffffffff);
+    file.u32(FRAME_TICKS);
+    file.end();
+    file.beginfull("stsc", 0);
+    file.u32(1);
+    file.u32(1);
+    file.u32(0xffffffff);
+    file.u32(1);
+    file.end();
+    file.beginfull("stsz", 0);
+    file.u32(uniform);
+    file.u32(0xffffffff);
+    file.end();
+    file.beginfull("stco", 0);
+    file.u32(chunkcount);
+    for (uint32_t i = 0; i < chunkcount; i++) {
+        file.u32(dataoffset);
+    }
+    file.end();
+    file.end();     // stbl
+    file.end();     // minf
+    file.end();     // mdia
+    file.end();     // trak
+    file.end();     // moov
+
+    FILE *f = tmpfile();
+    if (!f || fwrite(&file.data[0], 1, file.data.size(), f) != file.data.size() ||
+            fflush(f) != 0) {
+        perror("tmpfile");
+        return false;
+    }
+    mp4demuxer demuxer;
+    bool opened = demuxer.open(fileno(f), 0, (int64_t)file.data.size());
+    fclose(f);
+    if (chunkcount == 0) {
+        // no chunks to put the samples in
+        return !opened;
+    }
+    size_t expected = std::min(file.data.size() / std::max(uniform, 8u),
+                               (file.data.size() - dataoffset) / uniform);
+    return opened && demuxer.trackcount() == 1 &&
+            demuxer.track(0).samples.size() == expected;
+}
+
+// ----------------------------------------------------------------------------
+
+static void dropcache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+// adds up every byte, so every page is read
+static uint64_t touch(const uint8_t *p, size_t size) {
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        sum += v;
+    }
+    for (; i < size; i++) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+static double readbaseline(const char *path, uint64_t *bytes) {
+    *bytes = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    std::vector<uint8_t> buffer(4 << 20);
+    uint64_t sum = 0;
+    int64_t start = nowus();
+    ssize_t n;
+    while ((n = read(fd, &buffer[0], buffer.size())) > 0) {
+        sum += touch(&buffer[0], (size_t)n);
+        *bytes += n;
+    }
+    int64_t elapsed = nowus() - start;
+    close(fd);
+    if (sum == 1) {
+        printf("\n");   // keeps sum alive
+    }
+    return elapsed * 1e-6;
+}
+
+// reads every sample of every track, in file order
+static double readsamples(const mp4demuxer &demuxer, bool check, uint64_t *bytes, int *bad) {
+    struct ref {
+        uint64_t offset;
+        uint32_t track;
+        uint32_t index;
+        bool operator<(const ref &o) const { return offset < o.offset; }
+    };
+    std::vector<ref> order;
+    for (size_t t = 0; t < demuxer.trackcount(); t++) {
+        const std::vector<mp4sample> &samples = demuxer.track(t).samples;
+        for (size_t i = 0; i < samples.size(); i++) {
+            ref r = { samples[i].offset, (uint32_t)t, (uint32_t)i };
+            order.push_back(r);
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    uint64_t sum = 0;
+    uint64_t hinted = 0;
+    *bytes = 0;
+    *bad = 0;
+    int64_t start = nowus();
+    for (size_t i = 0; i < order.size(); i++) {
+        // keep the kernel READAHEAD_BYTES ahead
+        if (order[i].offset + READAHEAD_BYTES / 2 > hinted) {
+            size_t j = i;
+            while (j < order.size() && order[j].offset < order[i].offset + READAHEAD_BYTES) {
+                j++;
+            }
+            const mp4sample &s = demuxer.track(order[j - 1].track).samples[order[j - 1].index];
+            hinted = s.offset + s.size;
+            // with several tracks this asks for a bit more than needed
+            demuxer.willneed(order[i].track, order[i].index, j - i);
+        }
+        mp4span span;
+        demuxer.sample(order[i].track, order[i].index, &span);
+        sum += touch(span.data, span.size);
+        *bytes += span.size;
+        if (check) {
+            uint32_t index = order[i].index;
+            if (span.size != samplesize(index) || span.data[4] != (span.sync ? 0x65 : 0x41) ||
+                    ((uint32_t)span.data[5] << 24 | span.data[6] << 16 | span.data[7] << 8 |
+                     span.data[8]) != index ||
+                    span.ptsus != (int64_t)index * FRAME_TICKS * 1000000 / TIMESCALE ||
+                    span.sync != (index % SYNC_INTERVAL == 0)) {
+                (*bad)++;
+            }
+        }
+    }
+    int64_t elapsed = nowus() - start;
+    if (sum == 1) {
+        printf("\n");
+    }
+    return elapsed * 1e-6;
+}
+
+static void seeks(const mp4demuxer &demuxer, int track, int count) {
+    const mp4track &t = demuxer.track(track);
+    if (t.samples.empty()) {
+        return;
+    }
+    int64_t duration = demuxer.tous(t, t.samples.back().dts) + 1;
+    std::vector<int64_t> targets(count);
+    srand48(1);
+    for (int i = 0; i < count; i++) {
+        targets[i] = (int64_t)(drand48() * duration);
+    }
+    int wrong = 0;
+    int64_t start = nowus();
+    for (int i = 0; i < count; i++) {
+        size_t index = demuxer.seeksync(track, targets[i]);
+        mp4span span;
+        demuxer.sample(track, index, &span);
+        if (!span.sync || (span.dtsus > targets[i] && index != 0)) {
+            wrong++;
+        }
+    }
+    int64_t elapsed = nowus() - start;
+    printf("seek:  %d random seeks, %.0f ns each, %d wrong\n", count,
+           elapsed * 1000.0 / count, wrong);
+}
+
+static uint64_t parsesize(const char *s) {
+    char *end;
+    uint64_t size = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'G': case 'g': size <<= 30; break;
+        case 'M': case 'm': size <<= 20; break;
+        case 'K': case 'k': size <<= 10; break;
+    }
+    return size;
+}
+
+int main(int argc, char **argv) {
+    uint64_t generatesize = 0;
+    bool cold = false;
+    int c;
+    while ((c = getopt(argc, argv, "g:c")) != -1) {
+        switch (c) {
+            case 'g':
+                generatesize = parsesize(optarg);
+                break;
+            case 'c':
+                cold = true;
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-g size[K|M|G]] [-c] file.mp4\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[optind];
+
+    if (!checkuniform(1, 16) || !checkuniform(1, 1) || !checkuniform(0, 16)) {
+        fprintf(stderr, "check: a huge uniform stsz isn't bounded by the file\n");
+        return 1;
+    }
+
+    if (generatesize) {
+        int64_t start = nowus();
+        if (!generate(path, generatesize)) {
+            return 1;
+        }
+        printf("wrote %s in %.2f s\n", path, (nowus() - start) * 1e-6);
+    }
+
+    uint64_t bytes;
+    if (cold) {
+        dropcache(path);
+    }
+    double seconds = readbaseline(path, &bytes);
+    printf("read(): %.2f GB in %.3f s, %.2f GB/s\n", bytes / 1e9, seconds,
+           seconds > 0 ? bytes / 1e9 / seconds : 0.0);
+
+    if (cold) {
+        dropcache(path);
+    }
+    mp4demuxer demuxer;
+    int64_t start = nowus();
+    if (!demuxer.open(path)) {
+        fprintf(stderr, "%s: %s\n", path, demuxer.error());
+        return 1;
+    }
+    int64_t indexus = nowus() - start;
+    size_t samples = 0;
+    for (size_t t = 0; t < demuxer.trackcount(); t++) {
+        const mp4track &track = demuxer.track(t);
+        char handler[5], codec[5];
+        for (int i = 0; i < 4; i++) {
+            handler[i] = (char)(track.handler >> (24 - 8 * i));
+            codec[i] = (char)(track.codec >> (24 - 8 * i));
+        }
+        handler[4] = codec[4] = 0;
+        printf("track %u: %s %s, %zu samples, %zu sync, %.2f s", track.id, handler, codec,
+               track.samples.size(), track.syncsamples.size(), track.durationus * 1e-6);
+        std::vector<uint8_t> csd0, csd1;
+        if (mp4demuxer::annexbconfig(track, &csd0, &csd1)) {
+            printf(", %dx%d, parameter sets %zu + %zu bytes", track.width, track.height,
+                   csd0.size(), csd1.size());
+        }
+        printf("\n");
+        samples += track.samples.size();
+    }
+    printf("index: %zu samples in %.2f ms\n", samples, indexus * 1e-3);
+
+    if (cold) {
+        dropcache(path);
+    }
+    int bad;
+    seconds = readsamples(demuxer, generatesize != 0, &bytes, &bad);
+    printf("demux: %.2f GB of samples in %.3f s, %.2f GB/s\n", bytes / 1e9, seconds,
+           seconds > 0 ? bytes / 1e9 / seconds : 0.0);
+    if (generatesize) {
+        printf("check: %d bad samples\n", bad);
+    }
+
+    int video = demuxer.findtrack(MP4_FOURCC('v', 'i', 'd', 'e'));
+    if (video >= 0) {
+        seeks(demuxer, video, 100000);
+    }
+    return bad ? 1 : 0;
+}
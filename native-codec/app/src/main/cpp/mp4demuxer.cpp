@@ -0,0 +1,628 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mp4demuxer.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+static uint16_t be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t be64(const uint8_t *p) {
+    return ((uint64_t)be32(p) << 32) | be32(p + 4);
+}
+
+// a box's type and payload (after the size, type and largesize fields)
+struct mp4box {
+    uint32_t type;
+    const uint8_t *data;
+    uint64_t size;
+};
+
+// reads the box at *p and moves *p past it. Returns false at the end of the
+// parent, or if the box doesn't fit in it.
+static bool nextbox(const uint8_t **p, const uint8_t *end, mp4box *box) {
+    uint64_t left = (uint64_t)(end - *p);
+    if (left < 8) {
+        return false;
+    }
+    uint64_t size = be32(*p);
+    uint64_t header = 8;
+    box->type = be32(*p + 4);
+    if (size == 1) {
+        if (left < 16) {
+            return false;
+        }
+        size = be64(*p + 8);
+        header = 16;
+    } else if (size == 0) {
+        size = left;    // up to the end of the file
+    }
+    if (size < header || size > left) {
+        return false;
+    }
+    box->data = *p + header;
+    box->size = size - header;
+    *p += size;
+    return true;
+}
+
+// the sample tables of a track, as found in the file
+struct sampletables {
+    mp4box stts, ctts, stss, stsc, stsz, stco;
+    bool co64;
+    bool stz2;
+};
+
+// checks that a full box has a 32-bit entry count after its version and
+// flags (and after skip more bytes), and room for that many entries
+static bool entries(const mp4box &box, uint64_t skip, uint64_t entrysize, uint32_t *count) {
+    if (box.data == NULL || box.size < 8 + skip) {
+        return false;
+    }
+    *count = be32(box.data + 4 + skip);
+    return (box.size - 8 - skip) / entrysize >= *count;
+}
+
+mp4demuxer::mp4demuxer() : mMapping(NULL), mMappingSize(0), mData(NULL), mSize(0) {
+}
+
+mp4demuxer::~mp4demuxer() {
+    close();
+}
+
+void mp4demuxer::close() {
+    if (mMapping) {
+        munmap(mMapping, mMappingSize);
+    }
+    mMapping = NULL;
+    mMappingSize = 0;
+    mData = NULL;
+    mSize = 0;
+    mTracks.clear();
+}
+
+bool mp4demuxer::fail(const char *what) {
+    mError = what;
+    close();
+    return false;
+}
+
+bool mp4demuxer::open(const char *path) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return fail("can't open the file");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return fail("can't stat the file");
+    }
+    bool ok = open(fd, 0, st.st_size);
+    ::close(fd);
+    return ok;
+}
+
+bool mp4demuxer::open(int fd, int64_t offset, int64_t length) {
+    close();
+    mError.clear();
+    return map(fd, offset, length) && parse();
+}
+
+bool mp4demuxer::map(int fd, int64_t offset, int64_t length) {
+    if (length <= 0 || (uint64_t)length > SIZE_MAX - 65536) {
+        return fail("no file, or too big to map");
+    }
+    // mmap() wants a page aligned offset
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t aligned = offset - offset % page;
+    mMappingSize = (size_t)(length + (offset - aligned));
+    mMapping = mmap(NULL, mMappingSize, PROT_READ, MAP_SHARED, fd, (off_t)aligned);
+    if (mMapping == MAP_FAILED) {
+        mMapping = NULL;
+        return fail("can't map the file");
+    }
+    mData = (const uint8_t *)mMapping + (offset - aligned);
+    mSize = (uint64_t)length;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Parsing. Only the boxes on the way to the sample tables are looked at.
+
+static void parsesampleentry(const mp4box &stsd, mp4track *track) {
+    if (stsd.size < 8 || be32(stsd.data + 4) == 0) {
+        return;
+    }
+    // the first sample entry; tracks with several are rare
+    const uint8_t *p = stsd.data + 8;
+    mp4box entry;
+    if (!nextbox(&p, stsd.data + stsd.size, &entry)) {
+        return;
+    }
+    track->codec = entry.type;
+
+    uint64_t childrenat;
+    if (track->handler == MP4_FOURCC('v', 'i', 'd', 'e')) {
+        if (entry.size < 78) {
+            return;
+        }
+        track->width = be16(entry.data + 24);
+        track->height = be16(entry.data + 26);
+        childrenat = 78;
+    } else if (track->handler == MP4_FOURCC('s', 'o', 'u', 'n')) {
+        childrenat = 28;
+    } else {
+        return;
+    }
+    if (entry.size < childrenat) {
+        return;
+    }
+
+    p = entry.data + childrenat;
+    mp4box child;
+    while (nextbox(&p, entry.data + entry.size, &child)) {
+        if (child.type == MP4_FOURCC('a', 'v', 'c', 'C') ||
+                child.type == MP4_FOURCC('h', 'v', 'c', 'C')) {
+            track->config.assign(child.data, child.data + child.size);
+        } else if (child.type == MP4_FOURCC('e', 's', 'd', 's') && child.size > 4) {
+            track->config.assign(child.data + 4, child.data + child.size);
+        }
+    }
+}
+
+// walks the boxes of a trak, down to the sample tables
+static void parsetrackbox(const mp4box &parent, mp4track *track, sampletables *tables) {
+    const uint8_t *p = parent.data;
+    mp4box box;
+    while (nextbox(&p, parent.data + parent.size, &box)) {
+        switch (box.type) {
+            case MP4_FOURCC('m', 'd', 'i', 'a'):
+            case MP4_FOURCC('m', 'i', 'n', 'f'):
+            case MP4_FOURCC('s', 't', 'b', 'l'):
+                parsetrackbox(box, track, tables);
+                break;
+            case MP4_FOURCC('t', 'k', 'h', 'd'):
+                if (box.size >= 24) {
+                    track->id = be32(box.data + (box.data[0] == 1 ? 20 : 12));
+                }
+                break;
+            case MP4_FOURCC('m', 'd', 'h', 'd'):
+                if (box.size >= 32 && box.data[0] == 1) {
+                    track->timescale = be32(box.data + 20);
+                    track->durationus = (int64_t)be64(box.data + 24);
+                } else if (box.size >= 20) {
+                    track->timescale = be32(box.data + 12);
+                    track->durationus = be32(box.data + 16);
+                }
+                break;
+            case MP4_FOURCC('h', 'd', 'l', 'r'):
+                if (box.size >= 12) {
+                    track->handler = be32(box.data + 8);
+                }
+                break;
+            case MP4_FOURCC('s', 't', 's', 'd'):
+                // the handler comes first, in mdia
+                parsesampleentry(box, track);
+                break;
+            case MP4_FOURCC('s', 't', 't', 's'):
+                tables->stts = box;
+                break;
+            case MP4_FOURCC('c', 't', 't', 's'):
+                tables->ctts = box;
+                break;
+            case MP4_FOURCC('s', 't', 's', 's'):
+                tables->stss = box;
+                break;
+            case MP4_FOURCC('s', 't', 's', 'c'):
+                tables->stsc = box;
+                break;
+            case MP4_FOURCC('s', 't', 's', 'z'):
+            case MP4_FOURCC('s', 't', 'z', '2'):
+                tables->stsz = box;
+                tables->stz2 = box.type == MP4_FOURCC('s', 't', 'z', '2');
+                break;
+            case MP4_FOURCC('s', 't', 'c', 'o'):
+            case MP4_FOURCC('c', 'o', '6', '4'):
+                tables->stco = box;
+                tables->co64 = box.type == MP4_FOURCC('c', 'o', '6', '4');
+                break;
+        }
+    }
+}
+
+// turns the sample tables into track->samples. Samples that aren't all in
+// the file (a truncated download, say) are left out.
+static bool buildindex(const sampletables &t, uint64_t filesize, mp4track *track) {
+    uint32_t count, uniform = 0, fieldbits = 32;
+    if (t.stz2) {
+        if (t.stsz.data == NULL || t.stsz.size < 12) {
+            return false;
+        }
+        fieldbits = t.stsz.data[7];
+        count = be32(t.stsz.data + 8);
+        if ((fieldbits != 4 && fieldbits != 8 && fieldbits != 16) ||
+                (t.stsz.size - 12) * 8 / fieldbits < count) {
+            return false;
+        }
+    } else {
+        if (t.stsz.data == NULL || t.stsz.size < 12) {
+            return false;
+        }
+        uniform = be32(t.stsz.data + 4);
+        count = be32(t.stsz.data + 8);
+        if (uniform == 0 && (t.stsz.size - 12) / 4 < count) {
+            return false;
+        }
+    }
+
+    uint32_t chunks, stsccount, sttscount, cttscount = 0, stsscount = 0;
+    if (!entries(t.stco, 0, t.co64 ? 8 : 4, &chunks) ||
+            !entries(t.stsc, 0, 12, &stsccount) ||
+            !entries(t.stts, 0, 8, &sttscount) ||
+            (t.ctts.data && !entries(t.ctts, 0, 8, &cttscount)) ||
+            (t.stss.data && !entries(t.stss, 0, 4, &stsscount))) {
+        return false;
+    }
+
+    // A uniform stsz has no table to bound its count, so before allocating,
+    // the count is bounded by what the chunks hold and, with a uniform size,
+    // by what fits in the file; samples past either are dropped below anyway.
+    // Samples are taken to be at least 8 bytes there, so that a tiny size
+    // can't index an mp4sample per byte of the file.
+    uint64_t placeable = 0;
+    for (uint32_t e = 0; e < stsccount; e++) {
+        const uint8_t *entry = t.stsc.data + 8 + 12 * e;
+        uint32_t first = be32(entry), perchunk = be32(entry + 4);
+        uint32_t last = e + 1 < stsccount ? be32(entry + 12) - 1 : chunks;
+        if (first == 0 || last > chunks) {
+            break;
+        }
+        if (last >= first) {
+            placeable += (uint64_t)(last - first + 1) * perchunk;
+        }
+    }
+    if (uniform) {
+        placeable = std::min(placeable, filesize / std::max(uniform, 8u));
+    }
+    if (count > placeable) {
+        if (placeable == 0) {
+            return false;
+        }
+        count = (uint32_t)placeable;
+    }
+
+    std::vector<mp4sample> &samples = track->samples;
+    samples.resize(count);
+    const uint8_t *sizes = t.stsz.data + 12;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t size = uniform;
+        if (fieldbits == 32 && !uniform) {
+            size = be32(sizes + 4 * i);
+        } else if (fieldbits == 16) {
+            size = be16(sizes + 2 * i);
+        } else if (fieldbits == 8) {
+            size = sizes[i];
+        } else if (fieldbits == 4) {
+            size = (i & 1) ? sizes[i / 2] & 0xf : sizes[i / 2] >> 4;
+        }
+        samples[i].size = size;
+        samples[i].sync = 1;
+    }
+
+    // offsets: stsc gives runs of chunks with the same number of samples
+    uint32_t s = 0;
+    for (uint32_t e = 0; e < stsccount && s < count; e++) {
+        const uint8_t *entry = t.stsc.data + 8 + 12 * e;
+        uint32_t first = be32(entry), perchunk = be32(entry + 4);
+        uint32_t last = e + 1 < stsccount ? be32(entry + 12) - 1 : chunks;
+        if (first == 0 || last > chunks) {
+            break;
+        }
+        for (uint32_t c = first; c <= last && s < count; c++) {
+            uint64_t offset = t.co64 ? be64(t.stco.data + 8 + 8 * (c - 1))
+                                     : be32(t.stco.data + 8 + 4 * (c - 1));
+            for (uint32_t k = 0; k < perchunk && s < count; k++, s++) {
+                samples[s].offset = offset;
+                offset += samples[s].size;
+            }
+        }
+    }
+    count = s;
+
+    // times: stts is runs of samples with the same duration
+    int64_t dts = 0;
+    uint32_t delta = 0;
+    s = 0;
+    for (uint32_t e = 0; e < sttscount && s < count; e++) {
+        uint32_t run = be32(t.stts.data + 8 + 8 * e);
+        delta = be32(t.stts.data + 12 + 8 * e);
+        for (uint32_t k = 0; k < run && s < count; k++, s++) {
+            samples[s].dts = samples[s].pts = dts;
+            dts += delta;
+        }
+    }
+    for (; s < count; s++) {
+        samples[s].dts = samples[s].pts = dts;
+        dts += delta;
+    }
+
+    // composition offsets; version 0 ones are meant to be unsigned, but
+    // signed ones are common
+    s = 0;
+    for (uint32_t e = 0; e < cttscount && s < count; e++) {
+        uint32_t run = be32(t.ctts.data + 8 + 8 * e);
+        int32_t offset = (int32_t)be32(t.ctts.data + 12 + 8 * e);
+        for (uint32_t k = 0; k < run && s < count; k++, s++) {
+            samples[s].pts += offset;
+        }
+    }
+
+    // stop at the first sample that isn't in the file
+    for (s = 0; s < count; s++) {
+        if (samples[s].offset > filesize || samples[s].size > filesize - samples[s].offset) {
+            break;
+        }
+    }
+    count = s;
+    samples.resize(count);
+
+    if (t.stss.data) {
+        for (uint32_t i = 0; i < count; i++) {
+            samples[i].sync = 0;
+        }
+        track->syncsamples.reserve(stsscount);
+        for (uint32_t e = 0; e < stsscount; e++) {
+            uint32_t n = be32(t.stss.data + 8 + 4 * e);
+            if (n >= 1 && n <= count && (track->syncsamples.empty() ||
+                                          n - 1 > track->syncsamples.back())) {
+                samples[n - 1].sync = 1;
+                track->syncsamples.push_back(n - 1);
+            }
+        }
+        if (track->syncsamples.empty() && count > 0) {
+            // nothing to seek to otherwise
+            samples[0].sync = 1;
+            track->syncsamples.push_back(0);
+        }
+    }
+    return true;
+}
+
+bool mp4demuxer::parse() {
+    const uint8_t *p = mData;
+    const uint8_t *end = mData + mSize;
+    mp4box box, moov;
+    moov.data = NULL;
+    while (nextbox(&p, end, &box)) {
+        if (box.type == MP4_FOURCC('m', 'o', 'o', 'v')) {
+            moov = box;
+        } else if (box.type == MP4_FOURCC('m', 'o', 'o', 'f')) {
+            return fail("fragmented files aren't supported");
+        }
+    }
+    if (moov.data == NULL) {
+        return fail("no moov box");
+    }
+
+    p = moov.data;
+    while (nextbox(&p, moov.data + moov.size, &box)) {
+        if (box.type != MP4_FOURCC('t', 'r', 'a', 'k')) {
+            continue;
+        }
+        mp4track track;
+        track.id = track.handler = track.codec = track.timescale = 0;
+        track.durationus = 0;
+        track.width = track.height = 0;
+        sampletables tables;
+        memset(&tables, 0, sizeof(tables));
+        parsetrackbox(box, &track, &tables);
+        if (track.timescale == 0 || !buildindex(tables, mSize, &track)) {
+            continue;   // skip tracks we can't make sense of
+        }
+        track.durationus = tous(track, track.durationus);
+        mTracks.push_back(track);
+    }
+    if (mTracks.empty()) {
+        return fail("no usable tracks");
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+int mp4demuxer::findtrack(uint32_t handler) const {
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        if (mTracks[i].handler == handler) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int64_t mp4demuxer::tous(const mp4track &track, int64_t time) const {
+    // split, so that large times don't overflow
+    int64_t scale = track.timescale;
+    return time / scale * 1000000 + time % scale * 1000000 / scale;
+}
+
+bool mp4demuxer::sample(size_t track, size_t index, mp4span *out) const {
+    if (track >= mTracks.size() || index >= mTracks[track].samples.size()) {
+        return false;
+    }
+    const mp4track &t = mTracks[track];
+    const mp4sample &s = t.samples[index];
+    out->data = mData + s.offset;
+    out->size = s.size;
+    out->ptsus = tous(t, s.pts);
+    out->dtsus = tous(t, s.dts);
+    out->sync = s.sync != 0;
+    return true;
+}
+
+static bool dtsbefore(int64_t dts, const mp4sample &s) {
+    return dts < s.dts;
+}
+
+size_t mp4demuxer::seeksync(size_t track, int64_t timeus) const {
+    if (track >= mTracks.size() || mTracks[track].samples.empty()) {
+        return 0;
+    }
+    const mp4track &t = mTracks[track];
+    int64_t time = timeus / 1000000 * t.timescale + timeus % 1000000 * t.timescale / 1000000;
+    // the last sample that starts at or before time
+    std::vector<mp4sample>::const_iterator it =
+            std::upper_bound(t.samples.begin(), t.samples.end(), time, dtsbefore);
+    uint32_t index = it == t.samples.begin() ? 0 : (uint32_t)(it - t.samples.begin() - 1);
+    if (t.syncsamples.empty()) {
+        return index;
+    }
+    std::vector<uint32_t>::const_iterator sync =
+            std::upper_bound(t.syncsamples.begin(), t.syncsamples.end(), index);
+    return sync == t.syncsamples.begin() ? t.syncsamples[0] : *(sync - 1);
+}
+
+void mp4demuxer::willneed(size_t track, size_t first, size_t count) const {
+    if (track >= mTracks.size() || first >= mTracks[track].samples.size() || count == 0) {
+        return;
+    }
+    const std::vector<mp4sample> &samples = mTracks[track].samples;
+    size_t last = std::min(first + count, samples.size()) - 1;
+    uint64_t begin = samples[first].offset;
+    uint64_t end = samples[last].offset + samples[last].size;
+    if (end <= begin) {
+        return;
+    }
+    // madvise() wants a page aligned address
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t)(mData + begin) & ~(page - 1);
+    uintptr_t to = (uintptr_t)(mData + end);
+    madvise((void *)from, to - from, MADV_WILLNEED);
+}
+
+// ----------------------------------------------------------------------------
+// AVC and HEVC
+
+int mp4demuxer::nallengthsize(const mp4track &track) {
+    const std::vector<uint8_t> &c = track.config;
+    if ((track.codec == MP4_FOURCC('a', 'v', 'c', '1') ||
+            track.codec == MP4_FOURCC('a', 'v', 'c', '3')) && c.size() >= 7) {
+        return (c[4] & 3) + 1;
+    }
+    if ((track.codec == MP4_FOURCC('h', 'v', 'c', '1') ||
+            track.codec == MP4_FOURCC('h', 'e', 'v', '1')) && c.size() >= 23) {
+        return (c[21] & 3) + 1;
+    }
+    return 0;
+}
+
+// appends count parameter sets, each a 16-bit size and the data, with start
+// codes. Returns the number of bytes read from p, or 0 if they don't fit.
+static size_t appendparametersets(const uint8_t *p, const uint8_t *end, int count,
+                                  std::vector<uint8_t> *out) {
+    static const uint8_t startcode[4] = { 0, 0, 0, 1 };
+    const uint8_t *start = p;
+    for (int i = 0; i < count; i++) {
+        if (end - p < 2 || end - p - 2 < be16(p)) {
+            return 0;
+        }
+        size_t size = be16(p);
+        out->insert(out->end(), startcode, startcode + 4);
+        out->insert(out->end(), p + 2, p + 2 + size);
+        p += 2 + size;
+    }
+    return (size_t)(p - start);
+}
+
+bool mp4demuxer::annexbconfig(const mp4track &track, std::vector<uint8_t> *csd0,
+                              std::vector<uint8_t> *csd1) {
+    csd0->clear();
+    csd1->clear();
+    if (nallengthsize(track) == 0) {
+        return false;
+    }
+    const uint8_t *p = &track.config[0];
+    const uint8_t *end = p + track.config.size();
+
+    if (track.codec == MP4_FOURCC('a', 'v', 'c', '1') ||
+            track.codec == MP4_FOURCC('a', 'v', 'c', '3')) {
+        // avcC: 5 bytes, SPS count and SPSs, PPS count and PPSs
+        p += 5;
+        size_t n = appendparametersets(p + 1, end, p[0] & 0x1f, csd0);
+        if (n == 0 && (p[0] & 0x1f)) {
+            return false;
+        }
+        p += 1 + n;
+        if (p >= end) {
+            return false;
+        }
+        n = appendparametersets(p + 1, end, p[0], csd1);
+        return n > 0 || p[0] == 0;
+    }
+
+    // hvcC: 22 bytes, then arrays of VPS, SPS, PPS and SEI NAL units
+    int arrays = p[22];
+    p += 23;
+    for (int i = 0; i < arrays; i++) {
+        if (end - p < 3) {
+            return false;
+        }
+        int count = be16(p + 1);
+        size_t n = appendparametersets(p + 3, end, count, csd0);
+        if (n == 0 && count) {
+            return false;
+        }
+        p += 3 + n;
+    }
+    return true;
+}
+
+size_t mp4demuxer::toannexb(const mp4span &sample, int lengthsize, uint8_t *dst,
+                            size_t capacity) {
+    const uint8_t *p = sample.data;
+    const uint8_t *end = p + sample.size;
+    size_t written = 0;
+    while (p < end) {
+        if (end - p < lengthsize) {
+            return 0;
+        }
+        uint32_t size = 0;
+        for (int i = 0; i < lengthsize; i++) {
+            size = (size << 8) | p[i];
+        }
+        p += lengthsize;
+        if ((size_t)(end - p) < size || capacity - written < 4 + (size_t)size) {
+            return 0;
+        }
+        dst[written] = dst[written + 1] = dst[written + 2] = 0;
+        dst[written + 3] = 1;
+        memcpy(dst + written + 4, p, size);
+        written += 4 + size;
+        p += size;
+    }
+    return written;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP4DEMUXER_H
+#define MP4DEMUXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Demuxer for ISO base media (MP4) files, without any Android dependency.
+//
+// The file is memory-mapped, and open() turns each track's sample tables
+// (stsz, stco/co64, stsc, stts, ctts, stss) into one flat array of samples,
+// so that getting a sample is an array lookup, and samples are pointers into
+// the mapping: nothing is read or copied until the caller touches the data.
+//
+// Fragmented files (moof) and edit lists aren't supported.
+
+#define MP4_FOURCC(a, b, c, d) \
+    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+struct mp4sample {
+    uint64_t offset;    // in the file
+    uint32_t size;
+    uint32_t sync;      // 1 for sync samples (key frames)
+    int64_t dts;        // in the track's timescale
+    int64_t pts;
+};
+
+struct mp4track {
+    uint32_t id;
+    uint32_t handler;           // 'vide', 'soun', ...
+    uint32_t codec;             // sample entry type: 'avc1', 'hvc1', 'mp4a', ...
+    uint32_t timescale;
+    int64_t durationus;
+    int width;                  // video only
+    int height;
+    std::vector<uint8_t> config;    // avcC, hvcC or esds payload
+    std::vector<mp4sample> samples;
+    std::vector<uint32_t> syncsamples;  // indices of sync samples, empty if all are
+};
+
+// a sample, in the mapped file
+struct mp4span {
+    const uint8_t *data;
+    size_t size;
+    int64_t ptsus;
+    int64_t dtsus;
+    bool sync;
+};
+
+class mp4demuxer {
+    public:
+        mp4demuxer();
+        mp4demuxer& operator=(const mp4demuxer& ) = delete;
+        mp4demuxer(mp4demuxer&) = delete;
+        ~mp4demuxer();
+
+        bool open(const char *path);
+        // maps length bytes of fd from offset, for files inside an APK. The
+        // fd can be closed after this.
+        bool open(int fd, int64_t offset, int64_t length);
+        void close();
+        // why open() failed
+        const char *error() const { return mError.c_str(); }
+
+        size_t trackcount() const { return mTracks.size(); }
+        const mp4track &track(size_t index) const { return mTracks[index]; }
+        // the first track with this handler type, or -1
+        int findtrack(uint32_t handler) const;
+
+        bool sample(size_t track, size_t index, mp4span *out) const;
+        // the sync sample a seek to timeus should start at: the last one at
+        // or before timeus, or the first one. O(log n).
+        size_t seeksync(size_t track, int64_t timeus) const;
+        // tells the kernel that samples [first, first + count) will be read
+        // soon, so it reads them ahead
+        void willneed(size_t track, size_t first, size_t count) const;
+
+        int64_t tous(const mp4track &track, int64_t time) const;
+
+        // Codec setup for AVC and HEVC, whose samples are NAL units with a
+        // length prefix while decoders want start codes ("Annex B").
+        // Gets the parameter sets with start codes: SPS in csd0 and PPS in
+        // csd1 for AVC, all of them in csd0 for HEVC. Returns false for other
+        // codecs.
+        static bool annexbconfig(const mp4track &track, std::vector<uint8_t> *csd0,
+                                 std::vector<uint8_t> *csd1);
+        // bytes of each NAL unit length prefix, 0 if not AVC or HEVC
+        static int nallengthsize(const mp4track &track);
+        // copies a sample to dst with start codes instead of length prefixes.
+        // Returns the size written, or 0 if it doesn't fit or is malformed.
+        static size_t toannexb(const mp4span &sample, int lengthsize, uint8_t *dst,
+                               size_t capacity);
+
+    private:
+        bool map(int fd, int64_t offset, int64_t length);
+        bool parse();
+        bool fail(const char *what);
+
+        void *mMapping;
+        size_t mMappingSize;
+        const uint8_t *mData;   // the file in the mapping
+        uint64_t mSize;
+        std::vector<mp4track> mTracks;
+        std::string mError;
+};
+
+#endif // MP4DEMUXER_H
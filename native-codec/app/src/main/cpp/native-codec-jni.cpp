@@ -35,7 +35,12 @@
 #include <errno.h>
 #include <limits.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "looper.h"
+#include "mp4demuxer.h"
+#include "playback.h"
 #include "media/NdkMediaCodec.h"
 #include "media/NdkMediaExtractor.h"
 
@@ -50,101 +55,183 @@
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
 
-typedef struct {
-    int fd;
-    ANativeWindow* window;
-    AMediaExtractor* ex;
-    AMediaCodec *codec;
-    int64_t renderstart;
-    bool sawInputEOS;
-    bool sawOutputEOS;
-    bool isPlaying;
-    bool renderonce;
-} workerdata;
+// the demuxer is asked to read this many samples ahead of the codec
+#define READAHEAD_SAMPLES 30
+
+// AMediaCodec fed from our mp4demuxer or from an AMediaExtractor, for the
+// playback loop. Nothing here waits for the codec.
+class ndkcodec: public codecadapter {
+    public:
+        // one of ex and demuxer
+        ndkcodec(AMediaCodec *codec, AMediaExtractor *ex, mp4demuxer *demuxer, int track)
+                : ex(ex), codec(codec), sawInputEOS(false), mDemuxer(demuxer), mTrack(track),
+                  mNext(0), mLengthSize(0) {
+            if (demuxer) {
+                mLengthSize = mp4demuxer::nallengthsize(demuxer->track(track));
+            }
+        }
 
-workerdata data = {-1, NULL, NULL, NULL, 0, false, false, false, false};
+        virtual bool feedinput();
+        virtual ssize_t dequeueoutput(int64_t *ptsus, bool *render, bool *eos);
+        virtual void releaseoutput(ssize_t index, bool render);
 
-enum {
-    kMsgCodecBuffer,
-    kMsgPause,
-    kMsgResume,
-    kMsgPauseAck,
-    kMsgDecodeDone,
-    kMsgSeek,
-};
+        // back to the start, after the codec was flushed
+        void rewind();
 
+        AMediaExtractor *ex;
+        AMediaCodec *codec;
+        bool sawInputEOS;
 
+    private:
+        ssize_t readsample(uint8_t *buf, size_t bufsize, int64_t *ptsus);
 
-class mylooper: public looper {
-    virtual void handle(int what, void* obj);
+        mp4demuxer *mDemuxer;
+        int mTrack;
+        size_t mNext;       // the next sample of mTrack
+        int mLengthSize;
 };
 
-static mylooper *mlooper = NULL;
+// copies the next sample into buf. Returns its size, or -1 at the end.
+ssize_t ndkcodec::readsample(uint8_t *buf, size_t bufsize, int64_t *ptsus) {
+    if (ex) {
+        ssize_t size = AMediaExtractor_readSampleData(ex, buf, bufsize);
+        *ptsus = AMediaExtractor_getSampleTime(ex);
+        AMediaExtractor_advance(ex);
+        return size;
+    }
 
-int64_t systemnanotime() {
-    timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    return now.tv_sec * 1000000000LL + now.tv_nsec;
+    mp4span span;
+    if (!mDemuxer->sample(mTrack, mNext, &span)) {
+        return -1;
+    }
+    if (mNext % READAHEAD_SAMPLES == 0) {
+        mDemuxer->willneed(mTrack, mNext + READAHEAD_SAMPLES, READAHEAD_SAMPLES);
+    }
+    mNext++;
+    *ptsus = span.ptsus;
+    // the sample is in the mapped file; this copy into the codec's buffer is
+    // the only one on the way to the decoder
+    size_t size = 0;
+    if (mLengthSize) {
+        size = mp4demuxer::toannexb(span, mLengthSize, buf, bufsize);
+    } else if (span.size <= bufsize) {
+        memcpy(buf, span.data, span.size);
+        size = span.size;
+    }
+    if (size == 0 && span.size != 0) {
+        LOGE("sample %zu (%zu bytes) doesn't fit a %zu byte buffer", mNext - 1, span.size,
+             bufsize);
+        return -1;
+    }
+    return (ssize_t)size;
 }
 
-void doCodecWork(workerdata *d) {
+bool ndkcodec::feedinput() {
+    if (sawInputEOS) {
+        return false;
+    }
+    ssize_t bufidx = AMediaCodec_dequeueInputBuffer(codec, 0);
+    if (bufidx < 0) {
+        return false;
+    }
+    LOGV("input buffer %zd", bufidx);
+    size_t bufsize;
+    auto buf = AMediaCodec_getInputBuffer(codec, bufidx, &bufsize);
+    int64_t presentationTimeUs = 0;
+    auto sampleSize = readsample(buf, bufsize, &presentationTimeUs);
+    if (sampleSize < 0) {
+        sampleSize = 0;
+        sawInputEOS = true;
+        LOGV("EOS");
+    }
 
-    ssize_t bufidx = -1;
-    if (!d->sawInputEOS) {
-        bufidx = AMediaCodec_dequeueInputBuffer(d->codec, 2000);
-        LOGV("input buffer %zd", bufidx);
-        if (bufidx >= 0) {
-            size_t bufsize;
-            auto buf = AMediaCodec_getInputBuffer(d->codec, bufidx, &bufsize);
-            auto sampleSize = AMediaExtractor_readSampleData(d->ex, buf, bufsize);
-            if (sampleSize < 0) {
-                sampleSize = 0;
-                d->sawInputEOS = true;
-                LOGV("EOS");
-            }
-            auto presentationTimeUs = AMediaExtractor_getSampleTime(d->ex);
+    AMediaCodec_queueInputBuffer(codec, bufidx, 0, sampleSize, presentationTimeUs,
+            sawInputEOS ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0);
+    return true;
+}
 
-            AMediaCodec_queueInputBuffer(d->codec, bufidx, 0, sampleSize, presentationTimeUs,
-                    d->sawInputEOS ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0);
-            AMediaExtractor_advance(d->ex);
-        }
+void ndkcodec::rewind() {
+    if (ex) {
+        AMediaExtractor_seekTo(ex, 0, AMEDIAEXTRACTOR_SEEK_NEXT_SYNC);
+    } else {
+        mNext = mDemuxer->seeksync(mTrack, 0);
     }
+    sawInputEOS = false;
+}
 
-    if (!d->sawOutputEOS) {
+ssize_t ndkcodec::dequeueoutput(int64_t *ptsus, bool *render, bool *eos) {
+    while (true) {
         AMediaCodecBufferInfo info;
-        auto status = AMediaCodec_dequeueOutputBuffer(d->codec, &info, 0);
+        auto status = AMediaCodec_dequeueOutputBuffer(codec, &info, 0);
         if (status >= 0) {
             if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
                 LOGV("output EOS");
-                d->sawOutputEOS = true;
-            }
-            int64_t presentationNano = info.presentationTimeUs * 1000;
-            if (d->renderstart < 0) {
-                d->renderstart = systemnanotime() - presentationNano;
-            }
-            int64_t delay = (d->renderstart + presentationNano) - systemnanotime();
-            if (delay > 0) {
-                usleep(delay / 1000);
-            }
-            AMediaCodec_releaseOutputBuffer(d->codec, status, info.size != 0);
-            if (d->renderonce) {
-                d->renderonce = false;
-                return;
+                *eos = true;
             }
+            *ptsus = info.presentationTimeUs;
+            *render = info.size != 0;
+            return status;
         } else if (status == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
             LOGV("output buffers changed");
         } else if (status == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
-            auto format = AMediaCodec_getOutputFormat(d->codec);
+            auto format = AMediaCodec_getOutputFormat(codec);
             LOGV("format changed to: %s", AMediaFormat_toString(format));
             AMediaFormat_delete(format);
         } else if (status == AMEDIACODEC_INFO_TRY_AGAIN_LATER) {
             LOGV("no output buffer right now");
+            return -1;
         } else {
             LOGV("unexpected info code: %zd", status);
+            return -1;
         }
     }
+}
+
+void ndkcodec::releaseoutput(ssize_t index, bool render) {
+    AMediaCodec_releaseOutputBuffer(codec, index, render);
+}
+
+typedef struct {
+    int fd;
+    ANativeWindow* window;
+    AMediaExtractor* ex;
+    mp4demuxer *demuxer;
+    AMediaCodec *codec;
+    ndkcodec *source;
+    playback *player;
+    bool isPlaying;
+} workerdata;
+
+workerdata data = {-1, NULL, NULL, NULL, NULL, NULL, NULL, false};
 
-    if (!d->sawInputEOS || !d->sawOutputEOS) {
+enum {
+    kMsgCodecBuffer,
+    kMsgPause,
+    kMsgResume,
+    kMsgPauseAck,
+    kMsgDecodeDone,
+    kMsgSeek,
+};
+
+
+
+class mylooper: public looper {
+    virtual void handle(int what, void* obj);
+};
+
+static mylooper *mlooper = NULL;
+
+// the playback loop never waits: it says when it wants to run again, and
+// the looper handles other messages in the meantime
+void doCodecWork(workerdata *d) {
+    int64_t next = d->player->work();
+    if (next < 0) {
+        return;
+    }
+    int64_t delay = next - looper::nowus();
+    if (delay > 0) {
+        mlooper->postdelayed(kMsgCodecBuffer, d, delay);
+    } else {
         mlooper->post(kMsgCodecBuffer, d);
     }
 }
@@ -158,24 +245,31 @@ void mylooper::handle(int what, void* obj) {
         case kMsgDecodeDone:
         {
             workerdata *d = (workerdata*)obj;
+            d->player->flush();
             AMediaCodec_stop(d->codec);
             AMediaCodec_delete(d->codec);
-            AMediaExtractor_delete(d->ex);
-            d->sawInputEOS = true;
-            d->sawOutputEOS = true;
+            if (d->ex) {
+                AMediaExtractor_delete(d->ex);
+            }
+            delete d->demuxer;
+            delete d->player;
+            delete d->source;
+            d->player = NULL;
+            d->source = NULL;
+            d->ex = NULL;
+            d->demuxer = NULL;
         }
         break;
 
         case kMsgSeek:
         {
             workerdata *d = (workerdata*)obj;
-            AMediaExtractor_seekTo(d->ex, 0, AMEDIAEXTRACTOR_SEEK_NEXT_SYNC);
+            d->source->rewind();
+            // flushing the codec takes back the frames waiting to be shown
+            d->player->flush();
             AMediaCodec_flush(d->codec);
-            d->renderstart = -1;
-            d->sawInputEOS = false;
-            d->sawOutputEOS = false;
             if (!d->isPlaying) {
-                d->renderonce = true;
+                d->player->renderonce();
                 post(kMsgCodecBuffer, d);
             }
             LOGV("seeked");
@@ -188,6 +282,7 @@ void mylooper::handle(int what, void* obj) {
             if (d->isPlaying) {
                 // flush all outstanding codecbuffer messages with a no-op message
                 d->isPlaying = false;
+                d->player->pause();
                 post(kMsgPauseAck, NULL, true);
             }
         }
@@ -197,8 +292,8 @@ void mylooper::handle(int what, void* obj) {
         {
             workerdata *d = (workerdata*)obj;
             if (!d->isPlaying) {
-                d->renderstart = -1;
                 d->isPlaying = true;
+                d->player->resume();
                 post(kMsgCodecBuffer, d);
             }
         }
@@ -209,31 +304,8 @@ void mylooper::handle(int what, void* obj) {
 
 
 
-extern "C" {
-
-jboolean Java_com_example_nativecodec_NativeCodec_createStreamingMediaPlayer(JNIEnv* env,
-        jclass clazz, jobject assetMgr, jstring filename)
-{
-    LOGV("@@@ create");
-
-    // convert Java string to UTF-8
-    const char *utf8 = env->GetStringUTFChars(filename, NULL);
-    LOGV("opening %s", utf8);
-
-    off_t outStart, outLen;
-    int fd = AAsset_openFileDescriptor(AAssetManager_open(AAssetManager_fromJava(env, assetMgr), utf8, 0),
-                                       &outStart, &outLen);
-
-    env->ReleaseStringUTFChars(filename, utf8);
-    if (fd < 0) {
-        LOGE("failed to open file: %s %d (%s)", utf8, fd, strerror(errno));
-        return JNI_FALSE;
-    }
-
-    data.fd = fd;
-
-    workerdata *d = &data;
-
+// sets up d from an AMediaExtractor on d->fd, and closes it
+static bool openextractor(workerdata *d, off_t outStart, off_t outLen) {
     AMediaExtractor *ex = AMediaExtractor_new();
     media_status_t err = AMediaExtractor_setDataSourceFd(ex, d->fd,
                                                          static_cast<off64_t>(outStart),
@@ -241,7 +313,7 @@ jboolean Java_com_example_nativecodec_NativeCodec_createStreamingMediaPlayer(JNI
     close(d->fd);
     if (err != AMEDIA_OK) {
         LOGV("setDataSource error: %d", err);
-        return JNI_FALSE;
+        return false;
     }
 
     int numtracks = AMediaExtractor_getTrackCount(ex);
@@ -256,7 +328,7 @@ jboolean Java_com_example_nativecodec_NativeCodec_createStreamingMediaPlayer(JNI
         const char *mime;
         if (!AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime)) {
             LOGV("no mime type");
-            return JNI_FALSE;
+            return false;
         } else if (!strncmp(mime, "video/", 6)) {
             // Omitting most error handling for clarity.
             // Production code should check for errors.
@@ -265,15 +337,115 @@ jboolean Java_com_example_nativecodec_NativeCodec_createStreamingMediaPlayer(JNI
             AMediaCodec_configure(codec, format, d->window, NULL, 0);
             d->ex = ex;
             d->codec = codec;
-            d->renderstart = -1;
-            d->sawInputEOS = false;
-            d->sawOutputEOS = false;
+            d->source = new ndkcodec(codec, ex, NULL, -1);
+            d->player = new playback(d->source);
             d->isPlaying = false;
-            d->renderonce = true;
+            d->player->renderonce();
             AMediaCodec_start(codec);
         }
         AMediaFormat_delete(format);
     }
+    return true;
+}
+
+// the first AVC or HEVC video track, or -1
+static int findvideotrack(const mp4demuxer *demuxer) {
+    for (size_t i = 0; i < demuxer->trackcount(); i++) {
+        const mp4track &track = demuxer->track(i);
+        if (track.handler == MP4_FOURCC('v', 'i', 'd', 'e') &&
+                mp4demuxer::nallengthsize(track) != 0 && !track.samples.empty()) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// what AMediaExtractor_getTrackFormat() would say about the track
+static AMediaFormat *trackformat(const mp4track &track) {
+    AMediaFormat *format = AMediaFormat_new();
+    bool avc = track.codec == MP4_FOURCC('a', 'v', 'c', '1') ||
+            track.codec == MP4_FOURCC('a', 'v', 'c', '3');
+    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, avc ? "video/avc" : "video/hevc");
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, track.width);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, track.height);
+    AMediaFormat_setInt64(format, AMEDIAFORMAT_KEY_DURATION, track.durationus);
+
+    // samples grow a little when length prefixes shorter than start codes are
+    // replaced
+    uint32_t maxsize = 0;
+    for (size_t i = 0; i < track.samples.size(); i++) {
+        maxsize = std::max(maxsize, track.samples[i].size);
+    }
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_MAX_INPUT_SIZE,
+                          (int32_t)(maxsize + maxsize / 2 + 1024));
+
+    std::vector<uint8_t> csd0, csd1;
+    mp4demuxer::annexbconfig(track, &csd0, &csd1);
+    if (!csd0.empty()) {
+        AMediaFormat_setBuffer(format, "csd-0", &csd0[0], csd0.size());
+    }
+    if (!csd1.empty()) {
+        AMediaFormat_setBuffer(format, "csd-1", &csd1[0], csd1.size());
+    }
+    return format;
+}
+
+extern "C" {
+
+jboolean Java_com_example_nativecodec_NativeCodec_createStreamingMediaPlayer(JNIEnv* env,
+        jclass clazz, jobject assetMgr, jstring filename)
+{
+    LOGV("@@@ create");
+
+    // convert Java string to UTF-8
+    const char *utf8 = env->GetStringUTFChars(filename, NULL);
+    LOGV("opening %s", utf8);
+
+    off_t outStart, outLen;
+    int fd = AAsset_openFileDescriptor(AAssetManager_open(AAssetManager_fromJava(env, assetMgr), utf8, 0),
+                                       &outStart, &outLen);
+
+    env->ReleaseStringUTFChars(filename, utf8);
+    if (fd < 0) {
+        LOGE("failed to open file: %s %d (%s)", utf8, fd, strerror(errno));
+        return JNI_FALSE;
+    }
+
+    data.fd = fd;
+
+    workerdata *d = &data;
+
+    // MP4 files are demuxed here, from a mapping of the file; anything else
+    // goes through AMediaExtractor
+    mp4demuxer *demuxer = new mp4demuxer();
+    int track = -1;
+    if (demuxer->open(d->fd, outStart, outLen)) {
+        track = findvideotrack(demuxer);
+    } else {
+        LOGV("not demuxing it ourselves: %s", demuxer->error());
+    }
+    if (track >= 0) {
+        close(d->fd);
+        AMediaFormat *format = trackformat(demuxer->track(track));
+        LOGV("track %d format: %s", track, AMediaFormat_toString(format));
+        const char *mime;
+        AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime);
+        AMediaCodec *codec = AMediaCodec_createDecoderByType(mime);
+        AMediaCodec_configure(codec, format, d->window, NULL, 0);
+        AMediaFormat_delete(format);
+        d->demuxer = demuxer;
+        d->codec = codec;
+        d->source = new ndkcodec(codec, NULL, demuxer, track);
+        d->player = new playback(d->source);
+        d->isPlaying = false;
+        d->player->renderonce();
+        AMediaCodec_start(codec);
+    } else {
+        delete demuxer;
+        if (!openextractor(d, outStart, outLen)) {
+            return JNI_FALSE;
+        }
+    }
 
     mlooper = new mylooper();
     mlooper->post(kMsgCodecBuffer, d);
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host test of the media clock and the playback loop, against a mock codec
+ * whose frames are ready at scripted times. Time is simulated: the loop jumps
+ * straight to the time playback::work() asks to run again at.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "mediaclock.h"
+#include "playback.h"
+
+static int sFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+        sFailures++; \
+    } \
+} while (0)
+
+static int64_t sNow = 0;
+
+static int64_t fakenow() {
+    return sNow;
+}
+
+#define FRAME_US 33333
+
+struct scriptedframe {
+    int64_t ptsus;
+    int64_t readyus;    // when the codec has it decoded
+};
+
+struct releasedframe {
+    int64_t ptsus;
+    int64_t atus;
+    bool render;
+};
+
+// Decodes the script in order. Like a real codec it has a few input and
+// output buffers, so it only takes input a bit ahead of its output.
+class mockcodec: public codecadapter {
+    public:
+        explicit mockcodec(const std::vector<scriptedframe> &script)
+                : mScript(script), mFed(0), mOutput(0), mHeld(0), mEOSQueued(false) {
+            mHeldIndex.resize(script.size(), false);
+        }
+
+        virtual bool feedinput() {
+            if (mEOSQueued || mFed - mOutput >= 4) {
+                return false;
+            }
+            if (mFed == mScript.size()) {
+                mEOSQueued = true;
+            } else {
+                mFed++;
+            }
+            return true;
+        }
+
+        virtual ssize_t dequeueoutput(int64_t *ptsus, bool *render, bool *eos) {
+            if (mOutput >= mFed || mHeld >= 6 || mScript[mOutput].readyus > sNow) {
+                return -1;
+            }
+            *ptsus = mScript[mOutput].ptsus;
+            *render = true;
+            *eos = mEOSQueued && mOutput + 1 == mScript.size();
+            mHeld++;
+            mHeldIndex[mOutput] = true;
+            return (ssize_t)mOutput++;
+        }
+
+        virtual void releaseoutput(ssize_t index, bool render) {
+            CHECK(index >= 0 && (size_t)index < mScript.size() && mHeldIndex[index]);
+            mHeldIndex[index] = false;
+            mHeld--;
+            releasedframe r = { mScript[index].ptsus, sNow, render };
+            released.push_back(r);
+        }
+
+        std::vector<releasedframe> released;
+
+    private:
+        std::vector<scriptedframe> mScript;
+        std::vector<bool> mHeldIndex;
+        size_t mFed;
+        size_t mOutput;
+        int mHeld;
+        bool mEOSQueued;
+};
+
+// frames every FRAME_US, each decoded lead us before it's due when playback
+// starts at start
+static std::vector<scriptedframe> steadyscript(int count, int64_t start, int64_t lead) {
+    std::vector<scriptedframe> script(count);
+    for (int i = 0; i < count; i++) {
+        script[i].ptsus = i * FRAME_US;
+        script[i].readyus = start + i * FRAME_US - lead;
+    }
+    return script;
+}
+
+// runs p until it's done or until the time until, whichever is first
+static void run(playback *p, int64_t until) {
+    int steps = 0;
+    while (sNow < until && !p->done()) {
+        int64_t next = p->work();
+        if (next < 0) {
+            break;
+        }
+        CHECK(next >= sNow);
+        sNow = next < until ? next : until;
+        CHECK(++steps < 1000000);
+    }
+}
+
+static std::vector<releasedframe> rendered(const mockcodec &codec) {
+    std::vector<releasedframe> out;
+    for (size_t i = 0; i < codec.released.size(); i++) {
+        if (codec.released[i].render) {
+            out.push_back(codec.released[i]);
+        }
+    }
+    return out;
+}
+
+static void teststeady() {
+    sNow = 0;
+    mockcodec codec(steadyscript(90, 0, 20000));
+    playback p(&codec, fakenow);
+    p.resume();
+    run(&p, 10000000);
+
+    std::vector<releasedframe> r = rendered(codec);
+    CHECK(p.done());
+    CHECK(r.size() == 90);
+    CHECK(p.stats().dropped == 0);
+    CHECK(p.stats().repeated == 0);
+    for (size_t i = 0; i < r.size(); i++) {
+        // every frame on time, to the microsecond
+        CHECK(r[i].atus - r[0].atus == r[i].ptsus - r[0].ptsus);
+    }
+    printf("steady: %d rendered, max late %lld us\n", p.stats().rendered,
+           (long long)p.stats().maxlateus);
+}
+
+static void teststall() {
+    sNow = 0;
+    std::vector<scriptedframe> script = steadyscript(90, 0, 20000);
+    // frames 30 to 35 come out of the decoder 150 ms late
+    for (int i = 30; i <= 35; i++) {
+        script[i].readyus = 30 * FRAME_US + 150000;
+    }
+    mockcodec codec(script);
+    playback p(&codec, fakenow);
+    p.resume();
+    run(&p, 10000000);
+
+    std::vector<releasedframe> r = rendered(codec);
+    CHECK(p.done());
+    CHECK(codec.released.size() == 90);
+    CHECK(p.stats().dropped > 0);
+    CHECK(p.stats().repeated > 0);
+    CHECK(p.stats().rendered + p.stats().dropped == 90);
+    for (size_t i = 1; i < r.size(); i++) {
+        CHECK(r[i].ptsus > r[i - 1].ptsus);
+        CHECK(r[i].atus >= r[i - 1].atus);
+    }
+    // back on time once the decoder caught up
+    int64_t offset = r.back().atus - r.back().ptsus;
+    for (size_t i = 0; i < r.size(); i++) {
+        if (r[i].ptsus >= 40 * FRAME_US) {
+            CHECK(r[i].atus - r[i].ptsus == offset);
+        }
+    }
+    printf("stall: %d rendered, %d dropped, %d repeated, max late %lld us\n",
+           p.stats().rendered, p.stats().dropped, p.stats().repeated,
+           (long long)p.stats().maxlateus);
+}
+
+static void testreordered() {
+    sNow = 0;
+    std::vector<scriptedframe> script = steadyscript(30, 0, 100000);
+    // B-frame like output order: 0 2 1 3 5 4 ...
+    for (int i = 1; i + 1 < 30; i += 3) {
+        int64_t pts = script[i].ptsus;
+        script[i].ptsus = script[i + 1].ptsus;
+        script[i + 1].ptsus = pts;
+    }
+    mockcodec codec(script);
+    playback p(&codec, fakenow);
+    p.resume();
+    run(&p, 10000000);
+
+    std::vector<releasedframe> r = rendered(codec);
+    CHECK(r.size() == 30);
+    for (size_t i = 1; i < r.size(); i++) {
+        CHECK(r[i].ptsus > r[i - 1].ptsus);
+    }
+    printf("reordered: %d rendered in order\n", (int)r.size());
+}
+
+static void testpause() {
+    sNow = 0;
+    mockcodec codec(steadyscript(60, 0, 20000));
+    playback p(&codec, fakenow);
+    p.resume();
+    run(&p, 1000000);
+    p.pause();
+    size_t renderedbefore = rendered(codec).size();
+    CHECK(p.work() == -1);
+    sNow += 500000;
+    p.resume();
+    run(&p, 10000000);
+
+    std::vector<releasedframe> r = rendered(codec);
+    CHECK(r.size() == 60);
+    CHECK(p.stats().dropped == 0);
+    CHECK(p.stats().repeated == 0);
+    for (size_t i = 1; i < r.size(); i++) {
+        int64_t gap = r[i].atus - r[i - 1].atus;
+        CHECK(gap == FRAME_US || (i == renderedbefore && gap > 500000));
+    }
+    printf("pause: %d rendered before the pause, %d after\n", (int)renderedbefore,
+           (int)(r.size() - renderedbefore));
+}
+
+static void testrenderonce() {
+    sNow = 0;
+    mockcodec codec(steadyscript(10, 30000, 0));
+    playback p(&codec, fakenow);
+    p.renderonce();
+    run(&p, 1000000);
+    CHECK(rendered(codec).size() == 1);
+    CHECK(p.work() == -1);
+}
+
+static void testclock() {
+    sNow = 1000000;
+    mediaclock clock(fakenow);
+    CHECK(clock.systemtimeof(0) == INT64_MAX);
+    clock.start(5000000);
+    sNow += 100000;
+    CHECK(clock.mediatime() == 5100000);
+
+    // small errors are slewed away smoothly
+    clock.sync(clock.mediatime() + 20000);
+    CHECK(clock.rate(sNow) > 1.0 && clock.rate(sNow) <= 1.05);
+    int64_t last = clock.mediatime();
+    int64_t master = last + 20000;
+    for (int i = 0; i < 100; i++) {
+        sNow += 10000;
+        master += 10000;
+        int64_t t = clock.mediatime();
+        CHECK(t - last >= 10000 && t - last <= 10500);
+        last = t;
+    }
+    CHECK(llabs(clock.mediatime() - master) <= 1);
+    CHECK(clock.rate(sNow) == 1.0);
+
+    // systemtimeof() is the inverse of mediatimeat(), also while slewing
+    clock.sync(clock.mediatime() - 30000);
+    CHECK(clock.rate(sNow) < 1.0);
+    for (int64_t m = clock.mediatime(); m < clock.mediatime() + 2000000; m += 77777) {
+        CHECK(llabs(clock.mediatimeat(clock.systemtimeof(m)) - m) <= 1);
+    }
+
+    // big errors are jumped
+    clock.sync(clock.mediatime() + 500000);
+    int64_t jumped = clock.mediatime();
+    sNow += 1000;
+    CHECK(clock.mediatime() == jumped + 1000);
+
+    clock.pause();
+    int64_t paused = clock.mediatime();
+    sNow += 300000;
+    CHECK(clock.mediatime() == paused);
+    CHECK(clock.systemtimeof(paused + 1) == INT64_MAX);
+    clock.resume();
+    sNow += 1000;
+    CHECK(clock.mediatime() == paused + 1000);
+}
+
+int main() {
+    testclock();
+    teststeady();
+    teststall();
+    testreordered();
+    testpause();
+    testrenderonce();
+    if (sFailures) {
+        fprintf(stderr, "%d checks failed\n", sFailures);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "playback.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// a frame this late is dropped, unless nothing was shown for as long
+#define MAX_LATE_US 40000
+// decoded frames held back at most. Codecs only have a few output buffers,
+// and the ones held here can't be decoded into.
+#define MAX_QUEUED_FRAMES 3
+// input samples queued per work() at most, so output gets its turn
+#define MAX_INPUTS_PER_WORK 4
+// AMediaCodec can't say when it has a buffer before API 28, so a codec that
+// has none is asked again after this long
+#define CODEC_POLL_US 5000
+
+static bool framelater(const outputframe &a, const outputframe &b) {
+    return a.ptsus > b.ptsus;
+}
+
+framescheduler::framescheduler(int64_t maxlateus)
+        : mMaxLate(maxlateus), mLastRenderAt(-1), mLastPushedPts(-1), mFrameInterval(0) {
+    memset(&mStats, 0, sizeof(mStats));
+    mFrames.reserve(MAX_QUEUED_FRAMES);
+}
+
+void framescheduler::push(const outputframe &frame) {
+    if (mLastPushedPts >= 0 && frame.ptsus > mLastPushedPts) {
+        int64_t interval = frame.ptsus - mLastPushedPts;
+        if (mFrameInterval == 0 || interval < mFrameInterval) {
+            mFrameInterval = interval;
+        }
+    }
+    mLastPushedPts = frame.ptsus;
+    mFrames.push_back(frame);
+    std::push_heap(mFrames.begin(), mFrames.end(), framelater);
+}
+
+outputframe framescheduler::pop() {
+    std::pop_heap(mFrames.begin(), mFrames.end(), framelater);
+    outputframe frame = mFrames.back();
+    mFrames.pop_back();
+    return frame;
+}
+
+void framescheduler::clear() {
+    mFrames.clear();
+    mLastRenderAt = -1;
+    mLastPushedPts = -1;
+}
+
+void framescheduler::drop(const outputframe &frame, codecadapter *codec) {
+    codec->releaseoutput(frame.index, false);
+    if (frame.render) {
+        mStats.dropped++;
+    }
+}
+
+void framescheduler::render(const outputframe &frame, int64_t dueus, int64_t nowus,
+                            codecadapter *codec) {
+    codec->releaseoutput(frame.index, frame.render);
+    if (!frame.render) {
+        return;
+    }
+    mStats.rendered++;
+    if (nowus - dueus > mStats.maxlateus) {
+        mStats.maxlateus = nowus - dueus;
+    }
+    if (mLastRenderAt >= 0 && mFrameInterval > 0) {
+        int64_t intervals = (nowus - mLastRenderAt + mFrameInterval / 2) / mFrameInterval;
+        if (intervals > 1) {
+            mStats.repeated += (int)(intervals - 1);
+        }
+    }
+    mLastRenderAt = nowus;
+}
+
+int64_t framescheduler::service(const mediaclock &clock, codecadapter *codec) {
+    int64_t now = clock.now();
+    while (!mFrames.empty()) {
+        int64_t due = clock.systemtimeof(mFrames.front().ptsus);
+        if (due > now) {
+            return due;
+        }
+        outputframe frame = pop();
+        if (!mFrames.empty() && clock.systemtimeof(mFrames.front().ptsus) <= now) {
+            // a newer frame is due too
+            drop(frame, codec);
+        } else if (now - due > mMaxLate && mLastRenderAt >= 0 && now - mLastRenderAt < mMaxLate) {
+            drop(frame, codec);
+        } else {
+            render(frame, due, now, codec);
+        }
+    }
+    return INT64_MAX;
+}
+
+bool framescheduler::renderfirst(const mediaclock &clock, codecadapter *codec) {
+    if (mFrames.empty()) {
+        return false;
+    }
+    int64_t now = clock.now();
+    render(pop(), now, now, codec);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+playback::playback(codecadapter *codec, mediaclock::timesource now)
+        : mCodec(codec), mClock(now), mScheduler(MAX_LATE_US),
+          mPlaying(false), mRenderOnce(false), mSawOutputEOS(false) {
+}
+
+void playback::resume() {
+    if (!mPlaying) {
+        mPlaying = true;
+        mClock.resume();
+        mScheduler.forgetlast();
+    }
+}
+
+void playback::pause() {
+    if (mPlaying) {
+        mPlaying = false;
+        mClock.pause();
+    }
+}
+
+void playback::flush() {
+    mScheduler.clear();
+    mClock.reset();
+    mSawOutputEOS = false;
+}
+
+int64_t playback::work() {
+    if (!mPlaying && !mRenderOnce) {
+        return -1;
+    }
+
+    bool progress = false;
+    for (int i = 0; i < MAX_INPUTS_PER_WORK && mCodec->feedinput(); i++) {
+        progress = true;
+    }
+    while (!mSawOutputEOS && mScheduler.size() < MAX_QUEUED_FRAMES) {
+        outputframe frame;
+        bool eos = false;
+        frame.index = mCodec->dequeueoutput(&frame.ptsus, &frame.render, &eos);
+        if (frame.index < 0) {
+            break;
+        }
+        mSawOutputEOS = eos;
+        mScheduler.push(frame);
+        progress = true;
+    }
+
+    int64_t now = mClock.now();
+    if (mRenderOnce) {
+        if (mScheduler.renderfirst(mClock, mCodec)) {
+            mRenderOnce = false;
+            if (!mPlaying) {
+                return -1;
+            }
+        } else {
+            return progress ? now : now + CODEC_POLL_US;
+        }
+    }
+
+    // the clock starts with the first frame after a start or a seek
+    if (!mClock.isstarted() && mScheduler.size() > 0) {
+        mClock.start(mScheduler.firstpts());
+    }
+
+    size_t queued = mScheduler.size();
+    int64_t due = mScheduler.service(mClock, mCodec);
+    if (done()) {
+        return -1;
+    }
+    // releasing buffers lets the codec decode into them
+    if (progress || mScheduler.size() < queued) {
+        return now;
+    }
+    int64_t poll = now + CODEC_POLL_US;
+    return due < poll ? due : poll;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include "mediaclock.h"
+
+// What the playback loop needs from a decoder. None of these may block.
+// The app wraps AMediaCodec and AMediaExtractor in one; tests use a mock.
+class codecadapter {
+    public:
+        virtual ~codecadapter() {}
+
+        // queues one input sample, or the end of stream, if the codec has a
+        // free input buffer. Returns false if nothing was queued.
+        virtual bool feedinput() = 0;
+        // returns the index of a decoded buffer and fills in its presentation
+        // time, whether it has anything to render, and whether it's the last
+        // one. Returns -1 if no buffer is ready.
+        virtual ssize_t dequeueoutput(int64_t *ptsus, bool *render, bool *eos) = 0;
+        virtual void releaseoutput(ssize_t index, bool render) = 0;
+};
+
+struct outputframe {
+    ssize_t index;
+    int64_t ptsus;
+    bool render;
+};
+
+struct playbackstats {
+    int rendered;
+    int dropped;        // decoded, but released without rendering
+    int repeated;       // frame intervals for which the last frame stayed up
+    int64_t maxlateus;  // latest a rendered frame was, against its due time
+};
+
+// Decoded frames waiting for their time, earliest first. A frame is due when
+// the clock reaches its presentation time.
+//
+// Of the frames that are due, only the newest is rendered, and the others are
+// dropped. A frame that is more than maxlateus late is dropped too, unless
+// nothing was rendered for maxlateus, so a decoder that can't keep up still
+// shows some frames. When a frame comes later than one frame interval after
+// the previous one, the previous one was repeated.
+class framescheduler {
+    public:
+        explicit framescheduler(int64_t maxlateus);
+
+        void push(const outputframe &frame);
+        size_t size() const { return mFrames.size(); }
+        // forgets the frames without releasing them, for when the codec is
+        // flushed
+        void clear();
+        // the earliest frame's presentation time; there must be one
+        int64_t firstpts() const { return mFrames.front().ptsus; }
+        // the next frame doesn't repeat the last one, after a pause
+        void forgetlast() { mLastRenderAt = -1; }
+
+        // releases the frames that are due. Returns the system time the next
+        // frame is due, or INT64_MAX.
+        int64_t service(const mediaclock &clock, codecadapter *codec);
+        // releases the earliest frame whatever its time, if there is one
+        bool renderfirst(const mediaclock &clock, codecadapter *codec);
+
+        const playbackstats &stats() const { return mStats; }
+
+    private:
+        void render(const outputframe &frame, int64_t dueus, int64_t nowus,
+                    codecadapter *codec);
+        void drop(const outputframe &frame, codecadapter *codec);
+        outputframe pop();
+
+        std::vector<outputframe> mFrames;
+        int64_t mMaxLate;
+        int64_t mLastRenderAt;
+        int64_t mLastPushedPts;
+        int64_t mFrameInterval;     // shortest time between frames seen
+        playbackstats mStats;
+};
+
+// The decode loop, one step at a time: feeds the codec, collects its output
+// into a framescheduler and renders the frames on time. Nothing in here
+// waits; work() says when it wants to run again, and the caller arranges for
+// that (with looper::postdelayed() in the app).
+class playback {
+    public:
+        playback(codecadapter *codec, mediaclock::timesource now = NULL);
+
+        // does what can be done now. Returns the system time to call again
+        // at, which may be now, or -1 when there is nothing left to do until
+        // the next resume(), seek or renderonce().
+        int64_t work();
+
+        // the clock starts from the next frame
+        void resume();
+        void pause();
+        // shows the next frame even though paused, then stops
+        void renderonce() { mRenderOnce = true; }
+        // forgets all the frames and starts over, after the codec was flushed
+        void flush();
+
+        bool isplaying() const { return mPlaying; }
+        bool done() const { return mSawOutputEOS && mScheduler.size() == 0; }
+        mediaclock &clock() { return mClock; }
+        const playbackstats &stats() const { return mScheduler.stats(); }
+
+    private:
+        codecadapter *mCodec;
+        mediaclock mClock;
+        framescheduler mScheduler;
+        bool mPlaying;
+        bool mRenderOnce;
+        bool mSawOutputEOS;
+};
+
+#endif // PLAYBACK_H
@@ -42,6 +42,8 @@
 #include <android/native_window_jni.h>
 #include <android/asset_manager_jni.h>
 #include "android_fopen.h"
+#include "stream_source.h"
+#include "ts_demux.h"
 
 // engine interfaces
 static XAObjectItf engineObject = NULL;
@@ -75,22 +77,37 @@ static ANativeWindow* theNativeWindow;
 // determines how much memory we're dedicating to memory caching
 #define BUFFER_SIZE (PACKETS_PER_BUFFER*MPEG2_TS_PACKET_SIZE)
 
-// where we cache in memory the data to play
-// note this memory is re-used by the buffer queue callback
-static char dataCache[BUFFER_SIZE * NB_BUFFERS];
+// number of buffers read ahead of those in the buffer queue, an arbitrary number
+#define NB_READ_AHEAD_BUFFERS 32
 
-// handle of the file to play
-static FILE *file;
+// reads the file to play ahead of the player, on a thread of its own, so the
+// buffer queue callback only hands over buffers that are already filled
+static stream_source *source = NULL;
+
+// buffer queue slots left empty because their buffer wasn't read yet; the
+// source's on_ready callback fills them
+static int pendingBuffers = 0;
 static jobject android_java_asset_manager = NULL;
 
 // has the app reached the end of the file
 static jboolean reachedEof = JNI_FALSE;
 
+// looks into the data on its way to the player, for the streams and their timing
+static ts_demux *demux = NULL;
+
+// the streams seen so far
+#define MAX_STREAMS 8
+static uint16_t streamPids[MAX_STREAMS];
+static int numStreams = 0;
+
+// presentation time of the last video PES read, in 90 kHz units
+static int64_t lastVideoPts = TS_NO_TIMESTAMP;
+
 // constant to identify a buffer context which is the end of the stream to decode
 static const int kEosBufferCntxt = 1980; // a magic value we can compare against
 
 // For mutual exclusion between callback thread and application thread(s).
-// The mutex protects reachedEof, discontinuity,
+// The mutex protects reachedEof, discontinuity, pendingBuffers,
 // The condition is signalled when a discontinuity is acknowledged.
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -99,7 +116,95 @@ static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 // whether a discontinuity is in progress
 static jboolean discontinuity = JNI_FALSE;
 
-static jboolean enqueueInitialBuffers(jboolean discontinuity);
+
+// ts_demux callback, for each PES packet in the data read
+static void onPes(void *context, const ts_pes *pes)
+{
+    int i;
+    for (i = 0; i < numStreams && streamPids[i] != pes->pid; i++) {
+    }
+    if (i == numStreams && numStreams < MAX_STREAMS) {
+        streamPids[numStreams++] = pes->pid;
+        LOGV("Found stream on PID 0x%x of program %u: type 0x%02x, stream id 0x%02x",
+                pes->pid, pes->program, pes->stream_type, pes->stream_id);
+    }
+    if (pes->corrupt) {
+        LOGV("PES on PID 0x%x lost packets", pes->pid);
+    }
+    if ((pes->stream_id & 0xf0) == 0xe0 && pes->pts != TS_NO_TIMESTAMP) {
+        lastVideoPts = pes->pts;
+    }
+}
+
+// Enqueue a buffer read by the source, with a discontinuity indicator if it's the first after
+// a seek
+static void enqueueBuffer(stream_buffer *buffer)
+{
+    XAresult res;
+    ts_demux_feed(demux, buffer->data, buffer->size);
+    if (buffer->discontinuity) {
+        // signal discontinuity
+        XAAndroidBufferItem items[1];
+        items[0].itemKey = XA_ANDROID_ITEMKEY_DISCONTINUITY;
+        items[0].itemSize = 0;
+        // DISCONTINUITY message has no parameters,
+        //   so the total size of the message is the size of the key
+        //   plus the size if itemSize, both XAuint32
+        res = (*playerBQItf)->Enqueue(playerBQItf, buffer /*pBufferContext*/,
+                buffer->data, buffer->size, items /*pMsg*/,
+                sizeof(XAuint32)*2 /*msgLength*/);
+    } else {
+        res = (*playerBQItf)->Enqueue(playerBQItf, buffer /*pBufferContext*/,
+                buffer->data, buffer->size, NULL, 0);
+    }
+    assert(XA_RESULT_SUCCESS == res);
+}
+
+// Fill the empty buffer queue slots with the buffers the source has already read, without
+// waiting for the others, or signal EOS at the end of the file. Called with the mutex held.
+static void fillPendingBuffers(void)
+{
+    // the player is being destroyed
+    if (playerBQItf == NULL) {
+        return;
+    }
+    while (pendingBuffers > 0 && !reachedEof) {
+        int end;
+        stream_buffer *buffer = stream_source_try_next(source, &end);
+        if (buffer != NULL) {
+            enqueueBuffer(buffer);
+            pendingBuffers--;
+        } else if (end) {
+            // EOF or I/O error, signal EOS
+            XAAndroidBufferItem msgEos[1];
+            msgEos[0].itemKey = XA_ANDROID_ITEMKEY_EOS;
+            msgEos[0].itemSize = 0;
+            // EOS message has no parameters, so the total size of the message is the size of
+            //   the key plus the size if itemSize, both XAuint32
+            XAresult res = (*playerBQItf)->Enqueue(playerBQItf,
+                    (void *)&kEosBufferCntxt /*pBufferContext*/,
+                    NULL /*pData*/, 0 /*dataLength*/,
+                    msgEos /*pMsg*/,
+                    sizeof(XAuint32)*2 /*msgLength*/);
+            assert(XA_RESULT_SUCCESS == res);
+            reachedEof = JNI_TRUE;
+            ts_demux_flush(demux);
+        } else {
+            // the reads fell behind the player: onBuffersRead() comes back for the rest
+            break;
+        }
+    }
+}
+
+// stream_source callback, on its I/O thread, when more buffers are read
+static void onBuffersRead(void *context)
+{
+    int ok = pthread_mutex_lock(&mutex);
+    assert(0 == ok);
+    fillPendingBuffers();
+    ok = pthread_mutex_unlock(&mutex);
+    assert(0 == ok);
+}
 
 // AndroidBufferQueueItf callback to supply MPEG-2 TS packets to the media player
 static XAresult AndroidBufferQueueCallback(
@@ -118,7 +223,8 @@ static XAresult AndroidBufferQueueCallback(
     // pCallbackContext was specified as NULL at RegisterCallback and is unused here
     assert(NULL == pCallbackContext);
 
-    // note there is never any contention on this mutex unless a discontinuity request is active
+    // note there is only contention on this mutex when a discontinuity request is active, or
+    // when the source's I/O thread fills the slots left empty
     ok = pthread_mutex_lock(&mutex);
     assert(0 == ok);
 
@@ -131,9 +237,15 @@ static XAresult AndroidBufferQueueCallback(
             res = (*playerBQItf)->Clear(playerBQItf);
             assert(XA_RESULT_SUCCESS == res);
             // rewind the data source so we are guaranteed to be at an appropriate point
-            rewind(file);
-            // Enqueue the initial buffers, with a discontinuity indicator on first buffer
-            (void) enqueueInitialBuffers(JNI_TRUE);
+            if (lastVideoPts != TS_NO_TIMESTAMP) {
+                LOGV("Rewinding from %.2f s", lastVideoPts / 90000.0);
+            }
+            stream_source_seek(source, 0);
+            ts_demux_reset(demux);
+            // Enqueue the buffers read so far, with a discontinuity indicator on the first
+            // buffer; the others follow as they're read
+            pendingBuffers = NB_BUFFERS;
+            fillPendingBuffers();
         }
         // acknowledge the discontinuity request
         discontinuity = JNI_FALSE;
@@ -152,46 +264,18 @@ static XAresult AndroidBufferQueueCallback(
         }
     }
 
-    // pBufferData is a pointer to a buffer that we previously Enqueued
+    // pBufferData is a pointer to a buffer that we previously Enqueued, and
+    // pBufferContext is the stream buffer it belongs to; the buffer queue
+    // returns them in order, so it can be read into again
+    stream_buffer *buffer = (stream_buffer *) pBufferContext;
     assert((dataSize > 0) && ((dataSize % MPEG2_TS_PACKET_SIZE) == 0));
-    assert(dataCache <= (char *) pBufferData && (char *) pBufferData <
-            &dataCache[BUFFER_SIZE * NB_BUFFERS]);
-    assert(0 == (((char *) pBufferData - dataCache) % BUFFER_SIZE));
+    assert(buffer != NULL && buffer->data == pBufferData);
+    stream_source_release(source, buffer);
 
-    // don't bother trying to read more data once we've hit EOF
-    if (reachedEof) {
-        goto exit;
-    }
-
-    // note we do call fread from multiple threads, but never concurrently
-    size_t bytesRead;
-    bytesRead = fread(pBufferData, 1, BUFFER_SIZE, file);
-    if (bytesRead > 0) {
-        if ((bytesRead % MPEG2_TS_PACKET_SIZE) != 0) {
-            LOGV("Dropping last packet because it is not whole");
-        }
-        size_t packetsRead = bytesRead / MPEG2_TS_PACKET_SIZE;
-        size_t bufferSize = packetsRead * MPEG2_TS_PACKET_SIZE;
-        res = (*caller)->Enqueue(caller, NULL /*pBufferContext*/,
-                pBufferData /*pData*/,
-                bufferSize /*dataLength*/,
-                NULL /*pMsg*/,
-                0 /*msgLength*/);
-        assert(XA_RESULT_SUCCESS == res);
-    } else {
-        // EOF or I/O error, signal EOS
-        XAAndroidBufferItem msgEos[1];
-        msgEos[0].itemKey = XA_ANDROID_ITEMKEY_EOS;
-        msgEos[0].itemSize = 0;
-        // EOS message has no parameters, so the total size of the message is the size of the key
-        //   plus the size if itemSize, both XAuint32
-        res = (*caller)->Enqueue(caller, (void *)&kEosBufferCntxt /*pBufferContext*/,
-                NULL /*pData*/, 0 /*dataLength*/,
-                msgEos /*pMsg*/,
-                sizeof(XAuint32)*2 /*msgLength*/);
-        assert(XA_RESULT_SUCCESS == res);
-        reachedEof = JNI_TRUE;
-    }
+    // refill the slot, and any left empty before, with what's already read; this never
+    // waits for the reads, so the player isn't held up when they fall behind
+    pendingBuffers++;
+    fillPendingBuffers();
 
 exit:
     ok = pthread_mutex_unlock(&mutex);
@@ -271,57 +355,36 @@ void Java_com_example_nativemedia_NativeMedia_createEngine(JNIEnv* env, jclass c
 }
 
 
-// Enqueue the initial buffers, and optionally signal a discontinuity in the first buffer
-static jboolean enqueueInitialBuffers(jboolean discontinuity)
+// Enqueue the initial buffers, before the buffer queue callback runs
+static jboolean enqueueInitialBuffers(void)
 {
 
-    /* Fill our cache.
-     * We want to read whole packets (integral multiples of MPEG2_TS_PACKET_SIZE).
-     * fread returns units of "elements" not bytes, so we ask for 1-byte elements
-     * and then check that the number of elements is a multiple of the packet size.
+    /* Enqueue the first buffers read before starting to play,
+       we don't want to starve the player.
+       The source only hands out whole packets (integral multiples of MPEG2_TS_PACKET_SIZE).
+       This waits for the reads, but it's on the application thread.
      */
-    size_t bytesRead;
-    bytesRead = fread(dataCache, 1, BUFFER_SIZE * NB_BUFFERS, file);
-    if (bytesRead <= 0) {
+    size_t i, packetsQueued = 0;
+    for (i = 0; i < NB_BUFFERS; i++) {
+        stream_buffer *buffer = stream_source_next(source);
+        if (buffer == NULL) {
+            break;
+        }
+        enqueueBuffer(buffer);
+        packetsQueued += buffer->size / MPEG2_TS_PACKET_SIZE;
+    }
+    if (packetsQueued == 0) {
         // could be premature EOF or I/O error
         return JNI_FALSE;
     }
-    if ((bytesRead % MPEG2_TS_PACKET_SIZE) != 0) {
-        LOGV("Dropping last packet because it is not whole");
-    }
-    size_t packetsRead = bytesRead / MPEG2_TS_PACKET_SIZE;
-    LOGV("Initially queueing %zu packets", packetsRead);
-
-    /* Enqueue the content of our cache before starting to play,
-       we don't want to starve the player */
-    size_t i;
-    for (i = 0; i < NB_BUFFERS && packetsRead > 0; i++) {
-        // compute size of this buffer
-        size_t packetsThisBuffer = packetsRead;
-        if (packetsThisBuffer > PACKETS_PER_BUFFER) {
-            packetsThisBuffer = PACKETS_PER_BUFFER;
-        }
-        size_t bufferSize = packetsThisBuffer * MPEG2_TS_PACKET_SIZE;
-        XAresult res;
-        if (discontinuity) {
-            // signal discontinuity
-            XAAndroidBufferItem items[1];
-            items[0].itemKey = XA_ANDROID_ITEMKEY_DISCONTINUITY;
-            items[0].itemSize = 0;
-            // DISCONTINUITY message has no parameters,
-            //   so the total size of the message is the size of the key
-            //   plus the size if itemSize, both XAuint32
-            res = (*playerBQItf)->Enqueue(playerBQItf, NULL /*pBufferContext*/,
-                    dataCache + i*BUFFER_SIZE, bufferSize, items /*pMsg*/,
-                    sizeof(XAuint32)*2 /*msgLength*/);
-            discontinuity = JNI_FALSE;
-        } else {
-            res = (*playerBQItf)->Enqueue(playerBQItf, NULL /*pBufferContext*/,
-                    dataCache + i*BUFFER_SIZE, bufferSize, NULL, 0);
-        }
-        assert(XA_RESULT_SUCCESS == res);
-        packetsRead -= packetsThisBuffer;
-    }
+    LOGV("Initially queueing %zu packets", packetsQueued);
+
+    // from now on, the buffer queue callback and onBuffersRead() keep the queue full
+    int ok = pthread_mutex_lock(&mutex);
+    assert(0 == ok);
+    pendingBuffers = NB_BUFFERS - i;
+    ok = pthread_mutex_unlock(&mutex);
+    assert(0 == ok);
 
     return JNI_TRUE;
 }
@@ -339,9 +402,35 @@ jboolean Java_com_example_nativemedia_NativeMedia_createStreamingMediaPlayer(JNI
     const char *utf8 = (*env)->GetStringUTFChars(env, filename, NULL);
     assert(NULL != utf8);
 
-    // open the file to play
-    file = android_fopen(utf8, "rb");
-    if (file == NULL) {
+    // open the file to play: uncompressed assets (see noCompress in build.gradle)
+    // are read straight from the APK with pread, others through stdio
+    stream_source_config config = { MPEG2_TS_PACKET_SIZE, BUFFER_SIZE,
+            NB_BUFFERS, NB_READ_AHEAD_BUFFERS, STREAM_SOURCE_PREAD, onBuffersRead, NULL };
+    AAsset *asset = AAssetManager_open(AAssetManager_fromJava(env, android_java_asset_manager),
+            utf8, AASSET_MODE_STREAMING);
+    if (asset != NULL) {
+        off_t start, length;
+        int fd = AAsset_openFileDescriptor(asset, &start, &length);
+        AAsset_close(asset);
+        if (fd >= 0) {
+            source = stream_source_open_fd(fd, start, length, &config);
+        }
+    }
+    if (source == NULL) {
+        FILE *file = android_fopen(utf8, "rb");
+        if (file != NULL) {
+            source = stream_source_open_file(file, &config);
+        }
+    }
+    // release the Java string and UTF-8
+    (*env)->ReleaseStringUTFChars(env, filename, utf8);
+    if (source == NULL) {
+        return JNI_FALSE;
+    }
+    demux = ts_demux_create(onPes, NULL);
+    if (demux == NULL) {
+        stream_source_close(source);
+        source = NULL;
         return JNI_FALSE;
     }
 
@@ -380,9 +469,6 @@ jboolean Java_com_example_nativemedia_NativeMedia_createStreamingMediaPlayer(JNI
             required /*const XAboolean *pInterfaceRequired*/);
     assert(XA_RESULT_SUCCESS == res);
 
-    // release the Java string and UTF-8
-    (*env)->ReleaseStringUTFChars(env, filename, utf8);
-
     // realize the player
     res = (*playerObj)->Realize(playerObj, XA_BOOLEAN_FALSE);
     assert(XA_RESULT_SUCCESS == res);
@@ -417,7 +503,7 @@ jboolean Java_com_example_nativemedia_NativeMedia_createStreamingMediaPlayer(JNI
     assert(XA_RESULT_SUCCESS == res);
 
     // enqueue the initial buffers
-    if (!enqueueInitialBuffers(JNI_FALSE)) {
+    if (!enqueueInitialBuffers()) {
         return JNI_FALSE;
     }
 
@@ -461,6 +547,14 @@ void Java_com_example_nativemedia_NativeMedia_shutdown(JNIEnv* env, jclass clazz
 {
     // destroy streaming media player object, and invalidate all associated interfaces
     if (playerObj != NULL) {
+        // the source's I/O thread runs until it's closed, after the player; keep it from
+        // enqueueing buffers meanwhile
+        int ok = pthread_mutex_lock(&mutex);
+        assert(0 == ok);
+        playerBQItf = NULL;
+        pendingBuffers = 0;
+        ok = pthread_mutex_unlock(&mutex);
+        assert(0 == ok);
         (*playerObj)->Destroy(playerObj);
         playerObj = NULL;
         playerPlayItf = NULL;
@@ -482,10 +576,26 @@ void Java_com_example_nativemedia_NativeMedia_shutdown(JNIEnv* env, jclass clazz
         engineEngine = NULL;
     }
 
-    // close the file
-    if (file != NULL) {
-        fclose(file);
-        file = NULL;
+    // close the file, now that the player is done with its buffers
+    if (source != NULL) {
+        stream_source_stats stats;
+        stream_source_get_stats(source, &stats);
+        LOGV("Read %llu buffers: %llu underruns, waited %lld us, longest read %lld us",
+                (unsigned long long) stats.buffers, (unsigned long long) stats.underruns,
+                (long long) stats.wait_us, (long long) stats.max_read_us);
+        stream_source_close(source);
+        source = NULL;
+    }
+
+    if (demux != NULL) {
+        const ts_demux_stats *stats = ts_demux_get_stats(demux);
+        LOGV("Read %llu packets: %llu PES, %llu continuity errors, %llu resyncs",
+                (unsigned long long) stats->packets, (unsigned long long) stats->pes,
+                (unsigned long long) stats->cc_errors, (unsigned long long) stats->resyncs);
+        ts_demux_destroy(demux);
+        demux = NULL;
+        numStreams = 0;
+        lastVideoPts = TS_NO_TIMESTAMP;
     }
 
     if (android_java_asset_manager) {
@@ -526,7 +636,7 @@ void Java_com_example_nativemedia_NativeMedia_rewindStreamingMediaPlayer(JNIEnv
     }
 
     // make sure the streaming media player was created
-    if (NULL != playerBQItf && NULL != file) {
+    if (NULL != playerBQItf && NULL != source) {
         // first wait for buffers currently in queue to be drained
         int ok;
         ok = pthread_mutex_lock(&mutex);
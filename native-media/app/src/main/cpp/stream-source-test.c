@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host test and benchmark of the read-ahead stream source.
+ *
+ *   stream-source-test [-n megabytes] [file]
+ *
+ * Without a file, it writes a file whose every byte can be checked, a few
+ * bytes short of a whole number of packets, and reads it the way the app
+ * does: holding up to NB_BUFFERS buffers, and giving back the oldest. It
+ * checks that every buffer holds what the file has at its position, that
+ * the partial packet at the end is dropped, and that a seek restarts the
+ * stream with a discontinuity. It reads it again the way the app's buffer
+ * queue callback does, with try_next() only, waiting for on_ready when no
+ * buffer is filled yet. It does this with an fd (the stream in the middle of
+ * it, like an uncompressed asset) and with stdio, on each backend.
+ *
+ * With a file, it reads it with each backend and prints how fast.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "stream_source.h"
+
+// as in native-media-jni.c
+#define PACKET_SIZE 188
+#define BUFFER_SIZE (10 * PACKET_SIZE)
+#define NB_BUFFERS 8
+#define NB_READ_AHEAD_BUFFERS 32
+
+// where the stream starts in the file
+#define PREFIX 1000
+
+static int64_t nowus(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static const char *backend_name(stream_source_backend backend) {
+    return backend == STREAM_SOURCE_IO_URING ? "io_uring" : "pread";
+}
+
+static uint8_t pattern(int64_t position) {
+    return (uint8_t)(position * 7 + (position >> 12));
+}
+
+typedef struct {
+    stream_buffer *held[NB_BUFFERS];
+    int count;
+} consumer;
+
+static void hold(stream_source *source, consumer *c, stream_buffer *buffer) {
+    if (c->count == NB_BUFFERS) {
+        stream_source_release(source, c->held[0]);
+        memmove(c->held, c->held + 1, sizeof(c->held[0]) * (NB_BUFFERS - 1));
+        c->count--;
+    }
+    c->held[c->count++] = buffer;
+}
+
+// what on_ready signals, to a consumer that only takes buffers with try_next()
+static pthread_mutex_t ready_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
+static int ready_calls = 0;
+
+static void on_ready(void *context) {
+    pthread_mutex_lock(&ready_lock);
+    ready_calls++;
+    pthread_cond_signal(&ready_cond);
+    pthread_mutex_unlock(&ready_lock);
+}
+
+// checks a buffer that should start at expected. Returns the number of errors.
+static int check_buffer(const stream_buffer *buffer, int64_t expected, int discontinuity) {
+    int errors = 0;
+    size_t i;
+    if (buffer->position != expected || buffer->size % PACKET_SIZE != 0 ||
+            buffer->size > BUFFER_SIZE || buffer->discontinuity != discontinuity ||
+            ((uintptr_t)buffer->data & 4095) != 0) {
+        fprintf(stderr, "buffer at %lld (%zu bytes, discontinuity %d), expected %lld\n",
+                (long long)buffer->position, buffer->size, buffer->discontinuity,
+                (long long)expected);
+        errors++;
+    }
+    for (i = 0; i < buffer->size; i++) {
+        if (buffer->data[i] != pattern(PREFIX + buffer->position + i)) {
+            fprintf(stderr, "wrong data at %lld\n", (long long)(buffer->position + i));
+            errors++;
+            break;
+        }
+    }
+    return errors;
+}
+
+// reads the source from expected to its end, checking it; the first buffer
+// has discontinuity set if the source was just seeked. Seeks to seek_to once
+// past seek_at, if that's not negative. Returns the number of errors.
+static int check(stream_source *source, int64_t expected, int discontinuity, int64_t end,
+                 int64_t seek_at, int64_t seek_to) {
+    consumer c = { {NULL}, 0 };
+    stream_buffer *buffer;
+    int errors = 0;
+    while (errors < 10 && (buffer = stream_source_next(source)) != NULL) {
+        errors += check_buffer(buffer, expected, discontinuity);
+        expected = buffer->position + buffer->size;
+        discontinuity = 0;
+        hold(source, &c, buffer);
+        if (seek_at >= 0 && expected > seek_at) {
+            stream_source_seek(source, seek_to);
+            c.count = 0;
+            expected = seek_to;
+            discontinuity = 1;
+            seek_at = -1;
+        }
+    }
+    if (expected != end) {
+        fprintf(stderr, "stream ended at %lld, expected %lld\n", (long long)expected,
+                (long long)end);
+        errors++;
+    }
+    if (stream_source_next(source) != NULL) {
+        fprintf(stderr, "stream didn't stay ended\n");
+        errors++;
+    }
+    return errors;
+}
+
+// reads the source from its start to end as check() does, but never waits in
+// the source: when try_next() has no buffer, it waits for on_ready instead.
+// Returns the number of errors.
+static int check_try(stream_source *source, int64_t end) {
+    consumer c = { {NULL}, 0 };
+    stream_buffer *buffer;
+    int64_t expected = 0;
+    int errors = 0, at_end = 0;
+    while (errors < 10) {
+        // a call to on_ready after this means try_next() may have more
+        pthread_mutex_lock(&ready_lock);
+        int calls = ready_calls;
+        pthread_mutex_unlock(&ready_lock);
+
+        buffer = stream_source_try_next(source, &at_end);
+        if (buffer != NULL) {
+            errors += check_buffer(buffer, expected, 0);
+            expected = buffer->position + buffer->size;
+            hold(source, &c, buffer);
+        } else if (at_end) {
+            break;
+        } else {
+            pthread_mutex_lock(&ready_lock);
+            while (ready_calls == calls) {
+                pthread_cond_wait(&ready_cond, &ready_lock);
+            }
+            pthread_mutex_unlock(&ready_lock);
+        }
+    }
+    if (expected != end) {
+        fprintf(stderr, "try_next() stream ended at %lld, expected %lld\n",
+                (long long)expected, (long long)end);
+        errors++;
+    }
+    if (stream_source_try_next(source, &at_end) != NULL || !at_end) {
+        fprintf(stderr, "try_next() stream didn't stay ended\n");
+        errors++;
+    }
+    return errors;
+}
+
+static stream_source *open_path(const char *path, int use_stdio, int64_t offset, int64_t length,
+                                stream_source_backend backend) {
+    stream_source_config config = { PACKET_SIZE, BUFFER_SIZE,
+                                    NB_BUFFERS, NB_READ_AHEAD_BUFFERS, backend,
+                                    on_ready, NULL };
+    if (use_stdio) {
+        FILE *file = fopen(path, "rb");
+        if (file == NULL || fseeko(file, offset, SEEK_SET) != 0) {
+            return NULL;
+        }
+        return stream_source_open_file(file, &config);
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    return stream_source_open_fd(fd, offset, length, &config);
+}
+
+static int synthetic(size_t megabytes) {
+    char path[] = "/tmp/stream-source-testXXXXXX";
+    int fd = mkstemp(path);
+    // a partial packet at the end, then bytes that aren't part of the stream
+    int64_t length = (int64_t)megabytes * 1000000 / PACKET_SIZE * PACKET_SIZE + 100;
+    int64_t end = length - 100, i, size;
+    size_t chunk = 1 << 20;
+    uint8_t *data = malloc(chunk);
+    int errors = 0, use_stdio, backend;
+
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    for (i = 0; i < PREFIX + length + 5000; i += chunk) {
+        size_t j;
+        for (j = 0; j < chunk; j++) {
+            data[j] = pattern(i + j);
+        }
+        if (write(fd, data, chunk) != (ssize_t)chunk) {
+            perror("write");
+            return 1;
+        }
+    }
+    size = i;
+    close(fd);
+    free(data);
+
+    for (use_stdio = 0; use_stdio < 2; use_stdio++) {
+        for (backend = STREAM_SOURCE_PREAD; backend <= STREAM_SOURCE_IO_URING; backend++) {
+            stream_source *source;
+            stream_source_stats stats;
+            int64_t start;
+            int e;
+
+            // stdio reads to the end of the file: stop at a packet boundary
+            int64_t stream_end = use_stdio ? (size - PREFIX) / PACKET_SIZE * PACKET_SIZE : end;
+
+            source = open_path(path, use_stdio, PREFIX, length, backend);
+            if (source == NULL) {
+                fprintf(stderr, "can't open %s\n", path);
+                return 1;
+            }
+            start = nowus();
+            e = check(source, 0, 0, stream_end, -1, 0);
+            stream_source_get_stats(source, &stats);
+            printf("%s %-8s %7.1f MB/s, %llu buffers, %llu underruns, longest read %lld us\n",
+                   use_stdio ? "stdio" : "fd   ",
+                   backend_name(stream_source_get_backend(source)),
+                   stats.bytes / (double)(nowus() - start),
+                   (unsigned long long)stats.buffers, (unsigned long long)stats.underruns,
+                   (long long)stats.max_read_us);
+            stream_source_close(source);
+
+            // seeks: back, forward, to the start of the last buffer, and to the end
+            source = open_path(path, use_stdio, PREFIX, length, backend);
+            e += check(source, 0, 0, stream_end, end / 2, 50 * PACKET_SIZE);
+            stream_source_seek(source, 0);
+            e += check(source, 0, 1, stream_end, 100 * PACKET_SIZE,
+                       end / 2 / PACKET_SIZE * PACKET_SIZE);
+            stream_source_seek(source, 0);
+            e += check(source, 0, 1, stream_end, 0, stream_end - PACKET_SIZE);
+            stream_source_seek(source, 0);
+            e += check(source, 0, 1, stream_end, 0, stream_end);
+            stream_source_close(source);
+
+            source = open_path(path, use_stdio, PREFIX, length, backend);
+            e += check_try(source, stream_end);
+            stream_source_close(source);
+            if (e) {
+                fprintf(stderr, "%s with %s failed\n", use_stdio ? "stdio" : "fd",
+                        backend_name(backend));
+                errors += e;
+            }
+        }
+    }
+    unlink(path);
+    return errors != 0;
+}
+
+static int file(const char *path) {
+    int backend;
+    for (backend = STREAM_SOURCE_PREAD; backend <= STREAM_SOURCE_IO_URING; backend++) {
+        stream_source *source = open_path(path, 0, 0, -1, backend);
+        consumer c = { {NULL}, 0 };
+        stream_buffer *buffer;
+        stream_source_stats stats;
+        int64_t start = nowus();
+        if (source == NULL) {
+            perror(path);
+            return 1;
+        }
+        while ((buffer = stream_source_next(source)) != NULL) {
+            hold(source, &c, buffer);
+        }
+        stream_source_get_stats(source, &stats);
+        printf("%-8s %7.1f MB/s, %llu buffers, %llu underruns, waited %lld us, "
+               "longest read %lld us\n",
+               backend_name(stream_source_get_backend(source)),
+               stats.bytes / (double)(nowus() - start), (unsigned long long)stats.buffers,
+               (unsigned long long)stats.underruns, (long long)stats.wait_us,
+               (long long)stats.max_read_us);
+        stream_source_close(source);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t megabytes = 64;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                megabytes = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n megabytes] [file]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        return file(argv[optind]);
+    }
+    return synthetic(megabytes);
+}
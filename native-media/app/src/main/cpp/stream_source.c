@@ -0,0 +1,549 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include "stream_source.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(__ANDROID__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define PAGE_ALIGNMENT 4096
+
+enum {
+    kSlotFree,
+    kSlotReading,
+    kSlotFilled,
+};
+
+// a buffer of the ring; buffer comes first, so that the consumer's
+// stream_buffer pointers are slot pointers
+typedef struct {
+    stream_buffer buffer;
+    int state;
+    size_t want;
+    ssize_t result;         // of the read: bytes, or -errno
+    int64_t started_us;
+} slot;
+
+#ifdef HAVE_IO_URING
+typedef struct {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} uring;
+#endif
+
+struct stream_source {
+    int fd;
+    FILE *file;
+    int64_t file_position;  // where file is in the stream, for stdio
+    int64_t start;          // of the stream in fd or file
+    int64_t length;         // of the stream, or -1 if unknown
+
+    size_t unit;
+    size_t buffer_size;
+    int count;
+    slot *slots;
+    uint8_t *memory;
+
+    // The ring: slots [released, head) are the consumer's, [head, tail) are
+    // being read or filled, and the others are free. These only grow.
+    uint64_t released;
+    uint64_t head;
+    uint64_t tail;
+
+    int64_t position;       // of the next read
+    int eof;                // no more reads to start
+    int discontinuity;      // the next read is the first after a seek
+    int inflight;
+    int seeking;
+    int quit;
+
+    stream_source_backend backend;
+    void (*on_ready)(void *context);
+    void *context;
+#ifdef HAVE_IO_URING
+    uring ring;
+#endif
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t io_cond;     // signalled when slots are freed
+    pthread_cond_t ready_cond;  // when reads complete
+    stream_source_stats stats;
+};
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ----------------------------------------------------------------------------
+// Reading
+
+// a blocking read of want bytes at position, short only at the end
+static ssize_t read_at(stream_source *source, uint8_t *data, int64_t position, size_t want) {
+    size_t done = 0;
+    if (source->file) {
+        if (source->file_position != position) {
+            if (fseeko(source->file, (off_t)(source->start + position), SEEK_SET) != 0) {
+                return -errno;
+            }
+            source->file_position = position;
+        }
+        done = fread(data, 1, want, source->file);
+        source->file_position += done;
+        if (done < want && ferror(source->file)) {
+            return -EIO;
+        }
+        return (ssize_t)done;
+    }
+    while (done < want) {
+        ssize_t n = pread(source->fd, data + done, want - done,
+                          (off_t)(source->start + position + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -errno;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+#ifdef HAVE_IO_URING
+static int uring_setup(uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return 0;
+    }
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->sq_ring;
+    if (ring->sq_ring != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+            ring->sqes == MAP_FAILED) {
+        close(ring->fd);
+        ring->fd = -1;
+        return 0;
+    }
+    ring->sq_tail = (unsigned *)((uint8_t *)ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((uint8_t *)ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((uint8_t *)ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (unsigned *)((uint8_t *)ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((uint8_t *)ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((uint8_t *)ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((uint8_t *)ring->cq_ring + params.cq_off.cqes);
+    return 1;
+}
+
+static void uring_destroy(uring *ring) {
+    if (ring->fd < 0) {
+        return;
+    }
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+// queues reads for the slots in batch, and waits for at least one read to
+// complete. Returns the number of completed slots put in done.
+static int uring_read(stream_source *source, slot **batch, int count, slot **done) {
+    uring *ring = &source->ring;
+    unsigned tail = *ring->sq_tail;
+    int i, completed = 0;
+    for (i = 0; i < count; i++) {
+        unsigned index = tail & *ring->sq_mask;
+        struct io_uring_sqe *sqe = &ring->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = source->fd;
+        sqe->addr = (uint64_t)(uintptr_t)batch[i]->buffer.data;
+        sqe->len = (uint32_t)batch[i]->want;
+        sqe->off = (uint64_t)(source->start + batch[i]->buffer.position);
+        sqe->user_data = (uint64_t)(uintptr_t)batch[i];
+        ring->sq_array[index] = index;
+        tail++;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, ring->fd, count, 1, IORING_ENTER_GETEVENTS,
+                   NULL, 0) < 0) {
+        if (errno != EINTR) {
+            break;
+        }
+    }
+
+    unsigned head = *ring->cq_head;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        slot *s = (slot *)(uintptr_t)cqe->user_data;
+        s->result = cqe->res;
+        if (s->result == -EINVAL || s->result == -EOPNOTSUPP) {
+            // no IORING_OP_READ in this kernel
+            s->result = read_at(source, s->buffer.data, s->buffer.position, s->want);
+        } else if (s->result >= 0 && (size_t)s->result < s->want) {
+            // short, but maybe not at the end: read the rest
+            ssize_t more = read_at(source, s->buffer.data + s->result,
+                                   s->buffer.position + s->result, s->want - s->result);
+            s->result = more < 0 ? more : s->result + more;
+        }
+        done[completed++] = s;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return completed;
+}
+#endif
+
+// starts reads into free slots, as long as there are any
+static int start_reads(stream_source *source, slot **batch, int max) {
+    int count = 0;
+    while (!source->eof && !source->seeking && count < max &&
+            source->tail < source->released + source->count) {
+        slot *s = &source->slots[source->tail % source->count];
+        size_t want = source->buffer_size;
+        if (source->length >= 0 && source->position + (int64_t)want >= source->length) {
+            want = (size_t)(source->length - source->position);
+            want -= want % source->unit;
+            source->eof = 1;
+        }
+        s->state = kSlotReading;
+        s->want = want;
+        s->started_us = now_us();
+        s->buffer.position = source->position;
+        s->buffer.discontinuity = source->discontinuity;
+        s->buffer.size = 0;
+        source->discontinuity = 0;
+        source->position += want;
+        source->tail++;
+        source->inflight++;
+        batch[count++] = s;
+    }
+    return count;
+}
+
+static void *io_thread(void *arg) {
+    stream_source *source = arg;
+    slot **batch = calloc(source->count, sizeof(slot *));
+    slot **done = calloc(source->count, sizeof(slot *));
+    int i;
+
+    pthread_mutex_lock(&source->lock);
+    while (!source->quit) {
+        int max = source->backend == STREAM_SOURCE_IO_URING ? source->count : 1;
+        int started = start_reads(source, batch, max), completed;
+        if (started == 0 && source->inflight == 0) {
+            pthread_cond_wait(&source->io_cond, &source->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&source->lock);
+
+#ifdef HAVE_IO_URING
+        if (source->backend == STREAM_SOURCE_IO_URING) {
+            completed = uring_read(source, batch, started, done);
+        } else
+#endif
+        {
+            for (i = 0; i < started; i++) {
+                batch[i]->result = read_at(source, batch[i]->buffer.data,
+                                           batch[i]->buffer.position, batch[i]->want);
+                done[i] = batch[i];
+            }
+            completed = started;
+        }
+
+        pthread_mutex_lock(&source->lock);
+        int64_t now = now_us();
+        for (i = 0; i < completed; i++) {
+            slot *s = done[i];
+            if (now - s->started_us > source->stats.max_read_us) {
+                source->stats.max_read_us = now - s->started_us;
+            }
+            if (s->result < (ssize_t)s->want) {
+                // the end of the file, or an error: nothing comes after this
+                source->eof = 1;
+            }
+            s->buffer.size = s->result > 0 ? (size_t)s->result - (size_t)s->result % source->unit
+                                           : 0;
+            s->state = kSlotFilled;
+            source->inflight--;
+        }
+        pthread_cond_broadcast(&source->ready_cond);
+        if (source->on_ready) {
+            // the consumer takes its own lock, which it may hold while it
+            // calls into the source
+            pthread_mutex_unlock(&source->lock);
+            source->on_ready(source->context);
+            pthread_mutex_lock(&source->lock);
+        }
+    }
+    pthread_mutex_unlock(&source->lock);
+    free(batch);
+    free(done);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+static stream_source *create(const stream_source_config *config) {
+    stream_source *source = calloc(1, sizeof(stream_source));
+    size_t stride;
+    int i;
+    if (source == NULL) {
+        return NULL;
+    }
+    source->fd = -1;
+    source->length = -1;
+    source->unit = config->unit ? config->unit : 1;
+    source->buffer_size = config->buffer_size - config->buffer_size % source->unit;
+    if (source->buffer_size == 0) {
+        source->buffer_size = source->unit;
+    }
+    source->count = config->held + (config->read_ahead > 0 ? config->read_ahead : 1);
+    source->backend = config->backend;
+    source->on_ready = config->on_ready;
+    source->context = config->context;
+
+    stride = (source->buffer_size + PAGE_ALIGNMENT - 1) & ~(size_t)(PAGE_ALIGNMENT - 1);
+    source->slots = calloc(source->count, sizeof(slot));
+    if (source->slots == NULL ||
+            posix_memalign((void **)&source->memory, PAGE_ALIGNMENT, stride * source->count)) {
+        free(source->slots);
+        free(source);
+        return NULL;
+    }
+    for (i = 0; i < source->count; i++) {
+        source->slots[i].buffer.data = source->memory + stride * i;
+    }
+    pthread_mutex_init(&source->lock, NULL);
+    pthread_cond_init(&source->io_cond, NULL);
+    pthread_cond_init(&source->ready_cond, NULL);
+    return source;
+}
+
+static stream_source *start(stream_source *source) {
+#ifdef HAVE_IO_URING
+    source->ring.fd = -1;
+    if (source->backend == STREAM_SOURCE_IO_URING &&
+            (source->file || !uring_setup(&source->ring, (unsigned)source->count))) {
+        source->backend = STREAM_SOURCE_PREAD;
+    }
+#else
+    source->backend = STREAM_SOURCE_PREAD;
+#endif
+    if (pthread_create(&source->thread, NULL, io_thread, source) != 0) {
+        source->quit = 1;
+        stream_source_close(source);
+        return NULL;
+    }
+    return source;
+}
+
+stream_source *stream_source_open_fd(int fd, int64_t offset, int64_t length,
+                                     const stream_source_config *config) {
+    stream_source *source = create(config);
+    if (source == NULL) {
+        close(fd);
+        return NULL;
+    }
+    source->fd = fd;
+    source->start = offset;
+    source->length = length;
+    return start(source);
+}
+
+stream_source *stream_source_open_file(FILE *file, const stream_source_config *config) {
+    stream_source *source = create(config);
+    if (source == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    source->file = file;
+    source->start = ftello(file);
+    return start(source);
+}
+
+void stream_source_close(stream_source *source) {
+    if (source == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&source->lock);
+    int running = !source->quit;
+    source->quit = 1;
+    pthread_cond_signal(&source->io_cond);
+    pthread_mutex_unlock(&source->lock);
+    if (running) {
+        pthread_join(source->thread, NULL);
+    }
+#ifdef HAVE_IO_URING
+    uring_destroy(&source->ring);
+#endif
+    if (source->file) {
+        fclose(source->file);
+    }
+    if (source->fd >= 0) {
+        close(source->fd);
+    }
+    pthread_cond_destroy(&source->io_cond);
+    pthread_cond_destroy(&source->ready_cond);
+    pthread_mutex_destroy(&source->lock);
+    free(source->memory);
+    free(source->slots);
+    free(source);
+}
+
+// takes the next buffer if it's filled; otherwise sets *end if there are
+// none to come. Called with the lock held.
+static stream_buffer *take(stream_source *source, int *end) {
+    stream_buffer *buffer = NULL;
+    *end = 0;
+    if (source->head < source->tail) {
+        slot *s = &source->slots[source->head % source->count];
+        if (s->state == kSlotFilled) {
+            // an empty buffer is the end; it stays, for the next calls
+            if (s->buffer.size > 0) {
+                source->head++;
+                buffer = &s->buffer;
+                source->stats.buffers++;
+                source->stats.bytes += buffer->size;
+            } else {
+                *end = 1;
+            }
+        }
+    } else if (source->eof) {
+        *end = 1;
+    }
+    return buffer;
+}
+
+stream_buffer *stream_source_next(stream_source *source) {
+    stream_buffer *buffer;
+    int64_t waited = 0;
+    int end;
+    pthread_mutex_lock(&source->lock);
+    while ((buffer = take(source, &end)) == NULL && !end) {
+        if (waited == 0) {
+            waited = now_us();
+            source->stats.underruns++;
+        }
+        pthread_cond_wait(&source->ready_cond, &source->lock);
+    }
+    if (waited) {
+        source->stats.wait_us += now_us() - waited;
+    }
+    pthread_mutex_unlock(&source->lock);
+    return buffer;
+}
+
+stream_buffer *stream_source_try_next(stream_source *source, int *end) {
+    stream_buffer *buffer;
+    pthread_mutex_lock(&source->lock);
+    buffer = take(source, end);
+    if (buffer == NULL && !*end) {
+        source->stats.underruns++;
+    }
+    pthread_mutex_unlock(&source->lock);
+    return buffer;
+}
+
+void stream_source_release(stream_source *source, stream_buffer *buffer) {
+    pthread_mutex_lock(&source->lock);
+    slot *s = &source->slots[source->released % source->count];
+    assert(source->released < source->head && buffer == &s->buffer);
+    s->state = kSlotFree;
+    source->released++;
+    pthread_cond_signal(&source->io_cond);
+    pthread_mutex_unlock(&source->lock);
+}
+
+void stream_source_seek(stream_source *source, int64_t position) {
+    int i;
+    pthread_mutex_lock(&source->lock);
+    // reads in flight write into the slots; let them finish
+    source->seeking = 1;
+    while (source->inflight > 0) {
+        pthread_cond_wait(&source->ready_cond, &source->lock);
+    }
+    for (i = 0; i < source->count; i++) {
+        source->slots[i].state = kSlotFree;
+    }
+    source->released = source->head = source->tail = 0;
+    source->position = position;
+    source->eof = 0;
+    source->discontinuity = 1;
+    source->seeking = 0;
+    pthread_cond_signal(&source->io_cond);
+    pthread_mutex_unlock(&source->lock);
+}
+
+void stream_source_get_stats(stream_source *source, stream_source_stats *stats) {
+    pthread_mutex_lock(&source->lock);
+    *stats = source->stats;
+    pthread_mutex_unlock(&source->lock);
+}
+
+stream_source_backend stream_source_get_backend(const stream_source *source) {
+    return source->backend;
+}
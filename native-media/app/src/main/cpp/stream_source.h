@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STREAM_SOURCE_H
+#define STREAM_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reads a file ahead of its consumer, on a thread of its own.
+ *
+ * The file is read into a ring of page aligned buffers, each a whole number
+ * of units (transport stream packets) long. The consumer takes the filled
+ * buffers in order with stream_source_next(), and gives each back with
+ * stream_source_release() when it's done with it, in the same order, so it
+ * can be filled again. next() only waits when the reads fall behind; a
+ * consumer that must not wait takes them with stream_source_try_next()
+ * instead, and tries again when on_ready tells it more buffers are filled.
+ */
+
+typedef enum {
+    STREAM_SOURCE_PREAD,
+    // several reads in flight; falls back to pread where io_uring isn't
+    // available (Android doesn't allow it to apps)
+    STREAM_SOURCE_IO_URING,
+} stream_source_backend;
+
+typedef struct {
+    size_t unit;            // buffers hold whole units
+    size_t buffer_size;     // rounded down to whole units
+    int held;               // buffers the consumer holds at most
+    int read_ahead;         // buffers read ahead of those
+    stream_source_backend backend;
+    // called on the I/O thread after reads complete, with no lock of the
+    // source held, so it may call try_next(); may be NULL
+    void (*on_ready)(void *context);
+    void *context;
+} stream_source_config;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    int64_t position;       // in the stream
+    int discontinuity;      // first buffer after a seek
+} stream_buffer;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t buffers;
+    uint64_t underruns;     // times next() had to wait, or try_next() had none
+    int64_t wait_us;        // total time next() waited
+    int64_t max_read_us;    // longest read
+} stream_source_stats;
+
+typedef struct stream_source stream_source;
+
+// reads length bytes of fd from offset; the source owns fd from then on
+stream_source *stream_source_open_fd(int fd, int64_t offset, int64_t length,
+                                     const stream_source_config *config);
+// reads a stdio stream, for files that have no fd (compressed assets); the
+// source owns file from then on. The backend is ignored.
+stream_source *stream_source_open_file(FILE *file, const stream_source_config *config);
+void stream_source_close(stream_source *source);
+
+// the next buffer, waiting for it if needed. NULL at the end of the stream
+// or on an error.
+stream_buffer *stream_source_next(stream_source *source);
+// the next buffer if it's already read, without waiting. Otherwise NULL,
+// with *end set at the end of the stream or on an error, and cleared when
+// the reads are behind: on_ready is called once more of them complete.
+stream_buffer *stream_source_try_next(stream_source *source, int *end);
+// the oldest buffer next() or try_next() returned is done with
+void stream_source_release(stream_source *source, stream_buffer *buffer);
+// restarts at position, dropping what was read ahead. The consumer must be
+// done with all the buffers it holds; they all count as released. The first
+// buffer next() returns after this has discontinuity set.
+void stream_source_seek(stream_source *source, int64_t position);
+
+void stream_source_get_stats(stream_source *source, stream_source_stats *stats);
+// the backend in use, after any fallback
+stream_source_backend stream_source_get_backend(const stream_source *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
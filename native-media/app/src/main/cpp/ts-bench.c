@@ -0,0 +1,473 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Host test and benchmark of the transport stream demuxer.
+ *
+ *   ts-bench [-n megabytes] [file.ts]
+ *
+ * Without a file, it writes a synthetic stream with a video and an audio
+ * stream whose PES packets can be checked, demuxes it in the app's buffer
+ * size and in big chunks, and checks that every PES comes out intact. Then
+ * it drops packets and inserts garbage, and checks that the losses are
+ * noticed and everything else still comes out intact.
+ *
+ * With a file, it demuxes it and prints what it found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ts_demux.h"
+
+#define PMT_PID 0x1000
+#define VIDEO_PID 0x100
+#define AUDIO_PID 0x101
+#define FRAME_TICKS 3003    // 29.97 fps
+#define AUDIO_TICKS 1920    // 1024 samples at 48 kHz, in 90 kHz
+// PAT and PMT every this many video frames
+#define PSI_INTERVAL 15
+// what native-media-jni.c reads at a time
+#define APP_BUFFER_SIZE (10 * TS_PACKET_SIZE)
+
+static int64_t nowus(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// ----------------------------------------------------------------------------
+// The synthetic stream
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    uint8_t cc[0x2000];
+} writer;
+
+static uint8_t *new_packet(writer *w) {
+    if (w->size + TS_PACKET_SIZE > w->capacity) {
+        w->capacity = w->capacity ? w->capacity * 2 : 1 << 20;
+        w->data = realloc(w->data, w->capacity);
+    }
+    w->size += TS_PACKET_SIZE;
+    return w->data + w->size - TS_PACKET_SIZE;
+}
+
+// writes payload as packets of pid; the first one starts a unit
+static void packetize(writer *w, uint16_t pid, const uint8_t *payload, size_t size) {
+    int first = 1;
+    while (size > 0) {
+        uint8_t *p = new_packet(w);
+        size_t room = TS_PACKET_SIZE - 4;
+        size_t n = size < room ? size : room;
+        p[0] = TS_SYNC_BYTE;
+        p[1] = (uint8_t)((first ? 0x40 : 0) | pid >> 8);
+        p[2] = (uint8_t)pid;
+        p[3] = (uint8_t)(0x10 | (w->cc[pid]++ & 0xf));
+        if (n < room) {
+            // an adaptation field of stuffing fills the rest
+            size_t stuffing = room - n;
+            p[3] |= 0x20;
+            p[4] = (uint8_t)(stuffing - 1);
+            if (stuffing > 1) {
+                p[5] = 0;
+                memset(p + 6, 0xff, stuffing - 2);
+            }
+        }
+        memcpy(p + TS_PACKET_SIZE - n, payload, n);
+        payload += n;
+        size -= n;
+        first = 0;
+    }
+}
+
+static uint32_t crc32_mpeg(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    size_t i;
+    int j;
+    for (i = 0; i < size; i++) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (j = 0; j < 8; j++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// a section after a pointer field, with its length and CRC filled in
+static void write_section(writer *w, uint16_t pid, uint8_t *section, size_t size) {
+    uint32_t crc;
+    // the length counts from after itself, up to and with the CRC
+    section[2] = (uint8_t)(0xb0 | size >> 8);
+    section[3] = (uint8_t)size;
+    crc = crc32_mpeg(section + 1, size - 1);
+    section[size] = (uint8_t)(crc >> 24);
+    section[size + 1] = (uint8_t)(crc >> 16);
+    section[size + 2] = (uint8_t)(crc >> 8);
+    section[size + 3] = (uint8_t)crc;
+    packetize(w, pid, section, size + 4);
+}
+
+static void write_psi(writer *w) {
+    // pointer field, then the section up to its CRC
+    uint8_t pat[32] = { 0, 0x00, 0, 0, 0, 1, 0xc1, 0, 0,
+                        0, 1, 0xe0 | PMT_PID >> 8, PMT_PID & 0xff };
+    uint8_t pmt[64] = { 0, 0x02, 0, 0, 0, 1, 0xc1, 0, 0,
+                        0xe0 | VIDEO_PID >> 8, VIDEO_PID & 0xff, 0xf0, 0,
+                        0x1b, 0xe0 | VIDEO_PID >> 8, VIDEO_PID & 0xff, 0xf0, 0,
+                        0x0f, 0xe0 | AUDIO_PID >> 8, AUDIO_PID & 0xff, 0xf0, 0 };
+    write_section(w, 0, pat, 13);
+    write_section(w, PMT_PID, pmt, 23);
+}
+
+static void put_timestamp(uint8_t *p, int marker, int64_t ts) {
+    p[0] = (uint8_t)(marker << 4 | ((ts >> 29) & 0x0e) | 1);
+    p[1] = (uint8_t)(ts >> 22);
+    p[2] = (uint8_t)((ts >> 14) | 1);
+    p[3] = (uint8_t)(ts >> 7);
+    p[4] = (uint8_t)((ts << 1) | 1);
+}
+
+static size_t video_size(int frame) {
+    return frame % 30 == 0 ? 120000 : 2000 + (size_t)(frame * 2654435761u >> 8) % 30000;
+}
+
+static size_t audio_size(int frame) {
+    return 300 + frame % 5 * 40;
+}
+
+static uint8_t pattern(int pid, int frame, size_t offset) {
+    return (uint8_t)(frame * 7 + pid + offset);
+}
+
+// the PES of video frame frame: unbounded, with a pts and a dts
+static void write_video(writer *w, int frame, uint8_t *buffer) {
+    size_t size = video_size(frame), i;
+    int64_t dts = (int64_t)frame * FRAME_TICKS;
+    uint8_t header[19] = { 0, 0, 1, 0xe0, 0, 0, 0x80, 0xc0, 10 };
+    put_timestamp(header + 9, 3, dts + 2 * FRAME_TICKS);
+    put_timestamp(header + 14, 1, dts);
+    memcpy(buffer, header, sizeof(header));
+    for (i = 0; i < size; i++) {
+        buffer[sizeof(header) + i] = pattern(VIDEO_PID, frame, i);
+    }
+    packetize(w, VIDEO_PID, buffer, sizeof(header) + size);
+}
+
+// the PES of audio frame frame: bounded, with a pts
+static void write_audio(writer *w, int frame, uint8_t *buffer) {
+    size_t size = audio_size(frame), i;
+    uint8_t header[14] = { 0, 0, 1, 0xc0, 0, 0, 0x80, 0x80, 5 };
+    header[4] = (uint8_t)((size + 8) >> 8);
+    header[5] = (uint8_t)(size + 8);
+    put_timestamp(header + 9, 2, (int64_t)frame * AUDIO_TICKS);
+    memcpy(buffer, header, sizeof(header));
+    for (i = 0; i < size; i++) {
+        buffer[sizeof(header) + i] = pattern(AUDIO_PID, frame, i);
+    }
+    packetize(w, AUDIO_PID, buffer, sizeof(header) + size);
+}
+
+static void generate(writer *w, size_t target, int *video_frames, int *audio_frames) {
+    uint8_t *buffer = malloc(200000);
+    int video = 0, audio = 0;
+    while (w->size < target) {
+        if (video % PSI_INTERVAL == 0) {
+            write_psi(w);
+        }
+        write_video(w, video++, buffer);
+        // audio up to the video's time
+        while ((int64_t)audio * AUDIO_TICKS < (int64_t)video * FRAME_TICKS) {
+            write_audio(w, audio++, buffer);
+        }
+    }
+    free(buffer);
+    *video_frames = video;
+    *audio_frames = audio;
+}
+
+// ----------------------------------------------------------------------------
+// Checking what comes out
+
+typedef struct {
+    int intact;
+    int corrupt;
+    int bad;            // not corrupt, but wrong
+} checker;
+
+static void check_pes(void *context, const ts_pes *pes) {
+    checker *c = context;
+    int frame, ok = 1;
+    size_t size, i;
+    int64_t pts, dts;
+    if (pes->corrupt) {
+        c->corrupt++;
+        return;
+    }
+    // frames can be missing, when their first packet was lost; find out
+    // which one this is from its time
+    if (pes->pid == VIDEO_PID) {
+        frame = (int)(pes->dts / FRAME_TICKS);
+        size = video_size(frame);
+        dts = (int64_t)frame * FRAME_TICKS;
+        pts = dts + 2 * FRAME_TICKS;
+        ok = pes->stream_type == 0x1b && pes->stream_id == 0xe0;
+    } else if (pes->pid == AUDIO_PID) {
+        frame = (int)(pes->pts / AUDIO_TICKS);
+        size = audio_size(frame);
+        pts = dts = (int64_t)frame * AUDIO_TICKS;
+        ok = pes->stream_type == 0x0f && pes->stream_id == 0xc0;
+    } else {
+        c->bad++;
+        return;
+    }
+    ok = ok && pes->program == 1 && pes->size == size && pes->pts == pts && pes->dts == dts;
+    for (i = 0; ok && i < size; i++) {
+        ok = pes->data[i] == pattern(pes->pid, frame, i);
+    }
+    if (!ok) {
+        c->bad++;
+        return;
+    }
+    c->intact++;
+}
+
+// for timing: only looks at the PES
+static void count_pes(void *context, const ts_pes *pes) {
+    checker *c = context;
+    c->intact += !pes->corrupt;
+    c->corrupt += pes->corrupt;
+}
+
+static double demux(const uint8_t *data, size_t size, size_t chunk, ts_pes_callback callback,
+                    checker *c, ts_demux_stats *stats) {
+    ts_demux *demux = ts_demux_create(callback, c);
+    int64_t start = nowus();
+    size_t offset;
+    for (offset = 0; offset < size; offset += chunk) {
+        ts_demux_feed(demux, data + offset, size - offset < chunk ? size - offset : chunk);
+    }
+    ts_demux_flush(demux);
+    double seconds = (nowus() - start) * 1e-6;
+    *stats = *ts_demux_get_stats(demux);
+    ts_demux_destroy(demux);
+    return seconds;
+}
+
+static int synthetic(size_t megabytes) {
+    writer w;
+    checker c;
+    ts_demux_stats stats;
+    int video, audio, failures = 0;
+    size_t chunks[2] = { APP_BUFFER_SIZE, 1 << 20 };
+    int i;
+
+    memset(&w, 0, sizeof(w));
+    generate(&w, megabytes << 20, &video, &audio);
+    printf("stream: %.1f MB, %d video and %d audio PES\n", w.size / 1e6, video, audio);
+
+    for (i = 0; i < 2; i++) {
+        memset(&c, 0, sizeof(c));
+        double seconds = demux(w.data, w.size, chunks[i], count_pes, &c, &stats);
+        printf("clean, %7zu byte chunks: %7.0f MB/s\n", chunks[i], w.size / 1e6 / seconds);
+    }
+
+    memset(&c, 0, sizeof(c));
+    demux(w.data, w.size, APP_BUFFER_SIZE, check_pes, &c, &stats);
+    printf("clean: %d intact, %d corrupt, %d bad, %llu cc errors\n", c.intact, c.corrupt, c.bad,
+           (unsigned long long)stats.cc_errors);
+    if (c.intact != video + audio || c.corrupt || c.bad || stats.cc_errors ||
+            stats.resyncs || stats.crc_errors || stats.bad_pes) {
+        fprintf(stderr, "clean stream didn't demux exactly\n");
+        failures++;
+    }
+
+    // chunks that split packets anywhere
+    memset(&c, 0, sizeof(c));
+    demux(w.data, w.size, 1000, check_pes, &c, &stats);
+    if (c.intact != video + audio || c.bad) {
+        fprintf(stderr, "odd sized chunks didn't demux exactly\n");
+        failures++;
+    }
+
+    // lose a packet now and then, and insert garbage (without sync bytes)
+    {
+        size_t packets = w.size / TS_PACKET_SIZE, n;
+        uint8_t *damaged = malloc(w.size + packets);
+        size_t size = 0;
+        int dropped = 0, garbage = 0;
+        uint64_t garbage_bytes = 0;
+        srand(1);
+        for (n = 0; n < packets; n++) {
+            if (rand() % 1000 == 0) {
+                dropped++;
+                continue;
+            }
+            if (rand() % 3000 == 0) {
+                int k, length = 1 + rand() % 100;
+                for (k = 0; k < length; k++) {
+                    damaged[size++] = (uint8_t)(rand() % 0x40);
+                }
+                garbage++;
+                garbage_bytes += length;
+            }
+            memcpy(damaged + size, w.data + n * TS_PACKET_SIZE, TS_PACKET_SIZE);
+            size += TS_PACKET_SIZE;
+        }
+        memset(&c, 0, sizeof(c));
+        demux(damaged, size, APP_BUFFER_SIZE, check_pes, &c, &stats);
+        printf("damaged: %d packets dropped, %d garbage runs: %llu cc errors, %llu resyncs, "
+               "%d intact, %d corrupt, %d bad\n", dropped, garbage,
+               (unsigned long long)stats.cc_errors, (unsigned long long)stats.resyncs,
+               c.intact, c.corrupt, c.bad);
+        // garbage on both sides of a packet loses it too: the demuxer wants
+        // two sync bytes in a row before it trusts them
+        int losses = dropped + garbage;
+        if (c.bad || stats.resyncs == 0 || stats.skipped_bytes < garbage_bytes ||
+                stats.cc_errors == 0 || stats.cc_errors > (uint64_t)losses ||
+                c.intact < video + audio - 2 * losses) {
+            fprintf(stderr, "damage wasn't handled right\n");
+            failures++;
+        }
+        free(damaged);
+    }
+
+    free(w.data);
+    return failures;
+}
+
+// ----------------------------------------------------------------------------
+// A real file
+
+typedef struct {
+    uint16_t pid;
+    uint8_t stream_type;
+    int count;
+    int corrupt;
+    uint64_t bytes;
+    int64_t first_pts;
+    int64_t last_pts;
+} stream_summary;
+
+typedef struct {
+    stream_summary streams[16];
+    int count;
+} summary;
+
+static void summarize_pes(void *context, const ts_pes *pes) {
+    summary *s = context;
+    stream_summary *stream = NULL;
+    int i;
+    for (i = 0; i < s->count; i++) {
+        if (s->streams[i].pid == pes->pid) {
+            stream = &s->streams[i];
+        }
+    }
+    if (stream == NULL) {
+        if (s->count == 16) {
+            return;
+        }
+        stream = &s->streams[s->count++];
+        memset(stream, 0, sizeof(*stream));
+        stream->pid = pes->pid;
+        stream->stream_type = pes->stream_type;
+        stream->first_pts = pes->pts;
+    }
+    stream->count++;
+    stream->corrupt += pes->corrupt;
+    stream->bytes += pes->size;
+    if (pes->pts != TS_NO_TIMESTAMP) {
+        stream->last_pts = pes->pts;
+    }
+}
+
+static int file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    uint8_t *data;
+    size_t size;
+    summary s;
+    ts_demux *demux;
+    int i;
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(size);
+    if (fread(data, 1, size, f) != size) {
+        perror(path);
+        return 1;
+    }
+    fclose(f);
+
+    memset(&s, 0, sizeof(s));
+    demux = ts_demux_create(summarize_pes, &s);
+    int64_t start = nowus();
+    for (i = 0; (size_t)i * APP_BUFFER_SIZE < size; i++) {
+        size_t offset = (size_t)i * APP_BUFFER_SIZE;
+        ts_demux_feed(demux, data + offset,
+                      size - offset < APP_BUFFER_SIZE ? size - offset : APP_BUFFER_SIZE);
+    }
+    ts_demux_flush(demux);
+    double seconds = (nowus() - start) * 1e-6;
+    const ts_demux_stats *stats = ts_demux_get_stats(demux);
+
+    printf("%s: %.1f MB in %.2f ms, %.0f MB/s\n", path, size / 1e6, seconds * 1e3,
+           size / 1e6 / seconds);
+    for (i = 0; i < s.count; i++) {
+        stream_summary *stream = &s.streams[i];
+        printf("  pid 0x%x, type 0x%02x: %d PES (%d corrupt), %.1f MB, pts %.3f to %.3f s\n",
+               stream->pid, stream->stream_type, stream->count, stream->corrupt,
+               stream->bytes / 1e6, stream->first_pts / 90000.0, stream->last_pts / 90000.0);
+    }
+    printf("  %llu packets, %llu filtered, %llu cc errors, %llu resyncs, %llu bad PES\n",
+           (unsigned long long)stats->packets, (unsigned long long)stats->filtered,
+           (unsigned long long)stats->cc_errors, (unsigned long long)stats->resyncs,
+           (unsigned long long)stats->bad_pes);
+    int failed = s.count == 0;
+    ts_demux_destroy(demux);
+    free(data);
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    size_t megabytes = 128;
+    int c;
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+            case 'n':
+                megabytes = (size_t)atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n megabytes] [file.ts]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        return file(argv[optind]);
+    }
+    if (synthetic(megabytes)) {
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
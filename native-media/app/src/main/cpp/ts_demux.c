@@ -0,0 +1,588 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ts_demux.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define TS_MAX_PID 8192
+// PIDs followed at most: PMTs and elementary streams
+#define TS_MAX_STREAMS 64
+// PAT and PMT sections are at most 1024 bytes
+#define TS_MAX_SECTION_SIZE 1024
+// first size of a PES buffer; they grow as needed, and are reused
+#define TS_PES_BUFFER_SIZE (64 * 1024)
+
+#define TS_TABLE_PAT 0x00
+#define TS_TABLE_PMT 0x02
+
+// a reusable PES buffer
+typedef struct ts_buffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    struct ts_buffer *next;
+} ts_buffer;
+
+enum {
+    kPidPsi,
+    kPidPes,
+};
+
+typedef struct {
+    uint16_t pid;
+    uint8_t kind;
+    uint8_t cc;             // last continuity counter, or 0xff
+    uint16_t program;
+    uint8_t stream_type;
+
+    // PES
+    ts_buffer *pes;         // the one being assembled, or NULL
+    size_t expected;        // its size from its header, 0 if unbounded
+    int corrupt;
+
+    // PSI
+    int in_section;
+    size_t section_size;
+    int version;            // of the last table parsed, or -1
+    uint8_t section[TS_MAX_SECTION_SIZE + 3];
+} ts_pid;
+
+struct ts_demux {
+    uint32_t wanted[TS_MAX_PID / 32];   // bitmap of the PIDs in pids
+    uint8_t index[TS_MAX_PID];          // into pids
+    ts_pid pids[TS_MAX_STREAMS];
+    int pid_count;
+
+    ts_buffer *free_buffers;
+    uint8_t carry[TS_PACKET_SIZE];      // a packet split between feeds
+    size_t carry_size;
+
+    ts_pes_callback callback;
+    void *context;
+    ts_demux_stats stats;
+};
+
+static uint32_t crc_table[256];
+
+static void make_crc_table(void) {
+    uint32_t i, j;
+    for (i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (j = 0; j < 8; j++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+        crc_table[i] = crc;
+    }
+}
+
+// MPEG-2 CRC-32; a section including its CRC gives 0
+static uint32_t crc32_mpeg(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        crc = (crc << 8) ^ crc_table[(crc >> 24) ^ data[i]];
+    }
+    return crc;
+}
+
+static uint16_t be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t ts_find_sync(const uint8_t *data, size_t size) {
+    size_t i = 0;
+    // both the candidate and the byte a packet later must be sync bytes,
+    // tested 16 candidates at a time
+#if defined(__SSE2__)
+    const __m128i sync = _mm_set1_epi8(TS_SYNC_BYTE);
+    for (; i + TS_PACKET_SIZE + 16 <= size; i += 16) {
+        __m128i here = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), sync);
+        __m128i next = _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(data + i + TS_PACKET_SIZE)), sync);
+        int mask = _mm_movemask_epi8(_mm_and_si128(here, next));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t sync = vdupq_n_u8(TS_SYNC_BYTE);
+    for (; i + TS_PACKET_SIZE + 16 <= size; i += 16) {
+        uint8x16_t both = vandq_u8(vceqq_u8(vld1q_u8(data + i), sync),
+                                   vceqq_u8(vld1q_u8(data + i + TS_PACKET_SIZE), sync));
+        // narrowing leaves 4 bits per byte, in order
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+                vshrn_n_u16(vreinterpretq_u16_u8(both), 4)), 0);
+        if (mask) {
+            return i + __builtin_ctzll(mask) / 4;
+        }
+    }
+#endif
+    for (; i < size; i++) {
+        if (data[i] == TS_SYNC_BYTE &&
+                (i + TS_PACKET_SIZE >= size || data[i + TS_PACKET_SIZE] == TS_SYNC_BYTE)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+// ----------------------------------------------------------------------------
+
+ts_demux *ts_demux_create(ts_pes_callback callback, void *context) {
+    ts_demux *demux = calloc(1, sizeof(ts_demux));
+    if (demux == NULL) {
+        return NULL;
+    }
+    if (crc_table[1] == 0) {
+        make_crc_table();
+    }
+    demux->callback = callback;
+    demux->context = context;
+    return demux;
+}
+
+// starts following pid, or updates what is known of it. Returns NULL if
+// too many are followed already.
+static ts_pid *add_pid(ts_demux *demux, uint16_t pid, int kind, uint16_t program) {
+    ts_pid *state;
+    if (demux->wanted[pid / 32] & (1u << (pid % 32))) {
+        state = &demux->pids[demux->index[pid]];
+    } else {
+        if (demux->pid_count == TS_MAX_STREAMS) {
+            return NULL;
+        }
+        demux->index[pid] = (uint8_t)demux->pid_count;
+        state = &demux->pids[demux->pid_count++];
+        memset(state, 0, offsetof(ts_pid, section));
+        state->pid = pid;
+        state->cc = 0xff;
+        state->version = -1;
+        demux->wanted[pid / 32] |= 1u << (pid % 32);
+    }
+    state->kind = (uint8_t)kind;
+    state->program = program;
+    return state;
+}
+
+static ts_buffer *get_buffer(ts_demux *demux) {
+    ts_buffer *buffer = demux->free_buffers;
+    if (buffer) {
+        demux->free_buffers = buffer->next;
+    } else {
+        buffer = calloc(1, sizeof(ts_buffer));
+        if (buffer == NULL) {
+            return NULL;
+        }
+    }
+    buffer->size = 0;
+    return buffer;
+}
+
+static void put_buffer(ts_demux *demux, ts_buffer *buffer) {
+    buffer->next = demux->free_buffers;
+    demux->free_buffers = buffer;
+}
+
+static int append(ts_buffer *buffer, const uint8_t *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : TS_PES_BUFFER_SIZE;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+        uint8_t *grown = realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+void ts_demux_destroy(ts_demux *demux) {
+    if (demux == NULL) {
+        return;
+    }
+    ts_demux_reset(demux);
+    while (demux->free_buffers) {
+        ts_buffer *buffer = demux->free_buffers;
+        demux->free_buffers = buffer->next;
+        free(buffer->data);
+        free(buffer);
+    }
+    free(demux);
+}
+
+// ----------------------------------------------------------------------------
+// PSI: the PAT and the PMTs
+
+static void parse_pat(ts_demux *demux, const uint8_t *section, size_t size) {
+    const uint8_t *p;
+    // 8 bytes of header, 4 of CRC
+    for (p = section + 8; p + 4 <= section + size - 4; p += 4) {
+        uint16_t program = be16(p);
+        uint16_t pid = be16(p + 2) & 0x1fff;
+        if (program != 0) {     // 0 is the network PID
+            add_pid(demux, pid, kPidPsi, program);
+        }
+    }
+}
+
+static void parse_pmt(ts_demux *demux, const uint8_t *section, size_t size) {
+    uint16_t program = be16(section + 3);
+    const uint8_t *end = section + size - 4;
+    const uint8_t *p;
+    if (size < 16) {
+        return;
+    }
+    p = section + 12 + (be16(section + 10) & 0x0fff);
+    while (p + 5 <= end) {
+        uint8_t type = p[0];
+        uint16_t pid = be16(p + 1) & 0x1fff;
+        ts_pid *state = add_pid(demux, pid, kPidPes, program);
+        if (state) {
+            state->stream_type = type;
+        }
+        p += 5 + (be16(p + 3) & 0x0fff);
+    }
+}
+
+static void parse_section(ts_demux *demux, ts_pid *state) {
+    const uint8_t *section = state->section;
+    size_t size = state->section_size;
+    int version;
+    // long sections only, with their CRC
+    if (size < 12 || !(section[1] & 0x80)) {
+        return;
+    }
+    if (crc32_mpeg(section, size) != 0) {
+        demux->stats.crc_errors++;
+        return;
+    }
+    if (!(section[5] & 1)) {
+        return;     // not applicable yet
+    }
+    version = (section[5] >> 1) & 0x1f;
+    if (version == state->version) {
+        return;     // seen it
+    }
+    if (section[0] == TS_TABLE_PAT && state->pid == 0) {
+        parse_pat(demux, section, size);
+    } else if (section[0] == TS_TABLE_PMT) {
+        parse_pmt(demux, section, size);
+    } else {
+        return;
+    }
+    state->version = version;
+}
+
+// appends payload to the sections being assembled, parsing the complete ones
+static void section_data(ts_demux *demux, ts_pid *state, const uint8_t *p, size_t size) {
+    while (size > 0 && state->in_section) {
+        size_t want, n;
+        if (state->section_size == 0 && p[0] == 0xff) {
+            state->in_section = 0;      // stuffing up to the end of the packet
+            return;
+        }
+        want = 3;
+        if (state->section_size >= 3) {
+            want = 3 + (be16(state->section + 1) & 0x0fff);
+            // too short for a PAT or PMT: zeros instead of stuffing, say
+            if (want < 12 || want > sizeof(state->section)) {
+                state->in_section = 0;
+                state->section_size = 0;
+                return;
+            }
+        }
+        n = want - state->section_size;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(state->section + state->section_size, p, n);
+        state->section_size += n;
+        p += n;
+        size -= n;
+        if (state->section_size == want && want > 3) {
+            parse_section(demux, state);
+            state->section_size = 0;
+        }
+    }
+}
+
+static void psi_payload(ts_demux *demux, ts_pid *state, const uint8_t *p, size_t size,
+                        int unit_start) {
+    if (unit_start) {
+        // a pointer to the new section, after the end of the previous one
+        size_t pointer;
+        if (size == 0) {
+            return;
+        }
+        pointer = p[0];
+        p++;
+        size--;
+        if (pointer > size) {
+            state->in_section = 0;
+            state->section_size = 0;
+            return;
+        }
+        section_data(demux, state, p, pointer);
+        p += pointer;
+        size -= pointer;
+        state->in_section = 1;
+        state->section_size = 0;
+    }
+    section_data(demux, state, p, size);
+}
+
+// ----------------------------------------------------------------------------
+// PES
+
+static int64_t timestamp(const uint8_t *p) {
+    return ((int64_t)(p[0] & 0x0e) << 29) | ((int64_t)p[1] << 22) |
+           ((int64_t)(p[2] & 0xfe) << 14) | ((int64_t)p[3] << 7) | (p[4] >> 1);
+}
+
+// stream ids whose PES packets don't have the optional header
+static int has_pes_header(uint8_t id) {
+    return id != 0xbc && id != 0xbe && id != 0xbf && id != 0xf0 && id != 0xf1 &&
+           id != 0xf2 && id != 0xf8 && id != 0xff;
+}
+
+// hands the PES in state over to the callback, and its buffer back to the pool
+static void deliver(ts_demux *demux, ts_pid *state) {
+    ts_buffer *buffer = state->pes;
+    const uint8_t *p = buffer->data;
+    size_t size = buffer->size;
+    ts_pes pes;
+
+    state->pes = NULL;
+    if (state->expected && size > state->expected) {
+        size = state->expected;
+    }
+    if (size < 6 || p[0] != 0 || p[1] != 0 || p[2] != 1) {
+        demux->stats.bad_pes++;
+        put_buffer(demux, buffer);
+        return;
+    }
+    pes.pid = state->pid;
+    pes.program = state->program;
+    pes.stream_type = state->stream_type;
+    pes.stream_id = p[3];
+    pes.pts = pes.dts = TS_NO_TIMESTAMP;
+    pes.corrupt = state->corrupt;
+    pes.data = p + 6;
+    pes.size = size - 6;
+    if (has_pes_header(pes.stream_id)) {
+        uint8_t flags;
+        size_t header;
+        if (size < 9 || (p[6] & 0xc0) != 0x80 || 9 + (size_t)p[8] > size) {
+            demux->stats.bad_pes++;
+            put_buffer(demux, buffer);
+            return;
+        }
+        flags = p[7] >> 6;
+        header = p[8];
+        if ((flags & 2) && header >= 5) {
+            pes.pts = pes.dts = timestamp(p + 9);
+            if (flags == 3 && header >= 10) {
+                pes.dts = timestamp(p + 14);
+            }
+        }
+        pes.data = p + 9 + header;
+        pes.size = size - 9 - header;
+    }
+    demux->stats.pes++;
+    demux->callback(demux->context, &pes);
+    put_buffer(demux, buffer);
+}
+
+static void pes_payload(ts_demux *demux, ts_pid *state, const uint8_t *p, size_t size,
+                        int unit_start) {
+    if (unit_start) {
+        if (state->pes) {
+            deliver(demux, state);      // an unbounded one ends here
+        }
+        state->pes = get_buffer(demux);
+        state->expected = 0;
+        state->corrupt = 0;
+    }
+    if (state->pes == NULL) {
+        return;     // waiting for the start of a PES
+    }
+    if (!append(state->pes, p, size)) {
+        put_buffer(demux, state->pes);
+        state->pes = NULL;
+        return;
+    }
+    if (state->expected == 0 && state->pes->size >= 6) {
+        size_t length = be16(state->pes->data + 4);
+        if (length) {
+            state->expected = 6 + length;
+        }
+    }
+    if (state->expected && state->pes->size >= state->expected) {
+        deliver(demux, state);
+    }
+}
+
+// a PES or section lost some of its data
+static void lost(ts_pid *state) {
+    if (state->kind == kPidPes) {
+        state->corrupt = 1;
+    } else {
+        state->in_section = 0;
+        state->section_size = 0;
+    }
+}
+
+static void packet(ts_demux *demux, const uint8_t *p) {
+    uint16_t pid = be16(p + 1) & 0x1fff;
+    ts_pid *state;
+    const uint8_t *payload = p + 4;
+    int control, cc, discontinuity = 0;
+
+    demux->stats.packets++;
+    if (!(demux->wanted[pid / 32] & (1u << (pid % 32)))) {
+        demux->stats.filtered++;
+        return;
+    }
+    state = &demux->pids[demux->index[pid]];
+    if (p[1] & 0x80) {
+        lost(state);    // transport error indicator
+        return;
+    }
+
+    control = (p[3] >> 4) & 3;
+    cc = p[3] & 0xf;
+    if (control & 2) {
+        // adaptation field
+        size_t length = p[4];
+        if (length > TS_PACKET_SIZE - 5) {
+            lost(state);
+            return;
+        }
+        if (length > 0) {
+            discontinuity = p[5] & 0x80;
+        }
+        payload = p + 5 + length;
+    }
+    if (!(control & 1)) {
+        return;     // no payload, and the counter doesn't count these
+    }
+
+    if (state->cc != 0xff && !discontinuity) {
+        if (cc == state->cc) {
+            demux->stats.duplicates++;
+            return;
+        }
+        if (cc != ((state->cc + 1) & 0xf)) {
+            demux->stats.cc_errors++;
+            lost(state);
+        }
+    }
+    state->cc = (uint8_t)cc;
+
+    if (state->kind == kPidPes) {
+        pes_payload(demux, state, payload, p + TS_PACKET_SIZE - payload, p[1] & 0x40);
+    } else {
+        psi_payload(demux, state, payload, p + TS_PACKET_SIZE - payload, p[1] & 0x40);
+    }
+}
+
+void ts_demux_feed(ts_demux *demux, const uint8_t *data, size_t size) {
+    if (demux->pid_count == 0) {
+        add_pid(demux, 0, kPidPsi, 0);  // the PAT
+    }
+
+    // the rest of a packet split between feeds
+    if (demux->carry_size) {
+        size_t n = TS_PACKET_SIZE - demux->carry_size;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(demux->carry + demux->carry_size, data, n);
+        demux->carry_size += n;
+        data += n;
+        size -= n;
+        if (demux->carry_size < TS_PACKET_SIZE) {
+            return;
+        }
+        packet(demux, demux->carry);
+        demux->carry_size = 0;
+    }
+
+    while (size >= TS_PACKET_SIZE) {
+        if (data[0] != TS_SYNC_BYTE) {
+            size_t skip = ts_find_sync(data, size);
+            demux->stats.resyncs++;
+            demux->stats.skipped_bytes += skip;
+            data += skip;
+            size -= skip;
+            continue;
+        }
+        packet(demux, data);
+        data += TS_PACKET_SIZE;
+        size -= TS_PACKET_SIZE;
+    }
+
+    if (size > 0) {
+        size_t skip = ts_find_sync(data, size);
+        demux->stats.skipped_bytes += skip;
+        memcpy(demux->carry, data + skip, size - skip);
+        demux->carry_size = size - skip;
+    }
+}
+
+void ts_demux_flush(ts_demux *demux) {
+    int i;
+    for (i = 0; i < demux->pid_count; i++) {
+        if (demux->pids[i].pes) {
+            deliver(demux, &demux->pids[i]);
+        }
+    }
+    demux->carry_size = 0;
+}
+
+void ts_demux_reset(ts_demux *demux) {
+    int i;
+    for (i = 0; i < demux->pid_count; i++) {
+        ts_pid *state = &demux->pids[i];
+        if (state->pes) {
+            put_buffer(demux, state->pes);
+            state->pes = NULL;
+        }
+        state->cc = 0xff;
+        state->in_section = 0;
+        state->section_size = 0;
+    }
+    demux->carry_size = 0;
+}
+
+const ts_demux_stats *ts_demux_get_stats(const ts_demux *demux) {
+    return &demux->stats;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TS_DEMUX_H
+#define TS_DEMUX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* MPEG-2 transport stream demultiplexer, without any Android dependency.
+ *
+ * Feed it the stream in chunks of any size. It follows the PAT to the PMTs,
+ * and the PMTs to the elementary streams, and hands every PES packet of
+ * those streams, reassembled, to a callback. Packets of any other PID are
+ * rejected with a bitmap lookup. Lost sync is found again with SIMD.
+ */
+
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+#define TS_NO_TIMESTAMP INT64_MIN
+
+typedef struct ts_demux ts_demux;
+
+typedef struct {
+    uint16_t pid;
+    uint16_t program;
+    uint8_t stream_type;    // from the PMT: 0x1b H.264, 0x0f AAC, ...
+    uint8_t stream_id;      // from the PES header
+    int64_t pts;            // 90 kHz, or TS_NO_TIMESTAMP
+    int64_t dts;            // the pts if the PES has no dts
+    const uint8_t *data;    // the elementary stream data
+    size_t size;
+    int corrupt;            // packets of this PES were lost
+} ts_pes;
+
+// data is only valid during the call
+typedef void (*ts_pes_callback)(void *context, const ts_pes *pes);
+
+typedef struct {
+    uint64_t packets;
+    uint64_t filtered;      // on PIDs nobody wants
+    uint64_t resyncs;
+    uint64_t skipped_bytes; // looking for sync
+    uint64_t cc_errors;     // continuity counter jumps: lost packets
+    uint64_t duplicates;
+    uint64_t crc_errors;    // PSI sections
+    uint64_t pes;
+    uint64_t bad_pes;       // PES packets with a broken header, dropped
+} ts_demux_stats;
+
+ts_demux *ts_demux_create(ts_pes_callback callback, void *context);
+void ts_demux_destroy(ts_demux *demux);
+
+void ts_demux_feed(ts_demux *demux, const uint8_t *data, size_t size);
+// at the end of the stream: delivers the PES packets still being assembled
+void ts_demux_flush(ts_demux *demux);
+// at a discontinuity (a seek): drops them instead, and any partial packet.
+// The PAT and PMTs are kept.
+void ts_demux_reset(ts_demux *demux);
+
+const ts_demux_stats *ts_demux_get_stats(const ts_demux *demux);
+
+// the offset of the first sync byte in data that is followed by another one
+// a packet later (or by the end of data), or size if there is none
+size_t ts_find_sync(const uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
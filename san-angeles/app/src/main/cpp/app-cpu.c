@@ -0,0 +1,119 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2009 The Android Open Source Project
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+/* Runs the demo without a GPU: the GL calls go to cpugl, which transforms
+ * and lights every frame on the CPU, so the camera tracks become a CPU
+ * benchmark. Nothing is displayed.
+ *
+ * Usage: sanangeles-cpu [-t threads] [-x] [-s step] [-v]
+ *   -t  number of threads, including the main one (default: one per CPU)
+ *   -x  use the 16.16 fixed point path instead of the float one
+ *   -s  milliseconds of demo time per frame (default 16)
+ *   -v  print the statistics of every frame
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "importgl.h"
+#include "cpugl.h"
+
+#include "app.h"
+
+
+int gAppAlive = 1;
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-x] [-s step] [-v]\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int threads = 0, fixedPoint = 0, verbose = 0, step = 16;
+    int frames = 0, a;
+    long tick, vertices = 0;
+    float totalMs = 0, minMs = 0, maxMs = 0;
+    CPUTL_STATS stats;
+
+    for (a = 1; a < argc; ++a)
+    {
+        if (strcmp(argv[a], "-t") == 0 && a + 1 < argc)
+            threads = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc)
+            step = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-x") == 0)
+            fixedPoint = 1;
+        else if (strcmp(argv[a], "-v") == 0)
+            verbose = 1;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (step < 1)
+        step = 1;
+
+    if (!cpuglInit(threads, fixedPoint))
+    {
+        fprintf(stderr, "Failed to initialize the CPU renderer\n");
+        return 1;
+    }
+    appInit();
+
+    // appRender() clears gAppAlive after the last camera track
+    for (tick = step; ; tick += step)
+    {
+        appRender(tick, WINDOW_DEFAULT_WIDTH, WINDOW_DEFAULT_HEIGHT);
+        if (!gAppAlive)
+            break;
+        cpuglEndFrame(&stats);
+
+        if (frames == 0 || stats.ms < minMs)
+            minMs = stats.ms;
+        if (frames == 0 || stats.ms > maxMs)
+            maxMs = stats.ms;
+        totalMs += stats.ms;
+        vertices += stats.vertices;
+        ++frames;
+        if (verbose)
+            printf("frame %d (tick %ld): %d draws, %ld vertices, %ld lit, "
+                   "%.3f ms\n", frames, tick, stats.draws, stats.vertices,
+                   stats.litVertices, stats.ms);
+    }
+
+    if (frames > 0)
+    {
+        printf("%s path, %d threads: %d frames, %ld vertices\n",
+               fixedPoint ? "fixed point" : "float", stats.threads, frames,
+               vertices);
+        printf("frame time: avg %.3f ms, min %.3f ms, max %.3f ms, "
+               "%.1f Mvertices/s\n", totalMs / frames, minMs, maxMs,
+               totalMs > 0 ? vertices / totalMs / 1000 : 0);
+    }
+
+    appDeinit();
+    cpuglDeinit();
+    return 0;
+}
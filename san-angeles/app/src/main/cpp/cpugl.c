@@ -0,0 +1,600 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2009 The Android Open Source Project
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define CPUGL_IMPLEMENTATION
+#include "cpugl.h"
+
+
+#undef PI
+#define PI 3.1415926535897932f
+
+// Minimum depths required by the spec.
+#define MODELVIEW_STACK_DEPTH 16
+#define PROJECTION_STACK_DEPTH 2
+
+
+typedef struct {
+    int enabled;
+    float position[4];    // eye space
+    float ambient[4], diffuse[4], specular[4];
+} LIGHT;
+
+
+static CPUTL_ENGINE *sEngine = NULL;
+
+static float sModelview[MODELVIEW_STACK_DEPTH][16];
+static float sProjection[PROJECTION_STACK_DEPTH][16];
+static int sModelviewDepth = 0, sProjectionDepth = 0;
+static GLenum sMatrixMode = GL_MODELVIEW;
+
+static int sLighting = 0, sNormalize = 0;
+static LIGHT sLights[CPUTL_MAX_LIGHTS];
+static float sMaterialSpecular[4];
+static float sShininess = 0;
+static GLubyte sColor[4];
+
+static const GLfixed *sVertexPointer = NULL;
+static GLint sVertexSize = 4;
+static const GLfixed *sNormalPointer = NULL;
+static const GLubyte *sColorPointer = NULL;
+static int sNormalArray = 0, sColorArray = 0;
+
+/* Draws of the current frame, and the lighting environments they use. A
+ * new environment is recorded when a light or the material has changed
+ * since the last lit draw.
+ */
+static CPUTL_DRAW *sDraws = NULL;
+static int *sDrawLightings = NULL;    // index to sLightings, or -1
+static int sDrawCount = 0, sDrawCapacity = 0;
+static int sLastDrawCount = 0;    // draws of the last cpuglEndFrame()
+static CPUTL_LIGHTING *sLightings = NULL;
+static int sLightingCount = 0, sLightingCapacity = 0;
+static int sLightingDirty = 1;
+
+
+static float fixedToFloat(GLfixed value)
+{
+    return value * (1.0f / 65536);
+}
+
+
+static void loadIdentity(float *m)
+{
+    int a;
+    for (a = 0; a < 16; ++a)
+        m[a] = (a % 5) == 0 ? 1.0f : 0.0f;
+}
+
+
+static float * currentMatrix()
+{
+    if (sMatrixMode == GL_PROJECTION)
+        return sProjection[sProjectionDepth];
+    return sModelview[sModelviewDepth];
+}
+
+
+static void multCurrentMatrix(const float *m)
+{
+    float *current = currentMatrix();
+    cputlMultMatrix(current, current, m);
+}
+
+
+static void setColor4(float *dest, const GLfixed *params)
+{
+    int a;
+    for (a = 0; a < 4; ++a)
+        dest[a] = fixedToFloat(params[a]);
+}
+
+
+static void resetState()
+{
+    int i;
+    static const float black[4] = { 0, 0, 0, 1 };
+    static const float white[4] = { 1, 1, 1, 1 };
+
+    loadIdentity(sModelview[0]);
+    loadIdentity(sProjection[0]);
+    sModelviewDepth = sProjectionDepth = 0;
+    sMatrixMode = GL_MODELVIEW;
+
+    sLighting = sNormalize = 0;
+    for (i = 0; i < CPUTL_MAX_LIGHTS; ++i)
+    {
+        LIGHT *light = &sLights[i];
+        light->enabled = 0;
+        light->position[0] = light->position[1] = light->position[3] = 0;
+        light->position[2] = 1;
+        memcpy(light->ambient, black, sizeof(black));
+        memcpy(light->diffuse, i == 0 ? white : black, sizeof(white));
+        memcpy(light->specular, i == 0 ? white : black, sizeof(white));
+    }
+    memcpy(sMaterialSpecular, black, sizeof(black));
+    sShininess = 0;
+    sColor[0] = sColor[1] = sColor[2] = sColor[3] = 255;
+
+    sVertexPointer = sNormalPointer = NULL;
+    sColorPointer = NULL;
+    sVertexSize = 4;
+    sNormalArray = sColorArray = 0;
+    sLightingDirty = 1;
+}
+
+
+int cpuglInit(int threads, int fixedPoint)
+{
+    if (sEngine == NULL)
+        sEngine = cputlCreate(threads, fixedPoint);
+    resetState();
+    return sEngine != NULL;
+}
+
+
+void cpuglDeinit()
+{
+    cputlDestroy(sEngine);
+    sEngine = NULL;
+    free(sDraws);
+    free(sDrawLightings);
+    free(sLightings);
+    sDraws = NULL;
+    sDrawLightings = NULL;
+    sLightings = NULL;
+    sDrawCount = sDrawCapacity = sLastDrawCount = 0;
+    sLightingCount = sLightingCapacity = 0;
+}
+
+
+// Records the current lights and material; returns its index or -1.
+static int recordLighting()
+{
+    CPUTL_LIGHTING *lighting;
+    int i;
+
+    if (sLightingCount == sLightingCapacity)
+    {
+        int capacity = sLightingCapacity ? sLightingCapacity * 2 : 4;
+        CPUTL_LIGHTING *lightings = (CPUTL_LIGHTING *)realloc(sLightings,
+                                        capacity * sizeof(CPUTL_LIGHTING));
+        if (lightings == NULL)
+            return -1;
+        sLightings = lightings;
+        sLightingCapacity = capacity;
+    }
+    lighting = &sLightings[sLightingCount];
+    lighting->lightCount = 0;
+    for (i = 0; i < CPUTL_MAX_LIGHTS; ++i)
+    {
+        CPUTL_LIGHT *dest;
+        if (!sLights[i].enabled)
+            continue;
+        // only directional lights: a positional one shines from its position
+        dest = &lighting->lights[lighting->lightCount++];
+        memcpy(dest->direction, sLights[i].position, sizeof(dest->direction));
+        memcpy(dest->ambient, sLights[i].ambient, sizeof(dest->ambient));
+        memcpy(dest->diffuse, sLights[i].diffuse, sizeof(dest->diffuse));
+        memcpy(dest->specular, sLights[i].specular, sizeof(dest->specular));
+    }
+    lighting->sceneAmbient[0] = lighting->sceneAmbient[1] =
+        lighting->sceneAmbient[2] = 0.2f;
+    lighting->sceneAmbient[3] = 1;
+    memcpy(lighting->materialSpecular, sMaterialSpecular,
+           sizeof(sMaterialSpecular));
+    lighting->shininess = sShininess;
+    cputlSetupLighting(lighting);
+    sLightingDirty = 0;
+    return sLightingCount++;
+}
+
+
+void cpuglDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    CPUTL_DRAW *draw;
+    int lighting = -1;
+
+    // the primitive doesn't matter before rasterization
+    (void)mode;
+    if (sVertexPointer == NULL || count <= 0)
+        return;
+
+    if (sDrawCount == sDrawCapacity)
+    {
+        int capacity = sDrawCapacity ? sDrawCapacity * 2 : 64;
+        CPUTL_DRAW *draws = (CPUTL_DRAW *)realloc(sDraws,
+                                capacity * sizeof(CPUTL_DRAW));
+        int *lightings;
+        if (draws == NULL)
+            return;
+        sDraws = draws;
+        lightings = (int *)realloc(sDrawLightings, capacity * sizeof(int));
+        if (lightings == NULL)
+            return;
+        sDrawLightings = lightings;
+        sDrawCapacity = capacity;
+    }
+    if (sLighting)
+    {
+        lighting = sLightingDirty ? recordLighting() : sLightingCount - 1;
+        if (lighting < 0)
+            return;
+    }
+
+    draw = &sDraws[sDrawCount];
+    memcpy(draw->modelview, sModelview[sModelviewDepth], sizeof(draw->modelview));
+    memcpy(draw->projection, sProjection[sProjectionDepth],
+           sizeof(draw->projection));
+    draw->lighting = NULL;    // set by cpuglEndFrame
+    draw->normalize = sNormalize;
+    draw->vertexArray = sVertexPointer;
+    draw->vertexComponents = sVertexSize;
+    draw->normalArray = sNormalArray ? sNormalPointer : NULL;
+    draw->colorArray = sColorArray ? sColorPointer : NULL;
+    memcpy(draw->color, sColor, sizeof(sColor));
+    draw->first = first;
+    draw->count = count;
+    sDrawLightings[sDrawCount++] = lighting;
+}
+
+
+void cpuglEndFrame(CPUTL_STATS *stats)
+{
+    int i;
+    // sLightings doesn't move anymore in this frame
+    for (i = 0; i < sDrawCount; ++i)
+        sDraws[i].lighting = sDrawLightings[i] >= 0 ?
+                             &sLightings[sDrawLightings[i]] : NULL;
+    cputlRun(sEngine, sDraws, sDrawCount, stats);
+    sLastDrawCount = sDrawCount;
+    sDrawCount = 0;
+    sLightingCount = 0;
+    sLightingDirty = 1;
+}
+
+
+const CPUTL_DRAW * cpuglGetLastDraws(int *count)
+{
+    *count = sLastDrawCount;
+    return sDraws;
+}
+
+
+const CPUTL_ENGINE * cpuglGetEngine()
+{
+    return sEngine;
+}
+
+
+void cpuglEnable(GLenum cap)
+{
+    if (cap == GL_LIGHTING)
+        sLighting = 1;
+    else if (cap == GL_NORMALIZE)
+        sNormalize = 1;
+    else if (cap >= GL_LIGHT0 && cap < GL_LIGHT0 + CPUTL_MAX_LIGHTS)
+    {
+        sLights[cap - GL_LIGHT0].enabled = 1;
+        sLightingDirty = 1;
+    }
+    // The rest only matters to rasterization. Color material is always on.
+}
+
+
+void cpuglDisable(GLenum cap)
+{
+    if (cap == GL_LIGHTING)
+        sLighting = 0;
+    else if (cap == GL_NORMALIZE)
+        sNormalize = 0;
+    else if (cap >= GL_LIGHT0 && cap < GL_LIGHT0 + CPUTL_MAX_LIGHTS)
+    {
+        sLights[cap - GL_LIGHT0].enabled = 0;
+        sLightingDirty = 1;
+    }
+}
+
+
+void cpuglEnableClientState(GLenum array)
+{
+    if (array == GL_NORMAL_ARRAY)
+        sNormalArray = 1;
+    else if (array == GL_COLOR_ARRAY)
+        sColorArray = 1;
+}
+
+
+void cpuglDisableClientState(GLenum array)
+{
+    if (array == GL_NORMAL_ARRAY)
+        sNormalArray = 0;
+    else if (array == GL_COLOR_ARRAY)
+        sColorArray = 0;
+}
+
+
+void cpuglVertexPointer(GLint size, GLenum type, GLsizei stride,
+                        const GLvoid *pointer)
+{
+    if (type != GL_FIXED || stride != 0)
+        return;
+    sVertexSize = size;
+    sVertexPointer = (const GLfixed *)pointer;
+}
+
+
+void cpuglNormalPointer(GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    if (type != GL_FIXED || stride != 0)
+        return;
+    sNormalPointer = (const GLfixed *)pointer;
+}
+
+
+void cpuglColorPointer(GLint size, GLenum type, GLsizei stride,
+                       const GLvoid *pointer)
+{
+    if (size != 4 || type != GL_UNSIGNED_BYTE || stride != 0)
+        return;
+    sColorPointer = (const GLubyte *)pointer;
+}
+
+
+void cpuglColor4x(GLfixed red, GLfixed green, GLfixed blue, GLfixed alpha)
+{
+    const GLfixed color[4] = { red, green, blue, alpha };
+    int a;
+    for (a = 0; a < 4; ++a)
+    {
+        GLfixed c = color[a] < 0 ? 0 : color[a] > 0x10000 ? 0x10000 : color[a];
+        sColor[a] = (GLubyte)((c * 255 + 0x8000) >> 16);
+    }
+}
+
+
+void cpuglLightxv(GLenum light, GLenum pname, const GLfixed *params)
+{
+    LIGHT *l;
+    if (light < GL_LIGHT0 || light >= GL_LIGHT0 + CPUTL_MAX_LIGHTS)
+        return;
+    l = &sLights[light - GL_LIGHT0];
+    switch (pname)
+    {
+    case GL_POSITION:
+    {
+        // stored in eye space, as transformed by the current modelview
+        const float *m = sModelview[sModelviewDepth];
+        float p[4];
+        int row;
+        setColor4(p, params);
+        for (row = 0; row < 4; ++row)
+            l->position[row] = m[row] * p[0] + m[4 + row] * p[1] +
+                               m[8 + row] * p[2] + m[12 + row] * p[3];
+        break;
+    }
+    case GL_AMBIENT:
+        setColor4(l->ambient, params);
+        break;
+    case GL_DIFFUSE:
+        setColor4(l->diffuse, params);
+        break;
+    case GL_SPECULAR:
+        setColor4(l->specular, params);
+        break;
+    default:
+        return;
+    }
+    sLightingDirty = 1;
+}
+
+
+void cpuglMaterialxv(GLenum face, GLenum pname, const GLfixed *params)
+{
+    (void)face;
+    if (pname == GL_SPECULAR)
+    {
+        setColor4(sMaterialSpecular, params);
+        sLightingDirty = 1;
+    }
+    else if (pname == GL_SHININESS)
+        cpuglMaterialx(face, pname, params[0]);
+}
+
+
+void cpuglMaterialx(GLenum face, GLenum pname, GLfixed param)
+{
+    (void)face;
+    if (pname != GL_SHININESS)
+        return;
+    sShininess = fixedToFloat(param);
+    sLightingDirty = 1;
+}
+
+
+void cpuglMatrixMode(GLenum mode)
+{
+    if (mode == GL_MODELVIEW || mode == GL_PROJECTION)
+        sMatrixMode = mode;
+}
+
+
+void cpuglLoadIdentity()
+{
+    loadIdentity(currentMatrix());
+}
+
+
+void cpuglPushMatrix()
+{
+    if (sMatrixMode == GL_PROJECTION)
+    {
+        if (sProjectionDepth + 1 >= PROJECTION_STACK_DEPTH)
+            return;
+        memcpy(sProjection[sProjectionDepth + 1], sProjection[sProjectionDepth],
+               sizeof(sProjection[0]));
+        ++sProjectionDepth;
+    }
+    else
+    {
+        if (sModelviewDepth + 1 >= MODELVIEW_STACK_DEPTH)
+            return;
+        memcpy(sModelview[sModelviewDepth + 1], sModelview[sModelviewDepth],
+               sizeof(sModelview[0]));
+        ++sModelviewDepth;
+    }
+}
+
+
+void cpuglPopMatrix()
+{
+    if (sMatrixMode == GL_PROJECTION)
+    {
+        if (sProjectionDepth > 0)
+            --sProjectionDepth;
+    }
+    else if (sModelviewDepth > 0)
+        --sModelviewDepth;
+}
+
+
+void cpuglMultMatrixx(const GLfixed *m)
+{
+    float f[16];
+    int a;
+    for (a = 0; a < 16; ++a)
+        f[a] = fixedToFloat(m[a]);
+    multCurrentMatrix(f);
+}
+
+
+void cpuglTranslatex(GLfixed x, GLfixed y, GLfixed z)
+{
+    float m[16];
+    loadIdentity(m);
+    m[12] = fixedToFloat(x);
+    m[13] = fixedToFloat(y);
+    m[14] = fixedToFloat(z);
+    multCurrentMatrix(m);
+}
+
+
+void cpuglScalex(GLfixed x, GLfixed y, GLfixed z)
+{
+    float m[16];
+    loadIdentity(m);
+    m[0] = fixedToFloat(x);
+    m[5] = fixedToFloat(y);
+    m[10] = fixedToFloat(z);
+    multCurrentMatrix(m);
+}
+
+
+void cpuglRotatex(GLfixed angle, GLfixed x, GLfixed y, GLfixed z)
+{
+    float m[16];
+    float ax = fixedToFloat(x), ay = fixedToFloat(y), az = fixedToFloat(z);
+    float len = (float)sqrt(ax * ax + ay * ay + az * az);
+    float radians = fixedToFloat(angle) * PI / 180;
+    float c = (float)cos(radians), s = (float)sin(radians), ic = 1 - c;
+
+    if (len == 0)
+        return;
+    ax /= len;
+    ay /= len;
+    az /= len;
+
+    loadIdentity(m);
+    m[0] = ax * ax * ic + c;
+    m[1] = ay * ax * ic + az * s;
+    m[2] = az * ax * ic - ay * s;
+    m[4] = ax * ay * ic - az * s;
+    m[5] = ay * ay * ic + c;
+    m[6] = az * ay * ic + ax * s;
+    m[8] = ax * az * ic + ay * s;
+    m[9] = ay * az * ic - ax * s;
+    m[10] = az * az * ic + c;
+    multCurrentMatrix(m);
+}
+
+
+void cpuglFrustumx(GLfixed left, GLfixed right, GLfixed bottom, GLfixed top,
+                   GLfixed zNear, GLfixed zFar)
+{
+    float l = fixedToFloat(left), r = fixedToFloat(right);
+    float b = fixedToFloat(bottom), t = fixedToFloat(top);
+    float n = fixedToFloat(zNear), f = fixedToFloat(zFar);
+    float m[16];
+
+    if (l == r || b == t || n <= 0 || f <= 0 || n == f)
+        return;
+    memset(m, 0, sizeof(m));
+    m[0] = 2 * n / (r - l);
+    m[5] = 2 * n / (t - b);
+    m[8] = (r + l) / (r - l);
+    m[9] = (t + b) / (t - b);
+    m[10] = -(f + n) / (f - n);
+    m[11] = -1;
+    m[14] = -2 * f * n / (f - n);
+    multCurrentMatrix(m);
+}
+
+
+// State that only matters to rasterization.
+
+void cpuglBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+    (void)sfactor;
+    (void)dfactor;
+}
+
+
+void cpuglClear(GLbitfield mask)
+{
+    (void)mask;
+}
+
+
+void cpuglClearColorx(GLclampx red, GLclampx green, GLclampx blue,
+                      GLclampx alpha)
+{
+    (void)red;
+    (void)green;
+    (void)blue;
+    (void)alpha;
+}
+
+
+void cpuglShadeModel(GLenum mode)
+{
+    (void)mode;
+}
+
+
+void cpuglViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+}
@@ -0,0 +1,130 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2009 The Android Open Source Project
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+/* The GLES 1.x calls used by demo.c, implemented on the CPU with cputl:
+ * matrix stacks, lights and vertex arrays are tracked like GL does, and
+ * each glDrawArrays is recorded for transform and lighting at the end of
+ * the frame. Nothing is rasterized. Including this after importgl.h
+ * redirects the GL calls here, the way importgl.h redirects them to
+ * imported function pointers.
+ *
+ * Only what the demo uses is supported: tightly packed GL_FIXED vertex and
+ * normal arrays, GL_UNSIGNED_BYTE colors, directional lights and color
+ * material.
+ */
+
+#ifndef CPUGL_H_INCLUDED
+#define CPUGL_H_INCLUDED
+
+
+#include "importgl.h"
+#include "cputl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// threads and fixedPoint are as in cputlCreate(). Returns 0 on failure.
+extern int cpuglInit(int threads, int fixedPoint);
+extern void cpuglDeinit();
+
+/* Transforms and lights the draws recorded since the previous call, and
+ * returns their statistics.
+ */
+extern void cpuglEndFrame(CPUTL_STATS *stats);
+
+/* The draws transformed by the last cpuglEndFrame() and the engine holding
+ * their output, for checking it. Valid until the next GL call.
+ */
+extern const CPUTL_DRAW * cpuglGetLastDraws(int *count);
+extern const CPUTL_ENGINE * cpuglGetEngine();
+
+extern void cpuglBlendFunc(GLenum sfactor, GLenum dfactor);
+extern void cpuglClear(GLbitfield mask);
+extern void cpuglClearColorx(GLclampx red, GLclampx green, GLclampx blue,
+                             GLclampx alpha);
+extern void cpuglColor4x(GLfixed red, GLfixed green, GLfixed blue,
+                         GLfixed alpha);
+extern void cpuglColorPointer(GLint size, GLenum type, GLsizei stride,
+                              const GLvoid *pointer);
+extern void cpuglDisable(GLenum cap);
+extern void cpuglDisableClientState(GLenum array);
+extern void cpuglDrawArrays(GLenum mode, GLint first, GLsizei count);
+extern void cpuglEnable(GLenum cap);
+extern void cpuglEnableClientState(GLenum array);
+extern void cpuglFrustumx(GLfixed left, GLfixed right, GLfixed bottom,
+                          GLfixed top, GLfixed zNear, GLfixed zFar);
+extern void cpuglLightxv(GLenum light, GLenum pname, const GLfixed *params);
+extern void cpuglLoadIdentity();
+extern void cpuglMaterialx(GLenum face, GLenum pname, GLfixed param);
+extern void cpuglMaterialxv(GLenum face, GLenum pname, const GLfixed *params);
+extern void cpuglMatrixMode(GLenum mode);
+extern void cpuglMultMatrixx(const GLfixed *m);
+extern void cpuglNormalPointer(GLenum type, GLsizei stride,
+                               const GLvoid *pointer);
+extern void cpuglPopMatrix();
+extern void cpuglPushMatrix();
+extern void cpuglRotatex(GLfixed angle, GLfixed x, GLfixed y, GLfixed z);
+extern void cpuglScalex(GLfixed x, GLfixed y, GLfixed z);
+extern void cpuglShadeModel(GLenum mode);
+extern void cpuglTranslatex(GLfixed x, GLfixed y, GLfixed z);
+extern void cpuglVertexPointer(GLint size, GLenum type, GLsizei stride,
+                               const GLvoid *pointer);
+extern void cpuglViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+
+#ifndef CPUGL_IMPLEMENTATION
+#define glBlendFunc             cpuglBlendFunc
+#define glClear                 cpuglClear
+#define glClearColorx           cpuglClearColorx
+#define glColor4x               cpuglColor4x
+#define glColorPointer          cpuglColorPointer
+#define glDisable               cpuglDisable
+#define glDisableClientState    cpuglDisableClientState
+#define glDrawArrays            cpuglDrawArrays
+#define glEnable                cpuglEnable
+#define glEnableClientState     cpuglEnableClientState
+#define glFrustumx              cpuglFrustumx
+#define glLightxv               cpuglLightxv
+#define glLoadIdentity          cpuglLoadIdentity
+#define glMaterialx             cpuglMaterialx
+#define glMaterialxv            cpuglMaterialxv
+#define glMatrixMode            cpuglMatrixMode
+#define glMultMatrixx           cpuglMultMatrixx
+#define glNormalPointer         cpuglNormalPointer
+#define glPopMatrix             cpuglPopMatrix
+#define glPushMatrix            cpuglPushMatrix
+#define glRotatex               cpuglRotatex
+#define glScalex                cpuglScalex
+#define glShadeModel            cpuglShadeModel
+#define glTranslatex            cpuglTranslatex
+#define glVertexPointer         cpuglVertexPointer
+#define glViewport              cpuglViewport
+#endif // !CPUGL_IMPLEMENTATION
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !CPUGL_H_INCLUDED
@@ -0,0 +1,354 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2009 The Android Open Source Project
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+/* Host check of the CPU transform and lighting against the GL equations.
+ *
+ * Usage: cputl-test [-t threads] [-s step]
+ *   -t  number of threads of the engine (default: one per CPU)
+ *   -s  milliseconds of demo time per frame (default 1000)
+ *
+ * The demo runs through cpugl as in sanangeles-cpu. Every vertex of every
+ * frame is then transformed and lit again in double precision, straight
+ * from the GL 1.x equations, and both paths must agree with that: the float
+ * path (SIMD unless built with CPUTL_NO_SIMD) and the fixed point one. The
+ * output of the engine's threads must be the float path's, bit for bit.
+ * Exits non zero when a check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "importgl.h"
+#include "cpugl.h"
+
+#include "app.h"
+
+
+// Largest clip coordinate error, relative to the largest coordinate.
+#define MAX_FLOAT_CLIP_ERROR 1e-5
+#define MAX_FIXED_CLIP_ERROR 2e-3
+// Largest color error, in levels of 255.
+#define MAX_COLOR_ERROR 2
+
+
+int gAppAlive = 1;
+
+static int errors = 0;
+
+// largest errors seen, of the float and the fixed point path
+static double sClipError[2], sColorError[2];
+
+
+static void check(int ok, const char *what, int frame, int draw, long vertex)
+{
+    if (!ok && errors++ < 10)
+        fprintf(stderr, "frame %d, draw %d, vertex %ld: %s\n", frame, draw,
+                vertex, what);
+}
+
+
+// Column major, as in GL.
+static void multMatrix(double *dest, const float *a, const float *b)
+{
+    int row, col, k;
+    for (col = 0; col < 4; ++col)
+    {
+        for (row = 0; row < 4; ++row)
+        {
+            dest[col * 4 + row] = 0;
+            for (k = 0; k < 4; ++k)
+                dest[col * 4 + row] += (double)a[k * 4 + row] * b[col * 4 + k];
+        }
+    }
+}
+
+
+// Inverse transpose of the upper left 3x3 of m, column major.
+static void inverseTranspose(double *n, const float *m)
+{
+    double a[3][3], det;
+    int row, col;
+    for (row = 0; row < 3; ++row)
+    {
+        for (col = 0; col < 3; ++col)
+            a[row][col] = m[col * 4 + row];
+    }
+    det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+          a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+          a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    for (row = 0; row < 3; ++row)
+    {
+        for (col = 0; col < 3; ++col)
+        {
+            // cofactor of a[row][col], which is row of the inverse transpose
+            const int r1 = (row + 1) % 3, r2 = (row + 2) % 3;
+            const int c1 = (col + 1) % 3, c2 = (col + 2) % 3;
+            n[col * 3 + row] = (a[r1][c1] * a[r2][c2] - a[r1][c2] * a[r2][c1]) /
+                               det;
+        }
+    }
+}
+
+
+static void normalize(double *v)
+{
+    double len = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (len > 0)
+    {
+        v[0] /= len;
+        v[1] /= len;
+        v[2] /= len;
+    }
+}
+
+
+/* The GL lighting equation for directional lights, color material and an
+ * infinite viewer, from the public fields of the lighting only.
+ */
+static void lightVertex(const CPUTL_LIGHTING *l, const double *n,
+                        const GLubyte *vertexColor, double *color)
+{
+    int i, a;
+    for (a = 0; a < 3; ++a)
+    {
+        double c = l->sceneAmbient[a];
+        for (i = 0; i < l->lightCount; ++i)
+            c += l->lights[i].ambient[a];
+        color[a] = c * vertexColor[a] / 255;
+    }
+    for (i = 0; i < l->lightCount; ++i)
+    {
+        const CPUTL_LIGHT *light = &l->lights[i];
+        double dir[3], half[3], ndl, ndh;
+        for (a = 0; a < 3; ++a)
+            dir[a] = light->direction[a];
+        normalize(dir);
+        ndl = n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2];
+        if (ndl <= 0)
+            continue;
+        half[0] = dir[0];
+        half[1] = dir[1];
+        half[2] = dir[2] + 1;
+        normalize(half);
+        ndh = n[0] * half[0] + n[1] * half[1] + n[2] * half[2];
+        for (a = 0; a < 3; ++a)
+        {
+            color[a] += ndl * light->diffuse[a] * vertexColor[a] / 255;
+            if (ndh > 0)
+                color[a] += pow(ndh, l->shininess) * light->specular[a] *
+                            l->materialSpecular[a];
+        }
+    }
+    for (a = 0; a < 3; ++a)
+    {
+        color[a] = color[a] < 0 ? 0 : color[a] > 1 ? 1 : color[a];
+        color[a] *= 255;
+    }
+    color[3] = vertexColor[3];
+}
+
+
+static void referenceVertex(const CPUTL_DRAW *draw, const double *mvp,
+                            const double *normalMatrix, long v, double *clip,
+                            double *color)
+{
+    const GLfixed *src = &draw->vertexArray[v * draw->vertexComponents];
+    const GLubyte *vertexColor = draw->colorArray ?
+                                 &draw->colorArray[v * 4] : draw->color;
+    double p[4], n[3] = { 0, 0, 1 }, en[3];
+    int row;
+
+    p[0] = src[0] / 65536.0;
+    p[1] = src[1] / 65536.0;
+    p[2] = draw->vertexComponents > 2 ? src[2] / 65536.0 : 0;
+    p[3] = draw->vertexComponents > 3 ? src[3] / 65536.0 : 1;
+    for (row = 0; row < 4; ++row)
+        clip[row] = mvp[row] * p[0] + mvp[4 + row] * p[1] +
+                    mvp[8 + row] * p[2] + mvp[12 + row] * p[3];
+
+    if (draw->lighting == NULL)
+    {
+        for (row = 0; row < 4; ++row)
+            color[row] = vertexColor[row];
+        return;
+    }
+    if (draw->normalArray)
+    {
+        for (row = 0; row < 3; ++row)
+            n[row] = draw->normalArray[v * 3 + row] / 65536.0;
+    }
+    for (row = 0; row < 3; ++row)
+        en[row] = normalMatrix[row] * n[0] + normalMatrix[3 + row] * n[1] +
+                  normalMatrix[6 + row] * n[2];
+    if (draw->normalize)
+        normalize(en);
+    lightVertex(draw->lighting, en, vertexColor, color);
+}
+
+
+// Compares a path's output for one vertex; path 0 is float, 1 fixed point.
+static void compareVertex(int path, const double *clip, const double *color,
+                          const float *gotClip, const GLubyte *gotColor,
+                          int frame, int draw, long vertex)
+{
+    static const double maxClipError[2] = {
+        MAX_FLOAT_CLIP_ERROR, MAX_FIXED_CLIP_ERROR
+    };
+    double scale = 1, clipError = 0, colorError = 0;
+    int a;
+
+    for (a = 0; a < 4; ++a)
+    {
+        if (fabs(clip[a]) > scale)
+            scale = fabs(clip[a]);
+    }
+    for (a = 0; a < 4; ++a)
+    {
+        double e = fabs(gotClip[a] - clip[a]) / scale;
+        if (e > clipError)
+            clipError = e;
+        e = fabs(gotColor[a] - color[a]);
+        if (e > colorError)
+            colorError = e;
+    }
+    if (clipError > sClipError[path])
+        sClipError[path] = clipError;
+    if (colorError > sColorError[path])
+        sColorError[path] = colorError;
+    check(clipError <= maxClipError[path],
+          path ? "fixed point clip coordinates" : "float clip coordinates",
+          frame, draw, vertex);
+    // the reference is rounded too, so allow half a level more
+    check(colorError <= MAX_COLOR_ERROR + 0.5,
+          path ? "fixed point color" : "float color", frame, draw, vertex);
+}
+
+
+static long checkFrame(int frame)
+{
+    const CPUTL_ENGINE *engine = cpuglGetEngine();
+    const CPUTL_DRAW *draws;
+    int drawCount, d;
+    long vertices = 0;
+
+    draws = cpuglGetLastDraws(&drawCount);
+    for (d = 0; d < drawCount; ++d)
+    {
+        const CPUTL_DRAW *draw = &draws[d];
+        const float *engineClip = (const float *)cputlGetClip(engine, d);
+        const GLubyte *engineColors = cputlGetColors(engine, d);
+        float *clip = (float *)malloc(draw->count * 4 * sizeof(float));
+        GLfixed *clipx = (GLfixed *)malloc(draw->count * 4 * sizeof(GLfixed));
+        GLubyte *colors = (GLubyte *)malloc(draw->count * 4);
+        GLubyte *colorsx = (GLubyte *)malloc(draw->count * 4);
+        double mvp[16], normalMatrix[9];
+        long i;
+
+        if (clip == NULL || clipx == NULL || colors == NULL || colorsx == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        cputlProcessFloat(draw, clip, colors);
+        cputlProcessFixed(draw, clipx, colorsx);
+        check(memcmp(engineClip, clip, draw->count * 4 * sizeof(float)) == 0 &&
+              memcmp(engineColors, colors, draw->count * 4) == 0,
+              "engine output differs from the float path", frame, d, 0);
+
+        multMatrix(mvp, draw->projection, draw->modelview);
+        inverseTranspose(normalMatrix, draw->modelview);
+        for (i = 0; i < draw->count; ++i)
+        {
+            double refClip[4], refColor[4];
+            float fixedClip[4];
+            int a;
+            referenceVertex(draw, mvp, normalMatrix, draw->first + i, refClip,
+                            refColor);
+            compareVertex(0, refClip, refColor, &clip[i * 4], &colors[i * 4],
+                          frame, d, i);
+            for (a = 0; a < 4; ++a)
+                fixedClip[a] = clipx[i * 4 + a] / 65536.0f;
+            compareVertex(1, refClip, refColor, fixedClip, &colorsx[i * 4],
+                          frame, d, i);
+        }
+        vertices += draw->count;
+        free(clip);
+        free(clipx);
+        free(colors);
+        free(colorsx);
+    }
+    return vertices;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int threads = 0, step = 1000, frames = 0, a;
+    long tick, vertices = 0;
+    CPUTL_STATS stats;
+
+    for (a = 1; a < argc; ++a)
+    {
+        if (strcmp(argv[a], "-t") == 0 && a + 1 < argc)
+            threads = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc)
+            step = atoi(argv[++a]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-t threads] [-s step]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (step < 1)
+        step = 1;
+    memset(&stats, 0, sizeof(stats));
+
+    // the engine takes the float path; the fixed one is run directly
+    if (!cpuglInit(threads, 0))
+    {
+        fprintf(stderr, "Failed to initialize the CPU renderer\n");
+        return 1;
+    }
+    appInit();
+    for (tick = step; ; tick += step)
+    {
+        appRender(tick, WINDOW_DEFAULT_WIDTH, WINDOW_DEFAULT_HEIGHT);
+        if (!gAppAlive)
+            break;
+        cpuglEndFrame(&stats);
+        vertices += checkFrame(frames++);
+    }
+    appDeinit();
+    cpuglDeinit();
+
+    check(frames > 0, "no frames", 0, 0, 0);
+    printf("%d frames, %ld vertices, %d threads: largest clip error %.2g "
+           "float and %.2g fixed point, color error %.1f and %.1f levels\n",
+           frames, vertices, stats.threads, sClipError[0], sClipError[1],
+           sColorError[0], sColorError[1]);
+    if (errors)
+    {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,920 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2009 The Android Open Source Project
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cputl.h"
+
+#if defined(CPUTL_NO_SIMD)
+// scalar code only, for reference
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CPUTL_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define CPUTL_SSE
+#endif
+
+#if defined(CPUTL_NEON) || defined(CPUTL_SSE)
+#define CPUTL_SIMD
+#endif
+
+
+struct CPUTL_ENGINE {
+    int threadCount;
+    int fixedPoint;
+    pthread_t *threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t workCond, doneCond;
+    int generation;    // incremented by every run
+    int quit;
+    int busyThreads;
+
+    // current run
+    const CPUTL_DRAW *draws;
+    int drawCount;
+    int nextDraw;
+
+    // output of the last run, 4 clip coordinates and 4 colors per vertex
+    long *offsets;     // first vertex of each draw
+    int offsetCapacity;
+    void *clip;
+    GLubyte *colors;
+    long vertexCapacity;
+};
+
+
+// Per draw constants of the float path.
+typedef struct {
+    float mvp[16];
+    float normal[9];    // column major
+} FLOAT_SETUP;
+
+// Per draw constants of the fixed point path.
+typedef struct {
+    GLfixed mvp[16];
+    GLfixed normal[9];
+} FIXED_SETUP;
+
+
+void cputlMultMatrix(float *dest, const float *a, const float *b)
+{
+    float result[16];
+    int row, col;
+    for (col = 0; col < 4; ++col)
+    {
+        for (row = 0; row < 4; ++row)
+        {
+            result[col * 4 + row] = a[row] * b[col * 4] +
+                                    a[4 + row] * b[col * 4 + 1] +
+                                    a[8 + row] * b[col * 4 + 2] +
+                                    a[12 + row] * b[col * 4 + 3];
+        }
+    }
+    memcpy(dest, result, sizeof(result));
+}
+
+
+/* Normals are transformed by the inverse transpose of the upper left 3x3
+ * of the modelview matrix, which is its cofactor matrix over the
+ * determinant.
+ */
+static void normalMatrix(float *n, const float *m)
+{
+#define A(row, col) m[(col) * 4 + (row)]
+    float det;
+    int i;
+    n[0] = A(1, 1) * A(2, 2) - A(1, 2) * A(2, 1);
+    n[1] = A(1, 2) * A(2, 0) - A(1, 0) * A(2, 2);
+    n[2] = A(1, 0) * A(2, 1) - A(1, 1) * A(2, 0);
+    n[3] = A(0, 2) * A(2, 1) - A(0, 1) * A(2, 2);
+    n[4] = A(0, 0) * A(2, 2) - A(0, 2) * A(2, 0);
+    n[5] = A(0, 1) * A(2, 0) - A(0, 0) * A(2, 1);
+    n[6] = A(0, 1) * A(1, 2) - A(0, 2) * A(1, 1);
+    n[7] = A(0, 2) * A(1, 0) - A(0, 0) * A(1, 2);
+    n[8] = A(0, 0) * A(1, 1) - A(0, 1) * A(1, 0);
+    det = A(0, 0) * n[0] + A(0, 1) * n[1] + A(0, 2) * n[2];
+#undef A
+    // make n column major: n[col * 3 + row] is the cofactor of A(row, col)
+    {
+        float t;
+        t = n[1]; n[1] = n[3]; n[3] = t;
+        t = n[2]; n[2] = n[6]; n[6] = t;
+        t = n[5]; n[5] = n[7]; n[7] = t;
+    }
+    if (det != 0)
+    {
+        for (i = 0; i < 9; ++i)
+            n[i] /= det;
+    }
+}
+
+
+static GLfixed toFixed(float value)
+{
+    if (value < -32768) value = -32768;
+    if (value > 32767) value = 32767;
+    return (GLfixed)(value * 65536 + (value < 0 ? -0.5f : 0.5f));
+}
+
+
+static void normalize3(float *v)
+{
+    float len = (float)sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (len > 0)
+    {
+        v[0] /= len;
+        v[1] /= len;
+        v[2] /= len;
+    }
+}
+
+
+void cputlSetupLighting(CPUTL_LIGHTING *l)
+{
+    int i, a;
+    for (a = 0; a < 4; ++a)
+        l->ambient[a] = l->sceneAmbient[a];
+    for (i = 0; i < l->lightCount; ++i)
+    {
+        CPUTL_LIGHT *light = &l->lights[i];
+        float *dir = l->direction[i], *half = l->halfVector[i];
+        for (a = 0; a < 3; ++a)
+            dir[a] = light->direction[a];
+        normalize3(dir);
+        // the viewer is at infinity, in the direction of +z
+        half[0] = dir[0];
+        half[1] = dir[1];
+        half[2] = dir[2] + 1;
+        normalize3(half);
+        l->hasSpecular[i] = 0;
+        for (a = 0; a < 4; ++a)
+        {
+            l->ambient[a] += light->ambient[a];
+            l->specular[i][a] = light->specular[a] * l->materialSpecular[a];
+            l->diffusex[i][a] = toFixed(light->diffuse[a]);
+            l->specularx[i][a] = toFixed(l->specular[i][a]);
+            if (a < 3 && l->specular[i][a] != 0)
+                l->hasSpecular[i] = 1;
+        }
+        for (a = 0; a < 3; ++a)
+        {
+            l->directionx[i][a] = toFixed(dir[a]);
+            l->halfVectorx[i][a] = toFixed(half[a]);
+        }
+    }
+    for (a = 0; a < 4; ++a)
+        l->ambientx[a] = toFixed(l->ambient[a]);
+    for (i = 0; i <= CPUTL_SPECULAR_TABLE_SIZE; ++i)
+    {
+        l->specularTable[i] = (float)pow((float)i / CPUTL_SPECULAR_TABLE_SIZE,
+                                         l->shininess);
+        l->specularTablex[i] = toFixed(l->specularTable[i]);
+    }
+}
+
+
+// Specular term for n.h in [0, 1]; linear interpolation of the table.
+static float specularPower(const CPUTL_LIGHTING *l, float ndh)
+{
+    float f = ndh * CPUTL_SPECULAR_TABLE_SIZE;
+    int i = (int)f;
+    if (i >= CPUTL_SPECULAR_TABLE_SIZE)
+        return l->specularTable[CPUTL_SPECULAR_TABLE_SIZE];
+    return l->specularTable[i] +
+           (f - i) * (l->specularTable[i + 1] - l->specularTable[i]);
+}
+
+
+static GLubyte colorToUbyte(float c)
+{
+    if (c <= 0)
+        return 0;
+    if (c >= 1)
+        return 255;
+    return (GLubyte)(c * 255 + 0.5f);
+}
+
+
+/* The fixed function lighting equation with color material, for one
+ * vertex: vertex color * (ambient + sum of n.l * diffuse) + sum of
+ * (n.h)^shininess * specular. n must be normalized.
+ */
+static void lightVertexFloat(const CPUTL_LIGHTING *l, const float *n,
+                             const GLubyte *vertexColor, GLubyte *color)
+{
+    float diffuse[3], specular[3] = { 0, 0, 0 };
+    int i, a;
+    for (a = 0; a < 3; ++a)
+        diffuse[a] = l->ambient[a];
+    for (i = 0; i < l->lightCount; ++i)
+    {
+        const float *dir = l->direction[i], *half = l->halfVector[i];
+        float ndl = n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2];
+        float ndh, s;
+        if (ndl <= 0)
+            continue;
+        for (a = 0; a < 3; ++a)
+            diffuse[a] += ndl * l->lights[i].diffuse[a];
+        if (!l->hasSpecular[i])
+            continue;
+        ndh = n[0] * half[0] + n[1] * half[1] + n[2] * half[2];
+        if (ndh <= 0)
+            continue;
+        s = specularPower(l, ndh);
+        for (a = 0; a < 3; ++a)
+            specular[a] += s * l->specular[i][a];
+    }
+    for (a = 0; a < 3; ++a)
+        color[a] = colorToUbyte(vertexColor[a] * (1.0f / 255) * diffuse[a] +
+                                specular[a]);
+    // alpha is the material diffuse alpha
+    color[3] = vertexColor[3];
+}
+
+
+static void setupFloat(const CPUTL_DRAW *draw, FLOAT_SETUP *setup)
+{
+    cputlMultMatrix(setup->mvp, draw->projection, draw->modelview);
+    normalMatrix(setup->normal, draw->modelview);
+}
+
+
+static void loadPosition(const CPUTL_DRAW *draw, long v, float *p)
+{
+    const GLfixed *src = &draw->vertexArray[v * draw->vertexComponents];
+    const float scale = 1.0f / 65536;
+    p[0] = src[0] * scale;
+    p[1] = src[1] * scale;
+    p[2] = draw->vertexComponents > 2 ? src[2] * scale : 0;
+    p[3] = draw->vertexComponents > 3 ? src[3] * scale : 1;
+}
+
+
+static void processVertexFloat(const CPUTL_DRAW *draw, const FLOAT_SETUP *setup,
+                               long v, float *clip, GLubyte *color)
+{
+    const float *m = setup->mvp;
+    const GLubyte *vertexColor = draw->colorArray ?
+                                 &draw->colorArray[v * 4] : draw->color;
+    float p[4];
+    int row;
+
+    loadPosition(draw, v, p);
+    for (row = 0; row < 4; ++row)
+        clip[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] +
+                    m[12 + row] * p[3];
+
+    if (draw->lighting)
+    {
+        const float *nm = setup->normal;
+        float n[3] = { 0, 0, 1 }, en[3];
+        if (draw->normalArray)
+        {
+            const GLfixed *src = &draw->normalArray[v * 3];
+            n[0] = src[0] * (1.0f / 65536);
+            n[1] = src[1] * (1.0f / 65536);
+            n[2] = src[2] * (1.0f / 65536);
+        }
+        for (row = 0; row < 3; ++row)
+            en[row] = nm[row] * n[0] + nm[3 + row] * n[1] + nm[6 + row] * n[2];
+        if (draw->normalize)
+            normalize3(en);
+        lightVertexFloat(draw->lighting, en, vertexColor, color);
+    }
+    else
+        memcpy(color, vertexColor, 4);
+}
+
+
+#ifdef CPUTL_SIMD
+
+#if defined(CPUTL_NEON)
+typedef float32x4_t VEC4;
+#define VSET(x)         vdupq_n_f32(x)
+#define VLOAD(p)        vld1q_f32(p)
+#define VSTORE(p, v)    vst1q_f32(p, v)
+#define VADD(a, b)      vaddq_f32(a, b)
+#define VMUL(a, b)      vmulq_f32(a, b)
+#define VMAX(a, b)      vmaxq_f32(a, b)
+#define VMIN(a, b)      vminq_f32(a, b)
+// estimate refined with two Newton-Raphson steps
+static VEC4 vrsqrt(VEC4 x)
+{
+    float32x4_t e = vrsqrteq_f32(x);
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+    return e;
+}
+static void vstore4Interleaved(float *p, VEC4 a, VEC4 b, VEC4 c, VEC4 d)
+{
+    float32x4x4_t v;
+    v.val[0] = a;
+    v.val[1] = b;
+    v.val[2] = c;
+    v.val[3] = d;
+    vst4q_f32(p, v);
+}
+#elif defined(CPUTL_SSE)
+typedef __m128 VEC4;
+#define VSET(x)         _mm_set1_ps(x)
+#define VLOAD(p)        _mm_loadu_ps(p)
+#define VSTORE(p, v)    _mm_storeu_ps(p, v)
+#define VADD(a, b)      _mm_add_ps(a, b)
+#define VMUL(a, b)      _mm_mul_ps(a, b)
+#define VMAX(a, b)      _mm_max_ps(a, b)
+#define VMIN(a, b)      _mm_min_ps(a, b)
+// estimate refined with one Newton-Raphson step
+static VEC4 vrsqrt(VEC4 x)
+{
+    __m128 e = _mm_rsqrt_ps(x);
+    __m128 ex2 = _mm_mul_ps(_mm_mul_ps(x, e), e);
+    return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), e),
+                      _mm_sub_ps(_mm_set1_ps(3.0f), ex2));
+}
+static void vstore4Interleaved(float *p, VEC4 a, VEC4 b, VEC4 c, VEC4 d)
+{
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    _mm_storeu_ps(p, a);
+    _mm_storeu_ps(p + 4, b);
+    _mm_storeu_ps(p + 8, c);
+    _mm_storeu_ps(p + 12, d);
+}
+#endif
+
+// a * x + b * y + c * z + d * w with scalar a, b, c, d
+#define VDOT4(a, b, c, d, x, y, z, w) \
+    VADD(VADD(VMUL(VSET(a), x), VMUL(VSET(b), y)), \
+         VADD(VMUL(VSET(c), z), VMUL(VSET(d), w)))
+#define VDOT3(a, b, c, x, y, z) \
+    VADD(VADD(VMUL(VSET(a), x), VMUL(VSET(b), y)), VMUL(VSET(c), z))
+
+
+/* Four vertices from v on: the arrays are gathered into one vector per
+ * component, so the math is the same as processVertexFloat, lane by lane.
+ */
+static void processBlockFloat(const CPUTL_DRAW *draw, const FLOAT_SETUP *setup,
+                              long v, float *clip, GLubyte *color)
+{
+    const float *m = setup->mvp;
+    const CPUTL_LIGHTING *l = draw->lighting;
+    float px[4], py[4], pz[4], pw[4];
+    VEC4 x, y, z, w;
+    int j;
+
+    for (j = 0; j < 4; ++j)
+    {
+        float p[4];
+        loadPosition(draw, v + j, p);
+        px[j] = p[0];
+        py[j] = p[1];
+        pz[j] = p[2];
+        pw[j] = p[3];
+    }
+    x = VLOAD(px);
+    y = VLOAD(py);
+    z = VLOAD(pz);
+    w = VLOAD(pw);
+    vstore4Interleaved(clip,
+                       VDOT4(m[0], m[4], m[8], m[12], x, y, z, w),
+                       VDOT4(m[1], m[5], m[9], m[13], x, y, z, w),
+                       VDOT4(m[2], m[6], m[10], m[14], x, y, z, w),
+                       VDOT4(m[3], m[7], m[11], m[15], x, y, z, w));
+
+    if (l)
+    {
+        const float *nm = setup->normal;
+        float vc[4][4], ndl[4], ndh[4], rgb[3][4];
+        VEC4 nx, ny, nz, diffuse[3], specular[3];
+        int i, a;
+
+        for (j = 0; j < 4; ++j)
+        {
+            const GLubyte *src = draw->colorArray ?
+                                 &draw->colorArray[(v + j) * 4] : draw->color;
+            if (draw->normalArray)
+            {
+                const GLfixed *n = &draw->normalArray[(v + j) * 3];
+                px[j] = n[0] * (1.0f / 65536);
+                py[j] = n[1] * (1.0f / 65536);
+                pz[j] = n[2] * (1.0f / 65536);
+            }
+            else
+            {
+                px[j] = py[j] = 0;
+                pz[j] = 1;
+            }
+            for (a = 0; a < 4; ++a)
+                vc[a][j] = src[a] * (1.0f / 255);
+        }
+        x = VLOAD(px);
+        y = VLOAD(py);
+        z = VLOAD(pz);
+        nx = VDOT3(nm[0], nm[3], nm[6], x, y, z);
+        ny = VDOT3(nm[1], nm[4], nm[7], x, y, z);
+        nz = VDOT3(nm[2], nm[5], nm[8], x, y, z);
+        if (draw->normalize)
+        {
+            VEC4 len2 = VADD(VADD(VMUL(nx, nx), VMUL(ny, ny)), VMUL(nz, nz));
+            // zero normals stay zero
+            VEC4 inv = vrsqrt(VMAX(len2, VSET(1e-30f)));
+            nx = VMUL(nx, inv);
+            ny = VMUL(ny, inv);
+            nz = VMUL(nz, inv);
+        }
+
+        for (a = 0; a < 3; ++a)
+        {
+            diffuse[a] = VSET(l->ambient[a]);
+            specular[a] = VSET(0);
+        }
+        for (i = 0; i < l->lightCount; ++i)
+        {
+            const float *dir = l->direction[i], *half = l->halfVector[i];
+            VEC4 vndl = VDOT3(dir[0], dir[1], dir[2], nx, ny, nz);
+            VEC4 s;
+            if (l->hasSpecular[i])
+                VSTORE(ndl, vndl);
+            vndl = VMAX(vndl, VSET(0));
+            for (a = 0; a < 3; ++a)
+                diffuse[a] = VADD(diffuse[a],
+                                  VMUL(vndl, VSET(l->lights[i].diffuse[a])));
+            if (!l->hasSpecular[i])
+                continue;
+            VSTORE(ndh, VDOT3(half[0], half[1], half[2], nx, ny, nz));
+            // the table lookup is per lane
+            for (j = 0; j < 4; ++j)
+                ndh[j] = ndl[j] > 0 && ndh[j] > 0 ? specularPower(l, ndh[j]) : 0;
+            s = VLOAD(ndh);
+            for (a = 0; a < 3; ++a)
+                specular[a] = VADD(specular[a],
+                                   VMUL(s, VSET(l->specular[i][a])));
+        }
+        for (a = 0; a < 3; ++a)
+        {
+            VEC4 c = VADD(VMUL(VLOAD(vc[a]), diffuse[a]), specular[a]);
+            c = VMIN(VMAX(c, VSET(0)), VSET(1));
+            VSTORE(rgb[a], VADD(VMUL(c, VSET(255)), VSET(0.5f)));
+        }
+        for (j = 0; j < 4; ++j)
+        {
+            color[j * 4] = (GLubyte)rgb[0][j];
+            color[j * 4 + 1] = (GLubyte)rgb[1][j];
+            color[j * 4 + 2] = (GLubyte)rgb[2][j];
+            color[j * 4 + 3] = draw->colorArray ?
+                               draw->colorArray[(v + j) * 4 + 3] : draw->color[3];
+        }
+    }
+    else
+    {
+        for (j = 0; j < 4; ++j)
+            memcpy(&color[j * 4], draw->colorArray ?
+                   &draw->colorArray[(v + j) * 4] : draw->color, 4);
+    }
+}
+
+#endif // CPUTL_SIMD
+
+
+void cputlProcessFloat(const CPUTL_DRAW *draw, float *clip, GLubyte *color)
+{
+    FLOAT_SETUP setup;
+    long v = draw->first, end = draw->first + draw->count;
+
+    setupFloat(draw, &setup);
+#ifdef CPUTL_SIMD
+    for (; v + 4 <= end; v += 4, clip += 16, color += 16)
+        processBlockFloat(draw, &setup, v, clip, color);
+#endif
+    for (; v < end; ++v, clip += 4, color += 4)
+        processVertexFloat(draw, &setup, v, clip, color);
+}
+
+
+// 16.16 fixed point math on 64 bit intermediates.
+
+// 1 / sqrt((i + 0.5) / 256) in 2.30, for i in [64, 256)
+static unsigned long sRsqrtTable[256];
+static pthread_once_t sRsqrtTableOnce = PTHREAD_ONCE_INIT;
+
+
+static void initRsqrtTable()
+{
+    int i;
+    for (i = 64; i < 256; ++i)
+        sRsqrtTable[i] = (unsigned long)(1073741824.0 / sqrt((i + 0.5) / 256));
+}
+
+
+/* Returns 1 / sqrt(x) in 2.30, where x is in [2^30, 2^32) and stands for
+ * x / 2^32, i.e. [0.25, 1). Table estimate refined with two Newton-Raphson
+ * steps.
+ */
+static unsigned long long rsqrtx(unsigned long long x)
+{
+    unsigned long long y = sRsqrtTable[x >> 24];
+    int step;
+    for (step = 0; step < 2; ++step)
+    {
+        unsigned long long xy2 = (x * ((y * y) >> 30)) >> 32;
+        y = (y * ((3ULL << 30) - xy2)) >> 31;
+    }
+    return y;
+}
+
+
+/* Scales v (32.32) to a 16.16 unit vector. v is first shifted so that its
+ * largest component has 30 bits, which keeps the precision of short normals
+ * and bounds the squared length.
+ */
+static void normalizex(const long long *v, GLfixed *n)
+{
+    long long x = v[0], y = v[1], z = v[2], inv;
+    unsigned long long big = (unsigned long long)(x < 0 ? -x : x) |
+                             (unsigned long long)(y < 0 ? -y : y) |
+                             (unsigned long long)(z < 0 ? -z : z);
+    unsigned long long len2;
+    int shift, e;
+    if (big == 0)
+    {
+        n[0] = n[1] = n[2] = 0;
+        return;
+    }
+    shift = 63 - __builtin_clzll(big) - 29;
+    if (shift > 0)
+    {
+        x >>= shift;
+        y >>= shift;
+        z >>= shift;
+    }
+    else if (shift < 0)
+    {
+        x *= 1LL << -shift;
+        y *= 1LL << -shift;
+        z *= 1LL << -shift;
+    }
+    // len2 is in [2^58, 2^62): bring it to [2^30, 2^32) with an even shift
+    len2 = (unsigned long long)(x * x + y * y + z * z);
+    e = (63 - __builtin_clzll(len2) - 30) >> 1;
+    // 2^46 / sqrt(len2), so that n = v * inv / 2^30 is 16.16
+    inv = (long long)(rsqrtx(len2 >> (2 * e)) >> e);
+    n[0] = (GLfixed)((x * inv) >> 30);
+    n[1] = (GLfixed)((y * inv) >> 30);
+    n[2] = (GLfixed)((z * inv) >> 30);
+}
+
+
+static GLfixed specularPowerx(const CPUTL_LIGHTING *l, GLfixed ndh)
+{
+    long long f = (long long)ndh * CPUTL_SPECULAR_TABLE_SIZE;
+    int i = (int)(f >> 16);
+    GLfixed frac = (GLfixed)(f & 0xffff);
+    const GLfixed *table = l->specularTablex;
+    if (i >= CPUTL_SPECULAR_TABLE_SIZE)
+        return table[CPUTL_SPECULAR_TABLE_SIZE];
+    return table[i] +
+           (GLfixed)(((long long)(table[i + 1] - table[i]) * frac) >> 16);
+}
+
+
+static void lightVertexFixed(const CPUTL_LIGHTING *l, const GLfixed *n,
+                             const GLubyte *vertexColor, GLubyte *color)
+{
+    GLfixed diffuse[3], specular[3] = { 0, 0, 0 };
+    int i, a;
+    for (a = 0; a < 3; ++a)
+        diffuse[a] = l->ambientx[a];
+    for (i = 0; i < l->lightCount; ++i)
+    {
+        const GLfixed *dir = l->directionx[i], *half = l->halfVectorx[i];
+        GLfixed ndl = (GLfixed)(((long long)n[0] * dir[0] +
+                                 (long long)n[1] * dir[1] +
+                                 (long long)n[2] * dir[2]) >> 16);
+        GLfixed ndh, s;
+        if (ndl <= 0)
+            continue;
+        for (a = 0; a < 3; ++a)
+            diffuse[a] += (GLfixed)(((long long)ndl * l->diffusex[i][a]) >> 16);
+        if (!l->hasSpecular[i])
+            continue;
+        ndh = (GLfixed)(((long long)n[0] * half[0] + (long long)n[1] * half[1] +
+                         (long long)n[2] * half[2]) >> 16);
+        if (ndh <= 0)
+            continue;
+        s = specularPowerx(l, ndh);
+        for (a = 0; a < 3; ++a)
+            specular[a] += (GLfixed)(((long long)s * l->specularx[i][a]) >> 16);
+    }
+    for (a = 0; a < 3; ++a)
+    {
+        // 255 * 257 is 0xffff, i.e. almost 1.0
+        long long c = (((long long)vertexColor[a] * 257 * diffuse[a]) >> 16) +
+                      specular[a];
+        if (c < 0) c = 0;
+        if (c > 0xffff) c = 0xffff;
+        color[a] = (GLubyte)((c * 255 + 0x8000) >> 16);
+    }
+    color[3] = vertexColor[3];
+}
+
+
+static void setupFixed(const CPUTL_DRAW *draw, FIXED_SETUP *setup)
+{
+    FLOAT_SETUP f;
+    int i;
+    setupFloat(draw, &f);
+    for (i = 0; i < 16; ++i)
+        setup->mvp[i] = toFixed(f.mvp[i]);
+    if (draw->normalize)
+    {
+        // only the direction of normals matters: use the full fixed range
+        float big = 0;
+        for (i = 0; i < 9; ++i)
+        {
+            if (fabs(f.normal[i]) > big)
+                big = (float)fabs(f.normal[i]);
+        }
+        for (i = 0; big > 0 && i < 9; ++i)
+            f.normal[i] /= big;
+    }
+    for (i = 0; i < 9; ++i)
+        setup->normal[i] = toFixed(f.normal[i]);
+}
+
+
+void cputlProcessFixed(const CPUTL_DRAW *draw, GLfixed *clip, GLubyte *color)
+{
+    FIXED_SETUP setup;
+    const GLfixed *m = setup.mvp;
+    const int components = draw->vertexComponents;
+    long v, end = draw->first + draw->count;
+    int row;
+
+    pthread_once(&sRsqrtTableOnce, initRsqrtTable);
+    setupFixed(draw, &setup);
+    for (v = draw->first; v < end; ++v, clip += 4, color += 4)
+    {
+        const GLfixed *p = &draw->vertexArray[v * components];
+        const GLubyte *vertexColor = draw->colorArray ?
+                                     &draw->colorArray[v * 4] : draw->color;
+        const long long z = components > 2 ? p[2] : 0;
+        const long long w = components > 3 ? p[3] : 0x10000;
+
+        for (row = 0; row < 4; ++row)
+            clip[row] = (GLfixed)(((long long)m[row] * p[0] +
+                                   (long long)m[4 + row] * p[1] +
+                                   m[8 + row] * z + m[12 + row] * w) >> 16);
+
+        if (draw->lighting)
+        {
+            static const GLfixed defaultNormal[3] = { 0, 0, 0x10000 };
+            const GLfixed *nm = setup.normal;
+            const GLfixed *n = draw->normalArray ?
+                               &draw->normalArray[v * 3] : defaultNormal;
+            long long en64[3];
+            GLfixed en[3];
+            for (row = 0; row < 3; ++row)
+                en64[row] = (long long)nm[row] * n[0] +
+                            (long long)nm[3 + row] * n[1] +
+                            (long long)nm[6 + row] * n[2];
+            if (draw->normalize)
+                normalizex(en64, en);
+            else
+            {
+                for (row = 0; row < 3; ++row)
+                    en[row] = (GLfixed)(en64[row] >> 16);
+            }
+            lightVertexFixed(draw->lighting, en, vertexColor, color);
+        }
+        else
+            memcpy(color, vertexColor, 4);
+    }
+}
+
+
+static double nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+// Processes draws of the current run until there are none left.
+static void runDraws(CPUTL_ENGINE *engine)
+{
+    for (;;)
+    {
+        int i;
+        const CPUTL_DRAW *draw;
+        long offset;
+
+        pthread_mutex_lock(&engine->mutex);
+        i = engine->nextDraw++;
+        pthread_mutex_unlock(&engine->mutex);
+        if (i >= engine->drawCount)
+            return;
+
+        draw = &engine->draws[i];
+        offset = engine->offsets[i] * 4;
+        if (engine->fixedPoint)
+            cputlProcessFixed(draw, (GLfixed *)engine->clip + offset,
+                              engine->colors + offset);
+        else
+            cputlProcessFloat(draw, (float *)engine->clip + offset,
+                              engine->colors + offset);
+    }
+}
+
+
+static void * workerMain(void *arg)
+{
+    CPUTL_ENGINE *engine = (CPUTL_ENGINE *)arg;
+    int generation = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&engine->mutex);
+        while (!engine->quit && engine->generation == generation)
+            pthread_cond_wait(&engine->workCond, &engine->mutex);
+        if (engine->quit)
+        {
+            pthread_mutex_unlock(&engine->mutex);
+            return NULL;
+        }
+        generation = engine->generation;
+        pthread_mutex_unlock(&engine->mutex);
+
+        runDraws(engine);
+
+        pthread_mutex_lock(&engine->mutex);
+        if (--engine->busyThreads == 0)
+            pthread_cond_signal(&engine->doneCond);
+        pthread_mutex_unlock(&engine->mutex);
+    }
+}
+
+
+CPUTL_ENGINE * cputlCreate(int threads, int fixedPoint)
+{
+    CPUTL_ENGINE *engine;
+    int i;
+
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+
+    engine = (CPUTL_ENGINE *)calloc(1, sizeof(CPUTL_ENGINE));
+    if (engine == NULL)
+        return NULL;
+    engine->fixedPoint = fixedPoint;
+    pthread_mutex_init(&engine->mutex, NULL);
+    pthread_cond_init(&engine->workCond, NULL);
+    pthread_cond_init(&engine->doneCond, NULL);
+
+    // the calling thread is the first one
+    engine->threads = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    engine->threadCount = 1;
+    for (i = 1; engine->threads != NULL && i < threads; ++i)
+    {
+        if (pthread_create(&engine->threads[i], NULL, workerMain, engine) != 0)
+            break;
+        ++engine->threadCount;
+    }
+    return engine;
+}
+
+
+void cputlDestroy(CPUTL_ENGINE *engine)
+{
+    int i;
+    if (engine == NULL)
+        return;
+    pthread_mutex_lock(&engine->mutex);
+    engine->quit = 1;
+    pthread_cond_broadcast(&engine->workCond);
+    pthread_mutex_unlock(&engine->mutex);
+    for (i = 1; i < engine->threadCount; ++i)
+        pthread_join(engine->threads[i], NULL);
+
+    pthread_cond_destroy(&engine->doneCond);
+    pthread_cond_destroy(&engine->workCond);
+    pthread_mutex_destroy(&engine->mutex);
+    free(engine->threads);
+    free(engine->offsets);
+    free(engine->clip);
+    free(engine->colors);
+    free(engine);
+}
+
+
+// Lays out the output of draws; returns 0 if out of memory.
+static int reserveOutput(CPUTL_ENGINE *engine, const CPUTL_DRAW *draws,
+                         int count)
+{
+    long vertices = 0;
+    int i;
+
+    if (count > engine->offsetCapacity)
+    {
+        long *offsets = (long *)realloc(engine->offsets, count * sizeof(long));
+        if (offsets == NULL)
+            return 0;
+        engine->offsets = offsets;
+        engine->offsetCapacity = count;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        engine->offsets[i] = vertices;
+        vertices += draws[i].count;
+    }
+
+    if (vertices > engine->vertexCapacity)
+    {
+        // GLfixed and float are both 32 bits
+        void *clip = realloc(engine->clip, vertices * 4 * sizeof(float));
+        GLubyte *colors;
+        if (clip == NULL)
+            return 0;
+        engine->clip = clip;
+        colors = (GLubyte *)realloc(engine->colors, vertices * 4);
+        if (colors == NULL)
+            return 0;
+        engine->colors = colors;
+        engine->vertexCapacity = vertices;
+    }
+    return 1;
+}
+
+
+void cputlRun(CPUTL_ENGINE *engine, const CPUTL_DRAW *draws, int count,
+              CPUTL_STATS *stats)
+{
+    double start = nowMs();
+    int i;
+
+    stats->draws = 0;
+    stats->vertices = stats->litVertices = 0;
+    stats->threads = engine->threadCount;
+    if (!reserveOutput(engine, draws, count))
+        count = 0;
+
+    pthread_mutex_lock(&engine->mutex);
+    engine->draws = draws;
+    engine->drawCount = count;
+    engine->nextDraw = 0;
+    engine->busyThreads = engine->threadCount - 1;
+    ++engine->generation;
+    pthread_cond_broadcast(&engine->workCond);
+    pthread_mutex_unlock(&engine->mutex);
+
+    runDraws(engine);
+
+    pthread_mutex_lock(&engine->mutex);
+    while (engine->busyThreads > 0)
+        pthread_cond_wait(&engine->doneCond, &engine->mutex);
+    pthread_mutex_unlock(&engine->mutex);
+
+    for (i = 0; i < count; ++i)
+    {
+        stats->vertices += draws[i].count;
+        if (draws[i].lighting)
+            stats->litVertices += draws[i].count;
+    }
+    stats->draws = count;
+    stats->ms = (float)(nowMs() - start);
+}
+
+
+const void * cputlGetClip(const CPUTL_ENGINE *engine, int draw)
+{
+    return (const float *)engine->clip + engine->offsets[draw] * 4;
+}
+
+
+const GLubyte * cputlGetColors(const CPUTL_ENGINE *engine, int draw)
+{
+    return engine->colors + engine->offsets[draw] * 4;
+}
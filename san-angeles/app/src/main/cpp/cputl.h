@@ -0,0 +1,152 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2009 The Android Open Source Project
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+/* CPU transform and lighting of GLOBJECT style vertex arrays: what the
+ * GLES 1.x fixed function pipeline does to each vertex before
+ * rasterization. There are two paths: a float one, which works on four
+ * vertices at a time with NEON or SSE when available, and a 16.16 fixed
+ * point one for devices without a fast FPU. A frame's draws are spread
+ * over a pool of threads, one draw at a time.
+ */
+
+#ifndef CPUTL_H_INCLUDED
+#define CPUTL_H_INCLUDED
+
+
+#include "importgl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define CPUTL_MAX_LIGHTS 8
+
+// Samples of the specular power function (see CPUTL_LIGHTING).
+#define CPUTL_SPECULAR_TABLE_SIZE 256
+
+
+// Directional light. Colors are RGBA, direction is in eye space.
+typedef struct {
+    float direction[3];
+    float ambient[4], diffuse[4], specular[4];
+} CPUTL_LIGHT;
+
+
+/* Lights and material. The material ambient and diffuse colors are the
+ * vertex color, as with GL_COLOR_MATERIAL, and the viewer is at infinity.
+ * Set the public fields and call cputlSetupLighting(); the rest is derived.
+ */
+typedef struct {
+    int lightCount;
+    CPUTL_LIGHT lights[CPUTL_MAX_LIGHTS];
+    float sceneAmbient[4];
+    float materialSpecular[4];
+    float shininess;
+
+    // derived
+    float direction[CPUTL_MAX_LIGHTS][3];     // normalized
+    float halfVector[CPUTL_MAX_LIGHTS][3];    // normalized
+    float ambient[4];    // scene ambient + ambient of all lights
+    float specular[CPUTL_MAX_LIGHTS][4];      // times material specular
+    int hasSpecular[CPUTL_MAX_LIGHTS];        // specular is not black
+    // x^shininess at x = i / CPUTL_SPECULAR_TABLE_SIZE
+    float specularTable[CPUTL_SPECULAR_TABLE_SIZE + 1];
+    GLfixed directionx[CPUTL_MAX_LIGHTS][3];
+    GLfixed halfVectorx[CPUTL_MAX_LIGHTS][3];
+    GLfixed ambientx[4];
+    GLfixed diffusex[CPUTL_MAX_LIGHTS][4];
+    GLfixed specularx[CPUTL_MAX_LIGHTS][4];
+    GLfixed specularTablex[CPUTL_SPECULAR_TABLE_SIZE + 1];
+} CPUTL_LIGHTING;
+
+
+/* One glDrawArrays call: the arrays have the layout of GLOBJECT (tightly
+ * packed GL_FIXED vertices and normals, GL_UNSIGNED_BYTE RGBA colors).
+ * Matrices are column major, as in GL.
+ */
+typedef struct {
+    float modelview[16];
+    float projection[16];
+    const CPUTL_LIGHTING *lighting;    // NULL when lighting is disabled
+    int normalize;                      // GL_NORMALIZE
+    const GLfixed *vertexArray;
+    int vertexComponents;               // 2 to 4
+    const GLfixed *normalArray;         // NULL: normal is (0, 0, 1)
+    const GLubyte *colorArray;          // NULL: color is used
+    GLubyte color[4];
+    long first, count;
+} CPUTL_DRAW;
+
+
+// Statistics of one cputlRun().
+typedef struct {
+    int draws;
+    long vertices;
+    long litVertices;
+    int threads;
+    float ms;    // wall clock time
+} CPUTL_STATS;
+
+
+typedef struct CPUTL_ENGINE CPUTL_ENGINE;
+
+
+// dest = a * b, for column major 4x4 matrices. dest may be a or b.
+extern void cputlMultMatrix(float *dest, const float *a, const float *b);
+
+// Derives the rest of lighting from its public fields.
+extern void cputlSetupLighting(CPUTL_LIGHTING *lighting);
+
+/* Transforms and lights the vertices of draw. Writes 4 clip coordinates
+ * and an RGBA color per vertex.
+ */
+extern void cputlProcessFloat(const CPUTL_DRAW *draw, float *clip,
+                              GLubyte *color);
+extern void cputlProcessFixed(const CPUTL_DRAW *draw, GLfixed *clip,
+                              GLubyte *color);
+
+/* Creates an engine with the given number of threads (0 for one per CPU),
+ * including the calling thread.
+ */
+extern CPUTL_ENGINE * cputlCreate(int threads, int fixedPoint);
+extern void cputlDestroy(CPUTL_ENGINE *engine);
+
+/* Processes draws in parallel and returns when all are done. The lighting
+ * and the arrays of the draws are only read. The output stays valid until
+ * the next run.
+ */
+extern void cputlRun(CPUTL_ENGINE *engine, const CPUTL_DRAW *draws,
+                     int count, CPUTL_STATS *stats);
+
+/* Output of a draw of the last run: clip coordinates (float or GLfixed, as
+ * the engine's path) and colors, 4 per vertex.
+ */
+extern const void * cputlGetClip(const CPUTL_ENGINE *engine, int draw);
+extern const GLubyte * cputlGetColors(const CPUTL_ENGINE *engine, int draw);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !CPUTL_H_INCLUDED
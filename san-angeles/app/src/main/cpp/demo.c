@@ -26,8 +26,14 @@
 #include <math.h>
 #include <float.h>
 #include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "importgl.h"
+#ifdef SANANGELES_CPU_GL
+#include "cpugl.h"
+#endif
 
 #include "app.h"
 #include "shapes.h"
@@ -97,6 +103,25 @@ static GLOBJECT *sSuperShapeObjects[SUPERSHAPE_COUNT] = { NULL };
 static GLOBJECT *sGroundPlane = NULL;
 
 
+/* Generated supershapes, addressed by their content: the hash of the shape
+ * parameters and the base color. The arrays are client memory, not GL
+ * objects, so they outlive the GL context and appInit() reuses them when
+ * the surface is recreated instead of generating them again.
+ */
+typedef struct {
+    unsigned long key;
+    float params[SUPERSHAPE_PARAMS];
+    float baseColor[3];
+    GLOBJECT *object;
+} SUPERSHAPE_CACHE_ENTRY;
+
+static SUPERSHAPE_CACHE_ENTRY sSuperShapeCache[SUPERSHAPE_COUNT];
+static int sSuperShapeCacheCount = 0;
+
+// Upper limit of threads generating supershapes.
+#define MAX_SUPERSHAPE_THREADS 4
+
+
 typedef struct {
     float x, y, z;
 } VECTOR3;
@@ -174,26 +199,41 @@ static void vector3Sub(VECTOR3 *dest, VECTOR3 *v1, VECTOR3 *v2)
 }
 
 
-static void superShapeMap(VECTOR3 *point, float r1, float r2, float t, float p)
+static float ssFunc(const float t, const float *p)
 {
-    // sphere-mapping of supershape parameters
-    point->x = (float)(cos(t) * cos(p) / r1 / r2);
-    point->y = (float)(sin(t) * cos(p) / r1 / r2);
-    point->z = (float)(sin(p) / r2);
+    return (float)(pow(pow(fabs(cos(p[0] * t / 4)) / p[1], p[4]) +
+                       pow(fabs(sin(p[0] * t / 4)) / p[2], p[5]), 1 / p[3]));
 }
 
 
-static float ssFunc(const float t, const float *p)
+/* Evaluates the supershape along one axis: the angle, its cosine and sine,
+ * and the radius at each of the count + 1 grid lines from begin on. Every
+ * quad of the mesh only needs these, so ssFunc is called once per grid line
+ * instead of four times per quad.
+ */
+static void superShapeAxis(const float *params, int begin, int count,
+                           int resol, float start, float *r, double *c,
+                           double *s)
 {
-    return (float)(pow(pow(fabs(cos(p[0] * t / 4)) / p[1], p[4]) +
-                       pow(fabs(sin(p[0] * t / 4)) / p[2], p[5]), 1 / p[3]));
+    int i;
+    for (i = 0; i <= count; ++i)
+    {
+        float angle = start + (begin + i) * 2 * PI / resol;
+        r[i] = ssFunc(angle, params);
+        c[i] = cos(angle);
+        s[i] = sin(angle);
+    }
 }
 
 
+// Corners (pa, pb, pc, pd) of a supershape quad, as triangles a-b-d and b-c-d.
+static const int sQuadCorners[6] = { 0, 1, 3, 1, 2, 3 };
+
+
 // Creates and returns a supershape object.
 // Based on Paul Bourke's POV-Ray implementation.
 // http://astronomy.swin.edu.au/~pbourke/povray/supershape/
-static GLOBJECT * createSuperShape(const float *params)
+static GLOBJECT * createSuperShape(const float *params, const float *baseColor)
 {
     const int resol1 = (int)params[SUPERSHAPE_PARAMS - 3];
     const int resol2 = (int)params[SUPERSHAPE_PARAMS - 2];
@@ -205,58 +245,102 @@ static GLOBJECT * createSuperShape(const float *params)
     const int latitudeCount = latitudeEnd - latitudeBegin;
     const long triangleCount = longitudeCount * latitudeCount * 2;
     const long vertices = triangleCount * 3;
+    // the grid has one more line than quads on both axes
+    const int gridLongitudes = longitudeCount + 1;
+    const int gridLatitudes = latitudeCount + 1;
+    const int gridPoints = gridLongitudes * gridLatitudes;
     GLOBJECT *result;
-    float baseColor[3];
-    int a, longitude, latitude;
+    float *rLong, *rLat, *gridX, *gridY, *gridZ;
+    double *cosLong, *sinLong, *cosLat, *sinLat;
+    int longitude, latitude;
     long currentVertex, currentQuad;
 
     result = newGLObject(vertices, 3, 1);
     if (result == NULL)
         return NULL;
 
-    for (a = 0; a < 3; ++a)
-        baseColor[a] = ((randomUInt() % 155) + 100) / 255.f;
+    rLong = (float *)malloc((gridLongitudes + gridLatitudes + 3 * gridPoints) *
+                            sizeof(float));
+    cosLong = (double *)malloc(2 * (gridLongitudes + gridLatitudes) *
+                               sizeof(double));
+    if (rLong == NULL || cosLong == NULL)
+    {
+        free(rLong);
+        free(cosLong);
+        freeGLObject(result);
+        return NULL;
+    }
+    rLat = rLong + gridLongitudes;
+    gridX = rLat + gridLatitudes;
+    gridY = gridX + gridPoints;
+    gridZ = gridY + gridPoints;
+    sinLong = cosLong + gridLongitudes;
+    cosLat = sinLong + gridLongitudes;
+    sinLat = cosLat + gridLatitudes;
+
+    // longitude -pi to pi, latitude 0 to pi/2
+    superShapeAxis(params, 0, longitudeCount, resol1, -PI,
+                   rLong, cosLong, sinLong);
+    superShapeAxis(&params[6], latitudeBegin, latitudeCount, resol2, -PI / 2,
+                   rLat, cosLat, sinLat);
+
+    /* Sphere-map all grid points up front; each one is shared by four quads.
+     * The inner loop is a plain structure-of-arrays loop, so the compiler
+     * can vectorize it. Points with a zero radius come out as inf or nan,
+     * but they belong only to quads that are skipped below.
+     */
+    for (longitude = 0; longitude < gridLongitudes; ++longitude)
+    {
+        const double ct = cosLong[longitude], st = sinLong[longitude];
+        const float r1 = rLong[longitude];
+        float *x = gridX + longitude * gridLatitudes;
+        float *y = gridY + longitude * gridLatitudes;
+        float *z = gridZ + longitude * gridLatitudes;
+        for (latitude = 0; latitude < gridLatitudes; ++latitude)
+        {
+            const float r2 = rLat[latitude];
+            x[latitude] = (float)(ct * cosLat[latitude] / r1 / r2);
+            y[latitude] = (float)(st * cosLat[latitude] / r1 / r2);
+            z[latitude] = (float)(sinLat[latitude] / r2);
+        }
+    }
 
     currentQuad = 0;
     currentVertex = 0;
 
-    // longitude -pi to pi
     for (longitude = 0; longitude < longitudeCount; ++longitude)
     {
-
-        // latitude 0 to pi/2
-        for (latitude = latitudeBegin; latitude < latitudeEnd; ++latitude)
+        for (latitude = 0; latitude < latitudeCount; ++latitude)
         {
-            float t1 = -PI + longitude * 2 * PI / resol1;
-            float t2 = -PI + (longitude + 1) * 2 * PI / resol1;
-            float p1 = -PI / 2 + latitude * 2 * PI / resol2;
-            float p2 = -PI / 2 + (latitude + 1) * 2 * PI / resol2;
-            float r0, r1, r2, r3;
-
-            r0 = ssFunc(t1, params);
-            r1 = ssFunc(p1, &params[6]);
-            r2 = ssFunc(t2, params);
-            r3 = ssFunc(p2, &params[6]);
-
-            if (r0 != 0 && r1 != 0 && r2 != 0 && r3 != 0)
+            if (rLong[longitude] != 0 && rLat[latitude] != 0 &&
+                rLong[longitude + 1] != 0 && rLat[latitude + 1] != 0)
             {
-                VECTOR3 pa, pb, pc, pd;
+                // grid indices of the quad corners
+                const int ia = longitude * gridLatitudes + latitude;
+                const int ib = ia + gridLatitudes;
+                const int ic = ib + 1;
+                const int id = ia + 1;
+                VECTOR3 v[4];    // pa, pb, pc, pd
                 VECTOR3 v1, v2, n;
+                GLubyte color[3];
+                GLfixed fixedN[3];
+                GLfixed *vertex, *normal;
+                GLubyte *col;
                 float ca;
-                int i;
+                int a, i;
                 //float lenSq, invLenSq;
 
-                superShapeMap(&pa, r0, r1, t1, p1);
-                superShapeMap(&pb, r2, r1, t2, p1);
-                superShapeMap(&pc, r2, r3, t2, p2);
-                superShapeMap(&pd, r0, r3, t1, p2);
+                v[0].x = gridX[ia]; v[0].y = gridY[ia]; v[0].z = gridZ[ia];
+                v[1].x = gridX[ib]; v[1].y = gridY[ib]; v[1].z = gridZ[ib];
+                v[2].x = gridX[ic]; v[2].y = gridY[ic]; v[2].z = gridZ[ic];
+                v[3].x = gridX[id]; v[3].y = gridY[id]; v[3].z = gridZ[id];
 
                 // kludge to set lower edge of the object to fixed level
-                if (latitude == latitudeBegin + 1)
-                    pa.z = pb.z = 0;
+                if (latitude == 1)
+                    v[0].z = v[1].z = 0;
 
-                vector3Sub(&v1, &pb, &pa);
-                vector3Sub(&v2, &pd, &pa);
+                vector3Sub(&v1, &v[1], &v[0]);
+                vector3Sub(&v2, &v[3], &v[0]);
 
                 // Calculate normal with cross product.
                 /*   i    j    k      i    j
@@ -281,60 +365,45 @@ static GLOBJECT * createSuperShape(const float *params)
                 n.z *= invLenSq;
                 */
 
-                ca = pa.z + 0.5f;
+                ca = v[0].z + 0.5f;
+                for (a = 0; a < 3; ++a)
+                {
+                    int c = (int)(ca * baseColor[a] * 255);
+                    color[a] = (GLubyte)(c > 255 ? 255 : c);
+                }
+                fixedN[0] = FIXED(n.x);
+                fixedN[1] = FIXED(n.y);
+                fixedN[2] = FIXED(n.z);
 
-                for (i = currentVertex * 3;
-                     i < (currentVertex + 6) * 3;
-                     i += 3)
+                normal = &result->normalArray[currentVertex * 3];
+                col = &result->colorArray[currentVertex * 4];
+                for (i = 0; i < 6; ++i)
                 {
-                    result->normalArray[i] = FIXED(n.x);
-                    result->normalArray[i + 1] = FIXED(n.y);
-                    result->normalArray[i + 2] = FIXED(n.z);
+                    normal[i * 3] = fixedN[0];
+                    normal[i * 3 + 1] = fixedN[1];
+                    normal[i * 3 + 2] = fixedN[2];
+                    col[i * 4] = color[0];
+                    col[i * 4 + 1] = color[1];
+                    col[i * 4 + 2] = color[2];
+                    col[i * 4 + 3] = 0;
                 }
-                for (i = currentVertex * 4;
-                     i < (currentVertex + 6) * 4;
-                     i += 4)
+                vertex = &result->vertexArray[currentVertex * 3];
+                for (i = 0; i < 6; ++i)
                 {
-                    int a, color[3];
-                    for (a = 0; a < 3; ++a)
-                    {
-                        color[a] = (int)(ca * baseColor[a] * 255);
-                        if (color[a] > 255) color[a] = 255;
-                    }
-                    result->colorArray[i] = (GLubyte)color[0];
-                    result->colorArray[i + 1] = (GLubyte)color[1];
-                    result->colorArray[i + 2] = (GLubyte)color[2];
-                    result->colorArray[i + 3] = 0;
+                    const VECTOR3 *p = &v[sQuadCorners[i]];
+                    vertex[i * 3] = FIXED(p->x);
+                    vertex[i * 3 + 1] = FIXED(p->y);
+                    vertex[i * 3 + 2] = FIXED(p->z);
                 }
-                result->vertexArray[currentVertex * 3] = FIXED(pa.x);
-                result->vertexArray[currentVertex * 3 + 1] = FIXED(pa.y);
-                result->vertexArray[currentVertex * 3 + 2] = FIXED(pa.z);
-                ++currentVertex;
-                result->vertexArray[currentVertex * 3] = FIXED(pb.x);
-                result->vertexArray[currentVertex * 3 + 1] = FIXED(pb.y);
-                result->vertexArray[currentVertex * 3 + 2] = FIXED(pb.z);
-                ++currentVertex;
-                result->vertexArray[currentVertex * 3] = FIXED(pd.x);
-                result->vertexArray[currentVertex * 3 + 1] = FIXED(pd.y);
-                result->vertexArray[currentVertex * 3 + 2] = FIXED(pd.z);
-                ++currentVertex;
-                result->vertexArray[currentVertex * 3] = FIXED(pb.x);
-                result->vertexArray[currentVertex * 3 + 1] = FIXED(pb.y);
-                result->vertexArray[currentVertex * 3 + 2] = FIXED(pb.z);
-                ++currentVertex;
-                result->vertexArray[currentVertex * 3] = FIXED(pc.x);
-                result->vertexArray[currentVertex * 3 + 1] = FIXED(pc.y);
-                result->vertexArray[currentVertex * 3 + 2] = FIXED(pc.z);
-                ++currentVertex;
-                result->vertexArray[currentVertex * 3] = FIXED(pd.x);
-                result->vertexArray[currentVertex * 3 + 1] = FIXED(pd.y);
-                result->vertexArray[currentVertex * 3 + 2] = FIXED(pd.z);
-                ++currentVertex;
+                currentVertex += 6;
             } // r0 && r1 && r2 && r3
             ++currentQuad;
         } // latitude
     } // longitude
 
+    free(rLong);
+    free(cosLong);
+
     // Set number of vertices in object to the actual amount created.
     result->count = currentVertex;
 
@@ -342,6 +411,135 @@ static GLOBJECT * createSuperShape(const float *params)
 }
 
 
+// FNV-1a hash of the inputs of createSuperShape.
+static unsigned long superShapeKey(const float *params, const float *baseColor)
+{
+    const unsigned char *p;
+    unsigned long h = 2166136261u;
+    size_t i;
+    p = (const unsigned char *)params;
+    for (i = 0; i < SUPERSHAPE_PARAMS * sizeof(float); ++i)
+        h = ((h ^ p[i]) * 16777619u) & 0xffffffffu;
+    p = (const unsigned char *)baseColor;
+    for (i = 0; i < 3 * sizeof(float); ++i)
+        h = ((h ^ p[i]) * 16777619u) & 0xffffffffu;
+    return h;
+}
+
+
+static GLOBJECT * findCachedSuperShape(unsigned long key, const float *params,
+                                       const float *baseColor)
+{
+    int a;
+    for (a = 0; a < sSuperShapeCacheCount; ++a)
+    {
+        SUPERSHAPE_CACHE_ENTRY *entry = &sSuperShapeCache[a];
+        if (entry->key == key &&
+            memcmp(entry->params, params, sizeof(entry->params)) == 0 &&
+            memcmp(entry->baseColor, baseColor, sizeof(entry->baseColor)) == 0)
+            return entry->object;
+    }
+    return NULL;
+}
+
+
+static void cacheSuperShape(unsigned long key, const float *params,
+                            const float *baseColor, GLOBJECT *object)
+{
+    SUPERSHAPE_CACHE_ENTRY *entry;
+    if (sSuperShapeCacheCount >= SUPERSHAPE_COUNT)
+        return;
+    entry = &sSuperShapeCache[sSuperShapeCacheCount++];
+    entry->key = key;
+    memcpy(entry->params, params, sizeof(entry->params));
+    memcpy(entry->baseColor, baseColor, sizeof(entry->baseColor));
+    entry->object = object;
+}
+
+
+// Work of one supershape generating thread: every step-th shape from first on.
+typedef struct {
+    int first, step;
+    float (*baseColors)[3];
+} SUPERSHAPE_JOB;
+
+
+static void * superShapeWorker(void *arg)
+{
+    const SUPERSHAPE_JOB *job = (const SUPERSHAPE_JOB *)arg;
+    int a;
+    for (a = job->first; a < (int)SUPERSHAPE_COUNT; a += job->step)
+    {
+        // shapes found in the cache are already set
+        if (sSuperShapeObjects[a] == NULL)
+            sSuperShapeObjects[a] = createSuperShape(sSuperShapeParams[a],
+                                                     job->baseColors[a]);
+    }
+    return NULL;
+}
+
+
+/* Sets sSuperShapeObjects, from the cache or by generating the shapes. The
+ * shapes are independent of each other, so the missing ones are generated in
+ * parallel on up to threadCount threads; the calling thread works too.
+ */
+static void createSuperShapes(float (*baseColors)[3], int threadCount)
+{
+    SUPERSHAPE_JOB jobs[MAX_SUPERSHAPE_THREADS];
+    pthread_t threads[MAX_SUPERSHAPE_THREADS];
+    int started[MAX_SUPERSHAPE_THREADS];
+    unsigned long keys[SUPERSHAPE_COUNT];
+    int a, missing = 0;
+
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+    {
+        keys[a] = superShapeKey(sSuperShapeParams[a], baseColors[a]);
+        sSuperShapeObjects[a] = findCachedSuperShape(keys[a],
+                                                     sSuperShapeParams[a],
+                                                     baseColors[a]);
+        if (sSuperShapeObjects[a] == NULL)
+            ++missing;
+    }
+    if (missing == 0)
+        return;
+
+    if (threadCount > MAX_SUPERSHAPE_THREADS)
+        threadCount = MAX_SUPERSHAPE_THREADS;
+    if (threadCount > missing)
+        threadCount = missing;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    for (a = 0; a < threadCount; ++a)
+    {
+        jobs[a].first = a;
+        jobs[a].step = threadCount;
+        jobs[a].baseColors = baseColors;
+        started[a] = a > 0 &&
+            pthread_create(&threads[a], NULL, superShapeWorker, &jobs[a]) == 0;
+    }
+    // do the first job here, and the jobs of any thread that didn't start
+    for (a = 0; a < threadCount; ++a)
+    {
+        if (!started[a])
+            superShapeWorker(&jobs[a]);
+    }
+    for (a = 1; a < threadCount; ++a)
+    {
+        if (started[a])
+            pthread_join(threads[a], NULL);
+    }
+
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+    {
+        if (findCachedSuperShape(keys[a], sSuperShapeParams[a],
+                                 baseColors[a]) == NULL)
+            cacheSuperShape(keys[a], sSuperShapeParams[a], baseColors[a],
+                            sSuperShapeObjects[a]);
+    }
+}
+
+
 static GLOBJECT * createGroundPlane()
 {
     const int scale = 4;
@@ -462,7 +660,8 @@ static void drawFadeQuad()
 // Called from the app framework.
 void appInit()
 {
-    int a;
+    float baseColors[SUPERSHAPE_COUNT][3];
+    int a, b;
 
     glEnable(GL_NORMALIZE);
     glEnable(GL_DEPTH_TEST);
@@ -479,11 +678,16 @@ void appInit()
 
     seedRandom(15);
 
+    // Draw the random colors in shape order, before generating the shapes
+    // in parallel.
     for (a = 0; a < SUPERSHAPE_COUNT; ++a)
     {
-        sSuperShapeObjects[a] = createSuperShape(sSuperShapeParams[a]);
-        assert(sSuperShapeObjects[a] != NULL);
+        for (b = 0; b < 3; ++b)
+            baseColors[a][b] = ((randomUInt() % 155) + 100) / 255.f;
     }
+    createSuperShapes(baseColors, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+        assert(sSuperShapeObjects[a] != NULL);
     sGroundPlane = createGroundPlane();
     assert(sGroundPlane != NULL);
 }
@@ -493,9 +697,11 @@ void appInit()
 void appDeinit()
 {
     int a;
+    // The supershapes stay in sSuperShapeCache for the next appInit().
     for (a = 0; a < SUPERSHAPE_COUNT; ++a)
-        freeGLObject(sSuperShapeObjects[a]);
+        sSuperShapeObjects[a] = NULL;
     freeGLObject(sGroundPlane);
+    sGroundPlane = NULL;
 }
 
 
@@ -0,0 +1,307 @@
+/* San Angeles Observation OpenGL ES version example
+ * Copyright 2009 The Android Open Source Project
+ * All rights reserved.
+ *
+ * This source is free software; you can redistribute it and/or
+ * modify it under the terms of EITHER:
+ *   (1) The GNU Lesser General Public License as published by the Free
+ *       Software Foundation; either version 2.1 of the License, or (at
+ *       your option) any later version. The text of the GNU Lesser
+ *       General Public License is included with this source in the
+ *       file LICENSE-LGPL.txt.
+ *   (2) The BSD-style license that is included with this source in
+ *       the file LICENSE-BSD.txt.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files
+ * LICENSE-LGPL.txt and LICENSE-BSD.txt for more details.
+ */
+
+/* Host check and benchmark of the supershape generation in demo.c.
+ *
+ * Usage: supershape-bench [-r rounds] [-t threads]
+ *   -r  rounds of generation timed (default 20)
+ *   -t  most threads checked and timed (default 4)
+ *
+ * The shapes generated from the axis tables, with 1 to threads threads, must
+ * be byte for byte the shapes of the original generator, which evaluated
+ * ssFunc and the sphere mapping again at every quad corner. A second
+ * generation must come from the cache without generating anything. Then
+ * the original generator, the new one and a cache hit are timed. Exits non
+ * zero when a check fails.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+// demo.c keeps the generator and the cache static.
+#include "demo.c"
+
+
+int gAppAlive = 1;
+
+static int errors = 0;
+
+
+static void check(int ok, const char *what, int threads, int shape)
+{
+    if (!ok && errors++ < 10)
+        fprintf(stderr, "%d threads, shape %d: %s\n", threads, shape, what);
+}
+
+
+static double nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+static void refSuperShapeMap(VECTOR3 *point, float r1, float r2, float t,
+                             float p)
+{
+    // sphere-mapping of supershape parameters
+    point->x = (float)(cos(t) * cos(p) / r1 / r2);
+    point->y = (float)(sin(t) * cos(p) / r1 / r2);
+    point->z = (float)(sin(p) / r2);
+}
+
+
+static void refPutVertex(GLOBJECT *object, long vertex, const VECTOR3 *p)
+{
+    object->vertexArray[vertex * 3] = FIXED(p->x);
+    object->vertexArray[vertex * 3 + 1] = FIXED(p->y);
+    object->vertexArray[vertex * 3 + 2] = FIXED(p->z);
+}
+
+
+// createSuperShape as it was before the axis tables.
+static GLOBJECT * refCreateSuperShape(const float *params,
+                                      const float *baseColor)
+{
+    const int resol1 = (int)params[SUPERSHAPE_PARAMS - 3];
+    const int resol2 = (int)params[SUPERSHAPE_PARAMS - 2];
+    const int latitudeBegin = resol2 / 4;
+    const int latitudeEnd = resol2 / 2;    // non-inclusive
+    const int longitudeCount = resol1;
+    const int latitudeCount = latitudeEnd - latitudeBegin;
+    const long vertices = longitudeCount * latitudeCount * 2 * 3;
+    GLOBJECT *result;
+    int longitude, latitude;
+    long currentVertex = 0;
+
+    result = newGLObject(vertices, 3, 1);
+    if (result == NULL)
+        return NULL;
+
+    for (longitude = 0; longitude < longitudeCount; ++longitude)
+    {
+        for (latitude = latitudeBegin; latitude < latitudeEnd; ++latitude)
+        {
+            float t1 = -PI + longitude * 2 * PI / resol1;
+            float t2 = -PI + (longitude + 1) * 2 * PI / resol1;
+            float p1 = -PI / 2 + latitude * 2 * PI / resol2;
+            float p2 = -PI / 2 + (latitude + 1) * 2 * PI / resol2;
+            float r0, r1, r2, r3;
+
+            r0 = ssFunc(t1, params);
+            r1 = ssFunc(p1, &params[6]);
+            r2 = ssFunc(t2, params);
+            r3 = ssFunc(p2, &params[6]);
+
+            if (r0 != 0 && r1 != 0 && r2 != 0 && r3 != 0)
+            {
+                VECTOR3 pa, pb, pc, pd;
+                VECTOR3 v1, v2, n;
+                float ca;
+                int i;
+
+                refSuperShapeMap(&pa, r0, r1, t1, p1);
+                refSuperShapeMap(&pb, r2, r1, t2, p1);
+                refSuperShapeMap(&pc, r2, r3, t2, p2);
+                refSuperShapeMap(&pd, r0, r3, t1, p2);
+
+                // kludge to set lower edge of the object to fixed level
+                if (latitude == latitudeBegin + 1)
+                    pa.z = pb.z = 0;
+
+                vector3Sub(&v1, &pb, &pa);
+                vector3Sub(&v2, &pd, &pa);
+
+                n.x = v1.y * v2.z - v1.z * v2.y;
+                n.y = v1.z * v2.x - v1.x * v2.z;
+                n.z = v1.x * v2.y - v1.y * v2.x;
+
+                ca = pa.z + 0.5f;
+
+                for (i = currentVertex * 3; i < (currentVertex + 6) * 3; i += 3)
+                {
+                    result->normalArray[i] = FIXED(n.x);
+                    result->normalArray[i + 1] = FIXED(n.y);
+                    result->normalArray[i + 2] = FIXED(n.z);
+                }
+                for (i = currentVertex * 4; i < (currentVertex + 6) * 4; i += 4)
+                {
+                    int a, color[3];
+                    for (a = 0; a < 3; ++a)
+                    {
+                        color[a] = (int)(ca * baseColor[a] * 255);
+                        if (color[a] > 255) color[a] = 255;
+                    }
+                    result->colorArray[i] = (GLubyte)color[0];
+                    result->colorArray[i + 1] = (GLubyte)color[1];
+                    result->colorArray[i + 2] = (GLubyte)color[2];
+                    result->colorArray[i + 3] = 0;
+                }
+                refPutVertex(result, currentVertex++, &pa);
+                refPutVertex(result, currentVertex++, &pb);
+                refPutVertex(result, currentVertex++, &pd);
+                refPutVertex(result, currentVertex++, &pb);
+                refPutVertex(result, currentVertex++, &pc);
+                refPutVertex(result, currentVertex++, &pd);
+            }
+        }
+    }
+
+    result->count = currentVertex;
+    return result;
+}
+
+
+// The base colors appInit() draws.
+static void drawBaseColors(float (*baseColors)[3])
+{
+    int a, b;
+    seedRandom(15);
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+    {
+        for (b = 0; b < 3; ++b)
+            baseColors[a][b] = ((randomUInt() % 155) + 100) / 255.f;
+    }
+}
+
+
+static void clearSuperShapeCache()
+{
+    int a;
+    for (a = 0; a < sSuperShapeCacheCount; ++a)
+        freeGLObject(sSuperShapeCache[a].object);
+    sSuperShapeCacheCount = 0;
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+        sSuperShapeObjects[a] = NULL;
+}
+
+
+static int sameGLObject(const GLOBJECT *a, const GLOBJECT *b)
+{
+    return a != NULL && b != NULL && a->count == b->count &&
+        a->vertexComponents == b->vertexComponents &&
+        memcmp(a->vertexArray, b->vertexArray,
+               a->count * a->vertexComponents * sizeof(GLfixed)) == 0 &&
+        memcmp(a->colorArray, b->colorArray, a->count * 4) == 0 &&
+        memcmp(a->normalArray, b->normalArray,
+               a->count * 3 * sizeof(GLfixed)) == 0;
+}
+
+
+static void checkShapes(GLOBJECT **reference, float (*baseColors)[3],
+                        int threads)
+{
+    GLOBJECT *generated[SUPERSHAPE_COUNT];
+    int a;
+
+    clearSuperShapeCache();
+    createSuperShapes(baseColors, threads);
+    check(sSuperShapeCacheCount == SUPERSHAPE_COUNT, "not cached", threads, 0);
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+    {
+        check(sameGLObject(sSuperShapeObjects[a], reference[a]),
+              "differs from the original generator", threads, a);
+        generated[a] = sSuperShapeObjects[a];
+        sSuperShapeObjects[a] = NULL;
+    }
+
+    // as appDeinit() and appInit() do when the surface is recreated
+    createSuperShapes(baseColors, threads);
+    check(sSuperShapeCacheCount == SUPERSHAPE_COUNT, "cached again", threads,
+          0);
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+        check(sSuperShapeObjects[a] == generated[a], "not taken from the cache",
+              threads, a);
+}
+
+
+int main(int argc, char *argv[])
+{
+    GLOBJECT *reference[SUPERSHAPE_COUNT];
+    float baseColors[SUPERSHAPE_COUNT][3];
+    int rounds = 20, maxThreads = MAX_SUPERSHAPE_THREADS;
+    int threads, r, a;
+    double start, refMs, cacheMs;
+
+    for (a = 1; a < argc; ++a)
+    {
+        if (strcmp(argv[a], "-r") == 0 && a + 1 < argc)
+            rounds = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc)
+            maxThreads = atoi(argv[++a]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-r rounds] [-t threads]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (rounds < 1 || maxThreads < 1)
+    {
+        fprintf(stderr, "need at least one round and one thread\n");
+        return 1;
+    }
+
+    drawBaseColors(baseColors);
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+        reference[a] = refCreateSuperShape(sSuperShapeParams[a], baseColors[a]);
+    for (threads = 1; threads <= maxThreads; ++threads)
+        checkShapes(reference, baseColors, threads);
+
+    start = nowMs();
+    for (r = 0; r < rounds; ++r)
+    {
+        for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+            freeGLObject(refCreateSuperShape(sSuperShapeParams[a],
+                                             baseColors[a]));
+    }
+    refMs = (nowMs() - start) / rounds;
+    printf("%d shapes: original generator %.3f ms\n", (int)SUPERSHAPE_COUNT,
+           refMs);
+
+    for (threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        double ms = 0;
+        for (r = 0; r < rounds; ++r)
+        {
+            clearSuperShapeCache();
+            start = nowMs();
+            createSuperShapes(baseColors, threads);
+            ms += nowMs() - start;
+        }
+        printf("axis tables, %d threads: %.3f ms\n", threads, ms / rounds);
+    }
+
+    start = nowMs();
+    for (r = 0; r < rounds; ++r)
+        createSuperShapes(baseColors, maxThreads);
+    cacheMs = (nowMs() - start) / rounds;
+    printf("cache hit: %.4f ms\n", cacheMs);
+
+    clearSuperShapeCache();
+    for (a = 0; a < SUPERSHAPE_COUNT; ++a)
+        freeGLObject(reference[a]);
+    if (errors)
+    {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -40,9 +40,10 @@ enum APIMode {
   kAPIEGLExtension,
 };
 
+// Vsyncs per frame in throttled mode. The pacer goes up to
+// kMaxSwapInterval when frames take longer than that.
 const int32_t kFPSThrottleInterval = 2;
-const int64_t kFPSThrottlePresentationInterval = (kFPSThrottleInterval / 60.0f) * 1000000000;
-#define COULD_RENDER(now, last) (((now) - (last)) >= kFPSThrottlePresentationInterval)
+const int32_t kMaxSwapInterval = 4;
 
 // Declaration for native chreographer API.
 struct AChoreographer;
@@ -71,6 +72,8 @@ class Engine {
   ndk_helper::PinchDetector pinch_detector_;
   ndk_helper::DragDetector drag_detector_;
   ndk_helper::PerfMonitor monitor_;
+  ndk_helper::FramePacer pacer_;
+  uint64_t reported_late_frames_;
 
   ndk_helper::TapCamera tap_camera_;
 
@@ -87,7 +90,7 @@ class Engine {
   void CheckAPISupport();
   void StartFPSThrottle();
   void StopFPSThrottle();
-  int64_t GetCurrentTime();
+  void ReportPacing();
 
   void StartChoreographer();
   void StartJavaChoreographer();
@@ -99,14 +102,13 @@ class Engine {
   func_AChoreographer_postFrameCallback AChoreographer_postFrameCallback_;
 
   // Stuff for EGL Android presentation time extension.
-  int64_t presentation_time_;
   bool (*eglPresentationTimeANDROID_)(EGLDisplay dpy, EGLSurface sur,
                                       khronos_stime_nanoseconds_t time);
 
-  int64_t prevFrameTimeNanos_;
   bool should_render_;
   std::mutex mtx_;              // mutex for critical section
   std::condition_variable cv_;  // condition variable for critical section
+  bool present_pending_;        // set by the Java callback, guarded by mtx_
 
  public:
   static void HandleCmd(struct android_app* app, int32_t cmd);
@@ -137,9 +139,10 @@ Engine::Engine()
      initialized_resources_(false),
      has_focus_(false),
      fps_throttle_(true),
+     reported_late_frames_(0),
      api_mode_(kAPINone),
-     prevFrameTimeNanos_(static_cast<int64_t>(0)),
-     should_render_(true) {
+     should_render_(true),
+     present_pending_(false) {
   gl_context_ = ndk_helper::GLContext::GetInstance();
 }
 
@@ -179,7 +182,6 @@ void Engine::CheckAPISupport() {
         bool (*)(EGLDisplay, EGLSurface, khronos_stime_nanoseconds_t)>(
         eglGetProcAddress("eglPresentationTimeANDROID"));
     assert(eglPresentationTimeANDROID_);
-    presentation_time_ = GetCurrentTime();
   } else if (apilevel >= 16) {
     // Choreographer Java API is supported API level 16~.
     LOGI("Run with Chreographer Java API.");
@@ -192,21 +194,36 @@ void Engine::CheckAPISupport() {
 }
 
 void Engine::StartFPSThrottle() {
+  pacer_.SetSwapIntervalRange(kFPSThrottleInterval, kMaxSwapInterval);
+  // Count jank against the throttled rate, not the display's
+  monitor_.GetFrameStats().SetTargetInterval(1. / 30.);
   api_mode_ = original_api_mode_;
   if (api_mode_ == kAPINativeChoreographer) {
     // Initiate choreographer callback.
     StartChoreographer();
   } else if (api_mode_ == kAPIJavaChoreographer) {
+    // Drop the wakeup StopJavaChoreographer() left behind
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      present_pending_ = false;
+    }
     // Initiate Java choreographer callback.
     StartJavaChoreographer();
+  } else if (api_mode_ == kAPIEGLExtension) {
+    // The native Choreographer isn't there before API level 24. The Java one
+    // only feeds vsync times to the pacer, presentation times do the pacing.
+    StartJavaChoreographer();
   }
 }
 
 void Engine::StopFPSThrottle() {
+  pacer_.SetSwapIntervalRange(1, 1);
+  monitor_.GetFrameStats().SetTargetInterval(1. / 60.);
   if (api_mode_ == kAPINativeChoreographer) {
     should_render_ = true;
     //    ALooper_wake(app_->looper);
-  } else if (api_mode_ == kAPIJavaChoreographer) {
+  } else if (api_mode_ == kAPIJavaChoreographer ||
+             api_mode_ == kAPIEGLExtension) {
     StopJavaChoreographer();
   }
   api_mode_ = kAPINone;
@@ -218,15 +235,21 @@ void Engine::DoSwap() {
     // Do nothing but wait the until choreographer callback.
     should_render_ = false;
   } else if (api_mode_ == kAPIJavaChoreographer) {
-    // Wait until the conditional variable is signaled.
+    // Wait until the callback says the frame is due. It may already have,
+    // and the condition variable may wake up spuriously: go by the flag.
     std::unique_lock<std::mutex> lock(mtx_);
-    cv_.wait(lock);
+    cv_.wait(lock, [this] { return present_pending_; });
+    present_pending_ = false;
     Swap();
   } else if (api_mode_ == kAPIEGLExtension) {
-    // Use eglPresentationTimeANDROID extension.
-    presentation_time_ += kFPSThrottlePresentationInterval;
-    eglPresentationTimeANDROID_(gl_context_->GetDisplay(),
-                                gl_context_->GetSurface(), presentation_time_);
+    // Use eglPresentationTimeANDROID extension with the vsync the pacer
+    // predicted for this frame. Until the first vsync arrived the prediction
+    // is off the real grid, so just swap.
+    if (pacer_.HasVsync()) {
+      eglPresentationTimeANDROID_(gl_context_->GetDisplay(),
+                                  gl_context_->GetSurface(),
+                                  pacer_.GetPresentTime());
+    }
     Swap();
   } else {
     // Regular Swap.
@@ -252,16 +275,18 @@ void Engine::choreographer_callback(long frameTimeNanos, void* data) {
   if (engine->has_focus_) {
     engine->StartChoreographer();
   }
+  // Throttling was turned off while this callback was pending
+  if (engine->api_mode_ != kAPINativeChoreographer) return;
 
-  // Swap buffer if the timing meets the 30fps time interval condition.
+  // Swap buffer at the vsync the pacer picked for the pending frame.
   // The callback is in the same thread context, so that we can just invoke
   // eglSwapBuffers().
-  if (COULD_RENDER(frameTimeNanos, engine->prevFrameTimeNanos_)) {
+  engine->pacer_.OnVsync(frameTimeNanos);
+  if (engine->pacer_.ShouldPresent(frameTimeNanos)) {
     engine->should_render_ = true;
     engine->Swap();
     // Wake up main looper so that it will continue rendering.
     ALooper_wake(engine->app_->looper);
-    engine->prevFrameTimeNanos_ = frameTimeNanos;
   }
 }
 
@@ -288,14 +313,25 @@ void Engine::StopJavaChoreographer() {
   jni->CallVoidMethod(app_->activity->clazz, methodID);
   app_->activity->vm->DetachCurrentThread();
   // Make sure the render thread is not blocked.
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    present_pending_ = true;
+  }
   cv_.notify_one();
   return;
 }
 
 void Engine::SynchInCallback(jlong frameTimeInNanos) {
-  // Signal render thread if the timing meets the 30fps time interval condition.
-  if (COULD_RENDER(frameTimeInNanos, prevFrameTimeNanos_)) {
-    prevFrameTimeNanos_ = frameTimeInNanos;
+  // Signal render thread when the pending frame is due. FramePacer is thread
+  // safe, this runs on the Java UI thread. With the EGL extension the render
+  // thread doesn't wait, the callback only tracks vsyncs.
+  pacer_.OnVsync(frameTimeInNanos);
+  if (api_mode_ != kAPIJavaChoreographer) return;
+  if (pacer_.ShouldPresent(frameTimeInNanos)) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      present_pending_ = true;
+    }
     cv_.notify_one();
   }
 };
@@ -307,13 +343,6 @@ Java_com_sample_choreographer_ChoreographerNativeActivity_choregrapherCallback(
 }
 
 // Helper functions.
-int64_t Engine::GetCurrentTime() {
-  timespec time;
-  clock_gettime(CLOCK_MONOTONIC, &time);
-  return static_cast<int64_t>(time.tv_sec) * 1e9 +
-         static_cast<int64_t>(time.tv_nsec);
-}
-
 void Engine::Swap() {
   if (EGL_SUCCESS != gl_context_->Swap()) {
     UnloadResources();
@@ -385,18 +414,43 @@ void Engine::DrawFrame() {
   float fps;
   if (monitor_.Update(fps)) {
     UpdateFPS(fps);
+    ReportPacing();
+  }
+  pacer_.BeginFrame(ndk_helper::GetMonotonicTimeNs());
+  ndk_helper::FrameStats& stats = monitor_.GetFrameStats();
+  {
+    ndk_helper::ScopedFramePhase phase(stats, ndk_helper::FRAME_PHASE_UPDATE);
+    renderer_.Update(monitor_.GetCurrentTime());
   }
-  renderer_.Update(monitor_.GetCurrentTime());
 
   // Just fill the screen with a color.
-  glClearColor(0.5f, 0.5f, 0.5f, 1.f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  float color[2][3] = {{1.0f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}};
-  int32_t i = fps_throttle_ ? 0 : 1;
-  renderer_.Render(color[i][0], color[i][1], color[i][2]);
+  {
+    ndk_helper::ScopedFramePhase phase(stats, ndk_helper::FRAME_PHASE_SUBMIT);
+    glClearColor(0.5f, 0.5f, 0.5f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    float color[2][3] = {{1.0f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}};
+    int32_t i = fps_throttle_ ? 0 : 1;
+    renderer_.Render(color[i][0], color[i][1], color[i][2]);
+  }
+  pacer_.EndFrame(ndk_helper::GetMonotonicTimeNs());
   DoSwap();
 }
 
+/**
+ * Log pacing decisions and late frames since the last report.
+ */
+void Engine::ReportPacing() {
+  ndk_helper::FramePacerStats stats;
+  pacer_.GetStats(stats);
+  if (stats.late_frames == reported_late_frames_) return;
+  LOGI("Pacing: swap interval %d, vsync %.2fms, CPU p90 %.2fms, %llu late "
+       "frames (%llu missed vsyncs)",
+       stats.swap_interval, stats.vsync_period, stats.cpu_cost,
+       (unsigned long long)(stats.late_frames - reported_late_frames_),
+       (unsigned long long)stats.missed_vsyncs);
+  reported_late_frames_ = stats.late_frames;
+}
+
 /**
  * Tear down the EGL context currently associated with the display.
  */
@@ -405,6 +459,8 @@ void Engine::TermDisplay() { gl_context_->Suspend(); }
 void Engine::TrimMemory() {
   LOGI("Trimming memory");
   gl_context_->Invalidate();
+  // Shaders are mapped again on the next context, drop what nobody holds
+  ndk_helper::AssetCache::GetInstance()->Purge();
 }
 
 /**
@@ -500,8 +556,10 @@ void Engine::HandleCmd(struct android_app* app, int32_t cmd) {
       // Start animation
       eng->has_focus_ = true;
 
-      // Update counter when the app becomes active.
-      eng->presentation_time_ = eng->GetCurrentTime();
+      // Restart pacing when the app becomes active, the pause isn't a
+      // late frame.
+      eng->pacer_.Reset();
+      eng->reported_late_frames_ = 0;
       if (eng->api_mode_ == kAPINativeChoreographer) {
         eng->StartChoreographer();
       }
@@ -580,6 +638,10 @@ void android_main(android_app* state) {
 
   // Init helper functions
   ndk_helper::JNIHelper::Init(state->activity, HELPER_CLASS_NAME);
+  // Map the shaders while the window comes up, compiling them then reads
+  // memory instead of the APK
+  ndk_helper::AssetCache::GetInstance()->Prefetch({
+      "Shaders/VS_ShaderPlain.vsh", "Shaders/ShaderPlain.fsh"});
 
   state->userData = &g_engine;
   state->onAppCmd = Engine::HandleCmd;
@@ -27,6 +27,8 @@
 #include <android/log.h>
 #include <android_native_app_glue.h>
 
+#include "assetCache.h"
+
 #define LOGI(...)                                                           \
   ((void)__android_log_print(                                               \
       ANDROID_LOG_INFO, ndk_helper::JNIHelper::GetInstance()->GetAppName(), \
@@ -141,6 +143,7 @@ class JNIHelper {
    * First, the method tries to read the file from an external storage.
    * If it fails to read, it falls back to use assset manager and try to read
    * the file from APK asset.
+   * The file is served from AssetCache, prefer MapFile() to avoid the copy.
    *
    * arguments:
    * in: file_name, file name to read
@@ -154,6 +157,18 @@ class JNIHelper {
    */
   bool ReadFile(const char* file_name, std::vector<uint8_t>* buffer_ref);
 
+  /*
+   * Map a file read-only, with the same lookup order as ReadFile().
+   * Repeated calls for the same file share one mapping in AssetCache.
+   *
+   * arguments:
+   * in: file_name, file name to map
+   * return:
+   * span of the file contents, AssetSpan::IsValid() is false when the file
+   * can't be found
+   */
+  AssetSpan MapFile(const char* file_name);
+
   /*
    * Load and create OpenGL texture from given file name.
    * The method invokes BitmapFactory in Java so it can read jpeg/png formatted
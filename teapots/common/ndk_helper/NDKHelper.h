@@ -36,8 +36,13 @@
 #include "vecmath.h"  // Vector math support, C++ implementation n current version
 #include "tapCamera.h"        // Tap/Pinch camera control
 #include "JNIHelper.h"        // JNI support
+#include "assetCache.h"       // Memory mapped asset cache
 #include "gestureDetector.h"  // Tap/Doubletap/Pinch detector
 #include "perfMonitor.h"      // FPS counter
+#include "frameStats.h"       // Frame time histograms
+#include "framePacer.h"       // Vsync prediction and swap interval policy
 #include "sensorManager.h"    // SensorManager
 #include "interpolator.h"     // Interpolator
+#include "animationBatch.h"   // Batched interpolator tracks
+#include "jobSystem.h"        // Work stealing job system
 #endif
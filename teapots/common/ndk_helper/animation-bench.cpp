@@ -0,0 +1,200 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of AnimationBatch:
+ *
+ *   animation-bench [-n tracks] [-f frames]
+ *
+ * The batch must give the values Interpolator gives, follow queued segments
+ * without drifting and survive rebasing its clock, also after a long idle. Then the same tracks are
+ * updated as one Interpolator each and as one batch, and the time per track
+ * compared. Exits non zero when a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include "animationBatch.h"
+#include "frameStats.h"
+
+using ndk_helper::AnimationBatch;
+using ndk_helper::GetMonotonicTimeNs;
+using ndk_helper::Interpolator;
+using ndk_helper::INTERPOLATOR_TYPE;
+
+static int32_t errors = 0;
+
+static void Check(bool ok, const char* what, double time, float value,
+                  float expected) {
+  if (!ok && errors++ < 10) {
+    fprintf(stderr, "%s at %.3f s: %f, expected %f\n", what, time, value,
+            expected);
+  }
+}
+
+static double Now() { return GetMonotonicTimeNs() * 1e-9; }
+
+// Interpolator's in/out curves compute t/d/2 where Penner's use t/(d/2), so
+// they only ever run the first half; the batch runs the whole curve
+static bool IsInOut(int32_t type) {
+  return type == ndk_helper::INTERPOLATOR_TYPE_EASEINOUTQUAD ||
+         type == ndk_helper::INTERPOLATOR_TYPE_EASEINOUTCUBIC;
+}
+
+static void CheckEasing() {
+  for (int32_t type = 0; type < ndk_helper::kNumInterpolatorTypes; ++type) {
+    INTERPOLATOR_TYPE easing = (INTERPOLATOR_TYPE)type;
+    AnimationBatch batch;
+    Interpolator interpolator;
+    float value = 0.f, expected = 0.f;
+
+    // Interpolator starts on the clock, the batch at the time it is given
+    double start = Now();
+    interpolator.Set(0.f, 10.f, easing, 1.0);
+    batch.AddTrack(&value, 0.f, 10.f, easing, 1.0, start);
+    for (int32_t step = 0; step < 20; ++step) {
+      double time = start + step * 0.05;
+      batch.Update(time);
+      if (IsInOut(type)) {
+        if (step == 10) {
+          Check(fabsf(value - 5.f) < 1e-3f, "in/out half way", time, value,
+                5.f);
+        }
+        continue;
+      }
+      interpolator.Update(time, expected);
+      Check(fabsf(value - expected) < 2e-2f, "easing", time, value, expected);
+    }
+    batch.Update(start + 1.0);
+    Check(value == 10.f && !batch.GetActiveTrackCount(), "end", start + 1.0,
+          value, 10.f);
+  }
+}
+
+static void CheckSegments() {
+  AnimationBatch batch;
+  float value = 0.f;
+  AnimationBatch::TrackId id = batch.AddTrack(
+      &value, 0.f, 10.f, ndk_helper::INTERPOLATOR_TYPE_LINEAR, 1.0, 100.0);
+  batch.Queue(id, 4.f, ndk_helper::INTERPOLATOR_TYPE_LINEAR, 0.5);
+  batch.Queue(id, 8.f, ndk_helper::INTERPOLATOR_TYPE_LINEAR, 2.0);
+
+  // Frames late on a segment end don't shift the ones after it
+  // (the update that ends a segment writes its end value)
+  const double times[] = {100.5, 101.3, 101.4, 102.5, 103.0, 103.5};
+  const float values[] = {5.f, 10.f, 5.2f, 4.f, 7.f, 8.f};
+  for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); ++i) {
+    batch.Update(times[i]);
+    Check(fabsf(value - values[i]) < 1e-3f, "segments", times[i], value,
+          values[i]);
+  }
+  Check(!batch.IsActive(id), "segments done", 103.5, (float)batch.IsActive(id),
+        0.f);
+
+  // A removed track keeps its value, and its id is reused
+  id = batch.AddTrack(&value, 0.f, 1.f, ndk_helper::INTERPOLATOR_TYPE_LINEAR,
+                      1.0, 200.0);
+  batch.Update(200.25);
+  batch.RemoveTrack(id);
+  batch.Update(200.75);
+  Check(value == 0.25f && !batch.IsActive(id), "removed", 200.75, value,
+        0.25f);
+
+  // Long animations outlive the batch's float clock being rebased
+  id = batch.AddTrack(&value, 0.f, 3000.f,
+                      ndk_helper::INTERPOLATOR_TYPE_LINEAR, 3000.0, 300.0);
+  for (double time = 300.0; time < 2300.0; time += 100.0) batch.Update(time);
+  batch.Update(2300.0);
+  Check(fabsf(value - 2000.f) < 0.1f, "rebased", 2300.0, value, 2000.f);
+
+  // Nothing rebases an idle batch, a track added long after must start the
+  // clock over
+  batch.Update(3300.0);
+  id = batch.AddTrack(&value, 0.f, 1.f, ndk_helper::INTERPOLATOR_TYPE_LINEAR,
+                      0.01, 1000000.0);
+  batch.Update(1000000.005);
+  Check(fabsf(value - 0.5f) < 1e-3f, "after idle", 1000000.005, value, 0.5f);
+}
+
+static void Bench(int32_t count, int32_t frames) {
+  std::vector<Interpolator> interpolators(count);
+  std::vector<float> values(count), batch_values(count);
+  AnimationBatch batch;
+  srand48(1);
+  double start = Now();
+  for (int32_t i = 0; i < count; ++i) {
+    INTERPOLATOR_TYPE type =
+        (INTERPOLATOR_TYPE)(i % ndk_helper::kNumInterpolatorTypes);
+    // Long enough that every track is active throughout
+    double duration = 60.0 + drand48() * 60.0;
+    float dest = (float)drand48() * 100.f;
+    interpolators[i].Set(0.f, dest, type, duration);
+    batch.AddTrack(&batch_values[i], 0.f, dest, type, duration, start);
+  }
+
+  int64_t begin = GetMonotonicTimeNs();
+  for (int32_t frame = 0; frame < frames; ++frame) {
+    double time = start + frame / 60.0;
+    for (int32_t i = 0; i < count; ++i) {
+      interpolators[i].Update(time, values[i]);
+    }
+  }
+  int64_t interpolator_ns = GetMonotonicTimeNs() - begin;
+
+  begin = GetMonotonicTimeNs();
+  for (int32_t frame = 0; frame < frames; ++frame) {
+    batch.Update(start + frame / 60.0);
+  }
+  int64_t batch_ns = GetMonotonicTimeNs() - begin;
+
+  double updates = (double)count * frames;
+  printf("%d tracks, %d frames: Interpolator %.2f ns/track, "
+         "AnimationBatch %.2f ns/track (%.1fx)\n",
+         count, frames, interpolator_ns / updates, batch_ns / updates,
+         batch_ns ? (double)interpolator_ns / batch_ns : 0.0);
+}
+
+int main(int argc, char** argv) {
+  int32_t count = 10000;
+  int32_t frames = 600;
+  int c;
+  while ((c = getopt(argc, argv, "n:f:")) != -1) {
+    switch (c) {
+      case 'n':
+        count = atoi(optarg);
+        break;
+      case 'f':
+        frames = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n tracks] [-f frames]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  CheckEasing();
+  CheckSegments();
+  Bench(count, frames);
+  if (errors) {
+    fprintf(stderr, "%d checks failed\n", errors);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "animationBatch.h"
+#include <string.h>
+
+namespace ndk_helper {
+
+// Tracks are evaluated in blocks so the temporaries stay in L1
+const int32_t kBlockSize = 64;
+
+// Start times are floats relative to time_base_, rebased before they lose
+// sub-millisecond precision
+const float kRebaseInterval = 1024.f;
+
+//-------------------------------------------------
+// Easing functions on normalized time t = [0, 1]
+// Written without branches so each loop below vectorizes.
+//-------------------------------------------------
+static inline float Exp2(const float x) {
+  // 2^x = 2^i * 2^f, polynomial approximation of 2^f on [0, 1)
+  float y = x + 127.f;
+  int32_t i = (int32_t)y;
+  float f = y - (float)i;
+  float p =
+      1.f +
+      f * (0.6931472f +
+           f * (0.2402265f + f * (0.0555041f + f * (0.0096181f +
+                                                    f * 0.0013333f))));
+  int32_t bits = i << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return scale * p;
+}
+
+static void Ease(const int32_t type, const float* __restrict__ t,
+                 float* __restrict__ out, const int32_t count) {
+  switch (type) {
+    case INTERPOLATOR_TYPE_LINEAR:
+      for (int32_t i = 0; i < count; ++i) out[i] = t[i];
+      break;
+    case INTERPOLATOR_TYPE_EASEINQUAD:
+      for (int32_t i = 0; i < count; ++i) out[i] = t[i] * t[i];
+      break;
+    case INTERPOLATOR_TYPE_EASEOUTQUAD:
+      for (int32_t i = 0; i < count; ++i) out[i] = t[i] * (2.f - t[i]);
+      break;
+    case INTERPOLATOR_TYPE_EASEINOUTQUAD:
+      for (int32_t i = 0; i < count; ++i) {
+        float u = 1.f - t[i];
+        float in = 2.f * t[i] * t[i];
+        float out_half = 1.f - 2.f * u * u;
+        out[i] = t[i] < 0.5f ? in : out_half;
+      }
+      break;
+    case INTERPOLATOR_TYPE_EASEINCUBIC:
+      for (int32_t i = 0; i < count; ++i) out[i] = t[i] * t[i] * t[i];
+      break;
+    case INTERPOLATOR_TYPE_EASEOUTCUBIC:
+      for (int32_t i = 0; i < count; ++i) {
+        float u = t[i] - 1.f;
+        out[i] = u * u * u + 1.f;
+      }
+      break;
+    case INTERPOLATOR_TYPE_EASEINOUTCUBIC:
+      for (int32_t i = 0; i < count; ++i) {
+        float u = t[i] - 1.f;
+        float in = 4.f * t[i] * t[i] * t[i];
+        float out_half = 4.f * u * u * u + 1.f;
+        out[i] = t[i] < 0.5f ? in : out_half;
+      }
+      break;
+    case INTERPOLATOR_TYPE_EASEINQUART:
+      for (int32_t i = 0; i < count; ++i) {
+        float t2 = t[i] * t[i];
+        out[i] = t2 * t2;
+      }
+      break;
+    case INTERPOLATOR_TYPE_EASEINEXPO:
+      for (int32_t i = 0; i < count; ++i) {
+        float v = Exp2(10.f * (t[i] - 1.f));
+        out[i] = t[i] == 0.f ? 0.f : v;
+      }
+      break;
+    case INTERPOLATOR_TYPE_EASEOUTEXPO:
+      for (int32_t i = 0; i < count; ++i) {
+        float v = 1.f - Exp2(-10.f * t[i]);
+        out[i] = t[i] == 1.f ? 1.f : v;
+      }
+      break;
+    default:
+      for (int32_t i = 0; i < count; ++i) out[i] = 0.f;
+      break;
+  }
+}
+
+//-------------------------------------------------
+// Ctor
+//-------------------------------------------------
+AnimationBatch::AnimationBatch()
+    : free_segment_(-1), active_tracks_(0), time_base_(-1.0) {}
+
+//-------------------------------------------------
+// Dtor
+//-------------------------------------------------
+AnimationBatch::~AnimationBatch() {}
+
+void AnimationBatch::Clear() {
+  for (int32_t i = 0; i < kNumInterpolatorTypes; ++i) {
+    Group& group = groups_[i];
+    group.start_time.clear();
+    group.inv_duration.clear();
+    group.start_value.clear();
+    group.delta.clear();
+    group.output.clear();
+    group.track.clear();
+  }
+  tracks_.clear();
+  free_tracks_.clear();
+  segments_.clear();
+  free_segment_ = -1;
+  active_tracks_ = 0;
+  time_base_ = -1.0;
+}
+
+AnimationBatch::TrackId AnimationBatch::AddTrack(
+    float* output, const float start, const float dest,
+    const INTERPOLATOR_TYPE type, const double duration,
+    const double current_time) {
+  // Update() doesn't rebase while nothing runs, start over from here
+  if (time_base_ < 0.0 || active_tracks_ == 0) time_base_ = current_time;
+
+  TrackId id;
+  if (free_tracks_.size()) {
+    id = free_tracks_.back();
+    free_tracks_.pop_back();
+  } else {
+    id = (TrackId)tracks_.size();
+    tracks_.push_back(Track());
+  }
+  Track& track = tracks_[id];
+  track.group = -1;
+  track.first_segment = -1;
+  track.last_segment = -1;
+
+  Insert(id, output, (float)(current_time - time_base_), start, dest, type,
+         (float)duration);
+  return id;
+}
+
+void AnimationBatch::Queue(const TrackId id, const float dest,
+                           const INTERPOLATOR_TYPE type,
+                           const double duration) {
+  if (!IsActive(id)) return;
+
+  int32_t index;
+  if (free_segment_ >= 0) {
+    index = free_segment_;
+    free_segment_ = segments_[index].next;
+  } else {
+    index = (int32_t)segments_.size();
+    segments_.push_back(Segment());
+  }
+  Segment& segment = segments_[index];
+  segment.dest_value = dest;
+  segment.duration = (float)duration;
+  segment.type = type;
+  segment.next = -1;
+
+  Track& track = tracks_[id];
+  if (track.last_segment >= 0)
+    segments_[track.last_segment].next = index;
+  else
+    track.first_segment = index;
+  track.last_segment = index;
+}
+
+void AnimationBatch::RemoveTrack(const TrackId id) {
+  if (!IsActive(id)) return;
+  FreeSegments(tracks_[id]);
+  Erase(id);
+  free_tracks_.push_back(id);
+}
+
+bool AnimationBatch::IsActive(const TrackId id) const {
+  return id >= 0 && id < (TrackId)tracks_.size() && tracks_[id].group >= 0;
+}
+
+void AnimationBatch::FreeSegments(Track& track) {
+  if (track.first_segment < 0) return;
+  segments_[track.last_segment].next = free_segment_;
+  free_segment_ = track.first_segment;
+  track.first_segment = -1;
+  track.last_segment = -1;
+}
+
+void AnimationBatch::Insert(const TrackId id, float* output,
+                            const float start_time, const float start,
+                            const float dest, const INTERPOLATOR_TYPE type,
+                            const float duration) {
+  Group& group = groups_[type];
+  Track& track = tracks_[id];
+  track.group = type;
+  track.slot = (int32_t)group.track.size();
+  track.dest_value = dest;
+
+  group.start_time.push_back(start_time);
+  group.inv_duration.push_back(duration > 0.f ? 1.f / duration : 1e30f);
+  group.start_value.push_back(start);
+  group.delta.push_back(dest - start);
+  group.output.push_back(output);
+  group.track.push_back(id);
+  active_tracks_++;
+}
+
+void AnimationBatch::Erase(const TrackId id) {
+  Track& track = tracks_[id];
+  Group& group = groups_[track.group];
+  int32_t slot = track.slot;
+  int32_t last = (int32_t)group.track.size() - 1;
+
+  // Swap with the last element to keep the arrays dense
+  if (slot != last) {
+    group.start_time[slot] = group.start_time[last];
+    group.inv_duration[slot] = group.inv_duration[last];
+    group.start_value[slot] = group.start_value[last];
+    group.delta[slot] = group.delta[last];
+    group.output[slot] = group.output[last];
+    group.track[slot] = group.track[last];
+    tracks_[group.track[slot]].slot = slot;
+  }
+  group.start_time.pop_back();
+  group.inv_duration.pop_back();
+  group.start_value.pop_back();
+  group.delta.pop_back();
+  group.output.pop_back();
+  group.track.pop_back();
+
+  track.group = -1;
+  active_tracks_--;
+}
+
+void AnimationBatch::Rebase(const float offset) {
+  for (int32_t i = 0; i < kNumInterpolatorTypes; ++i) {
+    std::vector<float>& start_time = groups_[i].start_time;
+    for (size_t j = 0; j < start_time.size(); ++j) start_time[j] -= offset;
+  }
+  time_base_ += offset;
+}
+
+void AnimationBatch::EvaluateGroup(const int32_t type, const float time) {
+  Group& group = groups_[type];
+  const int32_t size = (int32_t)group.track.size();
+  const float* __restrict__ start_time = group.start_time.data();
+  const float* __restrict__ inv_duration = group.inv_duration.data();
+  const float* __restrict__ start_value = group.start_value.data();
+  const float* __restrict__ delta = group.delta.data();
+
+  float t[kBlockSize];
+  float eased[kBlockSize];
+  for (int32_t base = 0; base < size; base += kBlockSize) {
+    int32_t count = size - base < kBlockSize ? size - base : kBlockSize;
+
+    for (int32_t i = 0; i < count; ++i) {
+      float v = (time - start_time[base + i]) * inv_duration[base + i];
+      v = v < 0.f ? 0.f : v;
+      t[i] = v > 1.f ? 1.f : v;
+    }
+
+    Ease(type, t, eased, count);
+
+    for (int32_t i = 0; i < count; ++i) {
+      *group.output[base + i] =
+          start_value[base + i] + delta[base + i] * eased[i];
+      if (t[i] >= 1.f) finished_.push_back(group.track[base + i]);
+    }
+  }
+}
+
+int32_t AnimationBatch::Update(const double current_time) {
+  if (active_tracks_ == 0) return 0;
+
+  float time = (float)(current_time - time_base_);
+  if (time > kRebaseInterval) {
+    Rebase(time);
+    time = 0.f;
+  }
+
+  finished_.clear();
+  for (int32_t i = 0; i < kNumInterpolatorTypes; ++i) EvaluateGroup(i, time);
+
+  // Advance finished tracks to their next segment, or retire them
+  for (size_t i = 0; i < finished_.size(); ++i) {
+    TrackId id = finished_[i];
+    Track& track = tracks_[id];
+    Group& group = groups_[track.group];
+    float* output = group.output[track.slot];
+    float end_time = group.start_time[track.slot] +
+                     1.f / group.inv_duration[track.slot];
+    float value = track.dest_value;
+    Erase(id);
+
+    if (track.first_segment < 0) {
+      free_tracks_.push_back(id);
+      continue;
+    }
+
+    int32_t index = track.first_segment;
+    Segment segment = segments_[index];
+    track.first_segment = segment.next;
+    if (track.first_segment < 0) track.last_segment = -1;
+    segments_[index].next = free_segment_;
+    free_segment_ = index;
+
+    Insert(id, output, end_time, value, segment.dest_value, segment.type,
+           segment.duration);
+  }
+  return active_tracks_;
+}
+
+}  // namespace ndk_helper
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONBATCH_H_
+#define ANIMATIONBATCH_H_
+
+#include <stdint.h>
+#include <vector>
+#include "interpolator.h"
+
+namespace ndk_helper {
+
+const int32_t kNumInterpolatorTypes = INTERPOLATOR_TYPE_EASEOUTEXPO + 1;
+
+/******************************************************************
+ * Evaluates many float animation tracks at once.
+ * Tracks are stored as structure of arrays, grouped by easing type, so every
+ * group is evaluated with one branch free loop the compiler can vectorize.
+ * Each track writes its value straight into a caller owned float (e.g. an
+ * element of a transform array), so no per track object is touched per frame.
+ *
+ * Follow-up segments are kept in a shared pool instead of per track lists.
+ * A track moves to the group of its next segment when the current one ends.
+ *
+ * The batch isn't thread safe; Update() is expected to run on one thread.
+ */
+class AnimationBatch {
+ public:
+  typedef int32_t TrackId;
+  static const TrackId kInvalidTrack = -1;
+
+  AnimationBatch();
+  ~AnimationBatch();
+
+  /*
+   * Start animating *output from start to dest.
+   * output must stay valid until the track finishes or is removed.
+   */
+  TrackId AddTrack(float* output, const float start, const float dest,
+                   const INTERPOLATOR_TYPE type, const double duration,
+                   const double current_time);
+
+  /*
+   * Queue a segment that starts when the last one of the track ends.
+   * Equivalent to Interpolator::Add().
+   */
+  void Queue(const TrackId id, const float dest, const INTERPOLATOR_TYPE type,
+             const double duration);
+
+  /*
+   * Stop a track, leaving its output at the current value.
+   */
+  void RemoveTrack(const TrackId id);
+  bool IsActive(const TrackId id) const;
+
+  /*
+   * Evaluate every active track at current_time and write the outputs.
+   * return: number of tracks still active
+   */
+  int32_t Update(const double current_time);
+
+  int32_t GetActiveTrackCount() const { return active_tracks_; }
+  void Clear();
+
+ private:
+  AnimationBatch(const AnimationBatch& rhs);
+  AnimationBatch& operator=(const AnimationBatch& rhs);
+
+  // One easing group, all arrays share the same index
+  struct Group {
+    std::vector<float> start_time;
+    std::vector<float> inv_duration;
+    std::vector<float> start_value;
+    std::vector<float> delta;
+    std::vector<float*> output;
+    std::vector<TrackId> track;
+  };
+
+  struct Segment {
+    float dest_value;
+    float duration;
+    INTERPOLATOR_TYPE type;
+    int32_t next;
+  };
+
+  struct Track {
+    int32_t group;  // -1 when inactive
+    int32_t slot;
+    int32_t first_segment;
+    int32_t last_segment;
+    float dest_value;
+  };
+
+  void Insert(const TrackId id, float* output, const float start_time,
+              const float start, const float dest,
+              const INTERPOLATOR_TYPE type, const float duration);
+  void Erase(const TrackId id);
+  void Rebase(const float offset);
+  void FreeSegments(Track& track);
+  void EvaluateGroup(const int32_t type, const float time);
+
+  Group groups_[kNumInterpolatorTypes];
+  std::vector<Track> tracks_;
+  std::vector<TrackId> free_tracks_;
+  std::vector<Segment> segments_;
+  int32_t free_segment_;
+  int32_t active_tracks_;
+
+  double time_base_;
+  std::vector<TrackId> finished_;
+};
+
+}  // namespace ndk_helper
+#endif /* ANIMATIONBATCH_H_ */
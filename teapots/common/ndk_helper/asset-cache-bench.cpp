@@ -0,0 +1,196 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of AssetCache:
+ *
+ *   asset-cache-bench [-n files] [-s bytes] [-r rounds]
+ *
+ * Writes files into a temporary directory used as the search path. Opening
+ * a name twice must share one mapping, Prefetch() must leave files mapped
+ * for Open(), and Purge() must drop only what no span still holds. Then
+ * reading every file into a buffer, as ReadFile used to, is timed against
+ * opening it from the cache. Exits non zero when a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "assetCache.h"
+#include "frameStats.h"
+
+using ndk_helper::AssetCache;
+using ndk_helper::AssetSpan;
+using ndk_helper::GetMonotonicTimeNs;
+
+static int32_t errors = 0;
+
+static void Check(bool ok, const char* what) {
+  if (!ok && errors++ < 10) fprintf(stderr, "%s failed\n", what);
+}
+
+static std::string FileName(int32_t i) {
+  char name[32];
+  snprintf(name, sizeof(name), "asset%d.bin", i);
+  return name;
+}
+
+static bool WriteFiles(const std::string& dir, int32_t count, int32_t size) {
+  std::vector<uint8_t> bits(size);
+  for (int32_t i = 0; i < count; ++i) {
+    for (int32_t j = 0; j < size; ++j) bits[j] = (uint8_t)(i + j);
+    FILE* fp = fopen((dir + "/" + FileName(i)).c_str(), "wb");
+    if (fp == NULL) return false;
+    bool ok = fwrite(bits.data(), 1, bits.size(), fp) == bits.size();
+    if (fclose(fp) != 0 || !ok) return false;
+  }
+  return true;
+}
+
+static bool SameBits(const AssetSpan& span, int32_t i, int32_t size) {
+  if (!span.IsValid() || span.size() != (size_t)size) return false;
+  for (int32_t j = 0; j < size; ++j) {
+    if (span.data()[j] != (uint8_t)(i + j)) return false;
+  }
+  return true;
+}
+
+static void CheckCache(AssetCache* cache, int32_t count, int32_t size) {
+  AssetCache::Stats before = cache->GetStats();
+  AssetSpan first = cache->Open(FileName(0).c_str());
+  AssetSpan second = cache->Open(FileName(0).c_str());
+  Check(SameBits(first, 0, size), "open");
+  Check(first.data() == second.data(), "shared mapping");
+  Check(!cache->Open("missing.bin").IsValid(), "missing file");
+
+  std::vector<std::string> names;
+  for (int32_t i = 1; i < count; ++i) names.push_back(FileName(i));
+  cache->Prefetch(names);
+  // Wait for the prefetch thread to map the rest
+  int64_t deadline = GetMonotonicTimeNs() + 5000000000LL;
+  while (cache->GetStats().misses - before.misses < (uint64_t)count &&
+         GetMonotonicTimeNs() < deadline) {
+    usleep(1000);
+  }
+  AssetCache::Stats prefetched = cache->GetStats();
+  Check(prefetched.misses - before.misses == (uint64_t)count, "prefetch");
+  Check(prefetched.mapped_bytes - before.mapped_bytes ==
+            (uint64_t)count * size,
+        "mapped bytes");
+  for (int32_t i = 1; i < count; ++i) {
+    Check(SameBits(cache->Open(FileName(i).c_str()), i, size),
+          "open prefetched");
+  }
+  Check(cache->GetStats().misses == prefetched.misses, "prefetched hits");
+
+  // Only the span still held keeps its mapping, and stays readable
+  cache->Purge();
+  Check(cache->GetStats().mapped_bytes - before.mapped_bytes == (uint64_t)size,
+        "purge");
+  Check(SameBits(second, 0, size), "span after purge");
+  first = second = AssetSpan();
+  cache->Purge();
+  Check(cache->GetStats().mapped_bytes == before.mapped_bytes, "purge all");
+}
+
+static void Bench(AssetCache* cache, const std::string& dir, int32_t count,
+                  int32_t size, int32_t rounds) {
+  std::vector<uint8_t> buffer;
+  uint32_t sum = 0;
+  int64_t begin = GetMonotonicTimeNs();
+  for (int32_t round = 0; round < rounds; ++round) {
+    for (int32_t i = 0; i < count; ++i) {
+      FILE* fp = fopen((dir + "/" + FileName(i)).c_str(), "rb");
+      if (fp == NULL) continue;
+      fseek(fp, 0, SEEK_END);
+      buffer.resize(ftell(fp));
+      fseek(fp, 0, SEEK_SET);
+      if (fread(buffer.data(), 1, buffer.size(), fp) == buffer.size()) {
+        sum += buffer[0];
+      }
+      fclose(fp);
+    }
+  }
+  int64_t read_ns = GetMonotonicTimeNs() - begin;
+
+  begin = GetMonotonicTimeNs();
+  for (int32_t round = 0; round < rounds; ++round) {
+    for (int32_t i = 0; i < count; ++i) {
+      AssetSpan span = cache->Open(FileName(i).c_str());
+      if (!span.empty()) sum += span.data()[0];
+    }
+  }
+  int64_t cache_ns = GetMonotonicTimeNs() - begin;
+
+  double loads = (double)count * rounds;
+  printf("%d files of %d bytes, %d rounds: read %.2f us/file, "
+         "AssetCache %.2f us/file (%.1fx) [%u]\n",
+         count, size, rounds, read_ns / loads / 1000.0,
+         cache_ns / loads / 1000.0,
+         cache_ns ? (double)read_ns / cache_ns : 0.0, sum & 1);
+}
+
+int main(int argc, char** argv) {
+  int32_t count = 16;
+  int32_t size = 64 * 1024;
+  int32_t rounds = 100;
+  int c;
+  while ((c = getopt(argc, argv, "n:s:r:")) != -1) {
+    switch (c) {
+      case 'n':
+        count = atoi(optarg);
+        break;
+      case 's':
+        size = atoi(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n files] [-s bytes] [-r rounds]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (count < 1 || size < 1) {
+    fprintf(stderr, "need at least one file of one byte\n");
+    return 1;
+  }
+
+  char dir[] = "/tmp/asset-cache-XXXXXX";
+  if (mkdtemp(dir) == NULL || !WriteFiles(dir, count, size)) {
+    fprintf(stderr, "unable to write the files in %s\n", dir);
+    return 1;
+  }
+  AssetCache* cache = AssetCache::GetInstance();
+  cache->SetSearchPath(dir);
+  CheckCache(cache, count, size);
+  Bench(cache, dir, count, size, rounds);
+
+  for (int32_t i = 0; i < count; ++i) {
+    unlink((std::string(dir) + "/" + FileName(i)).c_str());
+  }
+  rmdir(dir);
+  if (errors) {
+    fprintf(stderr, "%d checks failed\n", errors);
+    return 1;
+  }
+  return 0;
+}
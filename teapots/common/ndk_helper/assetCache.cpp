@@ -0,0 +1,310 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "assetCache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ndk_helper {
+
+//---------------------------------------------------------------------------
+// AssetMapping: owns the memory behind a span
+//---------------------------------------------------------------------------
+class AssetMapping {
+ public:
+  AssetMapping()
+      : data_(NULL),
+        size_(0),
+        map_base_(MAP_FAILED),
+        map_length_(0)
+#ifdef __ANDROID__
+        ,
+        asset_(NULL)
+#endif
+  {
+  }
+
+  ~AssetMapping() {
+    if (map_base_ != MAP_FAILED) munmap(map_base_, map_length_);
+#ifdef __ANDROID__
+    if (asset_ != NULL) AAsset_close(asset_);
+#endif
+  }
+
+  /*
+   * Map [offset, offset + size) of fd. offset doesn't need to be page aligned.
+   */
+  bool Map(int fd, off_t offset, size_t size) {
+    static const off_t page_mask = (off_t)sysconf(_SC_PAGESIZE) - 1;
+    off_t aligned = offset & ~page_mask;
+    size_t delta = (size_t)(offset - aligned);
+
+    if (size == 0) {
+      // mmap rejects empty ranges, an empty span is still a valid asset
+      data_ = (const uint8_t*)"";
+      return true;
+    }
+    map_length_ = size + delta;
+    map_base_ = mmap(NULL, map_length_, PROT_READ, MAP_PRIVATE, fd, aligned);
+    if (map_base_ == MAP_FAILED) return false;
+    data_ = (const uint8_t*)map_base_ + delta;
+    size_ = size;
+    return true;
+  }
+
+  void WillNeed() const {
+    if (map_base_ != MAP_FAILED) madvise(map_base_, map_length_, MADV_WILLNEED);
+  }
+
+#ifdef __ANDROID__
+  /*
+   * Compressed APK entries can't be mapped, keep the AAsset (and the buffer
+   * it inflated) alive instead.
+   */
+  bool Adopt(AAsset* asset) {
+    const void* buffer = AAsset_getBuffer(asset);
+    if (buffer == NULL) {
+      AAsset_close(asset);
+      return false;
+    }
+    asset_ = asset;
+    data_ = (const uint8_t*)buffer;
+    size_ = (size_t)AAsset_getLength(asset);
+    return true;
+  }
+#endif
+
+  const uint8_t* data_;
+  size_t size_;
+
+ private:
+  void* map_base_;
+  size_t map_length_;
+#ifdef __ANDROID__
+  AAsset* asset_;
+#endif
+};
+
+static std::shared_ptr<AssetMapping> MapFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+
+  std::shared_ptr<AssetMapping> mapping;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    mapping.reset(new AssetMapping());
+    if (!mapping->Map(fd, 0, (size_t)st.st_size)) mapping.reset();
+  }
+  // The mapping keeps its own reference to the file
+  close(fd);
+  return mapping;
+}
+
+#ifdef __ANDROID__
+static std::shared_ptr<AssetMapping> MapAsset(AAssetManager* asset_manager,
+                                              const std::string& file_name) {
+  AAsset* asset = AAssetManager_open(asset_manager, file_name.c_str(),
+                                     AASSET_MODE_STREAMING);
+  if (asset == NULL) return nullptr;
+
+  std::shared_ptr<AssetMapping> mapping(new AssetMapping());
+  off_t start, length;
+  int fd = AAsset_openFileDescriptor(asset, &start, &length);
+  if (fd >= 0) {
+    // Stored uncompressed: map the range of the APK directly
+    AAsset_close(asset);
+    bool mapped = mapping->Map(fd, start, (size_t)length);
+    close(fd);
+    if (mapped) return mapping;
+    asset = AAssetManager_open(asset_manager, file_name.c_str(),
+                               AASSET_MODE_BUFFER);
+    if (asset == NULL) return nullptr;
+    mapping.reset(new AssetMapping());
+  }
+  if (!mapping->Adopt(asset)) return nullptr;
+  return mapping;
+}
+#endif
+
+//---------------------------------------------------------------------------
+// Singleton
+//---------------------------------------------------------------------------
+AssetCache* AssetCache::GetInstance() {
+  static AssetCache cache;
+  return &cache;
+}
+
+//---------------------------------------------------------------------------
+// Ctor
+//---------------------------------------------------------------------------
+AssetCache::AssetCache()
+    :
+#ifdef __ANDROID__
+      asset_manager_(NULL),
+#endif
+      quit_(false) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+//---------------------------------------------------------------------------
+// Dtor
+//---------------------------------------------------------------------------
+AssetCache::~AssetCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  prefetch_cond_.notify_all();
+  if (prefetch_thread_.joinable()) prefetch_thread_.join();
+}
+
+void AssetCache::SetSearchPath(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  search_path_ = path;
+}
+
+#ifdef __ANDROID__
+void AssetCache::SetAssetManager(AAssetManager* asset_manager) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  asset_manager_ = asset_manager;
+}
+#endif
+
+std::shared_ptr<const AssetMapping> AssetCache::Load(
+    const std::string& file_name) {
+  std::string search_path;
+#ifdef __ANDROID__
+  AAssetManager* asset_manager;
+#endif
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    search_path = search_path_;
+#ifdef __ANDROID__
+    asset_manager = asset_manager_;
+#endif
+  }
+
+  std::shared_ptr<AssetMapping> mapping;
+  if (file_name[0] == '/') {
+    mapping = MapFile(file_name);
+  } else if (!search_path.empty()) {
+    mapping = MapFile(search_path + "/" + file_name);
+  }
+#ifdef __ANDROID__
+  if (mapping == nullptr && file_name[0] != '/' && asset_manager != NULL) {
+    mapping = MapAsset(asset_manager, file_name);
+  }
+#endif
+  return mapping;
+}
+
+AssetSpan AssetCache::Open(const char* file_name) {
+  AssetSpan span;
+  if (file_name == NULL || file_name[0] == '\0') return span;
+  std::string name(file_name);
+
+  std::shared_ptr<const AssetMapping> mapping;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, std::shared_ptr<const AssetMapping> >::iterator it =
+        entries_.find(name);
+    if (it != entries_.end()) {
+      stats_.hits++;
+      mapping = it->second;
+    }
+  }
+
+  if (mapping == nullptr) {
+    // Map outside of the lock; inflating a compressed asset can take a while
+    mapping = Load(name);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mapping == nullptr) {
+      stats_.failures++;
+      return span;
+    }
+    std::pair<std::map<std::string,
+                       std::shared_ptr<const AssetMapping> >::iterator,
+              bool>
+        result = entries_.insert(std::make_pair(name, mapping));
+    if (result.second) {
+      stats_.misses++;
+      stats_.mapped_bytes += mapping->size_;
+    } else {
+      // Another thread mapped it first
+      stats_.hits++;
+      mapping = result.first->second;
+    }
+  }
+
+  span.mapping_ = mapping;
+  span.data_ = mapping->data_;
+  span.size_ = mapping->size_;
+  return span;
+}
+
+void AssetCache::Prefetch(const std::vector<std::string>& file_names) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    prefetch_queue_.insert(prefetch_queue_.end(), file_names.begin(),
+                           file_names.end());
+    if (!prefetch_thread_.joinable()) {
+      prefetch_thread_ = std::thread(&AssetCache::PrefetchLoop, this);
+    }
+  }
+  prefetch_cond_.notify_one();
+}
+
+void AssetCache::PrefetchLoop() {
+  while (true) {
+    std::string name;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      prefetch_cond_.wait(
+          lock, [this] { return quit_ || !prefetch_queue_.empty(); });
+      if (quit_) return;
+      name = prefetch_queue_.front();
+      prefetch_queue_.pop_front();
+    }
+    AssetSpan span = Open(name.c_str());
+    if (span.IsValid()) span.mapping_->WillNeed();
+  }
+}
+
+void AssetCache::Purge() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, std::shared_ptr<const AssetMapping> >::iterator it =
+      entries_.begin();
+  while (it != entries_.end()) {
+    if (it->second.use_count() == 1) {
+      stats_.mapped_bytes -= it->second->size_;
+      entries_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+AssetCache::Stats AssetCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace ndk_helper
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ASSETCACHE_H_
+#define ASSETCACHE_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#endif
+
+namespace ndk_helper {
+
+class AssetMapping;
+
+/******************************************************************
+ * Read-only view of a cached asset.
+ * Copies share the underlying mapping, which stays valid as long as any span
+ * or the cache still references it.
+ */
+class AssetSpan {
+ public:
+  AssetSpan() : data_(NULL), size_(0) {}
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool IsValid() const { return mapping_ != nullptr; }
+
+ private:
+  friend class AssetCache;
+  std::shared_ptr<const AssetMapping> mapping_;
+  const uint8_t* data_;
+  size_t size_;
+};
+
+/******************************************************************
+ * Memory mapped asset cache
+ * Files are mapped read-only instead of being copied into a buffer, and
+ * repeated loads of the same name (e.g. shaders on every context
+ * re-creation) return the existing mapping.
+ *
+ * Lookup order:
+ * - file_name itself when it's an absolute path
+ * - search path set with SetSearchPath() (external files dir on device, an
+ *   extracted asset directory on host)
+ * - APK assets, mapped straight from the APK when they're stored
+ *   uncompressed (Android only)
+ *
+ * Methods are thread safe.
+ */
+class AssetCache {
+ public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t failures;
+    uint64_t mapped_bytes;  // bytes currently held by the cache
+  };
+
+  static AssetCache* GetInstance();
+
+  void SetSearchPath(const std::string& path);
+#ifdef __ANDROID__
+  void SetAssetManager(AAssetManager* asset_manager);
+#endif
+
+  /*
+   * Returns a span of the asset, or an invalid span when it can't be found.
+   */
+  AssetSpan Open(const char* file_name);
+
+  /*
+   * Map given assets on a background thread and start paging them in, so a
+   * later Open() returns without touching the disk.
+   */
+  void Prefetch(const std::vector<std::string>& file_names);
+
+  /*
+   * Drop cached entries nobody else references, e.g. on low memory
+   */
+  void Purge();
+
+  Stats GetStats() const;
+
+ private:
+  AssetCache();
+  ~AssetCache();
+  AssetCache(const AssetCache& rhs);
+  AssetCache& operator=(const AssetCache& rhs);
+
+  std::shared_ptr<const AssetMapping> Load(const std::string& file_name);
+  void PrefetchLoop();
+
+  mutable std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<const AssetMapping> > entries_;
+  std::string search_path_;
+#ifdef __ANDROID__
+  AAssetManager* asset_manager_;
+#endif
+  Stats stats_;
+
+  std::thread prefetch_thread_;
+  std::deque<std::string> prefetch_queue_;
+  std::condition_variable prefetch_cond_;
+  bool quit_;
+};
+
+}  // namespace ndk_helper
+#endif /* ASSETCACHE_H_ */
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of FramePacer:
+ *
+ *   frame-pacer-bench [-f frames]
+ *
+ * A render loop is simulated against SyntheticVsyncSource the way the
+ * choreographer sample runs it: render, then wait for the vsync callback
+ * the pacer presents on. The pacer must find the display period through
+ * jitter and dropped callbacks, keep light frames at every vsync, back off
+ * to every other vsync as soon as frames don't fit, come back only once
+ * they have fit for a while, and hold a fixed 30 fps when asked to. Until a
+ * vsync was delivered no frame may count as late. Then the pacer's own cost
+ * per frame is measured. Exits non zero when a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "framePacer.h"
+#include "frameStats.h"
+
+using ndk_helper::FramePacer;
+using ndk_helper::FramePacerStats;
+using ndk_helper::GetMonotonicTimeNs;
+using ndk_helper::SyntheticVsyncSource;
+
+static const int64_t kPeriod60Hz = 16666667;
+static const int64_t kPeriod90Hz = 11111111;
+
+static int32_t errors = 0;
+
+static void Check(bool ok, const char* what, double value, double expected) {
+  if (!ok && errors++ < 10) {
+    fprintf(stderr, "%s: %f, expected %f\n", what, value, expected);
+  }
+}
+
+/*
+ * Vsyncs as the callback thread sees them, one ahead so the ones that
+ * arrive while a frame renders are delivered before it ends
+ */
+class Display {
+ public:
+  Display(FramePacer* pacer, SyntheticVsyncSource* source)
+      : pacer_(pacer), source_(source), next_(source->Next()), last_(0) {
+    now_ = Deliver();
+  }
+
+  /*
+   * Render one frame costing cost_ns and wait for its presentation.
+   * Returns the vsyncs since the previous presentation.
+   */
+  int64_t RunFrame(int64_t cost_ns) {
+    pacer_->BeginFrame(now_);
+    int64_t end = now_ + cost_ns;
+    while (next_ < end) Deliver();
+    pacer_->EndFrame(end);
+
+    int64_t vsync;
+    do {
+      vsync = Deliver();
+    } while (!pacer_->ShouldPresent(vsync));
+    int64_t period = source_->GetPeriod();
+    int64_t vsyncs = last_ ? (vsync - last_ + period / 2) / period : 0;
+    last_ = now_ = vsync;
+    return vsyncs;
+  }
+
+ private:
+  int64_t Deliver() {
+    int64_t vsync = next_;
+    pacer_->OnVsync(vsync);
+    next_ = source_->Next();
+    return vsync;
+  }
+
+  FramePacer* pacer_;
+  SyntheticVsyncSource* source_;
+  int64_t next_;
+  int64_t last_;
+  int64_t now_;
+};
+
+static void CheckPeriod() {
+  // The pacer assumes 60Hz until the callbacks say otherwise
+  FramePacer pacer;
+  SyntheticVsyncSource source(kPeriod90Hz, 1000000000LL);
+  source.SetJitter(500000);
+  source.SetDropRate(0.1f);
+  for (int32_t i = 0; i < 300; ++i) pacer.OnVsync(source.Next());
+  double period = (double)pacer.GetVsyncPeriod();
+  Check(period > kPeriod90Hz * 0.99 && period < kPeriod90Hz * 1.01,
+        "90Hz period (ns)", period, kPeriod90Hz);
+}
+
+static void CheckIntervals(int32_t frames) {
+  FramePacer pacer;
+  SyntheticVsyncSource source(kPeriod60Hz, 1000000000LL);
+  Display display(&pacer, &source);
+  FramePacerStats stats;
+
+  // Light frames are presented at every vsync, none late
+  int32_t skipped = 0;
+  for (int32_t i = 0; i < frames; ++i) {
+    if (display.RunFrame(8000000) > 1 && i > 0) skipped++;
+  }
+  pacer.GetStats(stats);
+  Check(skipped == 0 && stats.late_frames == 0, "light frames skipped", skipped,
+        0);
+  Check(pacer.GetSwapInterval() == 1, "light interval",
+        pacer.GetSwapInterval(), 1);
+
+  // Frames over the budget go to every other vsync as soon as they are the
+  // 90th percentile of the recent costs, only those before are late
+  int32_t backoff = FramePacer::kCostHistory / 10 + 1;
+  int32_t late_before = (int32_t)stats.late_frames;
+  int32_t every_other = 0;
+  for (int32_t i = 0; i < frames; ++i) {
+    if (display.RunFrame(20000000) == 2) every_other++;
+  }
+  pacer.GetStats(stats);
+  Check(pacer.GetSwapInterval() == 2, "heavy interval",
+        pacer.GetSwapInterval(), 2);
+  Check(every_other >= frames - backoff, "heavy frames at every other vsync",
+        every_other, frames);
+  Check((int32_t)stats.late_frames - late_before <= backoff,
+        "heavy late frames", (double)stats.late_frames - late_before, backoff);
+
+  // Back to 60 fps, but not before light frames lasted a second
+  int32_t switched = -1;
+  for (int32_t i = 0; i < frames + 60; ++i) {
+    display.RunFrame(8000000);
+    if (switched < 0 && pacer.GetSwapInterval() == 1) switched = i;
+  }
+  Check(switched >= 59, "frames before going back to 60 fps", switched, 60);
+  Check(pacer.GetSwapInterval() == 1, "recovered interval",
+        pacer.GetSwapInterval(), 1);
+
+  // Frames on the edge of the budget must not flip the rate every frame
+  pacer.GetStats(stats);
+  uint64_t changes = stats.interval_changes;
+  for (int32_t i = 0; i < frames; ++i) {
+    display.RunFrame(i % 2 ? 14000000 : 16000000);
+  }
+  pacer.GetStats(stats);
+  Check(stats.interval_changes - changes <= 1, "borderline interval changes",
+        (double)(stats.interval_changes - changes), 1);
+}
+
+static void CheckThrottle(int32_t frames) {
+  FramePacer pacer;
+  pacer.SetSwapIntervalRange(2, 2);
+  SyntheticVsyncSource source(kPeriod60Hz, 1000000000LL);
+  source.SetJitter(300000);
+  Display display(&pacer, &source);
+  int32_t off_rate = 0;
+  for (int32_t i = 0; i < frames; ++i) {
+    if (display.RunFrame(4000000) != 2 && i > 0) off_rate++;
+  }
+  Check(off_rate == 0, "30 fps frames off rate", off_rate, 0);
+}
+
+static void CheckWithoutVsync(int32_t frames) {
+  // Render loop that never hears from the display, frames of a period and a
+  // half each would all miss the made up grid
+  FramePacer pacer;
+  int64_t now = 1000000000LL;
+  for (int32_t i = 0; i < frames; ++i) {
+    pacer.BeginFrame(now);
+    now += kPeriod60Hz * 3 / 2;
+    pacer.EndFrame(now);
+  }
+  FramePacerStats stats;
+  pacer.GetStats(stats);
+  Check(!pacer.HasVsync() && stats.late_frames == 0,
+        "late frames without vsync", (double)stats.late_frames, 0);
+  pacer.OnVsync(now);
+  Check(pacer.HasVsync(), "vsync after OnVsync", 0, 1);
+}
+
+static void Bench(int32_t frames) {
+  FramePacer pacer;
+  SyntheticVsyncSource source(kPeriod60Hz, 1000000000LL);
+  source.SetJitter(300000);
+  Display display(&pacer, &source);
+  int64_t begin = GetMonotonicTimeNs();
+  for (int32_t i = 0; i < frames; ++i) {
+    display.RunFrame(i % 7 ? 9000000 : 18000000);
+  }
+  int64_t elapsed = GetMonotonicTimeNs() - begin;
+
+  FramePacerStats stats;
+  pacer.GetStats(stats);
+  printf("%d frames: %.1f ns/frame in the pacer, interval %d, %llu late, "
+         "%llu interval changes\n",
+         frames, (double)elapsed / frames, stats.swap_interval,
+         (unsigned long long)stats.late_frames,
+         (unsigned long long)stats.interval_changes);
+}
+
+int main(int argc, char** argv) {
+  int32_t frames = 600;
+  int c;
+  while ((c = getopt(argc, argv, "f:")) != -1) {
+    switch (c) {
+      case 'f':
+        frames = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-f frames]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (frames < 100) frames = 100;
+
+  CheckPeriod();
+  CheckIntervals(frames);
+  CheckThrottle(frames);
+  CheckWithoutVsync(frames);
+  Bench(frames * 100);
+  if (errors) {
+    fprintf(stderr, "%d checks failed\n", errors);
+    return 1;
+  }
+  return 0;
+}
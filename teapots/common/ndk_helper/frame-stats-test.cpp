@@ -0,0 +1,214 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check of FrameHistogram and FrameStats:
+ *
+ *   frame-stats-test
+ *
+ * Known durations go into a histogram, which must report them exactly below
+ * kSubBuckets microseconds and as the upper bound of their bucket above.
+ * Known frame times go through FrameStats, which must count the frames that
+ * missed a vsync as jank and export the window as the exact CSV and JSON
+ * lines expected. Exits non zero when a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "frameStats.h"
+
+using ndk_helper::FrameHistogram;
+using ndk_helper::FrameStats;
+using ndk_helper::FrameStatsReport;
+
+static int32_t errors = 0;
+
+static void Check(bool ok, const char* what, double value, double expected) {
+  if (!ok && errors++ < 10) {
+    fprintf(stderr, "%s: %f, expected %f\n", what, value, expected);
+  }
+}
+
+static void CheckText(const std::string& text, const std::string& expected,
+                      const char* what) {
+  if (text != expected && errors++ < 10) {
+    fprintf(stderr, "%s:\n%sexpected:\n%s", what, text.c_str(),
+            expected.c_str());
+  }
+}
+
+static void CheckHistogram() {
+  // Below kSubBuckets every microsecond has its own bucket
+  FrameHistogram histogram;
+  for (uint32_t value = 1; value <= 20; ++value) histogram.Record(value);
+  Check(histogram.GetPercentile(50.0) == 10, "small p50",
+        histogram.GetPercentile(50.0), 10);
+  Check(histogram.GetPercentile(90.0) == 18, "small p90",
+        histogram.GetPercentile(90.0), 18);
+  Check(histogram.GetPercentile(99.0) == 20, "small p99",
+        histogram.GetPercentile(99.0), 20);
+  Check(histogram.GetMax() == 20, "small max", histogram.GetMax(), 20);
+  Check(histogram.GetMean() == 10.5, "small mean", histogram.GetMean(), 10.5);
+
+  // 1 ms to 100 ms: the 50th value is 50000 us, in [49152, 50175]
+  histogram.Reset();
+  for (uint32_t ms = 100; ms >= 1; --ms) histogram.Record(ms * 1000);
+  Check(histogram.GetPercentile(50.0) == 50175, "p50",
+        histogram.GetPercentile(50.0), 50175);
+  // 90000 us is in [88064, 90111], 99000 us in [98304, 100351] clamped to
+  // the largest value recorded
+  Check(histogram.GetPercentile(90.0) == 90111, "p90",
+        histogram.GetPercentile(90.0), 90111);
+  Check(histogram.GetPercentile(99.0) == 100000, "p99",
+        histogram.GetPercentile(99.0), 100000);
+  Check(histogram.GetPercentile(100.0) == 100000, "p100",
+        histogram.GetPercentile(100.0), 100000);
+  Check(histogram.GetMax() == 100000, "max", histogram.GetMax(), 100000);
+  Check(histogram.GetCount() == 100, "count", (double)histogram.GetCount(),
+        100);
+
+  // Reported values are never more than 1/kSubBuckets over the real one
+  bool bounded = true;
+  for (uint32_t value = 1; value < 10000000; value = value * 9 / 8 + 1) {
+    FrameHistogram single;
+    single.Record(value);
+    single.Record(0xffffffffu);
+    uint32_t reported = single.GetPercentile(50.0);
+    bounded = bounded && reported >= value &&
+              reported - value <= value / FrameHistogram::kSubBuckets;
+  }
+  Check(bounded, "bucket error bounded", 0, 1);
+
+  histogram.Reset();
+  Check(histogram.GetPercentile(50.0) == 0 && histogram.GetMax() == 0,
+        "empty", histogram.GetPercentile(50.0), 0);
+}
+
+/*
+ * A second of 60 fps frames starting at 1 s: 96 frames of 16 ms, 3 of 33 ms
+ * and one of 50 ms, the long ones spread out
+ */
+static void MarkFrames(FrameStats& stats) {
+  int64_t now = 1000000000LL;
+  stats.MarkFrame(now);
+  for (int32_t i = 0; i < 100; ++i) {
+    int64_t interval = 16000000;
+    if (i == 20 || i == 50 || i == 80) interval = 33000000;
+    if (i == 99) interval = 50000000;
+    now += interval;
+    stats.MarkFrame(now);
+  }
+}
+
+static std::string ReadFile(const char* file_name) {
+  std::string text;
+  FILE* file = fopen(file_name, "r");
+  if (file == NULL) return text;
+  char buffer[256];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    text.append(buffer, size);
+  }
+  fclose(file);
+  return text;
+}
+
+// 16000 us is reported as its bucket's upper bound, 33000 us as well
+static const char kCsv[] =
+    "time_ms,frames,jank,frame_p50_ms,frame_p90_ms,frame_p99_ms,frame_max_ms,"
+    "update_p50_ms,update_p99_ms,update_max_ms,"
+    "cull_p50_ms,cull_p99_ms,cull_max_ms,"
+    "upload_p50_ms,upload_p99_ms,upload_max_ms,"
+    "submit_p50_ms,submit_p99_ms,submit_max_ms\n"
+    "1000.000,100,4,16.127,16.127,33.791,50.000,"
+    "0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000\n";
+
+static const char kJson[] =
+    "{\"time_ms\":1000.000,\"frames\":100,\"jank\":4,"
+    "\"frame\":{\"p50\":16.127,\"p90\":16.127,\"p99\":33.791,\"max\":50.000},"
+    "\"update\":{\"count\":0,\"p50\":0.000,\"p99\":0.000,\"max\":0.000},"
+    "\"cull\":{\"count\":0,\"p50\":0.000,\"p99\":0.000,\"max\":0.000},"
+    "\"upload\":{\"count\":0,\"p50\":0.000,\"p99\":0.000,\"max\":0.000},"
+    "\"submit\":{\"count\":0,\"p50\":0.000,\"p99\":0.000,\"max\":0.000}}\n";
+
+static void CheckFrameStats() {
+  FrameStats stats;
+  stats.SetTargetInterval(1. / 60.);
+  MarkFrames(stats);
+
+  // Frames over 1.5 target intervals missed a vsync
+  FrameStatsReport report;
+  stats.GetFrameReport(report);
+  Check(report.count == 100, "frames", (double)report.count, 100);
+  Check(report.jank_count == 4, "jank", (double)report.jank_count, 4);
+  Check(report.p50 == 16.127f, "frame p50", report.p50, 16.127);
+  Check(report.p90 == 16.127f, "frame p90", report.p90, 16.127);
+  Check(report.p99 == 33.791f, "frame p99", report.p99, 33.791);
+  Check(report.max == 50.f, "frame max", report.max, 50.0);
+  Check(fabsf(report.mean - 16.85f) < 1e-4f, "frame mean", report.mean,
+        16.85);
+
+  // At 30 fps only the 50 ms frame missed one
+  stats.Reset();
+  stats.SetTargetInterval(1. / 30.);
+  MarkFrames(stats);
+  stats.GetFrameReport(report);
+  Check(report.jank_count == 1, "jank at 30 fps", (double)report.jank_count,
+        1);
+}
+
+static void CheckExport(ndk_helper::FRAME_STATS_FORMAT format,
+                        const char* expected, const char* what) {
+  char file_name[] = "/tmp/frame-stats-XXXXXX";
+  int fd = mkstemp(file_name);
+  if (fd < 0) {
+    Check(false, "temporary file", fd, 0);
+    return;
+  }
+  close(fd);
+
+  {
+    FrameStats stats;
+    stats.SetTargetInterval(1. / 60.);
+    if (stats.EnableExport(file_name, format)) {
+      MarkFrames(stats);
+      stats.Flush();
+      // An empty window writes nothing
+      stats.Flush();
+    } else {
+      Check(false, "export enabled", 0, 1);
+    }
+  }
+  CheckText(ReadFile(file_name), expected, what);
+  unlink(file_name);
+}
+
+int main(int argc, char** argv) {
+  CheckHistogram();
+  CheckFrameStats();
+  CheckExport(ndk_helper::FRAME_STATS_FORMAT_CSV, kCsv, "CSV export");
+  CheckExport(ndk_helper::FRAME_STATS_FORMAT_JSON, kJson, "JSON export");
+  if (errors) {
+    fprintf(stderr, "%d checks failed\n", errors);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "framePacer.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace ndk_helper {
+
+const int32_t FramePacer::kCostHistory;
+
+// 60Hz until vsyncs tell otherwise
+static const int64_t kDefaultPeriodNs = 16666667;
+// Share of the frame budget the CPU may use before the interval goes up
+static const int64_t kBudgetPercent = 90;
+// Frames a lower interval has to fit before switching to it
+static const int32_t kDowngradeFrames = 60;
+// Weight of a new sample in the period estimate (1 / 2^kPeriodFilterShift)
+static const int32_t kPeriodFilterShift = 4;
+// Consecutive consistent outliers that are taken as a refresh rate change
+static const int32_t kPeriodOutlierLimit = 4;
+
+static inline int64_t Abs(int64_t value) { return value < 0 ? -value : value; }
+
+//-------------------------------------------------
+// Ctor
+//-------------------------------------------------
+FramePacer::FramePacer() : min_interval_(1), max_interval_(4) {
+  period_ns_ = kDefaultPeriodNs;
+  Reset();
+}
+
+void FramePacer::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  vsync_anchor_ns_ = 0;
+  last_vsync_ns_ = 0;
+  period_outliers_ = 0;
+  outlier_period_ns_ = 0;
+  swap_interval_ = min_interval_;
+  downgrade_frames_ = 0;
+  frame_begin_ns_ = 0;
+  frame_target_ns_ = 0;
+  next_present_ns_ = 0;
+  pending_present_ = false;
+  cost_index_ = 0;
+  cost_count_ = 0;
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void FramePacer::SetRefreshPeriod(int64_t period_ns) {
+  if (period_ns <= 0) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  period_ns_ = period_ns;
+}
+
+void FramePacer::SetSwapIntervalRange(int32_t min_interval,
+                                      int32_t max_interval) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  min_interval_ = std::max(min_interval, 1);
+  max_interval_ = std::max(max_interval, min_interval_);
+  int32_t interval =
+      std::min(std::max(swap_interval_, min_interval_), max_interval_);
+  if (interval != swap_interval_) {
+    swap_interval_ = interval;
+    stats_.interval_changes++;
+  }
+  downgrade_frames_ = 0;
+}
+
+//-------------------------------------------------
+// Vsync model
+//-------------------------------------------------
+void FramePacer::OnVsync(int64_t vsync_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (last_vsync_ns_ != 0 && vsync_ns > last_vsync_ns_) {
+    // Callbacks may be skipped, so divide by the number of periods elapsed
+    int64_t delta = vsync_ns - last_vsync_ns_;
+    int64_t periods = (delta + period_ns_ / 2) / period_ns_;
+    int64_t sample = periods > 0 ? delta / periods : delta;
+    if (periods <= 8) UpdatePeriodLocked(sample);
+  }
+  last_vsync_ns_ = vsync_ns;
+  vsync_anchor_ns_ = vsync_ns;
+}
+
+void FramePacer::UpdatePeriodLocked(int64_t sample) {
+  if (Abs(sample - period_ns_) * 4 <= period_ns_) {
+    period_ns_ += (sample - period_ns_) / (1 << kPeriodFilterShift);
+    period_outliers_ = 0;
+    return;
+  }
+
+  if (period_outliers_ > 0 &&
+      Abs(sample - outlier_period_ns_) * 8 <= outlier_period_ns_) {
+    if (++period_outliers_ >= kPeriodOutlierLimit) {
+      // Refresh rate switched, start over from the new period
+      period_ns_ = outlier_period_ns_;
+      period_outliers_ = 0;
+    }
+  } else {
+    outlier_period_ns_ = sample;
+    period_outliers_ = 1;
+  }
+}
+
+bool FramePacer::HasVsync() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return vsync_anchor_ns_ != 0;
+}
+
+int64_t FramePacer::PredictVsyncLocked(int64_t time_ns) const {
+  if (time_ns <= vsync_anchor_ns_) return vsync_anchor_ns_;
+  int64_t periods = (time_ns - vsync_anchor_ns_ + period_ns_ - 1) / period_ns_;
+  return vsync_anchor_ns_ + periods * period_ns_;
+}
+
+int64_t FramePacer::PredictVsync(int64_t time_ns) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return PredictVsyncLocked(time_ns);
+}
+
+bool FramePacer::ShouldPresent(int64_t vsync_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!pending_present_) return false;
+  if (vsync_ns + period_ns_ / 2 < frame_target_ns_) return false;
+  pending_present_ = false;
+  return true;
+}
+
+//-------------------------------------------------
+// Frame timing
+//-------------------------------------------------
+void FramePacer::BeginFrame(int64_t now_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  frame_begin_ns_ = now_ns;
+  // Present at the planned vsync, or at the next one we can still make
+  int64_t earliest = PredictVsyncLocked(now_ns + 1);
+  frame_target_ns_ = std::max(next_present_ns_, earliest);
+}
+
+void FramePacer::EndFrame(int64_t now_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (frame_begin_ns_ == 0) return;
+
+  int64_t cost = now_ns - frame_begin_ns_;
+  costs_ns_[cost_index_] = cost;
+  cost_index_ = (cost_index_ + 1) % kCostHistory;
+  if (cost_count_ < kCostHistory) cost_count_++;
+
+  stats_.frames++;
+  int64_t present = PredictVsyncLocked(now_ns);
+  // Without vsyncs the grid is made up, there is nothing to be late for
+  if (vsync_anchor_ns_ != 0 && present > frame_target_ns_ + period_ns_ / 2) {
+    stats_.late_frames++;
+    stats_.missed_vsyncs +=
+        (present - frame_target_ns_ + period_ns_ / 2) / period_ns_;
+    frame_target_ns_ = present;
+  }
+
+  UpdateSwapIntervalLocked();
+  next_present_ns_ = frame_target_ns_ + swap_interval_ * period_ns_;
+  pending_present_ = true;
+  frame_begin_ns_ = 0;
+}
+
+int64_t FramePacer::GetCostPercentileLocked() const {
+  if (cost_count_ == 0) return 0;
+  int64_t costs[kCostHistory];
+  memcpy(costs, costs_ns_, cost_count_ * sizeof(int64_t));
+  int32_t index = cost_count_ * 9 / 10;
+  std::nth_element(costs, costs + index, costs + cost_count_);
+  return costs[index];
+}
+
+void FramePacer::UpdateSwapIntervalLocked() {
+  if (min_interval_ == max_interval_) return;
+
+  int64_t cost = GetCostPercentileLocked();
+  int64_t budget = period_ns_ * kBudgetPercent / 100;
+  int32_t needed = (int32_t)((cost + budget - 1) / budget);
+  needed = std::min(std::max(needed, min_interval_), max_interval_);
+
+  int32_t interval = swap_interval_;
+  if (needed > swap_interval_) {
+    // Frames don't fit anymore, back off right away
+    interval = needed;
+    downgrade_frames_ = 0;
+  } else if (needed < swap_interval_) {
+    if (++downgrade_frames_ >= kDowngradeFrames) {
+      interval = swap_interval_ - 1;
+      downgrade_frames_ = 0;
+    }
+  } else {
+    downgrade_frames_ = 0;
+  }
+
+  if (interval != swap_interval_) {
+    swap_interval_ = interval;
+    stats_.interval_changes++;
+  }
+}
+
+int64_t FramePacer::GetPresentTime() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return frame_target_ns_;
+}
+
+int32_t FramePacer::GetSwapInterval() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return swap_interval_;
+}
+
+int64_t FramePacer::GetVsyncPeriod() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return period_ns_;
+}
+
+void FramePacer::GetStats(FramePacerStats& stats) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats = stats_;
+  stats.swap_interval = swap_interval_;
+  stats.vsync_period = period_ns_ / 1000000.f;
+  stats.cpu_cost = GetCostPercentileLocked() / 1000000.f;
+}
+
+//-------------------------------------------------
+// SyntheticVsyncSource
+//-------------------------------------------------
+SyntheticVsyncSource::SyntheticVsyncSource(int64_t period_ns, int64_t start_ns,
+                                           uint32_t seed)
+    : period_ns_(period_ns),
+      ideal_ns_(start_ns),
+      jitter_ns_(0),
+      drop_rate_(0.f),
+      state_(seed ? seed : 1) {}
+
+uint32_t SyntheticVsyncSource::Random() {
+  // xorshift32
+  state_ ^= state_ << 13;
+  state_ ^= state_ >> 17;
+  state_ ^= state_ << 5;
+  return state_;
+}
+
+int64_t SyntheticVsyncSource::Next() {
+  while (true) {
+    ideal_ns_ += period_ns_;
+    bool dropped = drop_rate_ > 0.f &&
+                   (Random() & 0xffffff) < (uint32_t)(drop_rate_ * 0x1000000);
+    if (dropped) continue;
+    int64_t jitter = 0;
+    if (jitter_ns_ > 0)
+      jitter = (int64_t)(Random() % (uint32_t)(2 * jitter_ns_ + 1)) - jitter_ns_;
+    return ideal_ns_ + jitter;
+  }
+}
+
+int64_t SyntheticVsyncSource::NextAfter(int64_t time_ns) {
+  int64_t vsync = Next();
+  while (vsync < time_ns) vsync = Next();
+  return vsync;
+}
+
+}  // namespace ndk_helper
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEPACER_H_
+#define FRAMEPACER_H_
+
+#include <stdint.h>
+#include <mutex>
+
+namespace ndk_helper {
+
+/*
+ * Pacing counters, times in milliseconds
+ */
+struct FramePacerStats {
+  uint64_t frames;
+  uint64_t late_frames;    // frames presented after their target vsync
+  uint64_t missed_vsyncs;  // vsyncs the late frames slipped by in total
+  uint64_t interval_changes;
+  int32_t swap_interval;
+  float vsync_period;
+  float cpu_cost;  // 90th percentile of recent frames
+};
+
+/******************************************************************
+ * Frame pacing scheduler.
+ * Tracks vsync timestamps to estimate the display period and phase, predicts
+ * the vsync each frame will be presented on and picks the swap interval
+ * (number of vsyncs per frame) from the measured CPU cost of recent frames.
+ *
+ * Intervals go up as soon as frames no longer fit, and come down only after
+ * a frame rate has been sustainable for a while, which avoids oscillating
+ * between 60 and 30 fps on borderline content.
+ *
+ * All timestamps are CLOCK_MONOTONIC nanoseconds (the time base of
+ * Choreographer frame times). Nothing depends on Android, so the pacer can be
+ * driven by SyntheticVsyncSource on a host. Methods are thread safe, vsync
+ * callbacks typically arrive on another thread than the render loop.
+ *
+ * Predictions are only as good as the vsyncs fed to OnVsync(), a render loop
+ * that presents with GetPresentTime() still needs a source of vsync times.
+ *
+ * Usage:
+ *   vsync callback:  pacer.OnVsync(frame_time);
+ *                    if (pacer.ShouldPresent(frame_time)) Swap();
+ *   render loop:     pacer.BeginFrame(now);  ...render...
+ *                    pacer.EndFrame(now);    wait for ShouldPresent() or
+ *                                            swap with GetPresentTime()
+ */
+class FramePacer {
+ public:
+  static const int32_t kCostHistory = 32;
+
+  FramePacer();
+
+  /*
+   * Nominal vsync period, used until OnVsync() measured the real one
+   */
+  void SetRefreshPeriod(int64_t period_ns);
+
+  /*
+   * Allowed swap intervals. min == max gives a fixed frame rate.
+   */
+  void SetSwapIntervalRange(int32_t min_interval, int32_t max_interval);
+
+  void OnVsync(int64_t vsync_ns);
+
+  /*
+   * Returns true once OnVsync() placed the vsync grid. Before that,
+   * predictions are multiples of the nominal period from zero, and frames
+   * are not counted as late.
+   */
+  bool HasVsync() const;
+
+  /*
+   * Returns true when the frame rendered last should be presented at given
+   * vsync. Returns true once per frame.
+   */
+  bool ShouldPresent(int64_t vsync_ns);
+
+  void BeginFrame(int64_t now_ns);
+  void EndFrame(int64_t now_ns);
+
+  /*
+   * Predicted presentation time of the current frame, suitable for
+   * eglPresentationTimeANDROID()
+   */
+  int64_t GetPresentTime() const;
+
+  /*
+   * Predicted time of the first vsync at or after time_ns
+   */
+  int64_t PredictVsync(int64_t time_ns) const;
+
+  int32_t GetSwapInterval() const;
+  int64_t GetVsyncPeriod() const;
+  void GetStats(FramePacerStats& stats) const;
+
+  /*
+   * Forget timing history, e.g. after the app was paused
+   */
+  void Reset();
+
+ private:
+  FramePacer(const FramePacer& rhs);
+  FramePacer& operator=(const FramePacer& rhs);
+
+  void UpdatePeriodLocked(int64_t sample);
+  int64_t PredictVsyncLocked(int64_t time_ns) const;
+  int64_t GetCostPercentileLocked() const;
+  void UpdateSwapIntervalLocked();
+
+  mutable std::mutex mutex_;
+
+  // Vsync model
+  int64_t period_ns_;
+  int64_t vsync_anchor_ns_;
+  int64_t last_vsync_ns_;
+  int32_t period_outliers_;
+  int64_t outlier_period_ns_;
+
+  // Swap interval policy
+  int32_t min_interval_;
+  int32_t max_interval_;
+  int32_t swap_interval_;
+  int32_t downgrade_frames_;
+
+  // Current frame
+  int64_t frame_begin_ns_;
+  int64_t frame_target_ns_;
+  int64_t next_present_ns_;
+  bool pending_present_;
+
+  int64_t costs_ns_[kCostHistory];
+  int32_t cost_index_;
+  int32_t cost_count_;
+
+  FramePacerStats stats_;
+};
+
+/******************************************************************
+ * Deterministic vsync generator for exercising pacing policies off device.
+ * Produces timestamps at a fixed period with optional jitter and randomly
+ * dropped callbacks, the way a busy UI thread delivers Choreographer frames.
+ */
+class SyntheticVsyncSource {
+ public:
+  explicit SyntheticVsyncSource(int64_t period_ns, int64_t start_ns = 0,
+                                uint32_t seed = 1);
+
+  void SetJitter(int64_t jitter_ns) { jitter_ns_ = jitter_ns; }
+  // Fraction (0-1) of vsyncs that are not delivered
+  void SetDropRate(float drop_rate) { drop_rate_ = drop_rate; }
+  void SetPeriod(int64_t period_ns) { period_ns_ = period_ns; }
+  int64_t GetPeriod() const { return period_ns_; }
+
+  /*
+   * Returns the timestamp of the next delivered vsync
+   */
+  int64_t Next();
+
+  /*
+   * Returns the first delivered vsync at or after time_ns, e.g. the one a
+   * render loop blocks on after a frame that took until time_ns
+   */
+  int64_t NextAfter(int64_t time_ns);
+
+ private:
+  uint32_t Random();
+
+  int64_t period_ns_;
+  int64_t ideal_ns_;
+  int64_t jitter_ns_;
+  float drop_rate_;
+  uint32_t state_;
+};
+
+}  // namespace ndk_helper
+#endif /* FRAMEPACER_H_ */
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frameStats.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace ndk_helper {
+
+const int32_t FrameHistogram::kSubBucketBits;
+const int32_t FrameHistogram::kSubBuckets;
+const int32_t FrameHistogram::kNumBuckets;
+
+//-------------------------------------------------
+// FrameHistogram
+//-------------------------------------------------
+FrameHistogram::FrameHistogram() { Reset(); }
+
+void FrameHistogram::Reset() {
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+
+int32_t FrameHistogram::GetBucketIndex(uint32_t value) {
+  if (value < (uint32_t)kSubBuckets) return value;
+  int32_t msb = 31 - __builtin_clz(value);
+  int32_t shift = msb - kSubBucketBits;
+  int32_t sub = (value >> shift) & (kSubBuckets - 1);
+  return (shift + 1) * kSubBuckets + sub;
+}
+
+uint32_t FrameHistogram::GetBucketUpperBound(int32_t index) {
+  if (index < kSubBuckets) return index;
+  int32_t shift = index / kSubBuckets - 1;
+  uint32_t sub = index % kSubBuckets;
+  uint32_t lower = ((uint32_t)kSubBuckets + sub) << shift;
+  return lower + ((1u << shift) - 1);
+}
+
+void FrameHistogram::Record(uint32_t value_us) {
+  counts_[GetBucketIndex(value_us)]++;
+  count_++;
+  sum_ += value_us;
+  if (value_us > max_) max_ = value_us;
+}
+
+uint32_t FrameHistogram::GetPercentile(double percentile) const {
+  if (count_ == 0) return 0;
+  uint64_t target = (uint64_t)ceil(percentile / 100.0 * count_);
+  if (target < 1) target = 1;
+  if (target > count_) target = count_;
+
+  uint64_t total = 0;
+  for (int32_t i = 0; i < kNumBuckets; ++i) {
+    total += counts_[i];
+    if (total >= target) {
+      uint32_t value = GetBucketUpperBound(i);
+      return value < max_ ? value : max_;
+    }
+  }
+  return max_;
+}
+
+//-------------------------------------------------
+// FrameStats
+//-------------------------------------------------
+FrameStats::FrameStats()
+    : last_frame_ns_(0),
+      window_start_ns_(0),
+      target_interval_ns_(1000000000LL / 60),
+      jank_count_(0),
+      export_file_(NULL),
+      export_format_(FRAME_STATS_FORMAT_CSV) {
+  memset(phase_start_ns_, 0, sizeof(phase_start_ns_));
+}
+
+FrameStats::~FrameStats() { DisableExport(); }
+
+void FrameStats::SetTargetInterval(double seconds) {
+  target_interval_ns_ = (int64_t)(seconds * 1e9);
+}
+
+void FrameStats::MarkFrame(int64_t now_ns) {
+  if (window_start_ns_ == 0) window_start_ns_ = now_ns;
+  if (last_frame_ns_ != 0) {
+    int64_t interval_ns = now_ns - last_frame_ns_;
+    frame_histogram_.Record((uint32_t)(interval_ns / 1000));
+    if (interval_ns * 2 > target_interval_ns_ * 3) jank_count_++;
+  }
+  last_frame_ns_ = now_ns;
+}
+
+void FrameStats::BeginPhase(FRAME_PHASE phase) {
+  phase_start_ns_[phase] = GetMonotonicTimeNs();
+}
+
+void FrameStats::EndPhase(FRAME_PHASE phase) {
+  int64_t duration_ns = GetMonotonicTimeNs() - phase_start_ns_[phase];
+  phase_histograms_[phase].Record((uint32_t)(duration_ns / 1000));
+}
+
+void FrameStats::FillReport(const FrameHistogram& histogram,
+                            FrameStatsReport& report) {
+  report.count = histogram.GetCount();
+  report.jank_count = 0;
+  report.mean = (float)(histogram.GetMean() / 1000.0);
+  report.p50 = histogram.GetPercentile(50.0) / 1000.f;
+  report.p90 = histogram.GetPercentile(90.0) / 1000.f;
+  report.p99 = histogram.GetPercentile(99.0) / 1000.f;
+  report.max = histogram.GetMax() / 1000.f;
+}
+
+void FrameStats::GetFrameReport(FrameStatsReport& report) const {
+  FillReport(frame_histogram_, report);
+  report.jank_count = jank_count_;
+}
+
+void FrameStats::GetPhaseReport(FRAME_PHASE phase,
+                                FrameStatsReport& report) const {
+  FillReport(phase_histograms_[phase], report);
+}
+
+const char* FrameStats::GetPhaseName(FRAME_PHASE phase) {
+  switch (phase) {
+    case FRAME_PHASE_UPDATE:
+      return "update";
+    case FRAME_PHASE_CULL:
+      return "cull";
+    case FRAME_PHASE_UPLOAD:
+      return "upload";
+    case FRAME_PHASE_SUBMIT:
+      return "submit";
+    default:
+      return "unknown";
+  }
+}
+
+//-------------------------------------------------
+// Export
+//-------------------------------------------------
+bool FrameStats::EnableExport(const char* file_name,
+                              FRAME_STATS_FORMAT format) {
+  DisableExport();
+  export_file_ = fopen(file_name, "w");
+  if (export_file_ == NULL) return false;
+  export_format_ = format;
+  WriteHeader();
+  return true;
+}
+
+void FrameStats::DisableExport() {
+  if (export_file_ == NULL) return;
+  fclose(export_file_);
+  export_file_ = NULL;
+}
+
+void FrameStats::WriteHeader() {
+  if (export_format_ != FRAME_STATS_FORMAT_CSV) return;
+  fprintf(export_file_,
+          "time_ms,frames,jank,frame_p50_ms,frame_p90_ms,frame_p99_ms,"
+          "frame_max_ms");
+  for (int32_t i = 0; i < FRAME_PHASE_COUNT; ++i) {
+    const char* name = GetPhaseName((FRAME_PHASE)i);
+    fprintf(export_file_, ",%s_p50_ms,%s_p99_ms,%s_max_ms", name, name, name);
+  }
+  fprintf(export_file_, "\n");
+}
+
+void FrameStats::WriteRecord() {
+  FrameStatsReport frame;
+  GetFrameReport(frame);
+  double time_ms = window_start_ns_ / 1e6;
+
+  if (export_format_ == FRAME_STATS_FORMAT_CSV) {
+    fprintf(export_file_, "%.3f,%llu,%llu,%.3f,%.3f,%.3f,%.3f", time_ms,
+            (unsigned long long)frame.count,
+            (unsigned long long)frame.jank_count, frame.p50, frame.p90,
+            frame.p99, frame.max);
+    for (int32_t i = 0; i < FRAME_PHASE_COUNT; ++i) {
+      FrameStatsReport phase;
+      GetPhaseReport((FRAME_PHASE)i, phase);
+      fprintf(export_file_, ",%.3f,%.3f,%.3f", phase.p50, phase.p99,
+              phase.max);
+    }
+    fprintf(export_file_, "\n");
+  } else {
+    fprintf(export_file_,
+            "{\"time_ms\":%.3f,\"frames\":%llu,\"jank\":%llu,"
+            "\"frame\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+            time_ms, (unsigned long long)frame.count,
+            (unsigned long long)frame.jank_count, frame.p50, frame.p90,
+            frame.p99, frame.max);
+    for (int32_t i = 0; i < FRAME_PHASE_COUNT; ++i) {
+      FrameStatsReport phase;
+      GetPhaseReport((FRAME_PHASE)i, phase);
+      fprintf(export_file_,
+              ",\"%s\":{\"count\":%llu,\"p50\":%.3f,\"p99\":%.3f,"
+              "\"max\":%.3f}",
+              GetPhaseName((FRAME_PHASE)i), (unsigned long long)phase.count,
+              phase.p50, phase.p99, phase.max);
+    }
+    fprintf(export_file_, "}\n");
+  }
+  fflush(export_file_);
+}
+
+void FrameStats::Flush() {
+  if (export_file_ != NULL && frame_histogram_.GetCount()) WriteRecord();
+
+  frame_histogram_.Reset();
+  for (int32_t i = 0; i < FRAME_PHASE_COUNT; ++i) phase_histograms_[i].Reset();
+  jank_count_ = 0;
+  window_start_ns_ = last_frame_ns_;
+}
+
+void FrameStats::Reset() {
+  Flush();
+  last_frame_ns_ = 0;
+  window_start_ns_ = 0;
+}
+
+}  // namespace ndk_helper
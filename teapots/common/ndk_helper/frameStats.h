@@ -0,0 +1,201 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMESTATS_H_
+#define FRAMESTATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+namespace ndk_helper {
+
+/*
+ * Frame phases that can be timed individually with ScopedFramePhase
+ */
+enum FRAME_PHASE {
+  FRAME_PHASE_UPDATE,
+  FRAME_PHASE_CULL,
+  FRAME_PHASE_UPLOAD,
+  FRAME_PHASE_SUBMIT,
+  FRAME_PHASE_COUNT,
+};
+
+enum FRAME_STATS_FORMAT {
+  FRAME_STATS_FORMAT_CSV,
+  FRAME_STATS_FORMAT_JSON,  // One JSON object per line
+};
+
+/*
+ * Monotonic clock in nanoseconds, unaffected by wall clock adjustments
+ */
+inline int64_t GetMonotonicTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/******************************************************************
+ * Log-linear (HDR style) histogram of durations in microseconds.
+ * Each power of two range is split into kSubBuckets linear buckets, which
+ * keeps the relative error of any reported value under 1/kSubBuckets with a
+ * fixed, allocation free footprint.
+ */
+class FrameHistogram {
+ public:
+  static const int32_t kSubBucketBits = 5;
+  static const int32_t kSubBuckets = 1 << kSubBucketBits;
+  static const int32_t kNumBuckets = (32 - kSubBucketBits + 1) * kSubBuckets;
+
+  FrameHistogram();
+
+  void Record(uint32_t value_us);
+  void Reset();
+
+  /*
+   * Returns the value at given percentile (0-100) in microseconds.
+   * The result is the upper bound of the bucket holding the percentile,
+   * clamped to the largest recorded value.
+   */
+  uint32_t GetPercentile(double percentile) const;
+
+  uint32_t GetMax() const { return max_; }
+  uint64_t GetCount() const { return count_; }
+  double GetMean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+
+ private:
+  static int32_t GetBucketIndex(uint32_t value);
+  static uint32_t GetBucketUpperBound(int32_t index);
+
+  uint32_t counts_[kNumBuckets];
+  uint64_t count_;
+  uint64_t sum_;
+  uint32_t max_;
+};
+
+/*
+ * Summary of a histogram, values in milliseconds
+ */
+struct FrameStatsReport {
+  uint64_t count;
+  uint64_t jank_count;
+  float mean;
+  float p50;
+  float p90;
+  float p99;
+  float max;
+};
+
+/******************************************************************
+ * Frame timing statistics.
+ * Records frame intervals and per phase durations into histograms, counts
+ * janky frames against a target interval and optionally streams a summary of
+ * every reporting window to a CSV or JSON lines file.
+ *
+ * The export only needs a writable path (e.g.
+ * ANativeActivity::internalDataPath), so it can be enabled from native code
+ * without any JNI call.
+ */
+class FrameStats {
+ public:
+  FrameStats();
+  ~FrameStats();
+
+  /*
+   * Set the expected frame interval. A frame is counted as jank when its
+   * interval exceeds 1.5x of the target, i.e. it missed at least one vsync.
+   */
+  void SetTargetInterval(double seconds);
+  double GetTargetInterval() const { return target_interval_ns_ * 1e-9; }
+
+  /*
+   * Marks a frame boundary and records the interval since the previous one.
+   */
+  void MarkFrame(int64_t now_ns);
+  void MarkFrame() { MarkFrame(GetMonotonicTimeNs()); }
+
+  void BeginPhase(FRAME_PHASE phase);
+  void EndPhase(FRAME_PHASE phase);
+
+  void GetFrameReport(FrameStatsReport& report) const;
+  void GetPhaseReport(FRAME_PHASE phase, FrameStatsReport& report) const;
+  uint64_t GetFrameCount() const { return frame_histogram_.GetCount(); }
+
+  /*
+   * Start streaming window summaries to file_name. Any previous export is
+   * closed. Returns false when the file can't be opened.
+   */
+  bool EnableExport(const char* file_name, FRAME_STATS_FORMAT format);
+  void DisableExport();
+  bool IsExportEnabled() const { return export_file_ != NULL; }
+
+  /*
+   * Write the current window to the export stream (if enabled) and start a
+   * new window.
+   */
+  void Flush();
+
+  /*
+   * Flush the current window and forget the previous frame boundary, e.g.
+   * after the app was paused so the gap isn't counted as a frame.
+   */
+  void Reset();
+
+  static const char* GetPhaseName(FRAME_PHASE phase);
+
+ private:
+  FrameStats(const FrameStats& rhs);
+  FrameStats& operator=(const FrameStats& rhs);
+
+  void WriteHeader();
+  void WriteRecord();
+  static void FillReport(const FrameHistogram& histogram,
+                         FrameStatsReport& report);
+
+  FrameHistogram frame_histogram_;
+  FrameHistogram phase_histograms_[FRAME_PHASE_COUNT];
+  int64_t phase_start_ns_[FRAME_PHASE_COUNT];
+
+  int64_t last_frame_ns_;
+  int64_t window_start_ns_;
+  int64_t target_interval_ns_;
+  uint64_t jank_count_;
+
+  FILE* export_file_;
+  FRAME_STATS_FORMAT export_format_;
+};
+
+/******************************************************************
+ * Times the enclosing scope as given phase of the current frame
+ */
+class ScopedFramePhase {
+ public:
+  ScopedFramePhase(FrameStats& stats, FRAME_PHASE phase)
+      : stats_(stats), phase_(phase) {
+    stats_.BeginPhase(phase_);
+  }
+  ~ScopedFramePhase() { stats_.EndPhase(phase_); }
+
+ private:
+  ScopedFramePhase(const ScopedFramePhase& rhs);
+  ScopedFramePhase& operator=(const ScopedFramePhase& rhs);
+
+  FrameStats& stats_;
+  FRAME_PHASE phase_;
+};
+
+}  // namespace ndk_helper
+#endif /* FRAMESTATS_H_ */
@@ -16,7 +16,7 @@
 
 #include "interpolator.h"
 #include <math.h>
-#include "interpolator.h"
+#include "frameStats.h"
 
 namespace ndk_helper {
 
@@ -36,7 +36,7 @@ Interpolator& Interpolator::Set(const float start, const float dest,
                                 const INTERPOLATOR_TYPE type,
                                 const double duration) {
   // init the parameters for the interpolation process
-  start_time_ = PerfMonitor::GetCurrentTime();
+  start_time_ = GetMonotonicTimeNs() * 1e-9;
   dest_time_ = start_time_ + duration;
   type_ = type;
 
@@ -17,11 +17,6 @@
 #ifndef INTERPOLATOR_H_
 #define INTERPOLATOR_H_
 
-#include <jni.h>
-#include <errno.h>
-#include <time.h>
-#include "JNIHelper.h"
-#include "perfMonitor.h"
 #include <list>
 
 namespace ndk_helper {
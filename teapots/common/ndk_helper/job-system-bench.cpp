@@ -0,0 +1,239 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmarks of JobSystem:
+ *
+ *   job-system-bench [-n jobs] [-m elements] [-w workers] [-s rounds]
+ *
+ * ParallelFor must visit every element once, RunAfter must hold a job until
+ * its dependency is done, and jobs spawned from a thread that isn't a worker
+ * must run. Many small ParallelFors in a row must never let Wait() return,
+ * or a continuation start, while a chunk still runs against the caller's
+ * stack, even when halves finish while the caller is still spawning. Then
+ * the cost of spawning and waiting for empty jobs is measured, and a
+ * ParallelFor over a fixed amount of work is timed with 1, 2, 4, ... up to
+ * the given number of workers. Exits non zero when a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "frameStats.h"
+#include "jobSystem.h"
+
+using ndk_helper::GetMonotonicTimeNs;
+using ndk_helper::JobCounter;
+using ndk_helper::JobSystem;
+using ndk_helper::JobSystemConfig;
+
+// Jobs in flight at once while spawning, well under a worker's pool
+static const int32_t kSpawnBatch = 1024;
+
+static int32_t errors = 0;
+
+static void Check(bool ok, const char* what, int32_t workers) {
+  if (!ok && errors++ < 10) {
+    fprintf(stderr, "%s failed with %d workers\n", what, workers);
+  }
+}
+
+static bool Start(int32_t workers) {
+  JobSystemConfig config;
+  config.worker_count = workers;
+  return JobSystem::GetInstance()->Init(config);
+}
+
+static void CheckJobs(int32_t workers) {
+  JobSystem* job_system = JobSystem::GetInstance();
+
+  // Odd sizes and grains so the last chunk is cut short
+  std::vector<int32_t> visits(100003);
+  JobCounter counter;
+  job_system->ParallelFor(0, (int32_t)visits.size(), 97,
+                          [&](int32_t begin, int32_t end) {
+                            for (int32_t i = begin; i < end; ++i) visits[i]++;
+                          },
+                          &counter);
+  job_system->Wait(&counter);
+  bool once = true;
+  for (size_t i = 0; i < visits.size(); ++i) once = once && visits[i] == 1;
+  Check(once, "ParallelFor", workers);
+
+  JobCounter first, second;
+  std::atomic<int32_t> done(0), early(0);
+  for (int32_t i = 0; i < 64; ++i) {
+    job_system->Run([&]() { done++; }, &first);
+  }
+  for (int32_t i = 0; i < 64; ++i) {
+    job_system->RunAfter(&first, [&]() {
+      if (done.load() != 64) early++;
+    }, &second);
+  }
+  job_system->Wait(&second);
+  Check(first.IsDone() && done.load() == 64 && early.load() == 0, "RunAfter",
+        workers);
+
+  // The spawning thread leaves before the jobs are waited for
+  JobCounter foreign;
+  std::atomic<int32_t> foreign_done(0);
+  std::thread thread([&]() {
+    for (int32_t i = 0; i < 100; ++i) {
+      job_system->Run([&]() { foreign_done++; }, &foreign);
+    }
+  });
+  thread.join();
+  job_system->Wait(&foreign);
+  Check(foreign_done.load() == 100, "foreign spawn", workers);
+}
+
+// One ParallelFor of the stress test, on the caller's stack
+struct StressRound {
+  int32_t round;
+  std::atomic<int32_t> visited;
+  std::atomic<int32_t> running;
+};
+
+static void StressParallelFor(int32_t rounds, int32_t workers) {
+  JobSystem* job_system = JobSystem::GetInstance();
+  const int32_t kElements = 64;
+  std::atomic<int32_t> late(0), early(0);
+  bool counted = true;
+  for (int32_t round = 0; round < rounds; ++round) {
+    StressRound state;
+    state.round = round;
+    state.visited = 0;
+    state.running = 0;
+    JobCounter counter, after;
+    // Grain 1, so the caller spawns halves for as long as possible
+    job_system->ParallelFor(0, kElements, 1,
+                            [&state, round, &late](int32_t begin, int32_t end) {
+                              state.running++;
+                              if (state.round != round) late++;
+                              state.visited += end - begin;
+                              state.running--;
+                            },
+                            &counter);
+    job_system->RunAfter(&counter, [&state, &early]() {
+      if (state.visited.load() != kElements) early++;
+    }, &after);
+    job_system->Wait(&counter);
+    job_system->Wait(&after);
+    counted = counted && state.visited.load() == kElements &&
+              state.running.load() == 0 && counter.IsDone();
+    // A chunk still running would see the round change
+    state.round = -1;
+  }
+  Check(counted && late.load() == 0 && early.load() == 0, "ParallelFor stress",
+        workers);
+}
+
+static double BenchSpawn(int32_t jobs) {
+  JobSystem* job_system = JobSystem::GetInstance();
+  int64_t begin = GetMonotonicTimeNs();
+  for (int32_t spawned = 0; spawned < jobs; spawned += kSpawnBatch) {
+    JobCounter counter;
+    for (int32_t i = 0; i < kSpawnBatch; ++i) {
+      job_system->Run([]() {}, &counter);
+    }
+    job_system->Wait(&counter);
+  }
+  int64_t elapsed = GetMonotonicTimeNs() - begin;
+  int32_t batches = (jobs + kSpawnBatch - 1) / kSpawnBatch;
+  return (double)elapsed / ((double)batches * kSpawnBatch);
+}
+
+static double BenchScaling(std::vector<float>& values) {
+  JobSystem* job_system = JobSystem::GetInstance();
+  int64_t start = GetMonotonicTimeNs();
+  JobCounter counter;
+  job_system->ParallelFor(0, (int32_t)values.size(), 256,
+                          [&](int32_t begin, int32_t end) {
+                            for (int32_t i = begin; i < end; ++i) {
+                              float v = values[i];
+                              for (int32_t j = 0; j < 32; ++j) {
+                                v = sinf(v) + 0.5f;
+                              }
+                              values[i] = v;
+                            }
+                          },
+                          &counter);
+  job_system->Wait(&counter);
+  return (GetMonotonicTimeNs() - start) * 1e-6;
+}
+
+int main(int argc, char** argv) {
+  int32_t jobs = 1000000;
+  int32_t elements = 1000000;
+  int32_t max_workers = JobSystem::GetCoreCount(ndk_helper::CORE_CLASS_ANY);
+  int32_t rounds = 100000;
+  int c;
+  while ((c = getopt(argc, argv, "n:m:w:s:")) != -1) {
+    switch (c) {
+      case 'n':
+        jobs = atoi(optarg);
+        break;
+      case 'm':
+        elements = atoi(optarg);
+        break;
+      case 'w':
+        max_workers = atoi(optarg);
+        break;
+      case 's':
+        rounds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "usage: %s [-n jobs] [-m elements] [-w workers] [-s rounds]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (max_workers < 1) max_workers = 1;
+
+  std::vector<float> values(elements > 0 ? elements : 1);
+  double serial_ms = 0.0;
+  for (int32_t workers = 1;; workers *= 2) {
+    if (workers > max_workers) workers = max_workers;
+    if (!Start(workers)) {
+      fprintf(stderr, "unable to start %d workers\n", workers);
+      return 1;
+    }
+    CheckJobs(workers);
+    StressParallelFor(rounds, workers);
+    double spawn_ns = BenchSpawn(jobs);
+    for (size_t i = 0; i < values.size(); ++i) values[i] = (float)i;
+    double ms = BenchScaling(values);
+    if (workers == 1) serial_ms = ms;
+    printf("%2d workers: spawn+wait %.1f ns/job, %d elements in %.2f ms "
+           "(%.2fx)\n",
+           workers, spawn_ns, (int32_t)values.size(), ms,
+           ms > 0.0 ? serial_ms / ms : 0.0);
+    JobSystem::GetInstance()->Shutdown();
+    if (workers == max_workers) break;
+  }
+
+  if (errors) {
+    fprintf(stderr, "%d checks failed\n", errors);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,419 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jobSystem.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace ndk_helper {
+
+// Jobs per worker pool, power of two
+static const uint32_t kJobPoolSize = 2048;
+// Idle rounds before a worker goes to sleep
+static const int32_t kSpinCount = 64;
+static const int32_t kMaxCpus = 64;
+// JobCounter states while the last job of a group finishes. Jobs added to the
+// group meanwhile count on top of them.
+static const int32_t kCounterCompleting = 0x40000000;
+static const int32_t kCounterDispatched = 0x20000000;
+
+// Index of the worker running on this thread, -1 for other threads
+static thread_local int32_t t_worker_index = -1;
+
+//---------------------------------------------------------------------------
+// WorkStealingDeque
+//---------------------------------------------------------------------------
+WorkStealingDeque::WorkStealingDeque() : top_(0), bottom_(0) {
+  for (int64_t i = 0; i < kCapacity; ++i)
+    buffer_[i].store(NULL, std::memory_order_relaxed);
+}
+
+bool WorkStealingDeque::Push(Job* job) {
+  int64_t b = bottom_.load(std::memory_order_relaxed);
+  int64_t t = top_.load(std::memory_order_acquire);
+  if (b - t >= kCapacity) return false;
+  buffer_[b & (kCapacity - 1)].store(job, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(b + 1, std::memory_order_relaxed);
+  return true;
+}
+
+Job* WorkStealingDeque::Pop() {
+  int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    // Empty
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return NULL;
+  }
+  Job* job = buffer_[b & (kCapacity - 1)].load(std::memory_order_relaxed);
+  if (t == b) {
+    // Last element, race against thieves
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      job = NULL;
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+Job* WorkStealingDeque::Steal() {
+  int64_t t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom_.load(std::memory_order_acquire);
+  if (t >= b) return NULL;
+
+  Job* job = buffer_[t & (kCapacity - 1)].load(std::memory_order_relaxed);
+  if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed))
+    return NULL;
+  return job;
+}
+
+//---------------------------------------------------------------------------
+// Core detection
+//---------------------------------------------------------------------------
+static int32_t GetCpuCount() {
+  long count = sysconf(_SC_NPROCESSORS_CONF);
+  if (count < 1) return 1;
+  return count > kMaxCpus ? kMaxCpus : (int32_t)count;
+}
+
+/*
+ * Returns the mask of the cores with the highest max frequency. Cores are
+ * treated as all big when cpufreq isn't readable.
+ */
+static uint64_t DetectBigCores(int32_t cpu_count) {
+  uint64_t all = cpu_count >= 64 ? ~0ULL : ((1ULL << cpu_count) - 1);
+  long max_freqs[kMaxCpus];
+  long highest = 0;
+  for (int32_t i = 0; i < cpu_count; ++i) {
+    char path[128];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", i);
+    max_freqs[i] = 0;
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) return all;
+    if (fscanf(fp, "%ld", &max_freqs[i]) != 1) max_freqs[i] = 0;
+    fclose(fp);
+    if (max_freqs[i] > highest) highest = max_freqs[i];
+  }
+
+  uint64_t mask = 0;
+  for (int32_t i = 0; i < cpu_count; ++i) {
+    if (max_freqs[i] == highest) mask |= 1ULL << i;
+  }
+  return mask ? mask : all;
+}
+
+static uint64_t GetCoreMask(CORE_CLASS core_class, uint64_t big_core_mask) {
+  int32_t cpu_count = GetCpuCount();
+  uint64_t all = cpu_count >= 64 ? ~0ULL : ((1ULL << cpu_count) - 1);
+  uint64_t big = big_core_mask ? (big_core_mask & all)
+                               : DetectBigCores(cpu_count);
+  if (big == 0) big = all;
+
+  switch (core_class) {
+    case CORE_CLASS_BIG:
+      return big;
+    case CORE_CLASS_LITTLE:
+      // Homogeneous SoC, every core is a "little" one too
+      return (all & ~big) ? (all & ~big) : all;
+    default:
+      return all;
+  }
+}
+
+static int32_t CountBits(uint64_t mask) {
+  int32_t count = 0;
+  for (; mask; mask &= mask - 1) ++count;
+  return count;
+}
+
+int32_t JobSystem::GetCoreCount(CORE_CLASS core_class,
+                                uint64_t big_core_mask) {
+  return CountBits(GetCoreMask(core_class, big_core_mask));
+}
+
+//---------------------------------------------------------------------------
+// Singleton
+//---------------------------------------------------------------------------
+JobSystem* JobSystem::GetInstance() {
+  static JobSystem job_system;
+  return &job_system;
+}
+
+//---------------------------------------------------------------------------
+// Ctor
+//---------------------------------------------------------------------------
+JobSystem::JobSystem()
+    : worker_count_(0), pending_(0), sleeping_(0), quit_(false) {}
+
+//---------------------------------------------------------------------------
+// Dtor
+//---------------------------------------------------------------------------
+JobSystem::~JobSystem() { Shutdown(); }
+
+bool JobSystem::Init(const JobSystemConfig& config) {
+  if (IsInitialized()) return true;
+
+  uint64_t cpu_mask = 0;
+  if (config.affinity != CORE_CLASS_ANY)
+    cpu_mask = GetCoreMask(config.affinity, config.big_core_mask);
+
+  worker_count_ = config.worker_count;
+  if (worker_count_ <= 0)
+    worker_count_ = GetCoreCount(config.affinity, config.big_core_mask);
+  if (worker_count_ <= 0) worker_count_ = 1;
+
+  quit_ = false;
+  pending_ = 0;
+  sleeping_ = 0;
+  for (int32_t i = 0; i < worker_count_; ++i) {
+    Worker* worker = new Worker();
+    worker->pool = new Job[kJobPoolSize];
+    for (uint32_t j = 0; j < kJobPoolSize; ++j)
+      worker->pool[j].busy.store(false, std::memory_order_relaxed);
+    worker->pool_index = 0;
+    workers_.push_back(worker);
+  }
+
+  // The calling thread is worker 0 but keeps its own affinity
+  t_worker_index = 0;
+  for (int32_t i = 1; i < worker_count_; ++i) {
+    threads_.push_back(
+        std::thread(&JobSystem::WorkerLoop, this, i, cpu_mask));
+  }
+  return true;
+}
+
+void JobSystem::Shutdown() {
+  if (!IsInitialized()) return;
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    quit_ = true;
+  }
+  sleep_cond_.notify_all();
+  for (size_t i = 0; i < threads_.size(); ++i) threads_[i].join();
+  threads_.clear();
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    delete[] workers_[i]->pool;
+    delete workers_[i];
+  }
+  workers_.clear();
+  injection_queue_.clear();
+  worker_count_ = 0;
+  t_worker_index = -1;
+}
+
+//---------------------------------------------------------------------------
+// Job allocation
+//---------------------------------------------------------------------------
+Job* JobSystem::AllocateJob() {
+  int32_t index = t_worker_index;
+  if (index >= 0 && index < (int32_t)workers_.size()) {
+    Worker* worker = workers_[index];
+    Job* job = &worker->pool[worker->pool_index++ & (kJobPoolSize - 1)];
+    if (!job->busy.load(std::memory_order_acquire)) {
+      job->busy.store(true, std::memory_order_relaxed);
+      job->heap_allocated = false;
+      return job;
+    }
+  }
+  // Foreign thread or the pool wrapped onto a job still in flight
+  Job* job = new Job();
+  job->busy.store(true, std::memory_order_relaxed);
+  job->heap_allocated = true;
+  return job;
+}
+
+void JobSystem::FreeJob(Job* job) {
+  job->destructor(job);
+  if (job->heap_allocated) {
+    delete job;
+  } else {
+    job->busy.store(false, std::memory_order_release);
+  }
+}
+
+//---------------------------------------------------------------------------
+// Scheduling
+//---------------------------------------------------------------------------
+void JobSystem::Submit(Job* job) {
+  if (!IsInitialized()) {
+    // No workers, run synchronously
+    Execute(job);
+    return;
+  }
+
+  int32_t index = t_worker_index;
+  if (index >= 0 && index < (int32_t)workers_.size()) {
+    if (!workers_[index]->deque.Push(job)) {
+      // Deque is full, running it here keeps the order of magnitude of
+      // outstanding work bounded
+      Execute(job);
+      return;
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(injection_mutex_);
+    injection_queue_.push_back(job);
+  }
+  pending_.fetch_add(1, std::memory_order_seq_cst);
+  NotifyWorkers();
+}
+
+void JobSystem::NotifyWorkers() {
+  if (sleeping_.load(std::memory_order_seq_cst) > 0) {
+    // Take the lock so the wakeup can't slip in between a worker checking
+    // its predicate and going to sleep
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    sleep_cond_.notify_one();
+  }
+}
+
+Job* JobSystem::FindJob(int32_t worker_index) {
+  Job* job = NULL;
+  int32_t count = (int32_t)workers_.size();
+  if (worker_index >= 0 && worker_index < count)
+    job = workers_[worker_index]->deque.Pop();
+
+  if (job == NULL) {
+    std::lock_guard<std::mutex> lock(injection_mutex_);
+    if (!injection_queue_.empty()) {
+      job = injection_queue_.front();
+      injection_queue_.pop_front();
+    }
+  }
+
+  if (job == NULL && count > 1) {
+    // Start stealing next to ourselves so thieves spread over the victims
+    int32_t start = worker_index >= 0 ? worker_index + 1 : 0;
+    for (int32_t i = 0; i < count && job == NULL; ++i) {
+      int32_t victim = (start + i) % count;
+      if (victim == worker_index) continue;
+      job = workers_[victim]->deque.Steal();
+    }
+  }
+
+  if (job != NULL) pending_.fetch_sub(1, std::memory_order_relaxed);
+  return job;
+}
+
+void JobSystem::Execute(Job* job) {
+  JobCounter* counter = job->counter;
+  job->function(job);
+  FreeJob(job);
+  Complete(counter);
+}
+
+void JobSystem::Complete(JobCounter* counter) {
+  if (counter == NULL) return;
+  int32_t count = counter->count_.load(std::memory_order_relaxed);
+  do {
+    if (count == 1) {
+      // Last job. Keep the count non-zero until we're done with the counter,
+      // a waiter may destroy it as soon as it reads zero.
+      if (!counter->count_.compare_exchange_weak(count, kCounterCompleting,
+                                                 std::memory_order_acq_rel))
+        continue;
+      std::vector<Job*> continuations;
+      {
+        std::lock_guard<std::mutex> lock(counter->mutex_);
+        continuations.swap(counter->continuations_);
+        counter->count_.fetch_sub(kCounterCompleting - kCounterDispatched,
+                                  std::memory_order_relaxed);
+      }
+      // Subtract rather than store, a job spawned into the group meanwhile
+      // must keep it from reaching zero
+      counter->count_.fetch_sub(kCounterDispatched, std::memory_order_acq_rel);
+      for (size_t i = 0; i < continuations.size(); ++i)
+        Submit(continuations[i]);
+      return;
+    }
+  } while (!counter->count_.compare_exchange_weak(
+      count, count - 1, std::memory_order_acq_rel));
+}
+
+bool JobSystem::AddContinuation(JobCounter* dependency, Job* job) {
+  if (dependency == NULL) return false;
+  std::lock_guard<std::mutex> lock(dependency->mutex_);
+  int32_t count = dependency->count_.load(std::memory_order_acquire);
+  // Continuations were already handed out, run it right away
+  if (count == 0 || (count >= kCounterDispatched && count < kCounterCompleting))
+    return false;
+  dependency->continuations_.push_back(job);
+  return true;
+}
+
+void JobSystem::Wait(JobCounter* counter) {
+  if (counter == NULL) return;
+  while (!counter->IsDone()) {
+    Job* job = IsInitialized() ? FindJob(t_worker_index) : NULL;
+    if (job != NULL) {
+      Execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+// Worker thread
+//---------------------------------------------------------------------------
+void JobSystem::WorkerLoop(int32_t worker_index, uint64_t cpu_mask) {
+  t_worker_index = worker_index;
+  if (cpu_mask) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int32_t i = 0; i < kMaxCpus; ++i) {
+      if (cpu_mask & (1ULL << i)) CPU_SET(i, &set);
+    }
+    // Best effort, the scheduler may still move us if the cores go offline
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+
+  int32_t idle = 0;
+  while (!quit_.load(std::memory_order_relaxed)) {
+    Job* job = FindJob(worker_index);
+    if (job != NULL) {
+      Execute(job);
+      idle = 0;
+      continue;
+    }
+    if (++idle < kSpinCount) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    sleep_cond_.wait(lock, [this] {
+      return quit_.load(std::memory_order_relaxed) ||
+             pending_.load(std::memory_order_seq_cst) > 0;
+    });
+    sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    idle = 0;
+  }
+  t_worker_index = -1;
+}
+
+}  // namespace ndk_helper
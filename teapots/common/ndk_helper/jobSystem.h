@@ -0,0 +1,262 @@
+/*
+ * Copyright 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef JOBSYSTEM_H_
+#define JOBSYSTEM_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ndk_helper {
+
+class JobSystem;
+
+/*
+ * Core classes on heterogeneous (big.LITTLE) SoCs
+ */
+enum CORE_CLASS {
+  CORE_CLASS_ANY,
+  CORE_CLASS_BIG,
+  CORE_CLASS_LITTLE,
+};
+
+const int32_t kJobDataSize = 64;
+
+/******************************************************************
+ * Unit of work. The callable is stored inline, so spawning a job doesn't
+ * allocate.
+ */
+struct Job {
+  void (*function)(Job* job);
+  void (*destructor)(Job* job);
+  class JobCounter* counter;
+  bool heap_allocated;
+  std::atomic<bool> busy;
+  std::aligned_storage<kJobDataSize, 16>::type data;
+};
+
+/******************************************************************
+ * Tracks completion of a group of jobs.
+ * Jobs passed to JobSystem::RunAfter() are held back until the counter
+ * reaches zero, which expresses dependencies between groups.
+ */
+class JobCounter {
+ public:
+  JobCounter() : count_(0) {}
+
+  bool IsDone() const { return count_.load(std::memory_order_acquire) == 0; }
+
+ private:
+  friend class JobSystem;
+  JobCounter(const JobCounter& rhs);
+  JobCounter& operator=(const JobCounter& rhs);
+
+  std::atomic<int32_t> count_;
+  std::mutex mutex_;
+  std::vector<Job*> continuations_;
+};
+
+/******************************************************************
+ * Fixed size Chase-Lev work stealing deque.
+ * The owner thread pushes and pops at the bottom, other threads steal from
+ * the top. Memory ordering follows Le et al., "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (PPoPP 2013).
+ */
+class WorkStealingDeque {
+ public:
+  static const int64_t kCapacity = 4096;
+
+  WorkStealingDeque();
+
+  bool Push(Job* job);  // owner only, false when full
+  Job* Pop();           // owner only
+  Job* Steal();         // any thread
+
+ private:
+  std::atomic<int64_t> top_;
+  std::atomic<int64_t> bottom_;
+  std::atomic<Job*> buffer_[kCapacity];
+};
+
+struct JobSystemConfig {
+  // Number of worker threads, including the thread calling Init(). 0 selects
+  // one per core of the requested class.
+  int32_t worker_count;
+  // Pin workers to given core class
+  CORE_CLASS affinity;
+  // CPU mask of the big cores. 0 detects them from cpufreq; set it to
+  // simulate a big.LITTLE topology on a homogeneous host.
+  uint64_t big_core_mask;
+
+  JobSystemConfig()
+      : worker_count(0), affinity(CORE_CLASS_ANY), big_core_mask(0) {}
+};
+
+/******************************************************************
+ * Work stealing job system
+ * Each worker owns a WorkStealingDeque; idle workers steal from the others.
+ * The thread that calls Init() becomes worker 0 and executes jobs while it
+ * waits in Wait(). Other threads may spawn jobs too, those go through a
+ * shared queue.
+ *
+ * Usage:
+ *   ndk_helper::JobCounter counter;
+ *   job_system->ParallelFor(0, count, 64,
+ *                           [&](int32_t begin, int32_t end) { ... },
+ *                           &counter);
+ *   job_system->Wait(&counter);
+ */
+class JobSystem {
+ public:
+  static JobSystem* GetInstance();
+
+  bool Init(const JobSystemConfig& config = JobSystemConfig());
+  void Shutdown();
+  bool IsInitialized() const { return !workers_.empty(); }
+
+  int32_t GetWorkerCount() const { return worker_count_; }
+
+  /*
+   * Spawn a job. counter, when given, is incremented now and decremented once
+   * the job finished.
+   */
+  template <typename F>
+  void Run(F&& function, JobCounter* counter = NULL) {
+    Submit(CreateJob(std::forward<F>(function), counter));
+  }
+
+  /*
+   * Spawn a job once dependency reached zero.
+   */
+  template <typename F>
+  void RunAfter(JobCounter* dependency, F&& function,
+                JobCounter* counter = NULL) {
+    Job* job = CreateJob(std::forward<F>(function), counter);
+    if (!AddContinuation(dependency, job)) Submit(job);
+  }
+
+  /*
+   * Call function(begin, end) over [begin, end) in chunks of at most grain
+   * elements. The range is split recursively so idle workers steal large
+   * halves first. The calling thread runs the first chunk itself; function
+   * must stay alive until Wait(counter) returns.
+   */
+  template <typename F>
+  void ParallelFor(int32_t begin, int32_t end, int32_t grain, const F& function,
+                   JobCounter* counter) {
+    if (begin >= end) return;
+    // The caller holds a count of its own while it spawns, so halves that
+    // finish early can't take the counter to zero before the last is spawned
+    if (counter) counter->count_.fetch_add(1, std::memory_order_relaxed);
+    SpawnRange(begin, end, grain < 1 ? 1 : grain, &function, counter);
+    Complete(counter);
+  }
+
+  /*
+   * Wait until counter reaches zero. Worker threads (and the Init() thread)
+   * run other jobs while waiting.
+   */
+  void Wait(JobCounter* counter);
+
+  static int32_t GetCoreCount(CORE_CLASS core_class,
+                              uint64_t big_core_mask = 0);
+
+ private:
+  JobSystem();
+  ~JobSystem();
+  JobSystem(const JobSystem& rhs);
+  JobSystem& operator=(const JobSystem& rhs);
+
+  template <typename F>
+  static void Invoke(Job* job) {
+    (*reinterpret_cast<F*>(&job->data))();
+  }
+
+  template <typename F>
+  static void Destroy(Job* job) {
+    reinterpret_cast<F*>(&job->data)->~F();
+  }
+
+  template <typename F>
+  Job* CreateJob(F&& function, JobCounter* counter) {
+    typedef typename std::decay<F>::type Function;
+    static_assert(sizeof(Function) <= kJobDataSize,
+                  "Job captures too much state, capture by reference");
+    Job* job = AllocateJob();
+    new (&job->data) Function(std::forward<F>(function));
+    job->function = &Invoke<Function>;
+    job->destructor = &Destroy<Function>;
+    job->counter = counter;
+    if (counter) counter->count_.fetch_add(1, std::memory_order_relaxed);
+    return job;
+  }
+
+  template <typename F>
+  void SpawnRange(int32_t begin, int32_t end, int32_t grain, const F* function,
+                  JobCounter* counter) {
+    // Hand the upper halves to other workers, keep the lowest chunk
+    while (end - begin > grain) {
+      int32_t middle = begin + (end - begin) / 2;
+      Run([this, middle, end, grain, function, counter]() {
+            SpawnRange(middle, end, grain, function, counter);
+          },
+          counter);
+      end = middle;
+    }
+    (*function)(begin, end);
+  }
+
+  Job* AllocateJob();
+  void FreeJob(Job* job);
+  void Submit(Job* job);
+  void Execute(Job* job);
+  void Complete(JobCounter* counter);
+  bool AddContinuation(JobCounter* dependency, Job* job);
+  Job* FindJob(int32_t worker_index);
+  void WorkerLoop(int32_t worker_index, uint64_t cpu_mask);
+  void NotifyWorkers();
+
+  struct Worker {
+    WorkStealingDeque deque;
+    Job* pool;
+    uint32_t pool_index;
+  };
+
+  std::vector<Worker*> workers_;
+  std::vector<std::thread> threads_;
+  int32_t worker_count_;
+
+  // Jobs from threads that aren't workers
+  std::mutex injection_mutex_;
+  std::deque<Job*> injection_queue_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cond_;
+  std::atomic<int32_t> pending_;
+  std::atomic<int32_t> sleeping_;
+  std::atomic<bool> quit_;
+};
+
+}  // namespace ndk_helper
+#endif /* JOBSYSTEM_H_ */
@@ -21,38 +21,36 @@
 #include <errno.h>
 #include <time.h>
 #include "JNIHelper.h"
+#include "frameStats.h"
 
 namespace ndk_helper {
 
-const int32_t kNumSamples = 100;
-
 /******************************************************************
  * Helper class for a performance monitoring and get current tick time
+ * Frame intervals are measured on a monotonic clock and accumulated in a
+ * FrameStats instance; use GetFrameStats() to time frame phases, query
+ * percentiles or enable the CSV/JSON export.
  */
 class PerfMonitor {
  private:
   float current_FPS_;
-  time_t tv_last_sec_;
-
-  double last_tick_;
-  int32_t tickindex_;
-  double ticksum_;
-  double ticklist_[kNumSamples];
-
-  double UpdateTick(double current_tick);
+  int64_t last_report_ns_;
+  FrameStats frame_stats_;
 
  public:
   PerfMonitor();
   virtual ~PerfMonitor();
 
+  /*
+   * Call once per frame. Returns true once per second with the average FPS
+   * of the last second in fFPS, after the window was flushed to the export
+   * stream.
+   */
   bool Update(float &fFPS);
 
-  static double GetCurrentTime() {
-    struct timeval time;
-    gettimeofday(&time, NULL);
-    double ret = time.tv_sec + time.tv_usec * 1.0 / 1000000.0;
-    return ret;
-  }
+  FrameStats &GetFrameStats() { return frame_stats_; }
+
+  static double GetCurrentTime() { return GetMonotonicTimeNs() * 1e-9; }
 };
 
 }  // namespace ndkHelper
@@ -27,15 +27,15 @@ namespace ndk_helper {
 bool shader::CompileShader(
     GLuint *shader, const GLenum type, const char *str_file_name,
     const std::map<std::string, std::string> &map_parameters) {
-  std::vector<uint8_t> data;
-  if (!JNIHelper::GetInstance()->ReadFile(str_file_name, &data)) {
+  AssetSpan data = JNIHelper::GetInstance()->MapFile(str_file_name);
+  if (!data.IsValid()) {
     LOGI("Can not open a file:%s", str_file_name);
     return false;
   }
 
   const char REPLACEMENT_TAG = '*';
   // Fill-in parameters
-  std::string str(data.begin(), data.end());
+  std::string str(data.data(), data.data() + data.size());
   std::string str_replacement_map(data.size(), ' ');
 
   std::map<std::string, std::string>::const_iterator it =
@@ -110,14 +110,14 @@ bool shader::CompileShader(GLuint *shader, const GLenum type,
 
 bool shader::CompileShader(GLuint *shader, const GLenum type,
                            const char *strFileName) {
-  std::vector<uint8_t> data;
-  bool b = JNIHelper::GetInstance()->ReadFile(strFileName, &data);
-  if (!b) {
+  AssetSpan data = JNIHelper::GetInstance()->MapFile(strFileName);
+  if (!data.IsValid()) {
     LOGI("Can not open a file:%s", strFileName);
     return false;
   }
 
-  return shader::CompileShader(shader, type, data);
+  return shader::CompileShader(shader, type, (const GLchar *)data.data(),
+                               (int32_t)data.size());
 }
 
 bool shader::LinkProgram(const GLuint prog) {
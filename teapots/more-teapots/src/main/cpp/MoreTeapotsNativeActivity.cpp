@@ -179,13 +179,20 @@ void Engine::DrawFrame() {
   if (monitor_.Update(fps)) {
     UpdateFPS(fps);
   }
-  double dTime = monitor_.GetCurrentTime();
-  renderer_.Update(dTime);
+  ndk_helper::FrameStats& stats = monitor_.GetFrameStats();
+  {
+    ndk_helper::ScopedFramePhase phase(stats, ndk_helper::FRAME_PHASE_UPDATE);
+    double dTime = monitor_.GetCurrentTime();
+    renderer_.Update(dTime);
+  }
 
   // Just fill the screen with a color.
-  glClearColor(0.5f, 0.5f, 0.5f, 1.f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  renderer_.Render();
+  {
+    ndk_helper::ScopedFramePhase phase(stats, ndk_helper::FRAME_PHASE_SUBMIT);
+    glClearColor(0.5f, 0.5f, 0.5f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    renderer_.Render();
+  }
 
   // Swap
   if (EGL_SUCCESS != gl_context_->Swap()) {
@@ -202,6 +209,8 @@ void Engine::TermDisplay() { gl_context_->Suspend(); }
 void Engine::TrimMemory() {
   LOGI("Trimming memory");
   gl_context_->Invalidate();
+  // Shaders are mapped again on the next context, drop what nobody holds
+  ndk_helper::AssetCache::GetInstance()->Purge();
 }
 /**
  * Process the next input event.
@@ -404,6 +413,15 @@ void android_main(android_app* state) {
   // Init helper functions
   ndk_helper::JNIHelper::GetInstance()->Init(state->activity,
                                              HELPER_CLASS_NAME);
+  // Map the shaders while the window comes up, compiling them then reads
+  // memory instead of the APK
+  ndk_helper::AssetCache::GetInstance()->Prefetch({
+      "Shaders/VS_ShaderPlainES3.vsh", "Shaders/ShaderPlainES3.fsh",
+      "Shaders/VS_ShaderPlain.vsh", "Shaders/ShaderPlain.fsh"});
+
+  // This thread becomes worker 0 of the job system, the renderer spreads
+  // per-instance matrix updates over the other cores
+  ndk_helper::JobSystem::GetInstance()->Init();
 
   state->userData = &g_engine;
   state->onAppCmd = Engine::HandleCmd;
@@ -436,6 +454,7 @@ void android_main(android_app* state) {
       // Check if we are exiting.
       if (state->destroyRequested != 0) {
         g_engine.TermDisplay();
+        ndk_helper::JobSystem::GetInstance()->Shutdown();
         return;
       }
     }
@@ -30,6 +30,9 @@
 //--------------------------------------------------------------------------------
 #include "teapot.inl"
 
+// Instances per job when filling the instancing UBO
+static const int32_t kMatrixUpdateGrain = 64;
+
 //--------------------------------------------------------------------------------
 // Ctor
 //--------------------------------------------------------------------------------
@@ -257,6 +260,29 @@ void MoreTeapotsRenderer::Update(float fTime) {
   }
 }
 
+//--------------------------------------------------------------------------------
+// UpdateInstanceMatrices
+//--------------------------------------------------------------------------------
+void MoreTeapotsRenderer::UpdateInstanceMatrices(int32_t begin, int32_t end,
+                                                 float* mat_mvp,
+                                                 float* mat_mv) {
+  for (int32_t i = begin; i < end; ++i) {
+    // Rotation
+    float x, y;
+    vec_current_rotations_[i] += vec_rotations_[i];
+    vec_current_rotations_[i].Value(x, y);
+    ndk_helper::Mat4 mat_rotation =
+        ndk_helper::Mat4::RotationX(x) * ndk_helper::Mat4::RotationY(y);
+
+    // Feed Projection and Model View matrices to the shaders
+    ndk_helper::Mat4 mat_v = mat_view_ * vec_mat_models_[i] * mat_rotation;
+    ndk_helper::Mat4 mat_vp = mat_projection_ * mat_v;
+
+    memcpy(mat_mvp + i * ubo_matrix_stride_, mat_vp.Ptr(), sizeof(mat_v));
+    memcpy(mat_mv + i * ubo_matrix_stride_, mat_v.Ptr(), sizeof(mat_v));
+  }
+}
+
 //--------------------------------------------------------------------------------
 // Render
 //--------------------------------------------------------------------------------
@@ -306,24 +332,16 @@ void MoreTeapotsRenderer::Render() {
         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
     float* mat_mvp = p;
     float* mat_mv = p + teapot_x_ * teapot_y_ * teapot_z_ * ubo_matrix_stride_;
-    for (int32_t i = 0; i < teapot_x_ * teapot_y_ * teapot_z_; ++i) {
-      // Rotation
-      float x, y;
-      vec_current_rotations_[i] += vec_rotations_[i];
-      vec_current_rotations_[i].Value(x, y);
-      ndk_helper::Mat4 mat_rotation =
-          ndk_helper::Mat4::RotationX(x) * ndk_helper::Mat4::RotationY(y);
-
-      // Feed Projection and Model View matrices to the shaders
-      ndk_helper::Mat4 mat_v = mat_view_ * vec_mat_models_[i] * mat_rotation;
-      ndk_helper::Mat4 mat_vp = mat_projection_ * mat_v;
-
-      memcpy(mat_mvp, mat_vp.Ptr(), sizeof(mat_v));
-      mat_mvp += ubo_matrix_stride_;
-
-      memcpy(mat_mv, mat_v.Ptr(), sizeof(mat_v));
-      mat_mv += ubo_matrix_stride_;
-    }
+    // Instances write disjoint slots of the mapped buffer, fill them in
+    // parallel
+    ndk_helper::JobCounter counter;
+    ndk_helper::JobSystem::GetInstance()->ParallelFor(
+        0, teapot_x_ * teapot_y_ * teapot_z_, kMatrixUpdateGrain,
+        [this, mat_mvp, mat_mv](int32_t begin, int32_t end) {
+          UpdateInstanceMatrices(begin, end, mat_mvp, mat_mv);
+        },
+        &counter);
+    ndk_helper::JobSystem::GetInstance()->Wait(&counter);
     glUnmapBuffer(GL_UNIFORM_BUFFER);
 
     // Instanced rendering
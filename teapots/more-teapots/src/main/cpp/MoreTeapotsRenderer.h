@@ -104,6 +104,8 @@ class MoreTeapotsRenderer {
   bool arb_support_;
 
   std::string ToString(const int32_t i);
+  void UpdateInstanceMatrices(int32_t begin, int32_t end, float* mat_mvp,
+                              float* mat_mv);
 
  public:
   MoreTeapotsRenderer();
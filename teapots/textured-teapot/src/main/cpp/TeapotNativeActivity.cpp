@@ -107,7 +107,8 @@ Engine::~Engine() {}
  * Load resources
  */
 void Engine::LoadResources() {
-  renderer_.Init(app_->activity->assetManager);
+  renderer_.Init(app_->activity->assetManager,
+                 app_->activity->internalDataPath);
   renderer_.Bind(&tap_camera_);
 }
 
@@ -170,12 +171,19 @@ void Engine::DrawFrame() {
   if (monitor_.Update(fps)) {
     UpdateFPS(fps);
   }
-  renderer_.Update(monitor_.GetCurrentTime());
+  ndk_helper::FrameStats& stats = monitor_.GetFrameStats();
+  {
+    ndk_helper::ScopedFramePhase phase(stats, ndk_helper::FRAME_PHASE_UPDATE);
+    renderer_.Update(monitor_.GetCurrentTime());
+  }
 
   // Just fill the screen with a color.
-  glClearColor(0.5f, 0.5f, 0.5f, 1.f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  renderer_.Render();
+  {
+    ndk_helper::ScopedFramePhase phase(stats, ndk_helper::FRAME_PHASE_SUBMIT);
+    glClearColor(0.5f, 0.5f, 0.5f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    renderer_.Render();
+  }
 
   // Swap
   if (EGL_SUCCESS != gl_context_->Swap()) {
@@ -192,6 +200,8 @@ void Engine::TermDisplay() { gl_context_->Suspend(); }
 void Engine::TrimMemory() {
   LOGI("Trimming memory");
   gl_context_->Invalidate();
+  // Shaders are mapped again on the next context, drop what nobody holds
+  ndk_helper::AssetCache::GetInstance()->Purge();
 }
 /**
  * Process the next input event.
@@ -393,6 +403,12 @@ void android_main(android_app* state) {
 
   // Init helper functions
   ndk_helper::JNIHelper::Init(state->activity, HELPER_CLASS_NAME);
+  // Map the shaders while the window comes up, compiling them then reads
+  // memory instead of the APK
+  ndk_helper::AssetCache::GetInstance()->Prefetch({
+      "Shaders/Cubemap.vsh", "Shaders/Cubemap.fsh", "Shaders/2DTexture.vsh",
+      "Shaders/2DTexture.fsh", "Shaders/VS_ShaderPlain.vsh",
+      "Shaders/ShaderPlain.fsh"});
 
   state->userData = &g_engine;
   state->onAppCmd = Engine::HandleCmd;
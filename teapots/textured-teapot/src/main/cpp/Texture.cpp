@@ -16,10 +16,9 @@
 
 #include "Texture.h"
 #include <GLES3/gl32.h>
+#include <cassert>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-#include "AssetUtil.h"
+#include "TextureLoader.h"
 
 #define MODULE_NAME "Teapot::Texture"
 #include "android_debug.h"
@@ -31,14 +30,17 @@ class TextureCubemap :public Texture {
 protected:
     GLuint texId_ = GL_INVALID_VALUE;
     bool activated_ = false;
+    // In-flight decodes, indexed by cube face
+    std::vector<std::shared_ptr<TextureRequest>> faces_;
 
 public:
     virtual ~TextureCubemap();
     TextureCubemap(std::vector<std::string>& texFiles,
-                   AAssetManager* assetManager);
+                   AAssetManager* assetManager, const std::string& cacheDir);
     virtual bool GetActiveSamplerInfo(std::vector<std::string>& names,
                                       std::vector<GLint>& units);
     virtual bool Activate(void);
+    virtual bool Update(void);
     virtual GLuint GetTexType();
     virtual GLuint GetTexId();
 };
@@ -47,17 +49,31 @@ class Texture2d :public Texture {
 protected:
     GLuint texId_ = GL_INVALID_VALUE;
     bool activated_ = false;
+    std::shared_ptr<TextureRequest> image_;
 public:
     virtual ~Texture2d();
     // Implement just one texture
-    Texture2d(std::string &texFiles, AAssetManager* assetManager);
+    Texture2d(std::string &texFiles, AAssetManager* assetManager,
+              const std::string& cacheDir);
     virtual bool GetActiveSamplerInfo(std::vector<std::string>& names,
                                       std::vector<GLint>& units);
     virtual bool Activate(void);
+    virtual bool Update(void);
     virtual GLuint GetTexType();
     virtual GLuint GetTexId();
 };
 
+/**
+ * Upload every level of a decoded image into the given target
+ */
+static void UploadImage(GLenum target, const TextureImage& image) {
+    for (size_t level = 0; level < image.levels.size(); level++) {
+        glTexImage2D(target, static_cast<GLint>(level), GL_RGBA,
+                     image.LevelWidth(level), image.LevelHeight(level),
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, image.levels[level].data());
+    }
+}
+
 /**
  * Capability debug string
  */
@@ -74,14 +90,18 @@ Texture::~Texture() {}
  * @param texFiles holds the texture file name(s) under APK's assets
  * @param type should be one (GL_TEXTURE_2D / GL_TEXTURE_CUBE_MAP)
  * @param assetManager is used to open texture files inside assets
+ * @param cacheDir is where decoded images are cached, may be empty
  * @return is the newly created Texture Object
  */
 Texture* Texture::Create( GLuint type, std::vector<std::string>& texFiles,
-                       AAssetManager* assetManager) {
+                       AAssetManager* assetManager,
+                       const std::string& cacheDir) {
     if (type == GL_TEXTURE_2D) {
-        return dynamic_cast<Texture*>(new Texture2d(texFiles[0], assetManager));
+        return dynamic_cast<Texture*>(
+            new Texture2d(texFiles[0], assetManager, cacheDir));
     } else if (type == GL_TEXTURE_CUBE_MAP) {
-        return dynamic_cast<Texture*>(new TextureCubemap(texFiles, assetManager));
+        return dynamic_cast<Texture*>(
+            new TextureCubemap(texFiles, assetManager, cacheDir));
     }
 
     LOGE("Unknow texture type %x to created", type);
@@ -139,13 +159,11 @@ GLuint TextureCubemap::GetTexId() {
 }
 
 TextureCubemap::TextureCubemap(std::vector<std::string> &files,
-                                    AAssetManager *mgr) {
+                               AAssetManager *mgr,
+                               const std::string& cacheDir) {
     // For Cubemap, we use world normal to sample the textures
     // so no texture vbo necessary
 
-    int32_t imgWidth, imgHeight, channelCount;
-    std::vector<uint8_t> fileBits;
-
     if (!mgr || files.size() != 6) {
         assert(false);
         return;
@@ -159,27 +177,15 @@ TextureCubemap::TextureCubemap(std::vector<std::string> &files,
         return;
     }
 
+    // Decode all six faces in parallel, Update() uploads them as they arrive
+    TextureLoader* loader = TextureLoader::GetInstance();
     for(GLuint i = 0; i < 6; i++) {
-        fileBits.clear();
-        AssetReadFile(mgr, files[i], fileBits);
-
-        // tga/bmp files are saved as vertical mirror images ( at least more than half ).
-        stbi_set_flip_vertically_on_load(1);
-
-        uint8_t* imageBits = stbi_load_from_memory(
-            fileBits.data(), fileBits.size(),
-            &imgWidth, &imgHeight, &channelCount, 4);
-
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                     0, GL_RGBA,
-                     imgWidth, imgHeight,
-                     0, GL_RGBA,
-                     GL_UNSIGNED_BYTE, imageBits);
-        stbi_image_free(imageBits);
+        faces_.push_back(loader->Load(mgr, files[i], cacheDir, true));
     }
 
     glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_REPEAT );
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_REPEAT );
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_REPEAT );
@@ -188,6 +194,27 @@ TextureCubemap::TextureCubemap(std::vector<std::string> &files,
     activated_ = true;
 }
 
+bool TextureCubemap::Update(void) {
+    bool done = true;
+    for(GLuint i = 0; i < faces_.size(); i++) {
+        if (!faces_[i]) {
+            continue;
+        }
+        if (!faces_[i]->IsReady()) {
+            done = false;
+            continue;
+        }
+        if (faces_[i]->Succeeded()) {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, texId_);
+            UploadImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faces_[i]->Image());
+        } else {
+            LOGE("Cubemap face %u failed to load", i);
+        }
+        faces_[i].reset();
+    }
+    return done;
+}
+
 /**
  * Dtor
  *    clean-up function
@@ -218,17 +245,14 @@ TextureCubemap::~TextureCubemap() {
 /**
  * Texture2D implementation
  */
-Texture2d::Texture2d(std::string& fileName, AAssetManager* assetManager)  {
+Texture2d::Texture2d(std::string& fileName, AAssetManager* assetManager,
+                     const std::string& cacheDir)  {
     if (!assetManager) {
         LOGE("AssetManager to Texture2D() could not be null!!!");
         assert(false);
         return;
     }
 
-    int32_t imgWidth, imgHeight, channelCount;
-    std::string texName(fileName);
-    std::vector<uint8_t> fileBits;
-
     glGenTextures(1, &texId_);
     glBindTexture(GL_TEXTURE_2D, texId_);
 
@@ -237,28 +261,33 @@ Texture2d::Texture2d(std::string& fileName, AAssetManager* assetManager)  {
         return;
     }
 
-    AssetReadFile(assetManager, texName, fileBits);
-
-    // tga/bmp files are saved as vertical mirror images ( at least more than half ).
-    stbi_set_flip_vertically_on_load(1);
-
-    uint8_t* imageBits = stbi_load_from_memory(
-            fileBits.data(), fileBits.size(),
-            &imgWidth, &imgHeight, &channelCount, 4);
-    glTexImage2D(GL_TEXTURE_2D, 0,  // mip level
-                 GL_RGBA,
-                 imgWidth, imgHeight,
-                 0,                // border color
-                 GL_RGBA, GL_UNSIGNED_BYTE, imageBits);
+    image_ = TextureLoader::GetInstance()->Load(assetManager, fileName,
+                                                cacheDir, true);
 
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
 
     glActiveTexture(GL_TEXTURE0);
+}
 
-    stbi_image_free(imageBits);
+bool Texture2d::Update(void) {
+    if (!image_) {
+        return true;
+    }
+    if (!image_->IsReady()) {
+        return false;
+    }
+    if (image_->Succeeded()) {
+        glBindTexture(GL_TEXTURE_2D, texId_);
+        UploadImage(GL_TEXTURE_2D, image_->Image());
+    } else {
+        LOGE("2D texture failed to load");
+    }
+    image_.reset();
+    return true;
 }
 
 Texture2d::~Texture2d() {
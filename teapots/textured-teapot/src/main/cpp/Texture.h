@@ -47,15 +47,26 @@ class Texture {
      *     2d texture uses the very first image texFiles[0]
      *     cube map needs 6 (direction of +x, -x, +y, -y, +z, -z)
      * @param assetManager Java side assetManager object
+     * @param cacheDir writable directory to keep decoded images in, so
+     *     later runs skip image decoding. Empty string disables the cache.
      * @return newly created texture object, or nullptr in case of errors
+     *
+     * Images are decoded on TextureLoader worker threads; call Update()
+     * from the GL thread to upload the ones that are ready.
      */
     static Texture* Create( GLuint type, std::vector<std::string>& texFiles,
-              AAssetManager* assetManager);
+              AAssetManager* assetManager,
+              const std::string& cacheDir = std::string());
     static void Delete(Texture *obj);
 
     virtual bool GetActiveSamplerInfo(std::vector<std::string> &names,
                                       std::vector<GLint> &units) = 0;
     virtual bool Activate(void) = 0;
+    /**
+     * Upload decoded images that became ready since the last call.
+     * @return true once every image is uploaded
+     */
+    virtual bool Update(void) = 0;
     virtual GLuint GetTexType() = 0;
     virtual GLuint GetTexId() = 0;
 
@@ -0,0 +1,369 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextureLoader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TEXTURE_LOADER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTURE_LOADER_SSE2 1
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#define MODULE_NAME "Teapot::TextureLoader"
+#include "android_debug.h"
+
+/**
+ * Cache container: header followed by tightly packed RGBA8888 mip levels.
+ * Entries are validated against the size and hash of the source asset, so
+ * an updated APK invalidates them automatically.
+ */
+static const uint32_t kCacheMagic = 0x31435854;  // "TXC1"
+static const uint32_t kCacheVersion = 1;
+// Larger than any GL_MAX_TEXTURE_SIZE, keeps the level sizes from overflowing
+static const int32_t kMaxCacheDimension = 16384;
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    uint32_t sourceHash;
+    int32_t width;
+    int32_t height;
+    int32_t levels;
+};
+
+static const uint32_t kMaxWorkers = 4;
+
+static uint32_t HashBytes(const uint8_t* data, size_t size) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start).count();
+}
+
+int32_t TextureImage::LevelWidth(int32_t level) const {
+    return std::max(width >> level, 1);
+}
+
+int32_t TextureImage::LevelHeight(int32_t level) const {
+    return std::max(height >> level, 1);
+}
+
+/**
+ * 2x2 box filter. SIMD paths average horizontally adjacent pixels first and
+ * then the two rows with rounding halving adds; the scalar path uses the same
+ * rounding so results (and cache files) match on every ABI.
+ */
+static inline uint8_t Average(uint8_t a, uint8_t b) {
+    return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+void DownsampleRGBA(const uint8_t* src, int32_t srcWidth, int32_t srcHeight,
+                    uint8_t* dst) {
+    const int32_t dstWidth = std::max(srcWidth / 2, 1);
+    const int32_t dstHeight = std::max(srcHeight / 2, 1);
+    const size_t srcStride = srcWidth * 4;
+
+    for (int32_t y = 0; y < dstHeight; y++) {
+        const uint8_t* row0 = src + (2 * y) * srcStride;
+        const uint8_t* row1 = src + std::min(2 * y + 1, srcHeight - 1) * srcStride;
+        uint8_t* out = dst + y * dstWidth * 4;
+        int32_t x = 0;
+
+        if (srcWidth > 1) {
+#if defined(TEXTURE_LOADER_NEON)
+            for (; x + 4 <= dstWidth; x += 4) {
+                uint32x4x2_t a = vld2q_u32(
+                    reinterpret_cast<const uint32_t*>(row0 + x * 8));
+                uint32x4x2_t b = vld2q_u32(
+                    reinterpret_cast<const uint32_t*>(row1 + x * 8));
+                uint8x16_t top = vrhaddq_u8(vreinterpretq_u8_u32(a.val[0]),
+                                            vreinterpretq_u8_u32(a.val[1]));
+                uint8x16_t bottom = vrhaddq_u8(vreinterpretq_u8_u32(b.val[0]),
+                                               vreinterpretq_u8_u32(b.val[1]));
+                vst1q_u8(out + x * 4, vrhaddq_u8(top, bottom));
+            }
+#elif defined(TEXTURE_LOADER_SSE2)
+            for (; x + 4 <= dstWidth; x += 4) {
+                __m128 a0 = _mm_castsi128_ps(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(row0 + x * 8)));
+                __m128 a1 = _mm_castsi128_ps(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(row0 + x * 8 + 16)));
+                __m128 b0 = _mm_castsi128_ps(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(row1 + x * 8)));
+                __m128 b1 = _mm_castsi128_ps(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(row1 + x * 8 + 16)));
+                __m128i top = _mm_avg_epu8(
+                    _mm_castps_si128(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0))),
+                    _mm_castps_si128(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1))));
+                __m128i bottom = _mm_avg_epu8(
+                    _mm_castps_si128(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0))),
+                    _mm_castps_si128(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1))));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4),
+                                 _mm_avg_epu8(top, bottom));
+            }
+#endif
+        }
+
+        for (; x < dstWidth; x++) {
+            int32_t x0 = 2 * x * 4;
+            int32_t x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+            for (int32_t c = 0; c < 4; c++) {
+                out[x * 4 + c] = Average(Average(row0[x0 + c], row0[x1 + c]),
+                                         Average(row1[x0 + c], row1[x1 + c]));
+            }
+        }
+    }
+}
+
+static bool ReadCache(const std::string& file, uint64_t sourceSize,
+                      uint32_t sourceHash, bool mipmaps, TextureImage& image) {
+    FILE* fp = fopen(file.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+
+    CacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1 &&
+                 header.magic == kCacheMagic &&
+                 header.version == kCacheVersion &&
+                 header.sourceSize == sourceSize &&
+                 header.sourceHash == sourceHash &&
+                 header.width > 0 && header.width <= kMaxCacheDimension &&
+                 header.height > 0 && header.height <= kMaxCacheDimension;
+    if (valid) {
+        image.width = header.width;
+        image.height = header.height;
+
+        // The header must describe exactly the levels the file holds, so a
+        // corrupt or truncated entry is dropped before anything is allocated
+        int32_t levels = 1;
+        uint64_t payload = static_cast<uint64_t>(image.width) * image.height * 4;
+        while (mipmaps && (image.LevelWidth(levels - 1) > 1 ||
+                           image.LevelHeight(levels - 1) > 1)) {
+            payload += static_cast<uint64_t>(image.LevelWidth(levels)) *
+                       image.LevelHeight(levels) * 4;
+            levels++;
+        }
+        long fileSize = -1;
+        if (fseek(fp, 0, SEEK_END) == 0) {
+            fileSize = ftell(fp);
+        }
+        valid = header.levels == levels && fileSize >= 0 &&
+                static_cast<uint64_t>(fileSize) == sizeof(header) + payload &&
+                fseek(fp, sizeof(header), SEEK_SET) == 0;
+    }
+    if (valid) {
+        image.levels.resize(header.levels);
+        for (int32_t level = 0; valid && level < header.levels; level++) {
+            std::vector<uint8_t>& bits = image.levels[level];
+            bits.resize(static_cast<size_t>(image.LevelWidth(level)) *
+                        image.LevelHeight(level) * 4);
+            valid = fread(bits.data(), bits.size(), 1, fp) == 1;
+        }
+    }
+    fclose(fp);
+
+    if (!valid) {
+        image = TextureImage();
+    }
+    return valid;
+}
+
+static void WriteCache(const std::string& file, uint64_t sourceSize,
+                       uint32_t sourceHash, const TextureImage& image) {
+    // Write to a temporary file first so readers never see a partial entry
+    std::string tmpFile = file + ".tmp";
+    FILE* fp = fopen(tmpFile.c_str(), "wb");
+    if (!fp) {
+        LOGW("Unable to create texture cache %s", tmpFile.c_str());
+        return;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kCacheMagic;
+    header.version = kCacheVersion;
+    header.sourceSize = sourceSize;
+    header.sourceHash = sourceHash;
+    header.width = image.width;
+    header.height = image.height;
+    header.levels = static_cast<int32_t>(image.levels.size());
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (size_t level = 0; ok && level < image.levels.size(); level++) {
+        ok = fwrite(image.levels[level].data(), image.levels[level].size(), 1,
+                    fp) == 1;
+    }
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(tmpFile.c_str(), file.c_str()) != 0) {
+        LOGW("Failed to write texture cache %s", file.c_str());
+        remove(tmpFile.c_str());
+    }
+}
+
+/**
+ * TextureLoader implementations
+ */
+TextureLoader* TextureLoader::GetInstance() {
+    static TextureLoader loader;
+    return &loader;
+}
+
+TextureLoader::TextureLoader() {
+    // tga/bmp files are saved as vertical mirror images ( at least more than half ).
+    // This is a global stb_image setting, set it once before any worker runs.
+    stbi_set_flip_vertically_on_load(1);
+
+    uint32_t count = std::min(std::max(std::thread::hardware_concurrency(), 1u),
+                              kMaxWorkers);
+    for (uint32_t i = 0; i < count; i++) {
+        workers_.push_back(std::thread(&TextureLoader::WorkerLoop, this));
+    }
+}
+
+TextureLoader::~TextureLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    cond_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::shared_ptr<TextureRequest> TextureLoader::Load(
+        AAssetManager* assetManager, const std::string& name,
+        const std::string& cacheDir, bool mipmaps) {
+    std::shared_ptr<TextureRequest> request(new TextureRequest);
+    request->assetManager_ = assetManager;
+    request->name_ = name;
+    request->mipmaps_ = mipmaps;
+    if (!cacheDir.empty()) {
+        std::string flatName(name);
+        std::replace(flatName.begin(), flatName.end(), '/', '_');
+        request->cacheFile_ = cacheDir + "/texcache_" + flatName +
+                              (mipmaps ? ".mip.txc" : ".txc");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(request);
+    }
+    cond_.notify_one();
+    return request;
+}
+
+void TextureLoader::WorkerLoop() {
+    while (true) {
+        std::shared_ptr<TextureRequest> request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return quit_ || !queue_.empty(); });
+            if (quit_) {
+                return;
+            }
+            request = queue_.front();
+            queue_.pop_front();
+        }
+        Process(*request);
+        request->ready_.store(true, std::memory_order_release);
+    }
+}
+
+void TextureLoader::Process(TextureRequest& request) {
+    auto start = std::chrono::steady_clock::now();
+
+    AAsset* asset = AAssetManager_open(request.assetManager_,
+                                       request.name_.c_str(),
+                                       AASSET_MODE_BUFFER);
+    if (!asset) {
+        LOGE("%s does not exist in %s", request.name_.c_str(), __FUNCTION__);
+        return;
+    }
+    const uint8_t* fileBits =
+        static_cast<const uint8_t*>(AAsset_getBuffer(asset));
+    size_t fileSize = static_cast<size_t>(AAsset_getLength(asset));
+    if (!fileBits) {
+        LOGE("Failed to read %s", request.name_.c_str());
+        AAsset_close(asset);
+        return;
+    }
+    uint32_t hash = HashBytes(fileBits, fileSize);
+
+    TextureImage& image = request.image_;
+    if (!request.cacheFile_.empty() &&
+        ReadCache(request.cacheFile_, fileSize, hash, request.mipmaps_, image)) {
+        AAsset_close(asset);
+        request.succeeded_ = true;
+        LOGI("%s: %dx%d, %zu levels from cache in %.2f ms",
+             request.name_.c_str(), image.width, image.height,
+             image.levels.size(), ElapsedMs(start));
+        return;
+    }
+
+    int32_t channelCount;
+    uint8_t* imageBits = stbi_load_from_memory(
+        fileBits, static_cast<int>(fileSize),
+        &image.width, &image.height, &channelCount, 4);
+    AAsset_close(asset);
+    if (!imageBits) {
+        LOGE("Failed to decode %s: %s", request.name_.c_str(),
+             stbi_failure_reason());
+        image = TextureImage();
+        return;
+    }
+
+    size_t baseSize = static_cast<size_t>(image.width) * image.height * 4;
+    image.levels.push_back(std::vector<uint8_t>(imageBits, imageBits + baseSize));
+    stbi_image_free(imageBits);
+
+    if (request.mipmaps_) {
+        for (int32_t level = 1; image.LevelWidth(level - 1) > 1 ||
+                                image.LevelHeight(level - 1) > 1; level++) {
+            std::vector<uint8_t> bits(static_cast<size_t>(image.LevelWidth(level)) *
+                                      image.LevelHeight(level) * 4);
+            DownsampleRGBA(image.levels[level - 1].data(),
+                           image.LevelWidth(level - 1),
+                           image.LevelHeight(level - 1), bits.data());
+            image.levels.push_back(std::move(bits));
+        }
+    }
+
+    if (!request.cacheFile_.empty()) {
+        WriteCache(request.cacheFile_, fileSize, hash, image);
+    }
+    request.succeeded_ = true;
+    LOGI("%s: %dx%d, %zu levels decoded in %.2f ms", request.name_.c_str(),
+         image.width, image.height, image.levels.size(), ElapsedMs(start));
+}
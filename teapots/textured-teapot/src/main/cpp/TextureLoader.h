@@ -0,0 +1,113 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEAPOTS_TEXTURELOADER_H
+#define TEAPOTS_TEXTURELOADER_H
+
+#include <android/asset_manager.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Decoded RGBA8888 image with its mip chain, level 0 first.
+ */
+struct TextureImage {
+    int32_t width = 0;
+    int32_t height = 0;
+    std::vector<std::vector<uint8_t>> levels;
+
+    int32_t LevelWidth(int32_t level) const;
+    int32_t LevelHeight(int32_t level) const;
+};
+
+/**
+ * One image decode handed to TextureLoader.
+ * Shared between the requester (GL thread) and a worker; the image may only
+ * be touched once IsReady() returns true.
+ */
+class TextureRequest {
+  public:
+    bool IsReady() const { return ready_.load(std::memory_order_acquire); }
+    bool Succeeded() const { return IsReady() && succeeded_; }
+    const TextureImage& Image() const { return image_; }
+
+  private:
+    friend class TextureLoader;
+    AAssetManager* assetManager_ = nullptr;
+    std::string name_;
+    std::string cacheFile_;
+    bool mipmaps_ = false;
+
+    TextureImage image_;
+    bool succeeded_ = false;
+    std::atomic<bool> ready_{false};
+};
+
+/**
+ *  class TextureLoader
+ *    decodes images on a small pool of worker threads so the GL thread
+ *    only uploads:
+ *     - read the asset and decode it with stb_image
+ *     - build the mip chain with a 2x2 box filter (NEON/SSE2)
+ *     - keep decoded levels in a raw container under the cache directory,
+ *       later loads of the same asset skip PNG/TGA/JPEG decoding entirely
+ */
+class TextureLoader {
+  public:
+    static TextureLoader* GetInstance();
+
+    /**
+     * Queue an asset for decoding.
+     * @param name asset file name under APK/assets
+     * @param cacheDir writable directory for decoded images, empty disables
+     *    the cache
+     * @param mipmaps generate the full mip chain
+     */
+    std::shared_ptr<TextureRequest> Load(AAssetManager* assetManager,
+                                         const std::string& name,
+                                         const std::string& cacheDir,
+                                         bool mipmaps);
+
+  private:
+    TextureLoader();
+    ~TextureLoader();
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    void WorkerLoop();
+    void Process(TextureRequest& request);
+
+    std::vector<std::thread> workers_;
+    std::deque<std::shared_ptr<TextureRequest>> queue_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool quit_ = false;
+};
+
+/**
+ * Downsample an RGBA8888 image by 2 in each direction with a box filter.
+ * dst must hold max(srcWidth / 2, 1) x max(srcHeight / 2, 1) pixels.
+ */
+void DownsampleRGBA(const uint8_t* src, int32_t srcWidth, int32_t srcHeight,
+                    uint8_t* dst);
+
+#endif //TEAPOTS_TEXTURELOADER_H
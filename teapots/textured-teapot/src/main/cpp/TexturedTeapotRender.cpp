@@ -69,8 +69,9 @@ GLint TexturedTeapotRender::GetTextureType(void) {
  *  - load image data into generated glBuffers
  *  - configure samplerObj in fragment shader
  * @param assetMgr android assetManager from java side
+ * @param cacheDir directory to cache decoded textures in, may be nullptr
  */
-void TexturedTeapotRender::Init(AAssetManager* assetMgr) {
+void TexturedTeapotRender::Init(AAssetManager* assetMgr, const char* cacheDir) {
     // initialize the basic things from TeapotRenderer, no change
     TeapotRenderer::Init();
 
@@ -130,7 +131,8 @@ void TexturedTeapotRender::Init(AAssetManager* assetMgr) {
         textures[0] = std::string("Textures/front.tga");
     }
 
-    texObj_ = Texture::Create(type, textures, assetMgr);
+    texObj_ = Texture::Create(type, textures, assetMgr,
+                              cacheDir ? std::string(cacheDir) : std::string());
     assert(texObj_);
 
     std::vector<std::string> samplers;
@@ -151,6 +153,10 @@ void TexturedTeapotRender::Init(AAssetManager* assetMgr) {
  *   For Texture, simply inform GL to stream texture coord from _texVbo
  */
 void TexturedTeapotRender::Render() {
+    // Images are decoded off the GL thread, pick up whatever finished
+    if (texObj_) {
+        texObj_->Update();
+    }
     TeapotRenderer::Render();
 }
 
@@ -38,7 +38,8 @@ class TexturedTeapotRender :public TeapotRenderer {
     // the rest of the code looks this function to decide
     // what to render.
     virtual GLint GetTextureType(void);
-    virtual void Init(AAssetManager* amgr);
+    // cacheDir: writable directory for decoded texture images
+    virtual void Init(AAssetManager* amgr, const char* cacheDir = nullptr);
     virtual void Render();
     virtual void Unload();
 };
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the WebpDecoder worker pool, on the sample's pictures:
+ *
+ *   webp-decoder-test <clips directory>
+ *
+ * The pictures are served from memory, next to a truncated one and one that
+ * isn't a picture at all, and each decode sleeps a random time so that the
+ * workers finish out of order. For each ring depth and worker count, the
+ * frames must come out in the order of the files, each what a direct decode
+ * of its picture gives, with the pictures that fail skipped. While a frame
+ * is held, the workers must fill the rest of the ring and then wait: no more
+ * than depth pictures are ever started past the frame shown. Then frames
+ * are presented on an RGBA memory surface: without a ring, from an RGBA
+ * ring, and from a YUV 420 ring as the view keeps, which must show exactly
+ * what converting a direct YUV decode gives. Exits non zero when a check
+ * fails.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "webp_decode.h"
+
+// a small frame, so decoding is quick next to the sleeps
+static const DecodeSurfaceDescriptor kFrameDesc = {
+    90, 160, 96, SurfaceFormat::SURFACE_FORMAT_RGBA_8888 };
+
+// the files of the slideshow, in order; the broken ones must be skipped
+static const char* kFiles[] = {
+    "frame1.webp", "truncated.webp", "frame2.webp", "garbage.webp", "frame3.webp",
+};
+static const uint32_t kFileCount = sizeof(kFiles) / sizeof(kFiles[0]);
+
+// frames shown for each depth and worker count
+static const uint32_t kShownFrames = 12;
+
+static int errors = 0;
+
+static void Check(bool ok, const char* what, uint32_t depth, uint32_t workers,
+                  uint64_t frame) {
+    if (!ok && errors++ < 10) {
+        fprintf(stderr, "depth %u, %u workers, frame %llu: %s\n", depth, workers,
+                static_cast<unsigned long long>(frame), what);
+    }
+}
+
+static uint64_t NowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool ReadFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    uint8_t chunk[65536];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data->insert(data->end(), chunk, chunk + len);
+    }
+    fclose(file);
+    return !data->empty();
+}
+
+/*
+ * The pictures, in memory. Counts the decodes started, and sleeps up to
+ * 2 ms before each one
+ */
+class MemoryPictureSource : public PictureSource {
+  public:
+    MemoryPictureSource() : started_(0), seed_(1) {
+        pthread_mutex_init(&lock_, nullptr);
+    }
+    ~MemoryPictureSource() { pthread_mutex_destroy(&lock_); }
+
+    void Add(const char* name, const std::vector<uint8_t>& data) {
+        pictures_[name] = data;
+    }
+    bool Decode(const char* name, std::vector<uint8_t>& data,
+                const SurfaceBuffer& dst) override {
+        pthread_mutex_lock(&lock_);
+        started_++;
+        useconds_t delay = rand_r(&seed_) % 2000;
+        pthread_mutex_unlock(&lock_);
+        usleep(delay);
+
+        auto picture = pictures_.find(name);
+        if (picture == pictures_.end()) {
+            return false;
+        }
+        // as the assets are read, through the worker's scratch memory
+        data.assign(picture->second.begin(), picture->second.end());
+        return DecodeWebp(data.data(), data.size(), dst);
+    }
+    uint64_t Started(void) {
+        pthread_mutex_lock(&lock_);
+        uint64_t started = started_;
+        pthread_mutex_unlock(&lock_);
+        return started;
+    }
+    void Reset(void) {
+        pthread_mutex_lock(&lock_);
+        started_ = 0;
+        pthread_mutex_unlock(&lock_);
+    }
+
+  private:
+    std::map<std::string, std::vector<uint8_t> > pictures_;
+    pthread_mutex_t lock_;
+    uint64_t started_;
+    unsigned seed_;
+};
+
+// the pixels of the two frames are the same; the padding of the rows isn't
+// decoded into
+static bool SamePixels(const uint8_t* a, const uint8_t* b) {
+    size_t stride = kFrameDesc.stride_ * BytesPerPixel(kFrameDesc.format_);
+    for (int32_t y = 0; y < kFrameDesc.height_; y++) {
+        if (memcmp(a + y * stride, b + y * stride,
+                   kFrameDesc.width_ * BytesPerPixel(kFrameDesc.format_))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the frames a direct decode of each file gives, empty for the broken ones;
+// and, for a YUV 420 ring, a direct YUV decode converted to RGBA. Scaled, the
+// two differ: the YUV frames keep the chroma at half the frame's size
+static std::vector<std::vector<uint8_t> > sExpected, sExpectedYuv;
+
+static void DecodeExpected(MemoryPictureSource* source) {
+    DecodeSurfaceDescriptor yuvDesc = { kFrameDesc.width_, kFrameDesc.height_,
+                                        kFrameDesc.width_,
+                                        SurfaceFormat::SURFACE_FORMAT_YUV_420 };
+    std::vector<uint8_t> data, yuv(FrameSize(yuvDesc));
+    for (uint32_t i = 0; i < kFileCount; i++) {
+        std::vector<uint8_t> frame(FrameSize(kFrameDesc)), converted(FrameSize(kFrameDesc));
+        SurfaceBuffer dst = { kFrameDesc, frame.data() };
+        SurfaceBuffer yuvDst = { yuvDesc, yuv.data() };
+        SurfaceBuffer convertedDst = { kFrameDesc, converted.data() };
+        if (!source->Decode(kFiles[i], data, dst) ||
+                !source->Decode(kFiles[i], data, yuvDst) ||
+                !CopyFrame(convertedDst, yuvDst)) {
+            frame.clear();
+            converted.clear();
+        }
+        sExpected.push_back(frame);
+        sExpectedYuv.push_back(converted);
+    }
+}
+
+// the next file from file on that decodes
+static uint64_t NextGood(uint64_t file) {
+    while (sExpected[file % kFileCount].empty()) {
+        file++;
+    }
+    return file;
+}
+
+// waits for the next frame, up to a second
+static uint8_t* WaitFrame(WebpDecoder* decoder) {
+    uint64_t start = NowUs();
+    uint8_t* frame;
+    while (!(frame = decoder->GetDecodedFrame()) && NowUs() - start < 1000000) {
+        usleep(100);
+    }
+    return frame;
+}
+
+static void CheckRing(MemoryPictureSource* source, uint32_t depth, uint32_t workers) {
+    source->Reset();
+    DecodeSurfaceDescriptor desc = kFrameDesc;
+    WebpDecoder* decoder = new WebpDecoder(kFiles, kFileCount, &desc, source, depth,
+                                           workers);
+    decoder->DecodeFrame();
+
+    uint64_t file = 0;
+    uint32_t skipped = 0;
+    for (uint32_t shown = 0; shown < kShownFrames; shown++) {
+        uint64_t next = NextGood(file);
+        skipped += static_cast<uint32_t>(next - file);
+        file = next;
+        uint8_t* frame = WaitFrame(decoder);
+        Check(frame != nullptr, "no frame decoded", depth, workers, file);
+        if (!frame) {
+            break;
+        }
+        Check(SamePixels(frame, sExpected[file % kFileCount].data()),
+              "frame out of order, or not the picture", depth, workers, file);
+        Check(decoder->GetDecodedFrame() == frame, "frame changed before its release",
+              depth, workers, file);
+
+        // while the frame is held, the ring fills up to depth frames from it,
+        // and stays there
+        if (shown % 3 == 0) {
+            uint64_t start = NowUs();
+            while (source->Started() < file + depth && NowUs() - start < 1000000) {
+                usleep(100);
+            }
+            usleep(5000);
+            Check(source->Started() == file + depth, "workers ran past the ring", depth,
+                  workers, file);
+        } else {
+            Check(source->Started() <= file + depth, "workers ran past the ring", depth,
+                  workers, file);
+        }
+        Check(decoder->DecodeFrame(), "frame not released", depth, workers, file);
+        file++;
+    }
+
+    DecodeStats stats;
+    decoder->GetStats(&stats);
+    Check(stats.frames_ >= kShownFrames && stats.failures_ >= skipped,
+          "frames or failures not counted", depth, workers, file);
+    Check(stats.frames_ + stats.failures_ <= source->Started(), "frames counted twice",
+          depth, workers, file);
+    // joins the workers, some of them waiting for a free slot
+    decoder->DestroyDecoder();
+}
+
+// PresentFrame() on an RGBA memory surface: from the ring, or decoding
+// straight into the surface with depth 0. With yuv, the ring is in YUV 420,
+// as in the view, and converted as frames are shown
+static void CheckPresent(MemoryPictureSource* source, uint32_t depth, bool yuv) {
+    DecodeSurfaceDescriptor desc = kFrameDesc;
+    if (yuv) {
+        desc.format_ = SurfaceFormat::SURFACE_FORMAT_YUV_420;
+        desc.stride_ = desc.width_;
+    }
+    WebpDecoder* decoder = new WebpDecoder(kFiles, kFileCount, &desc, source, depth);
+    MemorySurface surface(kFrameDesc);
+    uint64_t file = 0;
+    uint32_t posts = 0;
+    for (uint32_t shown = 0; shown < kShownFrames; file++, posts++) {
+        bool broken = sExpected[file % kFileCount].empty();
+        if (depth) {
+            // the ring skips the broken pictures
+            file = NextGood(file);
+            broken = false;
+            uint64_t start = NowUs();
+            while (!decoder->PresentFrame(&surface) && NowUs() - start < 1000000) {
+                usleep(100);
+            }
+        } else {
+            Check(decoder->PresentFrame(&surface) == !broken, "presented a broken picture",
+                  depth, 0, file);
+        }
+        const SurfaceBuffer& buf = surface.Buffer();
+        if (broken) {
+            std::vector<uint8_t> black(FrameSize(kFrameDesc));
+            ClearFrame({ kFrameDesc, black.data() });
+            Check(SamePixels(buf.bits_, black.data()), "broken picture not blanked",
+                  depth, 0, file);
+        } else {
+            const std::vector<uint8_t>& expected = yuv ? sExpectedYuv[file % kFileCount]
+                                                       : sExpected[file % kFileCount];
+            Check(SamePixels(buf.bits_, expected.data()),
+                  yuv ? "surface is not the YUV picture" : "surface is not the picture",
+                  depth, 0, file);
+            shown++;
+        }
+    }
+    Check(surface.Posts() == posts, "not posted once a picture", depth, 0, file);
+    decoder->DestroyDecoder();
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <clips directory>\n", argv[0]);
+        return 1;
+    }
+    MemoryPictureSource source;
+    std::vector<uint8_t> first;
+    for (int i = 1; i <= 3; i++) {
+        char path[1024], name[32];
+        snprintf(path, sizeof(path), "%s/frame%d.webp", argv[1], i);
+        snprintf(name, sizeof(name), "frame%d.webp", i);
+        std::vector<uint8_t> data;
+        if (!ReadFile(path, &data)) {
+            fprintf(stderr, "can't read %s\n", path);
+            return 1;
+        }
+        source.Add(name, data);
+        if (i == 1) {
+            first = data;
+        }
+    }
+    source.Add("truncated.webp",
+               std::vector<uint8_t>(first.begin(), first.begin() + first.size() / 2));
+    source.Add("garbage.webp", std::vector<uint8_t>(first.size(), 0x55));
+    DecodeExpected(&source);
+    if (sExpected[1].size() || sExpected[3].size()) {
+        fprintf(stderr, "the broken pictures decode\n");
+        return 1;
+    }
+
+    for (uint32_t depth = 1; depth <= 4; depth++) {
+        for (uint32_t workers = 1; workers <= depth; workers++) {
+            CheckRing(&source, depth, workers);
+        }
+    }
+    CheckPresent(&source, 0, false);
+    CheckPresent(&source, WebpDecoder::kDefaultDepth, false);
+    CheckPresent(&source, WebpDecoder::kDefaultDepth, true);
+    printf("%u frames shown for each depth up to 4 and worker count\n", kShownFrames);
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the decode surfaces, on the sample's pictures:
+ *
+ *   webp-surface-test <clips directory>
+ *
+ * Each picture is decoded straight into in-memory surfaces of both formats,
+ * with padded rows and a width that is not a multiple of the SIMD width.
+ * The copies between formats must give what decoding into that format
+ * gives, and copies to other strides must keep every row.
+ *
+ * Then the large picture paths, at the picture's own size: a decoded region,
+ * a picture decoded as it arrives and tiles drawn through WebpTileCache must
+ * give the pixels a full decode gives.
+ *
+ * Last, YUV 420 frames: converted to RGB, they must give exactly what
+ * decoding to RGB gives.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <webp/decode.h>
+#include "webp_surface.h"
+#include "webp_tiles.h"
+
+static uint64_t NowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool ReadFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    uint8_t chunk[65536];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data->insert(data->end(), chunk, chunk + len);
+    }
+    fclose(file);
+    return !data->empty();
+}
+
+static const uint8_t* Row(const SurfaceBuffer& buf, int32_t y) {
+    return buf.bits_ + static_cast<size_t>(y) * buf.desc_.stride_ *
+                       BytesPerPixel(buf.desc_.format_);
+}
+
+// rows of the two surfaces hold the same pixels
+static bool SameRows(const SurfaceBuffer& a, const SurfaceBuffer& b) {
+    size_t rowSize = static_cast<size_t>(a.desc_.width_) * BytesPerPixel(a.desc_.format_);
+    for (int32_t y = 0; y < a.desc_.height_; y++) {
+        if (memcmp(Row(a, y), Row(b, y), rowSize)) {
+            fprintf(stderr, "rows %d differ\n", y);
+            return false;
+        }
+    }
+    return true;
+}
+
+// the part of buf from (x, y) on, width by height
+static SurfaceBuffer SubBuffer(const SurfaceBuffer& buf, int32_t x, int32_t y,
+                               int32_t width, int32_t height) {
+    SurfaceBuffer sub = buf;
+    sub.desc_.width_ = width;
+    sub.desc_.height_ = height;
+    sub.bits_ = const_cast<uint8_t*>(Row(buf, y)) + x * BytesPerPixel(buf.desc_.format_);
+    return sub;
+}
+
+static bool Blank(const SurfaceBuffer& buf) {
+    size_t rowSize = static_cast<size_t>(buf.desc_.width_) * BytesPerPixel(buf.desc_.format_);
+    for (int32_t y = 0; y < buf.desc_.height_; y++) {
+        for (size_t i = 0; i < rowSize; i++) {
+            if (Row(buf, y)[i]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int TestLargePicture(const char* path, const std::vector<uint8_t>& data) {
+    int width, height;
+    if (!WebPGetInfo(data.data(), data.size(), &width, &height)) {
+        fprintf(stderr, "%s: no size\n", path);
+        return 1;
+    }
+    const SurfaceFormat format = SurfaceFormat::SURFACE_FORMAT_RGBA_8888;
+    MemorySurface full({width, height, width, format});
+    SurfaceBuffer fullBuf;
+    full.Lock(&fullBuf);
+    if (!DecodeWebp(data.data(), data.size(), fullBuf)) {
+        fprintf(stderr, "%s: can't decode at full size\n", path);
+        return 1;
+    }
+    int errors = 0;
+
+    // a region is what the full decode has there
+    DecodeRegion region = {width / 3 & ~1, height / 4 & ~1, width / 3, height / 3};
+    MemorySurface part({region.width_, region.height_, region.width_ + 7, format});
+    SurfaceBuffer partBuf;
+    part.Lock(&partBuf);
+    if (!DecodeWebp(data.data(), data.size(), partBuf, &region) ||
+            !SameRows(partBuf, SubBuffer(fullBuf, region.left_, region.top_,
+                                         region.width_, region.height_))) {
+        fprintf(stderr, "%s: region decode is wrong\n", path);
+        errors++;
+    }
+
+    // bytes arriving a few at a time, scaled as they are decoded
+    MemorySurface scaled({width * 3 / 4, height * 3 / 4, width, format});
+    MemorySurface streamed(scaled.Buffer().desc_);
+    SurfaceBuffer scaledBuf, streamedBuf;
+    scaled.Lock(&scaledBuf);
+    streamed.Lock(&streamedBuf);
+    DecodeWebp(data.data(), data.size(), scaledBuf);
+    {
+        WebpStreamDecoder decoder(streamedBuf);
+        int32_t rows = 0;
+        for (size_t i = 0; i < data.size(); i += 997) {
+            decoder.Append(data.data() + i, std::min<size_t>(997, data.size() - i));
+            if (decoder.Rows() < rows) {
+                fprintf(stderr, "%s: decoded rows went back\n", path);
+                errors++;
+            }
+            rows = decoder.Rows();
+        }
+        if (!decoder.Done() || decoder.Failed() || !SameRows(streamedBuf, scaledBuf)) {
+            fprintf(stderr, "%s: incremental decode is wrong\n", path);
+            errors++;
+        }
+    }
+
+    // a cut picture never finishes
+    {
+        WebpStreamDecoder decoder(streamedBuf);
+        decoder.Update(data.data(), data.size() / 2);
+        if (decoder.Done()) {
+            fprintf(stderr, "%s: half a picture decoded\n", path);
+            errors++;
+        }
+    }
+
+    // tiles: a view across tile edges, then the same view a little further
+    WebpTileCache tiles(data.data(), data.size(), format, 32, 16);
+    const int32_t viewWidth = 60, viewHeight = 48;
+    MemorySurface view({viewWidth, viewHeight, viewWidth + 3, format});
+    SurfaceBuffer viewBuf;
+    view.Lock(&viewBuf);
+    for (int32_t pan = 0; pan < 3; pan++) {
+        int32_t x = 10 + pan * 12, y = 20 + pan * 8;
+        if (!tiles.Render(0, x, y, viewBuf) ||
+                !SameRows(viewBuf, SubBuffer(fullBuf, x, y, viewWidth, viewHeight))) {
+            fprintf(stderr, "%s: tiles at %d, %d are wrong\n", path, x, y);
+            errors++;
+        }
+    }
+    TileStats stats;
+    tiles.GetStats(&stats);
+    // at most a band per row of tiles, and panning reuses tiles
+    if (!stats.hits_ || stats.decodes_ > 3 * 3) {
+        fprintf(stderr, "%s: %u hits, %u misses, %u decodes\n", path,
+                stats.hits_, stats.misses_, stats.decodes_);
+        errors++;
+    }
+
+    // hanging off the bottom right corner: the rest is blank
+    int32_t x = width - viewWidth / 2, y = height - viewHeight / 2;
+    if (!tiles.Render(0, x, y, viewBuf) ||
+            !SameRows(SubBuffer(viewBuf, 0, 0, viewWidth / 2, viewHeight / 2),
+                      SubBuffer(fullBuf, x, y, viewWidth / 2, viewHeight / 2)) ||
+            !Blank(SubBuffer(viewBuf, viewWidth / 2, 0, viewWidth - viewWidth / 2, viewHeight)) ||
+            !Blank(SubBuffer(viewBuf, 0, viewHeight / 2, viewWidth, viewHeight - viewHeight / 2))) {
+        fprintf(stderr, "%s: tiles at the edge are wrong\n", path);
+        errors++;
+    }
+
+    // half size, scaled on decode, is close to a thumbnail of the whole
+    int32_t halfWidth = tiles.Width(1), halfHeight = tiles.Height(1);
+    MemorySurface half({halfWidth, halfHeight, halfWidth, format});
+    MemorySurface thumb({halfWidth, halfHeight, halfWidth, format});
+    SurfaceBuffer halfBuf, thumbBuf;
+    half.Lock(&halfBuf);
+    thumb.Lock(&thumbBuf);
+    uint64_t diff = 0;
+    if (!tiles.Render(1, 0, 0, halfBuf) ||
+            !DecodeWebp(data.data(), data.size(), thumbBuf)) {
+        errors++;
+    }
+    for (size_t i = 0; i < static_cast<size_t>(halfWidth) * halfHeight * 4; i++) {
+        diff += abs(halfBuf.bits_[i] - thumbBuf.bits_[i]);
+    }
+    if (diff > static_cast<uint64_t>(halfWidth) * halfHeight * 4 * 4) {
+        fprintf(stderr, "%s: half size tiles are off\n", path);
+        errors++;
+    }
+    return errors;
+}
+
+static int TestYuv(const char* path, const std::vector<uint8_t>& data) {
+    int width, height;
+    if (!WebPGetInfo(data.data(), data.size(), &width, &height)) {
+        return 1;
+    }
+    int errors = 0;
+    // the whole picture, and a region of odd size
+    DecodeRegion regions[2] = {{0, 0, width, height}, {2, 2, width - 5, height - 3}};
+    for (const DecodeRegion& region : regions) {
+        int32_t w = region.width_, h = region.height_;
+        MemorySurface yuv({w, h, w + 3, SurfaceFormat::SURFACE_FORMAT_YUV_420});
+        MemorySurface rgba({w, h, w, SurfaceFormat::SURFACE_FORMAT_RGBA_8888});
+        MemorySurface rgb565({w, h, w + 1, SurfaceFormat::SURFACE_FORMAT_RGB_565});
+        SurfaceBuffer yuvBuf, rgbaBuf, rgb565Buf;
+        yuv.Lock(&yuvBuf);
+        rgba.Lock(&rgbaBuf);
+        rgb565.Lock(&rgb565Buf);
+        if (!DecodeWebp(data.data(), data.size(), yuvBuf, &region) ||
+                !DecodeWebp(data.data(), data.size(), rgbaBuf, &region) ||
+                !DecodeWebp(data.data(), data.size(), rgb565Buf, &region)) {
+            fprintf(stderr, "%s: can't decode %dx%d\n", path, w, h);
+            errors++;
+            continue;
+        }
+        if (FrameSize(yuvBuf.desc_) * 2 > FrameSize(rgbaBuf.desc_)) {
+            fprintf(stderr, "%s: YUV frame is too big\n", path);
+            errors++;
+        }
+
+        MemorySurface converted(rgbaBuf.desc_), packed(rgb565Buf.desc_);
+        SurfaceBuffer convertedBuf, packedBuf;
+        converted.Lock(&convertedBuf);
+        packed.Lock(&packedBuf);
+        if (!CopyFrame(convertedBuf, yuvBuf) || !SameRows(convertedBuf, rgbaBuf)) {
+            fprintf(stderr, "%s: YUV to RGBA is wrong\n", path);
+            errors++;
+        }
+        if (!CopyFrame(packedBuf, yuvBuf) || !SameRows(packedBuf, rgb565Buf)) {
+            fprintf(stderr, "%s: YUV to RGB 565 is wrong\n", path);
+            errors++;
+        }
+
+        // YUV to YUV keeps the planes, whatever the strides; not from RGB
+        MemorySurface copy({w, h, w, SurfaceFormat::SURFACE_FORMAT_YUV_420});
+        SurfaceBuffer copyBuf;
+        copy.Lock(&copyBuf);
+        if (!CopyFrame(copyBuf, yuvBuf) || !CopyFrame(convertedBuf, copyBuf) ||
+                !SameRows(convertedBuf, rgbaBuf) || CopyFrame(copyBuf, rgbaBuf)) {
+            fprintf(stderr, "%s: YUV copy is wrong\n", path);
+            errors++;
+        }
+
+        // blank is black
+        ClearFrame(yuvBuf);
+        CopyFrame(convertedBuf, yuvBuf);
+        for (int32_t y = 0; y < h; y++) {
+            for (int32_t x = 0; x < w * 4; x++) {
+                if (Row(convertedBuf, y)[x] != (x % 4 == 3 ? 0xff : 0)) {
+                    fprintf(stderr, "%s: blank YUV is not black\n", path);
+                    errors++;
+                    y = h;
+                    break;
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+static int TestPicture(const char* path) {
+    std::vector<uint8_t> data;
+    if (!ReadFile(path, &data)) {
+        fprintf(stderr, "can't read %s\n", path);
+        return 1;
+    }
+    const int32_t width = 357, height = 634;
+    MemorySurface rgba({width, height, width + 11, SurfaceFormat::SURFACE_FORMAT_RGBA_8888});
+    MemorySurface rgb565({width, height, width + 5, SurfaceFormat::SURFACE_FORMAT_RGB_565});
+    SurfaceBuffer rgbaBuf, rgb565Buf;
+    rgba.Lock(&rgbaBuf);
+    rgb565.Lock(&rgb565Buf);
+
+    uint64_t start = NowUs();
+    if (!DecodeWebp(data.data(), data.size(), rgbaBuf)) {
+        fprintf(stderr, "%s: can't decode to RGBA\n", path);
+        return 1;
+    }
+    uint64_t decodeUs = NowUs() - start;
+    rgba.Post();
+    if (!DecodeWebp(data.data(), data.size(), rgb565Buf)) {
+        fprintf(stderr, "%s: can't decode to RGB 565\n", path);
+        return 1;
+    }
+    rgb565.Post();
+    int errors = 0;
+
+    // the same stride and format: one memcpy
+    MemorySurface same(rgbaBuf.desc_);
+    SurfaceBuffer sameBuf;
+    same.Lock(&sameBuf);
+    if (!CopyFrame(sameBuf, rgbaBuf) || !SameRows(sameBuf, rgbaBuf)) {
+        fprintf(stderr, "%s: copy to the same layout is wrong\n", path);
+        errors++;
+    }
+
+    // RGBA to RGBX, another stride
+    MemorySurface rgbx({width, height, width + 3, SurfaceFormat::SURFACE_FORMAT_RGBX_8888});
+    SurfaceBuffer rgbxBuf;
+    rgbx.Lock(&rgbxBuf);
+    if (!CopyFrame(rgbxBuf, rgbaBuf) || !SameRows(rgbxBuf, rgbaBuf)) {
+        fprintf(stderr, "%s: copy to another stride is wrong\n", path);
+        errors++;
+    }
+
+    // RGBA to 565 packs what the decoder packs
+    MemorySurface packed(rgb565Buf.desc_);
+    SurfaceBuffer packedBuf;
+    packed.Lock(&packedBuf);
+    if (!CopyFrame(packedBuf, rgbaBuf) || !SameRows(packedBuf, rgb565Buf)) {
+        fprintf(stderr, "%s: RGBA to RGB 565 is wrong\n", path);
+        errors++;
+    }
+
+    // 565 to RGBA expands to the high bits of the decoded RGBA
+    MemorySurface expanded(rgbaBuf.desc_);
+    SurfaceBuffer expandedBuf;
+    expanded.Lock(&expandedBuf);
+    if (!CopyFrame(expandedBuf, rgb565Buf)) {
+        errors++;
+    }
+    for (int32_t y = 0; y < height && !errors; y++) {
+        const uint8_t* a = Row(expandedBuf, y);
+        const uint8_t* b = Row(rgbaBuf, y);
+        for (int32_t x = 0; x < width * 4; x += 4) {
+            if ((a[x] ^ b[x]) & 0xf8 || (a[x + 1] ^ b[x + 1]) & 0xfc ||
+                    (a[x + 2] ^ b[x + 2]) & 0xf8 || a[x + 3] != 0xff) {
+                fprintf(stderr, "%s: RGB 565 to RGBA is wrong at %d, %d\n", path, x / 4, y);
+                errors++;
+                break;
+            }
+        }
+    }
+
+    // sizes must match, there is no scaling on copy
+    MemorySurface other({width + 1, height, width + 1, SurfaceFormat::SURFACE_FORMAT_RGBA_8888});
+    SurfaceBuffer otherBuf;
+    other.Lock(&otherBuf);
+    if (CopyFrame(otherBuf, rgbaBuf)) {
+        fprintf(stderr, "copied between sizes\n");
+        errors++;
+    }
+
+    ClearFrame(rgbaBuf);
+    for (size_t i = 0; i < static_cast<size_t>(rgbaBuf.desc_.stride_) * height * 4; i++) {
+        if (rgbaBuf.bits_[i]) {
+            fprintf(stderr, "not blank\n");
+            errors++;
+            break;
+        }
+    }
+    if (rgba.Posts() != 1 || rgb565.Posts() != 1) {
+        errors++;
+    }
+    errors += TestLargePicture(path, data);
+    errors += TestYuv(path, data);
+    printf("%s: %u bytes, decoded in %llu us\n", path, static_cast<unsigned>(data.size()),
+           static_cast<unsigned long long>(decodeUs));
+    return errors;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <clips directory>\n", argv[0]);
+        return 1;
+    }
+    int errors = 0;
+    for (int i = 1; i <= 3; i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/frame%d.webp", argv[1], i);
+        errors += TestPicture(path);
+    }
+    return errors ? 1 : 0;
+}
@@ -14,51 +14,114 @@
  * limitations under the License.
  */
 #include <cassert>
+#include <ctime>
 #include <pthread.h>
-#include <webp/decode.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "webp_decode.h"
 
+static uint64_t NowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 WebpDecoder::WebpDecoder(const char** files, uint32_t count,
                          DecodeSurfaceDescriptor* frameBuf,
-                         AAssetManager* assetMgr)
-    : assetMgr_(assetMgr),
-      buf_(nullptr), stopPending_(false),
-      state_(state_idle), worker_(nullptr) {
+                         PictureSource* source,
+                         uint32_t depth, uint32_t workers)
+    : source_(source), frameSize_(0), nextFile_(0),
+      head_(0), next_(0), headShown_(false), headMissed_(false),
+      stopPending_(false), stats_(), workerCount_(workers) {
+    pthread_mutex_init(&lock_, nullptr);
+    pthread_cond_init(&slotFree_, nullptr);
     for (auto i = 0; i < count; i++) {
-        files_.push(files[i]);
+        files_.push_back(files[i]);
     }
-    if (count && assetMgr && frameBuf) {
+    if (count && source && frameBuf) {
         bufInfo_ = *frameBuf;
-        switch (bufInfo_.format_) {
-            case SurfaceFormat::SURFACE_FORMAT_RGB_565:
-                bytePerPix_ = 2;
-                break;
-            case SurfaceFormat::SURFACE_FORMAT_RGBA_8888:
-            case SurfaceFormat::SURFACE_FORMAT_RGBX_8888:
-                bytePerPix_ = 4;
-                break;
-            default:
-                assert(0);
-                return;
+        frameSize_ = FrameSize(bufInfo_);
+        if (!frameSize_) {
+            assert(0);
+            return;
+        }
+        // allocate the decode buffers once, they are reused round the ring
+        ring_.resize(depth);
+        for (auto& slot : ring_) {
+            slot.buf_ = new uint8_t [frameSize_];
+            slot.state_ = state_idle;
+            slot.failed_ = false;
+            assert(slot.buf_);
+        }
+        if (workerCount_ == 0) {
+            // leave a CPU for display, libwebp uses another thread of its own
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            workerCount_ = cpus > 2 ? static_cast<uint32_t>(cpus / 2) : 1;
+        }
+        if (workerCount_ > ring_.size()) {
+            workerCount_ = static_cast<uint32_t>(ring_.size());
         }
-        // allocate a private decode buffer
-        uint32_t size = bufInfo_.height_ * bufInfo_.stride_ * bytePerPix_;
-        buf_ = new uint8_t [size];
-        assert(buf_);
     }
 }
 
+#ifdef __ANDROID__
+WebpDecoder::WebpDecoder(const char** files, uint32_t count,
+                         DecodeSurfaceDescriptor* frameBuf,
+                         AAssetManager* assetMgr,
+                         uint32_t depth, uint32_t workers)
+    : WebpDecoder(files, count, frameBuf,
+                  assetMgr ? new AssetPictureSource(assetMgr) : nullptr,
+                  depth, workers) {
+    ownedSource_.reset(source_);
+}
+#endif
+
 /*
- * GetDecodedFrame():  return decoded frame if available,
+ * GetDecodedFrame():  return the oldest decoded frame if available,
  *                     return nullptr otherwise
  */
 uint8_t* WebpDecoder::GetDecodedFrame(void) {
-    return (state_ == state_ready ? buf_ : nullptr);
+    uint8_t* frame = nullptr;
+    pthread_mutex_lock(&lock_);
+    while (!ring_.empty() && head_ < next_) {
+        FrameSlot& slot = ring_[head_ % ring_.size()];
+        if (slot.state_ != state_ready) {
+            if (!headMissed_) {
+                headMissed_ = true;
+                stats_.underruns_++;
+            }
+            break;
+        }
+        if (!slot.failed_) {
+            headShown_ = true;
+            frame = slot.buf_;
+            break;
+        }
+        // skip the pictures we could not decode
+        slot.state_ = state_idle;
+        head_++;
+        headMissed_ = false;
+        pthread_cond_broadcast(&slotFree_);
+    }
+    pthread_mutex_unlock(&lock_);
+    return frame;
+}
+
+void WebpDecoder::GetStats(DecodeStats* stats) {
+    pthread_mutex_lock(&lock_);
+    *stats = stats_;
+    stats->ready_ = 0;
+    for (auto& slot : ring_) {
+        if (slot.state_ == state_ready && !slot.failed_) {
+            stats->ready_++;
+        }
+    }
+    pthread_mutex_unlock(&lock_);
 }
 
 /*
  * DecodeFrame():
- *    thread function to decode a picture
+ *    thread function of the workers
  *    directly pass through to internal decoding function
  */
 void* DecodeFrame(void * decoder) {
@@ -68,88 +131,153 @@ void* DecodeFrame(void * decoder) {
 
 /*
  * DecodeFrameInternal():
- *    Main decoding function from app side, and executing inside its own thread
+ *    Main loop of a worker: decode the next picture into a free slot of the
+ *    ring, and wait when there is none
  */
 void WebpDecoder::DecodeFrameInternal() {
-    const char * webpFile = files_.front();
-    files_.pop();
-    files_.push(webpFile);
-
-    AAsset* frameFile = AAssetManager_open(assetMgr_, webpFile, AASSET_MODE_BUFFER);
-    assert(frameFile != NULL);
-    int32_t len = AAsset_getLength(frameFile);
-    uint8_t *buf = new uint8_t[len];
-    assert(buf);
-    len = AAsset_read(frameFile, buf, len);
-    assert(len > 0);
-    AAsset_close(frameFile);
+    // the compressed picture, kept to save allocating it for each frame
+    std::vector<uint8_t> data;
 
-    WebPDecoderConfig config;
-    if (!WebPInitDecoderConfig(&config)) {
-        assert(0);
-    }
+    pthread_mutex_lock(&lock_);
+    for (;;) {
+        while (!stopPending_ && next_ >= head_ + ring_.size()) {
+            pthread_cond_wait(&slotFree_, &lock_);
+        }
+        if (stopPending_) {
+            break;
+        }
+        uint64_t frame = next_++;
+        FrameSlot& slot = ring_[frame % ring_.size()];
+        slot.state_ = state_decoding;
+        pthread_mutex_unlock(&lock_);
 
-    VP8StatusCode  status = WebPGetFeatures(buf, len, &config.input);
-    assert(status == VP8_STATUS_OK);
+        uint64_t start = NowUs();
+        SurfaceBuffer dst = { bufInfo_, slot.buf_ };
+        bool ok = source_->Decode(files_[frame % files_.size()], data, dst);
+        uint64_t decodeUs = NowUs() - start;
 
-    // let's decode it into a buffer ...
-    config.options.bypass_filtering = 1;
-    config.options.no_fancy_upsampling = 1;
-    config.options.flip = 0;
-    config.options.use_scaling = 1;
-    config.options.scaled_width = bufInfo_.width_;
-    config.options.scaled_height = bufInfo_.height_;
+        pthread_mutex_lock(&lock_);
+        slot.state_ = state_ready;
+        slot.failed_ = !ok;
+        AddDecodeTime(ok, decodeUs);
+    }
+    pthread_mutex_unlock(&lock_);
+}
 
-    // this does not seems to have difference on Nexus 5
-    config.options.use_threads = 1;
-    switch (bufInfo_.format_) {
-        case SurfaceFormat::SURFACE_FORMAT_RGB_565:
-            config.output.colorspace = MODE_RGB_565;
-            break;
-        case SurfaceFormat::SURFACE_FORMAT_RGBA_8888:
-        case SurfaceFormat::SURFACE_FORMAT_RGBX_8888:
-            config.output.colorspace = MODE_RGBA;
-            break;
-        default:
-            assert( 0 );
-            delete  [] buf;
-            return;
+// with lock_ held
+void WebpDecoder::AddDecodeTime(bool ok, uint64_t decodeUs) {
+    if (ok) {
+        stats_.frames_++;
+        stats_.totalDecodeUs_ += decodeUs;
+        if (decodeUs > stats_.maxDecodeUs_) {
+            stats_.maxDecodeUs_ = decodeUs;
+        }
+    } else {
+        stats_.failures_++;
     }
-    config.output.width = bufInfo_.width_;
-    config.output.height = bufInfo_.height_;
-    config.output.is_external_memory = 1;
-    config.output.private_memory = reinterpret_cast<uint8_t*>(buf_);
-    config.output.u.RGBA.stride = bufInfo_.stride_ * bytePerPix_;
-    config.output.u.RGBA.rgba  = config.output.private_memory;
-    config.output.u.RGBA.size  = config.output.height *
-                                 config.output.u.RGBA.stride;
+}
 
-    status = WebPDecode(buf, len, &config);
-    WebPFreeDecBuffer(&config.output);
-    delete [] buf;
+#ifdef __ANDROID__
+const size_t AssetPictureSource::kReadChunk;
 
-    // only change state when it is decoded OK. Our small decoder engine will be
-    // in decoding state when error happens
-    assert(status == VP8_STATUS_OK);
-    if (status == VP8_STATUS_OK) {
-        state_ = state_ready;
+/*
+ * AssetPictureSource::Decode():
+ *    decode one picture into dst, scaled to its size, without reading it all
+ *    in first:
+ *      - an asset stored uncompressed in the apk is mapped, and decoded in
+ *        place: no copy, and only the pages the decoder reads are loaded
+ *      - otherwise it is decoded chunk by chunk as it is read.
+ *    data is scratch memory for the chunks
+ */
+bool AssetPictureSource::Decode(const char* webpFile, std::vector<uint8_t>& data,
+                                const SurfaceBuffer& dst) {
+    // a picture that can't be read or decoded is skipped, not fatal
+    AAsset* frameFile = AAssetManager_open(assetMgr_, webpFile, AASSET_MODE_STREAMING);
+    if (frameFile == NULL) {
+        return false;
     }
+    bool ok = false;
+    off_t start, len;
+    int fd = AAsset_openFileDescriptor(frameFile, &start, &len);
+    if (fd >= 0) {
+        // mmap() wants a page aligned offset
+        off_t offset = start & ~static_cast<off_t>(sysconf(_SC_PAGESIZE) - 1);
+        size_t mapSize = static_cast<size_t>(start - offset + len);
+        void* map = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, offset);
+        close(fd);
+        if (map != MAP_FAILED) {
+            ok = DecodeWebp(static_cast<uint8_t*>(map) + (start - offset), len, dst);
+            munmap(map, mapSize);
+        }
+    } else {
+        if (data.size() < kReadChunk) {
+            data.resize(kReadChunk);
+        }
+        WebpStreamDecoder decoder(dst);
+        int32_t count;
+        while ((count = AAsset_read(frameFile, data.data(), kReadChunk)) > 0 &&
+               decoder.Append(data.data(), count)) {
+        }
+        ok = decoder.Done();
+    }
+    AAsset_close(frameFile);
+    return ok;
+}
+#endif
 
-    delete worker_;
-    worker_ = nullptr;
+/*
+ * PresentFrame():
+ *    Lock the surface and put the next frame on it:
+ *      - with a ring, copy the decoded frame; that is a single memcpy when
+ *        the surface has the layout the frames were decoded in, otherwise
+ *        the pixels are converted on the way
+ *      - without, decode the picture straight into the surface, no copy,
+ *        but on this thread and with the surface locked for the decode
+ */
+bool WebpDecoder::PresentFrame(OutputSurface* surface) {
+    if (files_.empty() || !frameSize_)
+        return false;
+    uint8_t* frame = nullptr;
+    if (!ring_.empty()) {
+        if (workers_.empty()) {
+            DecodeFrame();
+        }
+        frame = GetDecodedFrame();
+        if (!frame)
+            return false;
+    }
+
+    SurfaceBuffer dst;
+    if (!surface->Lock(&dst)) {
+        return false;
+    }
+    bool ok;
+    if (frame) {
+        SurfaceBuffer src = { bufInfo_, frame };
+        ok = CopyFrame(dst, src);
+    } else {
+        uint64_t start = NowUs();
+        ok = source_->Decode(files_[nextFile_++ % files_.size()], data_, dst);
+        pthread_mutex_lock(&lock_);
+        AddDecodeTime(ok, NowUs() - start);
+        pthread_mutex_unlock(&lock_);
+    }
+    if (!ok) {
+        // never show garbage
+        ClearFrame(dst);
+    }
+    surface->Post();
 
-    // if we were asked to release while we are busy decoding (at this point,
-    // this is dangling pointer), we perform the release here to complete the
-    // request.
-    if (stopPending_) {
-        stopPending_ = false;
-        delete  this;
+    if (frame) {
+        DecodeFrame();
     }
+    return ok;
 }
 
 /*
  * DecodeFrame(void):
- *     Start to decode a picture into internal frame memory
+ *     Release the frame returned by GetDecodedFrame(), so the workers decode
+ *     a later picture into its memory. The first call starts the workers.
  *     The internal memory layout and size are the same as andriod native
  *     window to save copying when possible.
  *
@@ -157,37 +285,49 @@ void WebpDecoder::DecodeFrameInternal() {
  *     window size.
  */
 bool WebpDecoder::DecodeFrame(void) {
-    if (state_ == state_decoding)
+    if (ring_.empty())
         return false;
-    pthread_t       worker_;
-    pthread_attr_t  attrib;
-    pthread_attr_init( &attrib);
-    pthread_attr_setdetachstate(&attrib, PTHREAD_CREATE_DETACHED);
-    int status = pthread_create(&worker_, &attrib, ::DecodeFrame, this);
-    pthread_attr_destroy(&attrib);
-
-    if (status == 0) {
-        state_ = state_decoding;
-        return true;
+    if (workers_.empty()) {
+        for (uint32_t i = 0; i < workerCount_; i++) {
+            pthread_t worker;
+            if (pthread_create(&worker, nullptr, ::DecodeFrame, this) != 0) {
+                // create thread failed... run with the workers we have
+                assert(false);
+                break;
+            }
+            workers_.push_back(worker);
+        }
+        return !workers_.empty();
     }
 
-    // create thread failed...
-    assert(false);
-    return false;
+    pthread_mutex_lock(&lock_);
+    bool released = headShown_;
+    if (headShown_) {
+        ring_[head_ % ring_.size()].state_ = state_idle;
+        head_++;
+        headShown_ = false;
+        headMissed_ = false;
+        pthread_cond_broadcast(&slotFree_);
+    }
+    pthread_mutex_unlock(&lock_);
+    return released;
 }
 
 /*
  * DestroyDecoder(void):
- *     Self-delete if decoder is idle
- *     Otherwise set up a flag to let decoding thread perform self-delete when
- *     it finishes. Upon returning from the function, the class pointer is invalid
- *     and should not be used
+ *     Stop the workers once they finish the pictures they are decoding, and
+ *     self-delete. Upon returning from the function, the class pointer is
+ *     invalid and should not be used
  */
 bool WebpDecoder::DestroyDecoder(void) {
-    if (state_ == state_decoding) {
-        stopPending_ = true;
-        return false;
+    pthread_mutex_lock(&lock_);
+    stopPending_ = true;
+    pthread_cond_broadcast(&slotFree_);
+    pthread_mutex_unlock(&lock_);
+    for (auto& worker : workers_) {
+        pthread_join(worker, nullptr);
     }
+    workers_.clear();
 
     delete this;
     return true;
@@ -197,7 +337,10 @@ bool WebpDecoder::DestroyDecoder(void) {
  * private destructor prevent object directly call delete
  */
 WebpDecoder::~WebpDecoder() {
-    if (buf_)  delete [] buf_;
-    buf_ = nullptr;
+    for (auto& slot : ring_) {
+        delete [] slot.buf_;
+        slot.buf_ = nullptr;
+    }
+    pthread_cond_destroy(&slotFree_);
+    pthread_mutex_destroy(&lock_);
 }
-
@@ -15,59 +15,144 @@
  */
 #ifndef __WEBP_DECODE_H__
 #define __WEBP_DECODE_H__
-#include <queue>
+#include <cstdint>
+#include <memory>
+#include <pthread.h>
+#include <vector>
+#ifdef __ANDROID__
 #include <android/asset_manager.h>
+#endif
+#include "webp_surface.h"
 
 enum DecodeState { state_idle, state_decoding, state_ready};
-enum class SurfaceFormat : unsigned int {
-    SURFACE_FORMAT_RGBA_8888,
-    SURFACE_FORMAT_RGBX_8888,
-    SURFACE_FORMAT_RGB_565,
-    SURFACE_FORMAT_YUV_420 // Not implemented yet
+
+/*
+ * Decoding statistics, since the decoder was created
+ */
+struct DecodeStats {
+    uint32_t frames_;       // decoded
+    uint32_t failures_;     // files that could not be decoded, skipped
+    uint32_t underruns_;    // frames asked for before they were decoded
+    uint32_t ready_;        // frames decoded ahead, right now
+    uint64_t totalDecodeUs_;
+    uint64_t maxDecodeUs_;
 };
-struct DecodeSurfaceDescriptor {
-    // surface size in pixels
-    int32_t width_, height_, stride_;
-    SurfaceFormat format_;
+
+/*
+ * Where the decoder gets its pictures from: Decode() decodes one, by name,
+ * into dst. It is called from several workers at once; data is the calling
+ * worker's scratch memory, for the compressed bytes
+ */
+class PictureSource {
+  public:
+    virtual ~PictureSource() {}
+    virtual bool Decode(const char* name, std::vector<uint8_t>& data,
+                        const SurfaceBuffer& dst) = 0;
+};
+
+#ifdef __ANDROID__
+/*
+ * The pictures in the app's assets
+ */
+class AssetPictureSource : public PictureSource {
+  public:
+    // compressed assets are read and decoded this much at a time
+    static const size_t kReadChunk = 64 * 1024;
+
+    explicit AssetPictureSource(AAssetManager* assetMgr) : assetMgr_(assetMgr) {}
+    bool Decode(const char* name, std::vector<uint8_t>& data,
+                const SurfaceBuffer& dst) override;
+
+  private:
+    AAssetManager* assetMgr_;
 };
+#endif
 
 /*
  * Webp decoder wrapper:
- *     Select a picture to decode in its own thread. The thread is deleted
- *     once a picture is decoded into its internal memory. The next picture
- *     will be decoded when:
- *       - the decoded frame is retrieved
- *       - Another DecodeFrame() is called [this is trigger]
+ *     Decodes the pictures in turn, round and round, on a pool of worker
+ *     threads that live as long as the decoder. The decoded frames go into a
+ *     ring of buffers allocated once, up to depth frames ahead of display;
+ *     the workers wait when the ring is full. A frame is shown with:
+ *       - GetDecodedFrame() to get the next frame, if it is decoded
+ *       - DecodeFrame() once done with it, so its buffer is decoded into again
+ *     or with PresentFrame(), which does both and copies the frame onto a
+ *     surface. The ring can be in another format than the surface: in YUV
+ *     420 it takes 1.5 bytes a pixel, converted to RGB as frames are shown.
+ *     With a depth of 0 there are no workers and no ring:
+ *     PresentFrame() decodes each picture straight into the surface, on the
+ *     calling thread while the surface is locked.
  *    when display format changes, call DestroyDecoder() to release this decoder
  *    and allocate a new deocder object.
  */
 class WebpDecoder {
   public:
+    static const uint32_t kDefaultDepth = 3;
+
+    // workers: 0 picks a count from the number of CPUs. The source must
+    // outlive the decoder
     explicit WebpDecoder(const char** files, uint32_t count,
                          DecodeSurfaceDescriptor* surfDesc,
-                         AAssetManager* assetMgr);
-    // Start decode a picture
+                         PictureSource* source,
+                         uint32_t depth = kDefaultDepth,
+                         uint32_t workers = 0);
+#ifdef __ANDROID__
+    // decodes the pictures from the app's assets
+    explicit WebpDecoder(const char** files, uint32_t count,
+                         DecodeSurfaceDescriptor* surfDesc,
+                         AAssetManager* assetMgr,
+                         uint32_t depth = kDefaultDepth,
+                         uint32_t workers = 0);
+#endif
+    // Done with the frame from GetDecodedFrame(), decode into it again.
+    // Starts the workers the first time.
     bool     DecodeFrame(void);
 
-    // Poll to see if a picture is decoded and ready to be used/displayed
+    // Poll to see if a picture is decoded and ready to be used/displayed.
+    // The same frame is returned until DecodeFrame() is called
     uint8_t *GetDecodedFrame(void);
 
+    // Show the next frame on surface, if it is decoded (or, with no ring,
+    // decode it there). Returns false if there was nothing to show
+    bool     PresentFrame(OutputSurface* surface);
+
+    void     GetStats(DecodeStats* stats);
+
     // WebpDecoder internal decoding function, no called from user
     void     DecodeFrameInternal(void);
 
-    // Release this decoder after usage
+    // Release this decoder after usage; waits for the frames being decoded
     bool     DestroyDecoder(void);
 
   private:
+    struct FrameSlot {
+        uint8_t*    buf_;
+        DecodeState state_;
+        bool        failed_;
+    };
+    void AddDecodeTime(bool ok, uint64_t decodeUs);
+
     DecodeSurfaceDescriptor bufInfo_;
-    AAssetManager*          assetMgr_;
-    std::queue<const char*> files_;
-    uint8_t*  buf_;
+    PictureSource*          source_;
+    std::unique_ptr<PictureSource> ownedSource_;
+    std::vector<const char*> files_;
+    std::vector<FrameSlot>  ring_;
+    size_t    frameSize_;
+    // the next picture and its read buffer, when decoding without a ring
+    uint64_t  nextFile_;
+    std::vector<uint8_t> data_;
+
+    // frames [head_, next_) are decoding or decoded, next_ is the next to
+    // hand to a worker; both only grow
+    uint64_t  head_, next_;
+    bool      headShown_, headMissed_;
     bool      stopPending_;
-    DecodeState state_;
+    DecodeStats stats_;
 
-    uint32_t   bytePerPix_;
-    pthread_t* worker_;
+    std::vector<pthread_t> workers_;
+    uint32_t        workerCount_;
+    pthread_mutex_t lock_;
+    pthread_cond_t  slotFree_;
     /*
      * private destructor prevent object directly call delete
      */
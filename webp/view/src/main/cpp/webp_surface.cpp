@@ -0,0 +1,508 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cstring>
+#include <webp/decode.h>
+#include "webp_surface.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+MemorySurface::MemorySurface(const DecodeSurfaceDescriptor& desc)
+    : posts_(0) {
+    buf_.desc_ = desc;
+    bits_.resize(FrameSize(desc));
+    buf_.bits_ = bits_.data();
+}
+
+bool MemorySurface::Lock(SurfaceBuffer* buf) {
+    *buf = buf_;
+    return true;
+}
+
+void MemorySurface::Post(void) {
+    posts_++;
+}
+
+uint32_t BytesPerPixel(SurfaceFormat format) {
+    switch (format) {
+        case SurfaceFormat::SURFACE_FORMAT_RGB_565:
+            return 2;
+        case SurfaceFormat::SURFACE_FORMAT_RGBA_8888:
+        case SurfaceFormat::SURFACE_FORMAT_RGBX_8888:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+YuvPlanes GetYuvPlanes(const SurfaceBuffer& buf) {
+    YuvPlanes planes;
+    planes.yStride_ = buf.desc_.stride_;
+    planes.uvStride_ = (buf.desc_.stride_ + 1) / 2;
+    planes.uvWidth_ = (buf.desc_.width_ + 1) / 2;
+    planes.uvHeight_ = (buf.desc_.height_ + 1) / 2;
+    planes.y_ = buf.bits_;
+    planes.u_ = planes.y_ + static_cast<size_t>(planes.yStride_) * buf.desc_.height_;
+    planes.v_ = planes.u_ + static_cast<size_t>(planes.uvStride_) * planes.uvHeight_;
+    return planes;
+}
+
+size_t FrameSize(const DecodeSurfaceDescriptor& desc) {
+    if (desc.format_ == SurfaceFormat::SURFACE_FORMAT_YUV_420) {
+        return static_cast<size_t>(desc.stride_) * desc.height_ +
+               static_cast<size_t>((desc.stride_ + 1) / 2) * ((desc.height_ + 1) / 2) * 2;
+    }
+    return static_cast<size_t>(desc.stride_) * desc.height_ * BytesPerPixel(desc.format_);
+}
+
+/*
+ * InitDecoderConfig():
+ *    set up config to decode into dst: libwebp writes the pixels straight
+ *    into it (external memory), with its stride, so there is nothing to copy
+ *    afterwards
+ */
+static bool InitDecoderConfig(WebPDecoderConfig* config, const SurfaceBuffer& dst,
+                              const DecodeRegion* region) {
+    if (!WebPInitDecoderConfig(config)) {
+        return false;
+    }
+
+    // let's decode it into a buffer ...
+    config->options.bypass_filtering = 1;
+    config->options.no_fancy_upsampling = 1;
+    config->options.flip = 0;
+    if (region) {
+        config->options.use_cropping = 1;
+        config->options.crop_left = region->left_;
+        config->options.crop_top = region->top_;
+        config->options.crop_width = region->width_;
+        config->options.crop_height = region->height_;
+    }
+    config->options.use_scaling = 1;
+    config->options.scaled_width = dst.desc_.width_;
+    config->options.scaled_height = dst.desc_.height_;
+
+    // this does not seems to have difference on Nexus 5
+    config->options.use_threads = 1;
+    config->output.width = dst.desc_.width_;
+    config->output.height = dst.desc_.height_;
+    config->output.is_external_memory = 1;
+    switch (dst.desc_.format_) {
+        case SurfaceFormat::SURFACE_FORMAT_RGB_565:
+            config->output.colorspace = MODE_RGB_565;
+            break;
+        case SurfaceFormat::SURFACE_FORMAT_RGBA_8888:
+        case SurfaceFormat::SURFACE_FORMAT_RGBX_8888:
+            config->output.colorspace = MODE_RGBA;
+            break;
+        case SurfaceFormat::SURFACE_FORMAT_YUV_420: {
+            // the decoder's own planes, no conversion at all
+            YuvPlanes planes = GetYuvPlanes(dst);
+            WebPYUVABuffer& yuv = config->output.u.YUVA;
+            config->output.colorspace = MODE_YUV;
+            yuv.y = planes.y_;
+            yuv.u = planes.u_;
+            yuv.v = planes.v_;
+            yuv.y_stride = planes.yStride_;
+            yuv.u_stride = yuv.v_stride = planes.uvStride_;
+            yuv.y_size = static_cast<size_t>(planes.yStride_) * dst.desc_.height_;
+            yuv.u_size = yuv.v_size = static_cast<size_t>(planes.uvStride_) * planes.uvHeight_;
+            return true;
+        }
+        default:
+            return false;
+    }
+    config->output.u.RGBA.rgba  = dst.bits_;
+    config->output.u.RGBA.stride = dst.desc_.stride_ * BytesPerPixel(dst.desc_.format_);
+    config->output.u.RGBA.size  = config->output.height *
+                                  config->output.u.RGBA.stride;
+    return true;
+}
+
+bool DecodeWebp(const uint8_t* data, size_t size, const SurfaceBuffer& dst,
+                const DecodeRegion* region) {
+    WebPDecoderConfig config;
+    if (!InitDecoderConfig(&config, dst, region) ||
+            WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK) {
+        return false;
+    }
+    // no rescaler when the picture (or region) is the size of dst: it is
+    // quicker, and regions then give exactly the pixels of a full decode
+    int32_t width = region ? region->width_ : config.input.width;
+    int32_t height = region ? region->height_ : config.input.height;
+    if (width == dst.desc_.width_ && height == dst.desc_.height_) {
+        config.options.use_scaling = 0;
+    }
+    VP8StatusCode status = WebPDecode(data, size, &config);
+    WebPFreeDecBuffer(&config.output);
+    return status == VP8_STATUS_OK;
+}
+
+WebpStreamDecoder::WebpStreamDecoder(const SurfaceBuffer& dst,
+                                     const DecodeRegion* region)
+    : config_(new WebPDecoderConfig()), idec_(nullptr),
+      done_(false), failed_(true) {
+    if (InitDecoderConfig(config_, dst, region)) {
+        idec_ = WebPIDecode(nullptr, 0, config_);
+        failed_ = (idec_ == nullptr);
+    }
+}
+
+WebpStreamDecoder::~WebpStreamDecoder() {
+    if (idec_) {
+        WebPIDelete(idec_);
+    }
+    WebPFreeDecBuffer(&config_->output);
+    delete config_;
+}
+
+bool WebpStreamDecoder::Check(int status) {
+    if (status == VP8_STATUS_OK) {
+        done_ = true;
+    } else if (status != VP8_STATUS_SUSPENDED) {
+        failed_ = true;
+    }
+    return !done_ && !failed_;
+}
+
+bool WebpStreamDecoder::Append(const uint8_t* data, size_t size) {
+    if (done_ || failed_) {
+        return false;
+    }
+    return Check(WebPIAppend(idec_, data, size));
+}
+
+bool WebpStreamDecoder::Update(const uint8_t* data, size_t size) {
+    if (done_ || failed_) {
+        return false;
+    }
+    return Check(WebPIUpdate(idec_, data, size));
+}
+
+int32_t WebpStreamDecoder::Rows(void) const {
+    int left, top, width, height = 0;
+    if (!idec_ || !WebPIDecodedArea(idec_, &left, &top, &width, &height)) {
+        return 0;
+    }
+    return height;
+}
+
+/*
+ * Rgba8888ToRgb565():
+ *    pack a row, dropping the low bits and alpha
+ */
+static void Rgba8888ToRgb565(uint16_t* dst, const uint8_t* src, int32_t width) {
+    int32_t x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x4_t rgba = vld4_u8(src + x * 4);
+        uint16x8_t pix = vshll_n_u8(rgba.val[0], 8);
+        pix = vsriq_n_u16(pix, vshll_n_u8(rgba.val[1], 8), 5);
+        pix = vsriq_n_u16(pix, vshll_n_u8(rgba.val[2], 8), 11);
+        vst1q_u16(dst + x, pix);
+    }
+#elif defined(__SSE2__)
+    const __m128i redMask = _mm_set1_epi32(0xf8);
+    const __m128i greenMask = _mm_set1_epi32(0xfc00);
+    const __m128i blueMask = _mm_set1_epi32(0xf80000);
+    // packs saturates signed, so pack pixel - 0x8000 and add it back
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+    for (; x + 8 <= width; x += 8) {
+        __m128i pix[2];
+        for (int i = 0; i < 2; i++) {
+            __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x + i * 4) * 4));
+            __m128i r = _mm_slli_epi32(_mm_and_si128(p, redMask), 8);
+            __m128i g = _mm_srli_epi32(_mm_and_si128(p, greenMask), 5);
+            __m128i b = _mm_srli_epi32(_mm_and_si128(p, blueMask), 19);
+            pix[i] = _mm_sub_epi32(_mm_or_si128(r, _mm_or_si128(g, b)), bias32);
+        }
+        __m128i packed = _mm_add_epi16(_mm_packs_epi32(pix[0], pix[1]), bias16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), packed);
+    }
+#endif
+    for (; x < width; x++) {
+        const uint8_t* p = src + x * 4;
+        dst[x] = static_cast<uint16_t>(((p[0] & 0xf8) << 8) | ((p[1] & 0xfc) << 3) | (p[2] >> 3));
+    }
+}
+
+/*
+ * Rgb565ToRgba8888():
+ *    expand a row, repeating the high bits into the low ones, opaque
+ */
+static void Rgb565ToRgba8888(uint8_t* dst, const uint16_t* src, int32_t width) {
+    int32_t x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 8 <= width; x += 8) {
+        uint16x8_t pix = vld1q_u16(src + x);
+        uint8x8x4_t rgba;
+        rgba.val[0] = vshrn_n_u16(pix, 8);
+        rgba.val[0] = vsri_n_u8(rgba.val[0], rgba.val[0], 5);
+        rgba.val[1] = vshrn_n_u16(pix, 3);
+        rgba.val[1] = vsri_n_u8(rgba.val[1], rgba.val[1], 6);
+        rgba.val[2] = vmovn_u16(vshlq_n_u16(pix, 3));
+        rgba.val[2] = vsri_n_u8(rgba.val[2], rgba.val[2], 5);
+        rgba.val[3] = vdup_n_u8(0xff);
+        vst4_u8(dst + x * 4, rgba);
+    }
+#elif defined(__SSE2__)
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    const __m128i alpha = _mm_set1_epi16(static_cast<int16_t>(0xff00));
+    for (; x + 8 <= width; x += 8) {
+        __m128i pix = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        __m128i r = _mm_srli_epi16(pix, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(pix, 5), mask6);
+        __m128i b = _mm_and_si128(pix, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+    for (; x < width; x++) {
+        uint32_t r = src[x] >> 11, g = (src[x] >> 5) & 0x3f, b = src[x] & 0x1f;
+        uint8_t* p = dst + x * 4;
+        p[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+        p[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+        p[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+        p[3] = 0xff;
+    }
+}
+
+/*
+ * YuvToRgba8888():
+ *    convert a row, each U and V sample serving two pixels (the decoder's
+ *    point upsampling); the arithmetic is libwebp's, so the pixels are what
+ *    decoding to RGBA gives
+ */
+static inline int32_t MultHi(int32_t v, int32_t coeff) {
+    return (v * coeff) >> 8;
+}
+
+static inline uint8_t Clip8(int32_t v) {
+    return static_cast<uint8_t>(!(v & ~16383) ? v >> 6 : (v < 0) ? 0 : 255);
+}
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+static inline uint16x8_t MultHi(uint16x8_t v, uint16_t coeff) {
+    return vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(v), coeff), 8),
+                        vshrn_n_u32(vmull_n_u16(vget_high_u16(v), coeff), 8));
+}
+#endif
+
+static void YuvToRgba8888(uint8_t* dst, const uint8_t* y, const uint8_t* u,
+                          const uint8_t* v, int32_t width) {
+    int32_t x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t y8 = vld1q_u8(y + x);
+        uint8x8_t u8 = vld1_u8(u + x / 2), v8 = vld1_u8(v + x / 2);
+        uint8x8x2_t uu = vzip_u8(u8, u8), vv = vzip_u8(v8, v8);
+        for (int i = 0; i < 2; i++) {
+            uint16x8_t y1 = MultHi(vmovl_u8(i ? vget_high_u8(y8) : vget_low_u8(y8)), 19077);
+            uint16x8_t u16 = vmovl_u8(uu.val[i]), v16 = vmovl_u8(vv.val[i]);
+            int16x8_t r = vreinterpretq_s16_u16(vaddq_u16(y1, MultHi(v16, 26149)));
+            r = vsubq_s16(r, vdupq_n_s16(14234));
+            int16x8_t g = vreinterpretq_s16_u16(vaddq_u16(y1, vdupq_n_u16(8708)));
+            g = vsubq_s16(g, vreinterpretq_s16_u16(vaddq_u16(MultHi(u16, 6419),
+                                                             MultHi(v16, 13320))));
+            // blue goes over 32767: unsigned, saturated
+            uint16x8_t b = vqsubq_u16(vqaddq_u16(y1, MultHi(u16, 33050)), vdupq_n_u16(17685));
+            uint8x8x4_t rgba;
+            rgba.val[0] = vqshrun_n_s16(r, 6);
+            rgba.val[1] = vqshrun_n_s16(g, 6);
+            rgba.val[2] = vqmovn_u16(vshrq_n_u16(b, 6));
+            rgba.val[3] = vdup_n_u8(0xff);
+            vst4_u8(dst + (x + i * 8) * 4, rgba);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+        __m128i u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2));
+        __m128i v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2));
+        u8 = _mm_unpacklo_epi8(u8, u8);
+        v8 = _mm_unpacklo_epi8(v8, v8);
+        __m128i r[2], g[2], b[2];
+        for (int i = 0; i < 2; i++) {
+            // samples in the high bytes: mulhi by the coefficient is MultHi()
+            __m128i y16 = i ? _mm_unpackhi_epi8(zero, y8) : _mm_unpacklo_epi8(zero, y8);
+            __m128i u16 = i ? _mm_unpackhi_epi8(zero, u8) : _mm_unpacklo_epi8(zero, u8);
+            __m128i v16 = i ? _mm_unpackhi_epi8(zero, v8) : _mm_unpacklo_epi8(zero, v8);
+            __m128i y1 = _mm_mulhi_epu16(y16, _mm_set1_epi16(19077));
+            r[i] = _mm_add_epi16(_mm_sub_epi16(y1, _mm_set1_epi16(14234)),
+                                 _mm_mulhi_epu16(v16, _mm_set1_epi16(26149)));
+            g[i] = _mm_sub_epi16(_mm_add_epi16(y1, _mm_set1_epi16(8708)),
+                                 _mm_add_epi16(_mm_mulhi_epu16(u16, _mm_set1_epi16(6419)),
+                                               _mm_mulhi_epu16(v16, _mm_set1_epi16(13320))));
+            // blue goes over 32767: unsigned, saturated
+            b[i] = _mm_subs_epu16(_mm_adds_epu16(y1, _mm_mulhi_epu16(
+                                          u16, _mm_set1_epi16(static_cast<int16_t>(33050)))),
+                                  _mm_set1_epi16(17685));
+            r[i] = _mm_srai_epi16(r[i], 6);
+            g[i] = _mm_srai_epi16(g[i], 6);
+            b[i] = _mm_srli_epi16(b[i], 6);
+        }
+        __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+        __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+        __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+        __m128i rg[2] = {_mm_unpacklo_epi8(r8, g8), _mm_unpackhi_epi8(r8, g8)};
+        __m128i ba[2] = {_mm_unpacklo_epi8(b8, alpha), _mm_unpackhi_epi8(b8, alpha)};
+        __m128i* out = reinterpret_cast<__m128i*>(dst + x * 4);
+        for (int i = 0; i < 2; i++) {
+            _mm_storeu_si128(out + i * 2, _mm_unpacklo_epi16(rg[i], ba[i]));
+            _mm_storeu_si128(out + i * 2 + 1, _mm_unpackhi_epi16(rg[i], ba[i]));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        int32_t y1 = MultHi(y[x], 19077), u1 = u[x / 2], v1 = v[x / 2];
+        uint8_t* p = dst + x * 4;
+        p[0] = Clip8(y1 + MultHi(v1, 26149) - 14234);
+        p[1] = Clip8(y1 - MultHi(u1, 6419) - MultHi(v1, 13320) + 8708);
+        p[2] = Clip8(y1 + MultHi(u1, 33050) - 17685);
+        p[3] = 0xff;
+    }
+}
+
+/*
+ * YuvToRgb565():
+ *    convert a row through RGBA, a piece at a time so it stays in the cache
+ */
+static void YuvToRgb565(uint16_t* dst, const uint8_t* y, const uint8_t* u,
+                        const uint8_t* v, int32_t width) {
+    const int32_t kPiece = 64;  // even, so pieces start on a U and V sample
+    uint8_t rgba[kPiece * 4];
+    for (int32_t x = 0; x < width; x += kPiece) {
+        int32_t count = std::min(kPiece, width - x);
+        YuvToRgba8888(rgba, y + x, u + x / 2, v + x / 2, count);
+        Rgba8888ToRgb565(dst + x, rgba, count);
+    }
+}
+
+static void CopyPlane(uint8_t* dst, int32_t dstStride, const uint8_t* src,
+                      int32_t srcStride, int32_t width, int32_t height) {
+    for (auto y = 0; y < height; y++) {
+        memcpy(dst, src, width);
+        dst += dstStride, src += srcStride;
+    }
+}
+
+/*
+ * CopyYuvFrame():
+ *    YUV 420 to YUV 420, or converted to RGB: only here do frames kept in
+ *    YUV pay for the conversion
+ */
+static bool CopyYuvFrame(const SurfaceBuffer& dst, const SurfaceBuffer& src) {
+    const DecodeSurfaceDescriptor& d = dst.desc_;
+    YuvPlanes s = GetYuvPlanes(src);
+    if (d.format_ == SurfaceFormat::SURFACE_FORMAT_YUV_420) {
+        if (d.stride_ == src.desc_.stride_) {
+            memcpy(dst.bits_, src.bits_, FrameSize(d));
+            return true;
+        }
+        YuvPlanes p = GetYuvPlanes(dst);
+        CopyPlane(p.y_, p.yStride_, s.y_, s.yStride_, d.width_, d.height_);
+        CopyPlane(p.u_, p.uvStride_, s.u_, s.uvStride_, s.uvWidth_, s.uvHeight_);
+        CopyPlane(p.v_, p.uvStride_, s.v_, s.uvStride_, s.uvWidth_, s.uvHeight_);
+        return true;
+    }
+    uint32_t dstBpp = BytesPerPixel(d.format_);
+    if (!dstBpp) {
+        return false;
+    }
+    uint8_t* dstRow = dst.bits_;
+    for (auto y = 0; y < d.height_; y++) {
+        const uint8_t* yRow = s.y_ + static_cast<size_t>(y) * s.yStride_;
+        size_t uvOffset = static_cast<size_t>(y / 2) * s.uvStride_;
+        if (dstBpp == 2) {
+            YuvToRgb565(reinterpret_cast<uint16_t*>(dstRow), yRow,
+                        s.u_ + uvOffset, s.v_ + uvOffset, d.width_);
+        } else {
+            YuvToRgba8888(dstRow, yRow, s.u_ + uvOffset, s.v_ + uvOffset, d.width_);
+        }
+        dstRow += static_cast<size_t>(d.stride_) * dstBpp;
+    }
+    return true;
+}
+
+bool CopyFrame(const SurfaceBuffer& dst, const SurfaceBuffer& src) {
+    const DecodeSurfaceDescriptor& d = dst.desc_;
+    const DecodeSurfaceDescriptor& s = src.desc_;
+    if (d.width_ != s.width_ || d.height_ != s.height_) {
+        return false;
+    }
+    if (d.height_ <= 0) {
+        return true;
+    }
+    if (s.format_ == SurfaceFormat::SURFACE_FORMAT_YUV_420) {
+        return CopyYuvFrame(dst, src);
+    }
+    uint32_t dstBpp = BytesPerPixel(d.format_), srcBpp = BytesPerPixel(s.format_);
+    if (!dstBpp || !srcBpp) {
+        return false;
+    }
+    size_t dstStride = static_cast<size_t>(d.stride_) * dstBpp;
+    size_t srcStride = static_cast<size_t>(s.stride_) * srcBpp;
+    uint8_t* dstRow = dst.bits_;
+    const uint8_t* srcRow = src.bits_;
+
+    if (dstBpp == srcBpp) {
+        // RGBA and RGBX are the same bytes
+        size_t rowSize = static_cast<size_t>(d.width_) * dstBpp;
+        if (dstStride == srcStride) {
+            memcpy(dstRow, srcRow, dstStride * (d.height_ - 1) + rowSize);
+            return true;
+        }
+        for (auto y = 0; y < d.height_; y++) {
+            memcpy(dstRow, srcRow, rowSize);
+            dstRow += dstStride, srcRow += srcStride;
+        }
+        return true;
+    }
+    for (auto y = 0; y < d.height_; y++) {
+        if (dstBpp == 2) {
+            Rgba8888ToRgb565(reinterpret_cast<uint16_t*>(dstRow), srcRow, d.width_);
+        } else {
+            Rgb565ToRgba8888(dstRow, reinterpret_cast<const uint16_t*>(srcRow), d.width_);
+        }
+        dstRow += dstStride, srcRow += srcStride;
+    }
+    return true;
+}
+
+void ClearFrame(const SurfaceBuffer& dst) {
+    // the padding at the end of the rows is ours too: blank it all at once
+    if (dst.desc_.format_ == SurfaceFormat::SURFACE_FORMAT_YUV_420) {
+        // black is Y 16, with neutral U and V
+        YuvPlanes planes = GetYuvPlanes(dst);
+        memset(planes.y_, 16, planes.u_ - planes.y_);
+        memset(planes.u_, 128, dst.bits_ + FrameSize(dst.desc_) - planes.u_);
+        return;
+    }
+    memset(dst.bits_, 0, FrameSize(dst.desc_));
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBP_SURFACE_H__
+#define __WEBP_SURFACE_H__
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct WebPDecoderConfig;
+struct WebPIDecoder;
+
+enum class SurfaceFormat : unsigned int {
+    SURFACE_FORMAT_RGBA_8888,
+    SURFACE_FORMAT_RGBX_8888,
+    SURFACE_FORMAT_RGB_565,
+    SURFACE_FORMAT_YUV_420 // planar, see YuvPlanes
+};
+struct DecodeSurfaceDescriptor {
+    // surface size in pixels
+    int32_t width_, height_, stride_;
+    SurfaceFormat format_;
+};
+
+/*
+ * Pixels of a locked surface, or of a decoded frame: height_ rows of
+ * stride_ pixels each. YUV 420 frames hold their planes one after the
+ * other, see GetYuvPlanes()
+ */
+struct SurfaceBuffer {
+    DecodeSurfaceDescriptor desc_;
+    uint8_t* bits_;
+};
+
+/*
+ * Part of a picture, in its pixels
+ */
+struct DecodeRegion {
+    int32_t left_, top_, width_, height_;
+};
+
+/*
+ * Somewhere to show frames: lock it, write the pixels, post it.
+ * Android windows are one (see webp_view.cpp), MemorySurface is another
+ */
+class OutputSurface {
+  public:
+    virtual ~OutputSurface() {}
+    // false if the surface can't be drawn to now
+    virtual bool Lock(SurfaceBuffer* buf) = 0;
+    virtual void Post(void) = 0;
+};
+
+/*
+ * A surface in memory, for testing off device
+ */
+class MemorySurface : public OutputSurface {
+  public:
+    explicit MemorySurface(const DecodeSurfaceDescriptor& desc);
+    bool Lock(SurfaceBuffer* buf) override;
+    void Post(void) override;
+
+    const SurfaceBuffer& Buffer(void) const { return buf_; }
+    uint32_t Posts(void) const { return posts_; }
+
+  private:
+    std::vector<uint8_t> bits_;
+    SurfaceBuffer buf_;
+    uint32_t posts_;
+};
+
+/*
+ * The planes of a YUV 420 frame: Y, then U and V at half the size each way
+ * (rounded up), with half the stride
+ */
+struct YuvPlanes {
+    uint8_t *y_, *u_, *v_;
+    int32_t yStride_, uvStride_;    // in bytes
+    int32_t uvWidth_, uvHeight_;
+};
+YuvPlanes GetYuvPlanes(const SurfaceBuffer& buf);
+
+// 0 for formats without packed pixels
+uint32_t BytesPerPixel(SurfaceFormat format);
+// bytes of a whole frame, all its planes and row padding included; 0 for
+// unknown formats
+size_t FrameSize(const DecodeSurfaceDescriptor& desc);
+
+// Decode a webp picture straight into dst, scaled to its size. With a
+// region, only that part of the picture is decoded (and scaled), and the
+// rows below it are not decoded at all
+bool DecodeWebp(const uint8_t* data, size_t size, const SurfaceBuffer& dst,
+                const DecodeRegion* region = nullptr);
+
+/*
+ * Decode a webp picture as its bytes arrive, into dst, as DecodeWebp() does.
+ * Either Append() the bytes as they come (they are copied), or Update() with
+ * all the bytes so far when they stay in one place, like a mapped file.
+ */
+class WebpStreamDecoder {
+  public:
+    explicit WebpStreamDecoder(const SurfaceBuffer& dst,
+                               const DecodeRegion* region = nullptr);
+    ~WebpStreamDecoder();
+
+    // false once the picture is decoded, or on an error
+    bool Append(const uint8_t* data, size_t size);
+    bool Update(const uint8_t* data, size_t size);
+
+    bool Done(void) const { return done_; }
+    bool Failed(void) const { return failed_; }
+    // rows of dst decoded so far, to show a picture while it loads
+    int32_t Rows(void) const;
+
+  private:
+    bool Check(int status);
+
+    // libwebp keeps pointers into the config, for as long as idec_ lives
+    WebPDecoderConfig* config_;
+    WebPIDecoder* idec_;
+    bool done_, failed_;
+};
+
+// Copy a frame of the same size, converting the pixels if the formats
+// differ, in a single pass. YUV 420 converts to RGB, not the other way
+bool CopyFrame(const SurfaceBuffer& dst, const SurfaceBuffer& src);
+
+// Blank (black) the surface
+void ClearFrame(const SurfaceBuffer& dst);
+#endif // __WEBP_SURFACE_H__
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <webp/decode.h>
+#include "webp_tiles.h"
+
+static uint64_t TileKey(int32_t level, int32_t column, int32_t row) {
+    return (static_cast<uint64_t>(level) << 48) |
+           (static_cast<uint64_t>(row) << 24) | static_cast<uint64_t>(column);
+}
+
+WebpTileCache::WebpTileCache(const uint8_t* data, size_t size, SurfaceFormat format,
+                             int32_t tileSize, uint32_t maxTiles)
+    : data_(data), size_(size), format_(format),
+      width_(0), height_(0), tileSize_(tileSize), maxTiles_(maxTiles),
+      stats_() {
+    int width, height;
+    if (BytesPerPixel(format) && tileSize > 0 &&
+            WebPGetInfo(data, size, &width, &height)) {
+        width_ = width;
+        height_ = height;
+    }
+}
+
+int32_t WebpTileCache::Width(int32_t level) const {
+    return (width_ + (1 << level) - 1) >> level;
+}
+
+int32_t WebpTileCache::Height(int32_t level) const {
+    return (height_ + (1 << level) - 1) >> level;
+}
+
+/*
+ * TileBuffer():
+ *     the layout of a tile: tiles on the right and bottom edges are cut short
+ */
+SurfaceBuffer WebpTileCache::TileBuffer(int32_t level, int32_t column, int32_t row,
+                                        uint8_t* bits) const {
+    SurfaceBuffer buf;
+    buf.desc_.width_ = std::min(tileSize_, Width(level) - column * tileSize_);
+    buf.desc_.height_ = std::min(tileSize_, Height(level) - row * tileSize_);
+    buf.desc_.stride_ = buf.desc_.width_;
+    buf.desc_.format_ = format_;
+    buf.bits_ = bits;
+    return buf;
+}
+
+/*
+ * Blit():
+ *     copy the part of src from (srcX, srcY) that lands in dst at (x, y)
+ */
+void WebpTileCache::Blit(const SurfaceBuffer& src, int32_t srcX, int32_t srcY,
+                         int32_t x, int32_t y, const SurfaceBuffer& dst) {
+    uint32_t bpp = BytesPerPixel(format_);
+    int32_t width = std::min(src.desc_.width_ - srcX, dst.desc_.width_ - x);
+    int32_t height = std::min(src.desc_.height_ - srcY, dst.desc_.height_ - y);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    SurfaceBuffer from = src, to = dst;
+    from.desc_.width_ = to.desc_.width_ = width;
+    from.desc_.height_ = to.desc_.height_ = height;
+    from.bits_ += (static_cast<size_t>(srcY) * src.desc_.stride_ + srcX) * bpp;
+    to.bits_ += (static_cast<size_t>(y) * dst.desc_.stride_ + x) * bpp;
+    CopyFrame(to, from);
+}
+
+/*
+ * Insert():
+ *     cache the tile at bandX of a decoded band, reusing the memory of the
+ *     least recently drawn tile when the cache is full
+ */
+void WebpTileCache::Insert(uint64_t key, const SurfaceBuffer& band, int32_t bandX) {
+    if (!maxTiles_) {
+        return;
+    }
+    if (tiles_.size() >= maxTiles_) {
+        tiles_.splice(tiles_.begin(), tiles_, std::prev(tiles_.end()));
+        index_.erase(tiles_.front().key_);
+        stats_.evictions_++;
+    } else {
+        tiles_.emplace_front();
+    }
+    Tile& tile = tiles_.front();
+    tile.key_ = key;
+    int32_t level = static_cast<int32_t>(key >> 48);
+    int32_t row = static_cast<int32_t>((key >> 24) & 0xffffff);
+    int32_t column = static_cast<int32_t>(key & 0xffffff);
+    uint32_t bpp = BytesPerPixel(format_);
+    SurfaceBuffer buf = TileBuffer(level, column, row, nullptr);
+    tile.bits_.resize(static_cast<size_t>(buf.desc_.stride_) * buf.desc_.height_ * bpp);
+    buf.bits_ = tile.bits_.data();
+
+    SurfaceBuffer from = band;
+    from.desc_.width_ = buf.desc_.width_;
+    from.bits_ += static_cast<size_t>(bandX) * bpp;
+    CopyFrame(buf, from);
+    index_[key] = tiles_.begin();
+}
+
+/*
+ * DecodeBand():
+ *     decode tiles first to last of a row in one go, draw them, and cache
+ *     them. Only the rows of the picture down to the band's are decoded
+ */
+bool WebpTileCache::DecodeBand(int32_t level, int32_t row, int32_t first, int32_t last,
+                               int32_t x, int32_t y, const SurfaceBuffer& dst) {
+    int32_t left = first * tileSize_;
+    int32_t top = row * tileSize_;
+    int32_t right = std::min((last + 1) * tileSize_, Width(level));
+    int32_t bottom = std::min(top + tileSize_, Height(level));
+
+    SurfaceBuffer band;
+    band.desc_.width_ = right - left;
+    band.desc_.height_ = bottom - top;
+    band.desc_.stride_ = band.desc_.width_;
+    band.desc_.format_ = format_;
+    band_.resize(static_cast<size_t>(band.desc_.stride_) * band.desc_.height_ *
+                 BytesPerPixel(format_));
+    band.bits_ = band_.data();
+
+    // the band in the full size picture
+    DecodeRegion region;
+    region.left_ = left << level;
+    region.top_ = top << level;
+    region.width_ = std::min(right << level, width_) - region.left_;
+    region.height_ = std::min(bottom << level, height_) - region.top_;
+    stats_.decodes_++;
+    if (!DecodeWebp(data_, size_, band, &region)) {
+        return false;
+    }
+
+    for (int32_t column = first; column <= last; column++) {
+        int32_t bandX = column * tileSize_ - left;
+        if (!index_.count(TileKey(level, column, row))) {
+            Insert(TileKey(level, column, row), band, bandX);
+            stats_.misses_++;
+        }
+    }
+    Blit(band, std::max(x - left, 0), std::max(y - top, 0),
+         std::max(left - x, 0), std::max(top - y, 0), dst);
+    return true;
+}
+
+bool WebpTileCache::Render(int32_t level, int32_t x, int32_t y, const SurfaceBuffer& dst) {
+    if (!Valid() || dst.desc_.format_ != format_ || level < 0 || level > 24) {
+        return false;
+    }
+    int32_t right = std::min(x + dst.desc_.width_, Width(level));
+    int32_t bottom = std::min(y + dst.desc_.height_, Height(level));
+    if (x < 0 || y < 0 || right < x + dst.desc_.width_ ||
+            bottom < y + dst.desc_.height_) {
+        ClearFrame(dst);
+    }
+    if (right <= std::max(x, 0) || bottom <= std::max(y, 0)) {
+        return true;
+    }
+
+    bool ok = true;
+    int32_t firstColumn = std::max(x, 0) / tileSize_, lastColumn = (right - 1) / tileSize_;
+    int32_t firstRow = std::max(y, 0) / tileSize_, lastRow = (bottom - 1) / tileSize_;
+    for (int32_t row = firstRow; row <= lastRow; row++) {
+        // draw the cached tiles, and decode the others in one band: from the
+        // first missing one to the last, cached ones in between included
+        int32_t first = -1, last = -1;
+        for (int32_t column = firstColumn; column <= lastColumn; column++) {
+            auto it = index_.find(TileKey(level, column, row));
+            if (it == index_.end()) {
+                if (first < 0) {
+                    first = column;
+                }
+                last = column;
+                continue;
+            }
+            tiles_.splice(tiles_.begin(), tiles_, it->second);
+            SurfaceBuffer tile = TileBuffer(level, column, row, it->second->bits_.data());
+            int32_t left = column * tileSize_, top = row * tileSize_;
+            Blit(tile, std::max(x - left, 0), std::max(y - top, 0),
+                 std::max(left - x, 0), std::max(top - y, 0), dst);
+            stats_.hits_++;
+        }
+        if (first >= 0 && !DecodeBand(level, row, first, last, x, y, dst)) {
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBP_TILES_H__
+#define __WEBP_TILES_H__
+#include <list>
+#include <unordered_map>
+#include "webp_surface.h"
+
+struct TileStats {
+    uint32_t hits_;         // tiles drawn from the cache
+    uint32_t misses_;       // tiles that had to be decoded
+    uint32_t decodes_;      // decoder runs, one per band of missing tiles
+    uint32_t evictions_;
+};
+
+/*
+ * Panning and zooming over a picture too big to decode whole:
+ *     The picture is cut in square tiles, at levels of detail that halve its
+ *     size each: level 0 is full size, level 1 half size, ... Render() draws
+ *     part of a level, decoding only the tiles it shows that are not cached
+ *     yet. Missing tiles next to each other are decoded together, cropped
+ *     (and scaled) on decode. The least recently drawn tiles are dropped
+ *     first, and their memory reused.
+ */
+class WebpTileCache {
+  public:
+    static const int32_t kDefaultTileSize = 256;
+    static const uint32_t kDefaultMaxTiles = 64;
+
+    // data must stay as long as the cache, a mapped file is best
+    explicit WebpTileCache(const uint8_t* data, size_t size, SurfaceFormat format,
+                           int32_t tileSize = kDefaultTileSize,
+                           uint32_t maxTiles = kDefaultMaxTiles);
+
+    // false if the picture can't be decoded
+    bool    Valid(void) const { return width_ > 0; }
+    // size of the picture at a level
+    int32_t Width(int32_t level) const;
+    int32_t Height(int32_t level) const;
+
+    // Draw the pixels of level from (x, y) on, 1:1, into dst, which has the
+    // cache's format. What is outside the picture is blank
+    bool    Render(int32_t level, int32_t x, int32_t y, const SurfaceBuffer& dst);
+
+    void    GetStats(TileStats* stats) const { *stats = stats_; }
+
+  private:
+    struct Tile {
+        uint64_t key_;
+        std::vector<uint8_t> bits_;
+    };
+    typedef std::list<Tile>::iterator TileRef;
+
+    bool DecodeBand(int32_t level, int32_t row, int32_t first, int32_t last,
+                    int32_t x, int32_t y, const SurfaceBuffer& dst);
+    void Blit(const SurfaceBuffer& src, int32_t srcX, int32_t srcY,
+              int32_t x, int32_t y, const SurfaceBuffer& dst);
+    SurfaceBuffer TileBuffer(int32_t level, int32_t column, int32_t row,
+                             uint8_t* bits) const;
+    void Insert(uint64_t key, const SurfaceBuffer& band, int32_t bandX);
+
+    const uint8_t* data_;
+    size_t size_;
+    SurfaceFormat format_;
+    int32_t width_, height_;
+    int32_t tileSize_;
+    uint32_t maxTiles_;
+
+    // most recently drawn first
+    std::list<Tile> tiles_;
+    std::unordered_map<uint64_t, TileRef> index_;
+    std::vector<uint8_t> band_;
+    TileStats stats_;
+};
+#endif // __WEBP_TILES_H__
@@ -29,7 +29,7 @@
 /*
  * webp files that are inside assets folder:
  *    they will be decoded and displayed as slide-show
- *    decoding will happen in its own thread
+ *    decoding will happen on the decoder's worker threads, ahead of display
  */
 const char * frames[] = {
         "clips/frame1.webp",
@@ -38,6 +38,59 @@ const char * frames[] = {
 };
 const int kFRAME_COUNT = sizeof(frames) / sizeof(frames[0]);
 const int kFRAME_DISPLAY_TIME = 2;
+// frames decoded ahead of display, on the decoder's workers; showing one is a
+// copy into the window buffer. With 0 each picture would be decoded straight
+// into the window buffer, without a copy, but on the looper thread with the
+// window locked, holding up input and lifecycle events for the whole decode
+const uint32_t kFRAME_DECODE_AHEAD = WebpDecoder::kDefaultDepth;
+// keep the frames decoded ahead in YUV 420, converted as they are shown:
+// less than half the memory and copy bandwidth of RGBA. The chroma is then
+// at half the window's resolution, so when the pictures are scaled, colour
+// edges are a little softer than in an RGB decode
+const bool kFRAME_DECODE_YUV = true;
+
+/*
+ * The app window as a surface to decode into
+ */
+class WindowSurface : public OutputSurface {
+  public:
+    explicit WindowSurface(ANativeWindow* window) : window_(window) {}
+    void SetWindow(ANativeWindow* window) { window_ = window; }
+
+    bool Lock(SurfaceBuffer* buf) override {
+        ANativeWindow_Buffer buffer;
+        if (!window_ || ANativeWindow_lock(window_, &buffer, nullptr) < 0) {
+            LOGW("Unable to lock window buffer");
+            return false;
+        }
+        switch (buffer.format) {
+            case WINDOW_FORMAT_RGB_565:
+                buf->desc_.format_ = SurfaceFormat::SURFACE_FORMAT_RGB_565;
+                break;
+            case WINDOW_FORMAT_RGBX_8888:
+                buf->desc_.format_ = SurfaceFormat::SURFACE_FORMAT_RGBX_8888;
+                break;
+            case WINDOW_FORMAT_RGBA_8888:
+                buf->desc_.format_ = SurfaceFormat::SURFACE_FORMAT_RGBA_8888;
+                break;
+            default:
+                LOGW("Unsupported window format %d", buffer.format);
+                ANativeWindow_unlockAndPost(window_);
+                return false;
+        }
+        buf->desc_.width_  = buffer.width;
+        buf->desc_.height_ = buffer.height;
+        buf->desc_.stride_ = buffer.stride;
+        buf->bits_ = reinterpret_cast<uint8_t*>(buffer.bits);
+        return true;
+    }
+    void Post(void) override {
+        ANativeWindow_unlockAndPost(window_);
+    }
+
+  private:
+    ANativeWindow* window_;
+};
 
 /*
  * main object handles Android window frame update, and use webp to decode
@@ -47,6 +100,7 @@ class Engine {
   public:
     explicit Engine(android_app* app) :
                 app_(app),
+                surface_(nullptr),
                 decoder_(nullptr),
                 animating_(false) {
         memset(&frameStartTime_, 0, sizeof(frameStartTime_));
@@ -68,8 +122,8 @@ class Engine {
     bool UpdateDisplay(void);
 
   private:
-    void UpdateFrameBuffer(ANativeWindow_Buffer* buf, uint8_t* src);
     struct android_app* app_;
+    WindowSurface surface_;
     WebpDecoder* decoder_;
     bool animating_;
     struct timespec frameStartTime_;
@@ -170,34 +224,34 @@ extern "C" void android_main(struct android_app* state) {
 bool Engine::PrepareDrawing(void) {
     // create decoder
     if (decoder_) {
+        DecodeStats stats;
+        decoder_->GetStats(&stats);
+        LOGI("Decoded %u frames, %u late: %llu us average, %llu us max",
+             stats.frames_, stats.underruns_,
+             static_cast<unsigned long long>(stats.frames_ ?
+                     stats.totalDecodeUs_ / stats.frames_ : 0),
+             static_cast<unsigned long long>(stats.maxDecodeUs_));
         decoder_->DestroyDecoder();
+        decoder_ = nullptr;
     }
-    ANativeWindow_Buffer buf;
-    if (ANativeWindow_lock(app_->window, &buf, NULL) < 0) {
+    // blank the window, and decode for its geometry
+    SurfaceBuffer buf;
+    surface_.SetWindow(app_->window);
+    if (!surface_.Lock(&buf)) {
         LOGW("Unable to lock window buffer to create decoder");
         return false;
     }
-    UpdateFrameBuffer(&buf, nullptr);
-    ANativeWindow_unlockAndPost(app_->window);
-    DecodeSurfaceDescriptor descriptor;
-    switch (buf.format) {
-        case  WINDOW_FORMAT_RGB_565:
-            descriptor.format_ = SurfaceFormat::SURFACE_FORMAT_RGB_565;
-            break;
-        case WINDOW_FORMAT_RGBX_8888:
-            descriptor.format_ = SurfaceFormat::SURFACE_FORMAT_RGBX_8888;
-            break;
-        case WINDOW_FORMAT_RGBA_8888:
-            descriptor.format_ = SurfaceFormat::SURFACE_FORMAT_RGBA_8888;
-        default:
-            return false;
-    }
-    descriptor.width_  = buf.width;
-    descriptor.height_ = buf.height;
-    descriptor.stride_ = buf.stride;
+    ClearFrame(buf);
+    surface_.Post();
 
-    decoder_ = new WebpDecoder(frames, kFRAME_COUNT, &descriptor,
-                               app_->activity->assetManager);
+    DecodeSurfaceDescriptor frameDesc = buf.desc_;
+    if (kFRAME_DECODE_YUV) {
+        frameDesc.format_ = SurfaceFormat::SURFACE_FORMAT_YUV_420;
+        frameDesc.stride_ = frameDesc.width_;
+    }
+    decoder_ = new WebpDecoder(frames, kFRAME_COUNT, &frameDesc,
+                               app_->activity->assetManager,
+                               kFRAME_DECODE_AHEAD);
     assert(decoder_);
     if (!decoder_) {
         return false;
@@ -208,10 +262,9 @@ bool Engine::PrepareDrawing(void) {
 }
 
 /*
- * Only copy decoded webp picture when:
+ * Only show the next webp picture when:
  *  - current frame has been on for kFrame_DISPLAY_TIME seconds
- *  - a new picture is decoded
- * After copying, start decoding the next frame
+ *  - a new picture is decoded, if decoding ahead
  */
 bool Engine::UpdateDisplay(void) {
     if (!app_->window || !decoder_) {
@@ -225,62 +278,8 @@ bool Engine::UpdateDisplay(void) {
         // current frame is displayed less than required duration
         return false;
     }
-    uint8_t *frame = decoder_->GetDecodedFrame();
-    if (!frame)
-        return false;
-
-    ANativeWindow_Buffer buffer;
-    if (ANativeWindow_lock(app_->window, &buffer, nullptr) < 0) {
-        LOGW("Unable to lock window buffer");
+    if (!decoder_->PresentFrame(&surface_))
         return false;
-    }
-    UpdateFrameBuffer(&buffer, frame);
-    ANativeWindow_unlockAndPost(app_->window);
     clock_gettime(CLOCK_MONOTONIC, &frameStartTime_);
-
-    // start decoding next frame
-    decoder_->DecodeFrame();
     return true;
 }
-
-/*
- * UpdateFrameBuffer():
- *     Internal function to perform bits copying onto current frame buffer
- *     src:
- *        - if nullptr, blank it
- *        - otherwise,  copy to given buf
- *     assumption:
- *         src and bug MUST be in the same geometry format & layout
- */
-void Engine::UpdateFrameBuffer(ANativeWindow_Buffer* buf, uint8_t* src) {
-    // src is either null: to blank the screen
-    //     or holding exact pixels with the same fmt [stride is the SAME]
-    uint8_t *dst = reinterpret_cast<uint8_t*> (buf->bits);
-    uint32_t bpp;
-    switch (buf->format) {
-        case WINDOW_FORMAT_RGB_565:
-            bpp = 2;
-            break;
-        case WINDOW_FORMAT_RGBA_8888:
-        case WINDOW_FORMAT_RGBX_8888:
-            bpp = 4;
-            break;
-        default:
-            assert( 0 );
-            return;
-    }
-    uint32_t stride, width;
-    stride = buf->stride * bpp;
-    width = buf->width * bpp;
-    if (src) {
-        for (auto height =0; height < buf->height; ++height) {
-            memcpy(dst, src, width);
-            dst += stride, src += stride;
-        }
-    } else {
-        for (auto height =0; height < buf->height; ++height) {
-            memset(dst, 0, width);
-            dst += stride;
-        }
-    }
-}